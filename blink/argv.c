@@ -80,6 +80,9 @@ void LoadArgv(struct Machine *m, char *execfn, char *prog, char **args,
       naux += 1;
     }
   }
+  if (elf->at_sysinfo_ehdr) {
+    naux += 1;
+  }
   nenv = GetArgListLen(vars);
   narg = GetArgListLen(args);
   nall = 1 + narg + 1 + nenv + 1 + naux * 2;
@@ -96,6 +99,9 @@ void LoadArgv(struct Machine *m, char *execfn, char *prog, char **args,
   PUSH_AUXV(AT_CLKTCK_LINUX, sysconf(_SC_CLK_TCK));
   PUSH_AUXV(AT_RANDOM_LINUX, PushBuffer(m, rng, 16));
   PUSH_AUXV(AT_EXECFN_LINUX, PushString(m, execfn));
+  if (elf->at_sysinfo_ehdr) {
+    PUSH_AUXV(AT_SYSINFO_EHDR_LINUX, elf->at_sysinfo_ehdr);
+  }
   if (elf->at_entry) {
     PUSH_AUXV(AT_PHDR_LINUX, elf->at_phdr);
     PUSH_AUXV(AT_PHENT_LINUX, elf->at_phent);
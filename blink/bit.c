@@ -16,6 +16,7 @@
 │ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
 │ PERFORMANCE OF THIS SOFTWARE.                                                │
 ╚─────────────────────────────────────────────────────────────────────────────*/
+#include "blink/atomic.h"
 #include "blink/bus.h"
 #include "blink/flags.h"
 #include "blink/machine.h"
@@ -34,6 +35,30 @@ static u64 Btc(u64 x, u64 y) {
   return (x & ~y) | (~x & y);
 }
 
+// locked bit operations only need to modify the byte holding the bit
+// and that's always aligned, so they never need to acquire a bus lock
+static void OpBitLocked(struct Machine *m, u8 *p, int op, unsigned bit) {
+  u8 x, y;
+  p += bit >> 3;
+  y = 1 << (bit & 7);
+  switch (op) {
+    case 5:
+      x = atomic_fetch_or_explicit((_Atomic(u8) *)p, y, memory_order_acq_rel);
+      break;
+    case 6:
+      x = atomic_fetch_and_explicit((_Atomic(u8) *)p, ~y,
+                                    memory_order_acq_rel);
+      break;
+    case 7:
+      x = atomic_fetch_xor_explicit((_Atomic(u8) *)p, y,
+                                    memory_order_acq_rel);
+      break;
+    default:
+      OpUdImpl(m);
+  }
+  m->flags = SetFlag(m->flags, FLAGS_CF, !!(x & y));
+}
+
 void OpBit(P) {
   u8 *p;
   int op;
@@ -59,6 +84,10 @@ void OpBit(P) {
     v = MaskAddress(Eamode(rde), ComputeAddress(A) + bitdisp);
     p = ReserveAddress(m, v, 1 << w, op != 4);
   }
+  if (Lock(rde) && !IsModrmRegister(rde)) {
+    OpBitLocked(m, p, op, bit);
+    return;
+  }
   if (Lock(rde)) LockBus(p);
   y = 1;
   y <<= bit;
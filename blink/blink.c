@@ -16,6 +16,7 @@
 │ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
 │ PERFORMANCE OF THIS SOFTWARE.                                                │
 ╚─────────────────────────────────────────────────────────────────────────────*/
+#include <errno.h>
 #include <locale.h>
 #include <signal.h>
 #include <stdio.h>
@@ -32,7 +33,10 @@
 #include "blink/dll.h"
 #include "blink/endian.h"
 #include "blink/flag.h"
+#include "blink/futex.h"
 #include "blink/jit.h"
+#include "blink/jitpool.h"
+#include "blink/linkcache.h"
 #include "blink/loader.h"
 #include "blink/log.h"
 #include "blink/machine.h"
@@ -40,10 +44,13 @@
 #include "blink/map.h"
 #include "blink/overlays.h"
 #include "blink/pml4t.h"
+#include "blink/prefetch.h"
 #include "blink/signal.h"
 #include "blink/sigwinch.h"
+#include "blink/snapshot.h"
 #include "blink/stats.h"
 #include "blink/syscall.h"
+#include "blink/systrace.h"
 #include "blink/thread.h"
 #include "blink/tunables.h"
 #include "blink/util.h"
@@ -90,10 +97,11 @@ Toolchain: " BUILD_TOOLCHAIN "\n\
 Revision: #" BLINK_COMMITS " " BLINK_GITSHA "\n\
 Config: ./configure MODE=" BUILD_MODE " " CONFIG_ARGUMENTS "\n"
 
-#define OPTS "hvjemZs0L:C:"
+#define OPTS "hvjemZs0L:C:T:S:R:"
 
 _Alignas(1) static const char USAGE[] =
     " [-" OPTS "] PROG [ARGS...]\n"
+    "       blink -R PATH\n"
     "Options:\n"
     "  -h                   help\n"
 #ifndef DISABLE_JIT
@@ -108,8 +116,11 @@ _Alignas(1) static const char USAGE[] =
 #if !defined(DISABLE_STRACE) && !defined(TINY)
     "  -s                   enable system call logging\n"
 #endif
+    "  -T PATH              write binary system call trace to PATH\n"
+    "  -S SYSNO:PATH        snapshot process to PATH on first SYSNO call\n"
+    "  -R PATH              resume process from snapshot at PATH\n"
+    "  -Z                   print internal statistics on exit or SIGUSR2\n"
 #ifndef NDEBUG
-    "  -Z                   print internal statistics on exit\n"
     "  -L PATH              log filename (default is blink.log)\n"
 #endif
 #if !defined(DISABLE_OVERLAYS) || !defined(DISABLE_VFS)
@@ -132,10 +143,16 @@ _Alignas(1) static const char USAGE[] =
 
 extern char **environ;
 static bool FLAG_nojit;
+static const char *FLAG_systrace;
+static const char *FLAG_restore;
 static char g_pathbuf[PATH_MAX];
 
 static void OnSigSys(int sig) {
-  // do nothing
+  InterruptFutex(g_machine);
+}
+
+static void OnSigUsr2(int sig) {
+  PrintStatsFromSignal();
 }
 
 static void PrintDiagnostics(struct Machine *m) {
@@ -167,6 +184,7 @@ void TerminateSignal(struct Machine *m, int sig, int code) {
 #ifdef HAVE_JIT
   ShutdownJit();
 #endif
+  FlushSysTraces();
   sa.sa_flags = 0;
   sa.sa_handler = SIG_DFL;
   sigemptyset(&sa.sa_mask);
@@ -208,13 +226,16 @@ static int Exec(char *execfn, char *prog, char **argv, char **envp) {
   struct Machine *m, *old;
   if ((old = g_machine)) KillOtherThreads(old->system);
   unassert((g_machine = m = NewMachine(NewSystem(XED_MACHINE_MODE_LONG), 0)));
+  RegisterStats(m->tid);
 #ifdef HAVE_JIT
   if (FLAG_nojit) DisableJit(&m->system->jit);
 #endif
   m->system->exec = Exec;
   if (!old) {
     // this is the first time a program is being loaded
-    LoadProgram(m, execfn, prog, argv, envp, NULL);
+    if (!RestoreLinkCache(m, execfn, prog, argv, envp)) {
+      LoadProgram(m, execfn, prog, argv, envp, NULL);
+    }
     SetupCod(m);
     for (i = 0; i < 10; ++i) {
       AddStdFd(&m->system->fds, i);
@@ -223,9 +244,11 @@ static int Exec(char *execfn, char *prog, char **argv, char **envp) {
   } else {
 #ifdef HAVE_JIT
     DisableJit(&old->system->jit);  // unmapping exec pages is slow
+    InheritJit(m->system, old->system);
 #endif
     unassert(!m->sysdepth);
     unassert(!m->pagelocks.i);
+    SavePrefetchProfile(old->system);
     unassert(!FreeVirtual(old->system, -0x800000000000, 0x1000000000000));
     for (i = 1; i <= 64; ++i) {
       if (Read64(old->system->hands[i - 1].handler) == SIG_IGN_LINUX) {
@@ -233,9 +256,10 @@ static int Exec(char *execfn, char *prog, char **argv, char **envp) {
       }
     }
     memcpy(m->system->rlim, old->system->rlim, sizeof(old->system->rlim));
-    LoadProgram(m, execfn, prog, argv, envp, NULL);
-    m->system->fds.list = old->system->fds.list;
-    old->system->fds.list = 0;
+    if (!RestoreLinkCache(m, execfn, prog, argv, envp)) {
+      LoadProgram(m, execfn, prog, argv, envp, NULL);
+    }
+    MoveFds(&m->system->fds, &old->system->fds);
     // releasing the execve() lock must come after unlocking fds
     memcpy(&oldmask, &old->system->exec_sigmask, sizeof(oldmask));
     UNLOCK(&old->system->exec_lock);
@@ -247,6 +271,31 @@ static int Exec(char *execfn, char *prog, char **argv, char **envp) {
   Blink(m);
 }
 
+_Noreturn static void Restore(const char *path) {
+  int i;
+  struct Machine *m;
+  PrepareSnapshot(path);
+  unassert((g_machine = m = NewMachine(NewSystem(XED_MACHINE_MODE_LONG), 0)));
+  RegisterStats(m->tid);
+#ifdef HAVE_JIT
+  if (FLAG_nojit) DisableJit(&m->system->jit);
+#endif
+  m->system->exec = Exec;
+  for (i = 0; i < 3; ++i) {
+    AddStdFd(&m->system->fds, i);
+  }
+  if (RestoreSnapshot(m, path, 0, 0)) {
+    WriteErrorString(path);
+    WriteErrorString(": failed to restore snapshot: ");
+    WriteErrorString(DescribeHostErrno(errno));
+    WriteErrorString("\n");
+    exit(127);
+  }
+  SetupCod(m);
+  ProgramLimit(m->system, RLIMIT_NOFILE, RLIMIT_NOFILE_LINUX);
+  Blink(m);
+}
+
 static void Print(int fd, const char *s) {
   (void)!write(fd, s, strlen(s));
 }
@@ -265,6 +314,7 @@ _Noreturn static void PrintVersion(void) {
 
 static void GetOpts(int argc, char *argv[]) {
   int opt;
+  const char *s;
   FLAG_nolinear = !CanHaveLinearMemory();
 #ifndef DISABLE_OVERLAYS
   FLAG_overlays = getenv("BLINK_OVERLAYS");
@@ -273,6 +323,9 @@ static void GetOpts(int argc, char *argv[]) {
 #ifndef DISABLE_VFS
   FLAG_prefix = getenv("BLINK_PREFIX");
 #endif
+  FLAG_prefetch = getenv("BLINK_PREFETCH");
+  FLAG_linkcache = getenv("BLINK_LINKCACHE");
+  FLAG_keepaslr = (s = getenv("BLINK_KEEPASLR")) && *s;
 #if LOG_ENABLED
   FLAG_logpath = getenv("BLINK_LOG_FILENAME");
 #endif
@@ -299,6 +352,18 @@ static void GetOpts(int argc, char *argv[]) {
       case 'L':
         FLAG_logpath = optarg_;
         break;
+      case 'T':
+        FLAG_systrace = optarg_;
+        break;
+      case 'S':
+        if (SetSnapshotSpec(optarg_)) {
+          WriteErrorString("error: snapshot spec should be SYSNO:PATH\n");
+          exit(1);
+        }
+        break;
+      case 'R':
+        FLAG_restore = optarg_;
+        break;
       case 'C':
 #if !defined(DISABLE_OVERLAYS)
         FLAG_overlays = optarg_;
@@ -338,6 +403,13 @@ static void HandleSigs(void) {
   unassert(!sigaction(SIGTERM, &sa, 0));
   unassert(!sigaction(SIGXCPU, &sa, 0));
   unassert(!sigaction(SIGXFSZ, &sa, 0));
+  if (FLAG_statistics) {
+    // let operators see what a long-running guest is doing
+    sa.sa_handler = OnSigUsr2;
+    sa.sa_flags = SA_RESTART;
+    unassert(!sigaction(SIGUSR2, &sa, 0));
+    sa.sa_flags = 0;
+  }
 #if !defined(__SANITIZE_THREAD__) && !defined(__SANITIZE_ADDRESS__)
   sa.sa_sigaction = OnFatalSystemSignal;
   sa.sa_flags = SA_SIGINFO;
@@ -374,7 +446,7 @@ int main(int argc, char *argv[]) {
   WriteErrorInit();
   InitMap();
   GetOpts(argc, argv);
-  if (optind_ == argc) {
+  if (optind_ == argc && !FLAG_restore) {
     PrintUsage(argc, argv, 48, 2);
   }
 #ifndef DISABLE_OVERLAYS
@@ -389,8 +461,15 @@ int main(int argc, char *argv[]) {
     exit(1);
   }
 #endif
+  if (FLAG_systrace && OpenSysTrace(FLAG_systrace)) {
+    perror(FLAG_systrace);
+    exit(1);
+  }
+  if (FLAG_statistics) g_systrace = true;
   HandleSigs();
   InitBus();
+  InitFutexes();
+  if (FLAG_restore) Restore(FLAG_restore);
   if (!Commandv(argv[optind_], g_pathbuf, sizeof(g_pathbuf))) {
     WriteErrorString(argv[0]);
     WriteErrorString(": command not found: ");
@@ -57,6 +57,7 @@
 #include "blink/flag.h"
 #include "blink/flags.h"
 #include "blink/fpu.h"
+#include "blink/futex.h"
 #include "blink/high.h"
 #include "blink/linux.h"
 #include "blink/loader.h"
@@ -814,7 +815,7 @@ static void OnV(void) {
 }
 
 static void OnSigSys(int sig) {
-  // do nothing
+  InterruptFutex(g_machine);
 }
 
 static void OnSigWinch(int sig, siginfo_t *si, void *uc) {
@@ -2065,8 +2066,8 @@ static void AddHistory(const char *ansi, size_t size) {
   r->origsize = size;
   r->data = Deflate(ansi, size, &r->compsize);
   ++g_history.index;
-  STATISTIC(AVERAGE(redraw_compressed_bytes, r->compsize));
-  STATISTIC(AVERAGE(redraw_uncompressed_bytes, r->origsize));
+  STATISTIC(AVERAGE(g_stats.redraw_compressed_bytes, r->compsize));
+  STATISTIC(AVERAGE(g_stats.redraw_uncompressed_bytes, r->origsize));
 }
 
 static void RewindHistory(int delta) {
@@ -2182,7 +2183,7 @@ void Redraw(bool force) {
   END_NO_PAGE_FAULTS;
   end_draw = GetTime();
   (void)end_draw;
-  STATISTIC(AVERAGE(redraw_latency_us,
+  STATISTIC(AVERAGE(g_stats.redraw_latency_us,
                     ToMicroseconds(SubtractTime(end_draw, start_draw))));
   if (force || PreventBufferbloat()) {
     HandleEpipe(UninterruptibleWrite(ttyout, ansi, size));
@@ -3467,6 +3468,7 @@ static void GetOpts(int argc, char *argv[]) {
 #ifndef DISABLE_VFS
   FLAG_prefix = getenv("BLINK_PREFIX");
 #endif
+  FLAG_prefetch = getenv("BLINK_PREFETCH");
   while ((opt = GetOpt(argc, argv, "0hjmvVtrzRNsZb:Hw:L:C:B:")) != -1) {
     switch (opt) {
       case '0':
@@ -3697,6 +3699,7 @@ int main(int argc, char *argv[]) {
   InitMap();
   GetOpts(argc, argv);
   InitBus();
+  InitFutexes();
 #ifndef DISABLE_OVERLAYS
   if (SetOverlays(FLAG_overlays, true)) {
     WriteErrorString("bad blink overlays spec; see log for details\n");
@@ -3716,6 +3719,7 @@ int main(int argc, char *argv[]) {
   unassert((s = NewSystem(wantmetal ? XED_MACHINE_MODE_REAL
                                     : XED_MACHINE_MODE_LONG)));
   unassert((m = g_machine = NewMachine(s, 0)));
+  RegisterStats(m->tid);
 #ifdef HAVE_JIT
   if (!FLAG_wantjit || wantmetal) {
     DisableJit(&m->system->jit);
@@ -42,30 +42,31 @@
 struct Bus *g_bus;
 
 void InitBus(void) {
+#ifndef HAVE_FUTEX
   unsigned i;
   pthread_condattr_t_ cattr;
   pthread_mutexattr_t_ mattr;
+#endif
 #ifndef HAVE_PTHREAD_PROCESS_SHARED
   if (g_bus) FreeBig(g_bus, sizeof(*g_bus));
 #endif
   unassert(g_bus =
                (struct Bus *)AllocateBig(sizeof(*g_bus), PROT_READ | PROT_WRITE,
                                          BUS_MEMORY | MAP_ANONYMOUS_, -1, 0));
+#ifndef HAVE_FUTEX
   unassert(!pthread_condattr_init(&cattr));
   unassert(!pthread_mutexattr_init(&mattr));
 #ifdef HAVE_PTHREAD_PROCESS_SHARED
   unassert(!pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED));
   unassert(!pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED));
 #endif
-  unassert(!pthread_mutex_init(&g_bus->futexes.lock, &mattr));
-  for (i = 0; i < kFutexMax; ++i) {
-    unassert(!pthread_cond_init(&g_bus->futexes.mem[i].cond, &cattr));
-    unassert(!pthread_mutex_init(&g_bus->futexes.mem[i].lock, &mattr));
-    dll_init(&g_bus->futexes.mem[i].elem);
-    dll_make_last(&g_bus->futexes.free, &g_bus->futexes.mem[i].elem);
+  for (i = 0; i < kBusFutexes; ++i) {
+    unassert(!pthread_cond_init(&g_bus->futexes[i].cond, &cattr));
+    unassert(!pthread_mutex_init(&g_bus->futexes[i].lock, &mattr));
   }
   unassert(!pthread_mutexattr_destroy(&mattr));
   unassert(!pthread_condattr_destroy(&cattr));
+#endif
 }
 
 void LockBus(const u8 *locality) {
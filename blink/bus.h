@@ -14,23 +14,12 @@
 #include "blink/tunables.h"
 #include "blink/types.h"
 
-#define FUTEX_CONTAINER(e) DLL_CONTAINER(struct Futex, elem, e)
-
-struct Futex {
-  i64 addr;
-  int waiters;
-  struct Dll elem;
+struct BusFutex {
+  u32 seq;
   pthread_cond_t_ cond;
   pthread_mutex_t_ lock;
 };
 
-struct Futexes {
-  struct Dll *active;
-  struct Dll *free;
-  pthread_mutex_t_ lock;
-  struct Futex mem[kFutexMax];
-};
-
 struct Bus {
   /* When software uses locks or semaphores to synchronize processes,
      threads, or other code sections; Intel recommends that only one lock
@@ -42,7 +31,9 @@ struct Bus {
      begins on a 128-byte boundary. The practice minimizes the bus traffic
      required to service locks. ──Intel V.3 §8.10.6.7 */
   _Alignas(kSemSize) _Atomic(u32) lock[kBusCount][kSemSize / sizeof(int)];
-  struct Futexes futexes;
+#ifndef HAVE_FUTEX
+  struct BusFutex futexes[kBusFutexes];
+#endif
 };
 
 extern struct Bus *g_bus;
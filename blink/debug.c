@@ -261,7 +261,7 @@ const char *GetBacktrace(struct Machine *m) {
          Get64(m->bx), Get64(m->sp), Get64(m->bp), Get64(m->si), Get64(m->di),
          Get64(m->r8), Get64(m->r9), Get64(m->r10), Get64(m->r11),
          Get64(m->r12), Get64(m->r13), Get64(m->r14), Get64(m->r15), m->fs.base,
-         m->gs.base, GET_COUNTER(instructions_decoded),
+         m->gs.base, GET_COUNTER(g_stats.instructions_decoded),
          DescribeCpuFlags(m->flags), g_progname);
 
 #ifndef DISABLE_BACKTRACE
@@ -127,3 +127,11 @@ long exdev(void) {
 long enametoolong(void) {
   return ReturnErrno(ENAMETOOLONG);
 }
+
+long enoexec(void) {
+  return ReturnErrno(ENOEXEC);
+}
+
+long edeadlk(void) {
+  return ReturnErrno(EDEADLK);
+}
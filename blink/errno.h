@@ -3,6 +3,7 @@
 
 long eagain(void);
 long ebadf(void);
+long edeadlk(void);
 long efault(void);
 void *efault0(void);
 long eintr(void);
@@ -26,5 +27,6 @@ long eexist(void);
 long eloop(void);
 long exdev(void);
 long enametoolong(void);
+long enoexec(void);
 
 #endif /* BLINK_ERRNO_H_ */
@@ -0,0 +1,893 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "blink/assert.h"
+#include "blink/atomic.h"
+#include "blink/bitscan.h"
+#include "blink/endian.h"
+#include "blink/errno.h"
+#include "blink/fds.h"
+#include "blink/linux.h"
+#include "blink/log.h"
+#include "blink/machine.h"
+#include "blink/macros.h"
+#include "blink/signal.h"
+#include "blink/syscall.h"
+#include "blink/thread.h"
+#include "blink/timespec.h"
+#include "blink/tunables.h"
+#include "blink/util.h"
+#include "blink/vfs.h"
+#include "blink/xlat.h"
+
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+#ifdef HAVE_TIMERFD
+#include <sys/timerfd.h>
+#endif
+
+/**
+ * @fileoverview Linux event notification file descriptors.
+ *
+ * Modern event loops (e.g. libuv, glib, tokio) expect to be able to
+ * wait on counters, timers, and signals with the same epoll() set as
+ * their sockets. When the host is Linux, eventfd() and timerfd() are
+ * simply passed along to the host kernel. Otherwise they're emulated
+ * using an anonymous fifo, opened for both reading and writing, which
+ * gets a byte written to it whenever the object becomes readable, so
+ * the host's poll() and epoll() are able to report readiness for us.
+ *
+ * The signalfd() system call is always emulated this way, since guest
+ * signals are queued by Blink rather than the host kernel. Whenever a
+ * signal is enqueued on a thread which blocks it, each signalfd that's
+ * interested gets a byte written to its fifo to wake up any readers.
+ */
+
+#define kEventFdCounter   1
+#define kEventFdSemaphore 2
+#define kEventFdTimer     3
+#define kEventFdSignal    4
+
+#define kEventFdMax 0xfffffffffffffffe
+
+struct EventFd {
+  int kind;                // kEventFdXXX or zero if slot is free
+  _Atomic(int) fd;         // blink's own non-blocking handle on fifo
+  _Atomic(u64) sigmask;    // signals monitored by signalfd
+  dev_t dev;               // identifies fifo, since guest may dup()
+  ino_t ino;               // identifies fifo, since guest may dup()
+  u64 count;               // timerfd expirations
+  clock_t clock;           // timerfd clock
+  struct timespec value;   // timerfd absolute deadline, zero if disarmed
+  struct timespec interval;
+};
+
+static struct EventFds {
+  pthread_once_t_ once;
+  pthread_mutex_t_ lock;
+  pthread_cond_t_ cond;
+  int worker;  // pid of process whose timer thread is running
+  struct EventFd fds[kMaxEventFds];
+} g_eventfds = {PTHREAD_ONCE_INIT_};
+
+static void InitEventFds(void) {
+  unassert(!pthread_mutex_init(&g_eventfds.lock, 0));
+  unassert(!pthread_cond_init(&g_eventfds.cond, 0));
+}
+
+static void LockEventFds(void) {
+  pthread_once_(&g_eventfds.once, InitEventFds);
+  LOCK(&g_eventfds.lock);
+}
+
+static void UnlockEventFds(void) {
+  UNLOCK(&g_eventfds.lock);
+}
+
+static int NoTcgetwinsize(int fildes, struct winsize *ws) {
+  errno = ENOTTY;
+  return -1;
+}
+
+static int NoTcsetwinsize(int fildes, const struct winsize *ws) {
+  errno = ENOTTY;
+  return -1;
+}
+
+static size_t GetIovSize(const struct iovec *iov, int iovlen) {
+  int i;
+  size_t n;
+  for (n = i = 0; i < iovlen; ++i) n += iov[i].iov_len;
+  return n;
+}
+
+static void CopyToIovs(const struct iovec *iov, int iovlen, const void *data,
+                       size_t size) {
+  int i;
+  size_t n;
+  for (i = 0; size && i < iovlen; ++i) {
+    n = MIN(size, iov[i].iov_len);
+    memcpy(iov[i].iov_base, data, n);
+    data = (const u8 *)data + n;
+    size -= n;
+  }
+}
+
+static void CopyFromIovs(void *data, size_t size, const struct iovec *iov,
+                         int iovlen) {
+  int i;
+  size_t n;
+  for (i = 0; size && i < iovlen; ++i) {
+    n = MIN(size, iov[i].iov_len);
+    memcpy(data, iov[i].iov_base, n);
+    data = (u8 *)data + n;
+    size -= n;
+  }
+}
+
+static bool IsNonBlocking(int fildes) {
+  int oflags;
+  return (oflags = fcntl(fildes, F_GETFL)) != -1 && (oflags & O_NDELAY);
+}
+
+static int WaitReadable(int fildes) {
+  struct pollfd pfd;
+  pfd.fd = fildes;
+  pfd.events = POLLIN;
+  return poll(&pfd, 1, -1) == -1 ? -1 : 0;
+}
+
+// creates anonymous fifo that's open for both reading and writing. the
+// returned handle is for the guest. a second independent non-blocking
+// handle is stored to `*priv` which is moved out of the guest fd range
+static int OpenLoopbackFifo(int oflags, int *priv) {
+  int e, fd, fd2;
+  const char *tmpdir;
+  char path[PATH_MAX];
+  static _Atomic(unsigned) counter;
+  if (!(tmpdir = getenv("TMPDIR")) || !*tmpdir) tmpdir = "/tmp";
+  snprintf(path, sizeof(path), "%s/blink-fifo-%d-%u", tmpdir, (int)getpid(),
+           atomic_fetch_add(&counter, 1));
+  if (mkfifo(path, 0600)) return -1;
+  if ((fd = open(path, O_RDWR | oflags)) != -1) {
+    if ((fd2 = open(path, O_RDWR | O_NDELAY | O_CLOEXEC)) != -1) {
+      *priv = fcntl(fd2, F_DUPFD_CLOEXEC, kMinBlinkFd);
+      close(fd2);
+    } else {
+      *priv = -1;
+    }
+    if (*priv == -1) {
+      e = errno;
+      close(fd);
+      errno = e;
+      fd = -1;
+    }
+  }
+  e = errno;
+  unlink(path);
+  errno = e;
+  return fd;
+}
+
+static void Notify(struct EventFd *efd) {
+  char b = 0;
+  ssize_t rc;
+  // the fifo being full is fine, since that means it's readable
+  rc = write(atomic_load_explicit(&efd->fd, memory_order_relaxed), &b, 1);
+  (void)rc;
+}
+
+static void Drain(struct EventFd *efd) {
+  char buf[64];
+  while (read(atomic_load_explicit(&efd->fd, memory_order_relaxed), buf,
+              sizeof(buf)) > 0) {
+  }
+}
+
+static struct EventFd *FindEventFd(int fildes, int kind) {
+  int i;
+  struct stat st;
+  if (fstat(fildes, &st)) return 0;
+  for (i = 0; i < kMaxEventFds; ++i) {
+    if (g_eventfds.fds[i].kind && g_eventfds.fds[i].dev == st.st_dev &&
+        g_eventfds.fds[i].ino == st.st_ino) {
+      if (kind && g_eventfds.fds[i].kind != kind &&
+          !(kind == kEventFdCounter &&
+            g_eventfds.fds[i].kind == kEventFdSemaphore)) {
+        break;
+      }
+      return g_eventfds.fds + i;
+    }
+  }
+  einval();
+  return 0;
+}
+
+static const struct FdCb kFdCbEventFd;
+
+static bool IsEventFdReferenced(dev_t dev, ino_t ino) {
+  struct Fd *fd;
+  struct Dll *e;
+  struct stat st;
+  bool res = false;
+  if (!g_machine) return false;
+  LOCK(&g_machine->system->fds.lock);
+  for (e = dll_first(g_machine->system->fds.list); e;
+       e = dll_next(g_machine->system->fds.list, e)) {
+    fd = FD_CONTAINER(e);
+    if (fd->cb == &kFdCbEventFd && !fstat(fd->fildes, &st) &&
+        st.st_dev == dev && st.st_ino == ino) {
+      res = true;
+      break;
+    }
+  }
+  UNLOCK(&g_machine->system->fds.lock);
+  return res;
+}
+
+static int CloseEventFd(int fildes) {
+  int i, rc;
+  struct stat st;
+  struct EventFd *efd;
+  if (fstat(fildes, &st)) return close(fildes);
+  rc = close(fildes);
+  if (!IsEventFdReferenced(st.st_dev, st.st_ino)) {
+    LockEventFds();
+    for (i = 0; i < kMaxEventFds; ++i) {
+      efd = g_eventfds.fds + i;
+      if (efd->kind && efd->dev == st.st_dev && efd->ino == st.st_ino) {
+        atomic_store(&efd->sigmask, 0);
+        close(atomic_exchange(&efd->fd, -1));
+        efd->kind = 0;
+        break;
+      }
+    }
+    UnlockEventFds();
+  }
+  return rc;
+}
+
+// allocates emulated event object, returning guest fd
+static int CreateEventFd(struct Machine *m, int kind, int oflags, u64 count,
+                         u64 sigmask) {
+  u8 buf[8];
+  int i, lim, fd, fd2;
+  struct Fd *gfd;
+  struct stat st;
+  struct EventFd *efd;
+  if (!(lim = GetFileDescriptorLimit(m->system))) return emfile();
+  LockEventFds();
+  for (efd = 0, i = 0; i < kMaxEventFds; ++i) {
+    if (!g_eventfds.fds[i].kind) {
+      efd = g_eventfds.fds + i;
+      break;
+    }
+  }
+  if (!efd) {
+    UnlockEventFds();
+    LOGF("too many emulated event fds");
+    return emfile();
+  }
+  if ((fd = OpenLoopbackFifo(oflags, &fd2)) == -1) {
+    UnlockEventFds();
+    return -1;
+  }
+  if (fd >= lim) {
+    close(fd);
+    close(fd2);
+    UnlockEventFds();
+    return emfile();
+  }
+  unassert(!fstat(fd, &st));
+  memset(efd, 0, sizeof(*efd));
+  efd->kind = kind;
+  efd->dev = st.st_dev;
+  efd->ino = st.st_ino;
+  atomic_store(&efd->fd, fd2);
+  atomic_store(&efd->sigmask, sigmask);
+  if (count) {
+    Write64(buf, count);
+    unassert(write(fd2, buf, 8) == 8);
+  }
+  UnlockEventFds();
+  LOCK(&m->system->fds.lock);
+  unassert(gfd = AddFd(&m->system->fds, fd, O_RDWR | oflags));
+  gfd->cb = &kFdCbEventFd;
+  UNLOCK(&m->system->fds.lock);
+  return fd;
+}
+
+#if defined(HAVE_EVENTFD) || defined(HAVE_TIMERFD)
+static int AddHostEventFd(struct Machine *m, int fildes, int oflags) {
+  int lim;
+  if (fildes == -1) return -1;
+  if (!(lim = GetFileDescriptorLimit(m->system)) || fildes >= lim) {
+    close(fildes);
+    return emfile();
+  }
+  LOCK(&m->system->fds.lock);
+  unassert(AddFd(&m->system->fds, fildes, O_RDWR | oflags));
+  UNLOCK(&m->system->fds.lock);
+  return fildes;
+}
+#endif
+
+static bool IsZeroTime(struct timespec ts) {
+  return !ts.tv_sec && !ts.tv_nsec;
+}
+
+static int LoadTimespec(struct timespec *ts, const struct timespec_linux *gt) {
+  ts->tv_sec = Read64(gt->sec);
+  ts->tv_nsec = Read64(gt->nsec);
+  if (ts->tv_sec < 0 || !(0 <= ts->tv_nsec && ts->tv_nsec < 1000000000)) {
+    return einval();
+  }
+  return 0;
+}
+
+static int LoadItimerspec(struct Machine *m, i64 addr,
+                          struct timespec *interval, struct timespec *value) {
+  const struct itimerspec_linux *git;
+  if (!(git = (const struct itimerspec_linux *)SchlepR(m, addr,
+                                                        sizeof(*git)))) {
+    return -1;
+  }
+  if (LoadTimespec(interval, &git->interval) == -1) return -1;
+  if (LoadTimespec(value, &git->value) == -1) return -1;
+  return 0;
+}
+
+static int StoreItimerspec(struct Machine *m, i64 addr,
+                           struct timespec interval, struct timespec value) {
+  struct itimerspec_linux git;
+  Write64(git.interval.sec, interval.tv_sec);
+  Write64(git.interval.nsec, interval.tv_nsec);
+  Write64(git.value.sec, value.tv_sec);
+  Write64(git.value.nsec, value.tv_nsec);
+  return CopyToUserWrite(m, addr, &git, sizeof(git));
+}
+
+#ifdef HAVE_THREADS
+
+static void AdvanceTimer(struct EventFd *efd, struct timespec now) {
+  u64 n;
+  time_t interval;
+  n = 1;
+  if (!IsZeroTime(efd->interval)) {
+    interval = ToNanoseconds(efd->interval);
+    n += ToNanoseconds(SubtractTime(now, efd->value)) / interval;
+    efd->value = AddTime(efd->value, FromNanoseconds(n * interval));
+  } else {
+    efd->value = GetZeroTime();
+  }
+  if (!efd->count) Notify(efd);
+  efd->count = n <= kEventFdMax - efd->count ? efd->count + n : kEventFdMax;
+}
+
+static void *TimerWorker(void *arg) {
+  int i;
+  struct EventFd *efd;
+  struct timespec now, wait, deadline;
+  LockEventFds();
+  for (;;) {
+    wait = GetMaxTime();
+    for (i = 0; i < kMaxEventFds; ++i) {
+      efd = g_eventfds.fds + i;
+      if (efd->kind != kEventFdTimer || IsZeroTime(efd->value)) continue;
+      unassert(!clock_gettime(efd->clock, &now));
+      if (CompareTime(now, efd->value) >= 0) {
+        AdvanceTimer(efd, now);
+        if (IsZeroTime(efd->value)) continue;
+      }
+      if (CompareTime(SubtractTime(efd->value, now), wait) < 0) {
+        wait = SubtractTime(efd->value, now);
+      }
+    }
+    if (!CompareTime(wait, GetMaxTime())) {
+      unassert(!pthread_cond_wait(&g_eventfds.cond, &g_eventfds.lock));
+    } else {
+      deadline = AddTime(GetTime(), wait);
+      pthread_cond_timedwait(&g_eventfds.cond, &g_eventfds.lock, &deadline);
+    }
+  }
+  return 0;
+}
+
+// launches thread which expires timers for current process. it's done
+// lazily, since timerfd() is rare, and the thread won't survive fork()
+static int StartTimerWorker(void) {
+  int err;
+  pthread_t th;
+  pthread_attr_t attr;
+  sigset_t block, oldmask;
+  if (g_eventfds.worker == getpid()) return 0;
+  unassert(!sigfillset(&block));
+  unassert(!pthread_sigmask(SIG_BLOCK, &block, &oldmask));
+  unassert(!pthread_attr_init(&attr));
+  unassert(!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED));
+  err = pthread_create(&th, &attr, TimerWorker, 0);
+  unassert(!pthread_attr_destroy(&attr));
+  unassert(!pthread_sigmask(SIG_SETMASK, &oldmask, 0));
+  if (err) {
+    LOGF("failed to create timerfd thread: %s", DescribeHostErrno(err));
+    errno = err;
+    return -1;
+  }
+  g_eventfds.worker = getpid();
+  return 0;
+}
+
+#endif /* HAVE_THREADS */
+
+static int CollectSignals(struct Machine *m, u64 mask,
+                          struct signalfd_siginfo_linux *si, int max,
+                          bool *more) {
+  int n, sig;
+  struct Dll *e;
+  struct Machine *m2;
+  *more = false;
+  n = 0;
+  LOCK(&m->system->sig_lock);
+  LOCK(&m->system->machines_lock);
+  for (m2 = m, e = 0;;) {
+    while (m2->signals & mask) {
+      if (n == max) {
+        *more = true;
+        break;
+      }
+      sig = bsf(m2->signals & mask) + 1;
+      m2->signals &= ~((u64)1 << (sig - 1));
+      memset(si + n, 0, sizeof(*si));
+      Write32(si[n].signo, sig);
+      Write32(si[n].code, SI_USER_LINUX);
+      ++n;
+    }
+    if (*more) break;
+    do {
+      e = e ? dll_next(m->system->machines, e)
+            : dll_first(m->system->machines);
+    } while (e && MACHINE_CONTAINER(e) == m);
+    if (!e) break;
+    m2 = MACHINE_CONTAINER(e);
+  }
+  UNLOCK(&m->system->machines_lock);
+  UNLOCK(&m->system->sig_lock);
+  return n;
+}
+
+static ssize_t ReadSignalFd(int fildes, const struct iovec *iov, int iovlen) {
+  u64 mask;
+  int n, max;
+  bool more;
+  struct EventFd *efd;
+  struct signalfd_siginfo_linux si[8];
+  unassert(g_machine);
+  max = MIN(ARRAYLEN(si), GetIovSize(iov, iovlen) / sizeof(si[0]));
+  if (!max) return einval();
+  for (;;) {
+    LockEventFds();
+    if (!(efd = FindEventFd(fildes, kEventFdSignal))) {
+      UnlockEventFds();
+      return -1;
+    }
+    mask = atomic_load(&efd->sigmask);
+    Drain(efd);
+    UnlockEventFds();
+    if ((n = CollectSignals(g_machine, mask, si, max, &more))) {
+      if (more) {
+        LockEventFds();
+        if ((efd = FindEventFd(fildes, kEventFdSignal))) Notify(efd);
+        UnlockEventFds();
+      }
+      CopyToIovs(iov, iovlen, si, n * sizeof(si[0]));
+      return n * sizeof(si[0]);
+    }
+    if (IsNonBlocking(fildes)) return eagain();
+    if (WaitReadable(fildes) == -1) return -1;
+  }
+}
+
+// reads eventfd counter. since it's shared across fork(), the counter
+// lives in the fifo itself as 8-byte records, which are atomic to pipes
+static ssize_t ReadCounterFd(int fildes, const struct iovec *iov,
+                             int iovlen) {
+  u8 buf[8];
+  ssize_t rc;
+  u64 x, count;
+  struct EventFd *efd;
+  if (GetIovSize(iov, iovlen) < 8) return einval();
+  if ((rc = read(fildes, buf, 8)) != 8) {
+    if (rc != -1) errno = EIO;
+    return -1;
+  }
+  count = Read64(buf);
+  LockEventFds();
+  if ((efd = FindEventFd(fildes, kEventFdCounter))) {
+    if (efd->kind == kEventFdSemaphore) {
+      if (count > 1) {
+        Write64(buf, count - 1);
+        unassert(write(efd->fd, buf, 8) == 8);
+      }
+      count = 1;
+    } else {
+      while (read(efd->fd, buf, 8) == 8) {
+        x = Read64(buf);
+        count = x <= kEventFdMax - count ? count + x : kEventFdMax;
+      }
+    }
+  }
+  UnlockEventFds();
+  Write64(buf, count);
+  CopyToIovs(iov, iovlen, buf, 8);
+  return 8;
+}
+
+static ssize_t ReadEventFd(int fildes, const struct iovec *iov, int iovlen) {
+  u8 buf[8];
+  int kind;
+  u64 count;
+  struct EventFd *efd;
+  for (;;) {
+    LockEventFds();
+    if (!(efd = FindEventFd(fildes, 0))) {
+      UnlockEventFds();
+      return -1;
+    }
+    if ((kind = efd->kind) != kEventFdTimer) {
+      UnlockEventFds();
+      if (kind == kEventFdSignal) {
+        return ReadSignalFd(fildes, iov, iovlen);
+      } else {
+        return ReadCounterFd(fildes, iov, iovlen);
+      }
+    }
+    if (GetIovSize(iov, iovlen) < 8) {
+      UnlockEventFds();
+      return einval();
+    }
+    if ((count = efd->count)) {
+      efd->count = 0;
+      Drain(efd);
+      UnlockEventFds();
+      Write64(buf, count);
+      CopyToIovs(iov, iovlen, buf, 8);
+      return 8;
+    }
+#ifdef HAVE_THREADS
+    if (!IsZeroTime(efd->value) && StartTimerWorker() == -1) {
+      UnlockEventFds();
+      return -1;
+    }
+#endif
+    UnlockEventFds();
+    if (IsNonBlocking(fildes)) return eagain();
+    if (WaitReadable(fildes) == -1) return -1;
+  }
+}
+
+static ssize_t WriteEventFd(int fildes, const struct iovec *iov, int iovlen) {
+  u8 buf[8];
+  u64 x, y, count;
+  struct EventFd *efd;
+  if (GetIovSize(iov, iovlen) < 8) return einval();
+  CopyFromIovs(buf, 8, iov, iovlen);
+  if ((x = Read64(buf)) > kEventFdMax) return einval();
+  for (;;) {
+    LockEventFds();
+    if (!(efd = FindEventFd(fildes, kEventFdCounter))) {
+      UnlockEventFds();
+      return -1;
+    }
+    // merge pending records, so the fifo never fills up
+    for (count = 0; read(efd->fd, buf, 8) == 8;) {
+      y = Read64(buf);
+      count = y <= kEventFdMax - count ? count + y : kEventFdMax;
+    }
+    if (x <= kEventFdMax - count) {
+      count += x;
+      x = 0;
+    }
+    if (count) {
+      Write64(buf, count);
+      unassert(write(efd->fd, buf, 8) == 8);
+    }
+    UnlockEventFds();
+    if (!x) return 8;
+    // linux blocks until a read() makes room, which is rare enough that
+    // we're content to just poll for it
+    if (IsNonBlocking(fildes)) return eagain();
+    if (!g_machine) {
+      poll(0, 0, kPollingMs);
+    } else if (SleepHost(g_machine,
+                         AddTime(GetTime(), FromMilliseconds(kPollingMs))) ==
+               -1) {
+      return -1;
+    }
+  }
+}
+
+static const struct FdCb kFdCbEventFd = {
+    .close = CloseEventFd,
+    .readv = ReadEventFd,
+    .writev = WriteEventFd,
+    .poll = VfsPoll,
+    .tcgetattr = VfsTcgetattr,
+    .tcsetattr = VfsTcsetattr,
+    .tcgetwinsize = NoTcgetwinsize,
+    .tcsetwinsize = NoTcsetwinsize,
+};
+
+int SysEventfd2(struct Machine *m, u32 initval, i32 flags) {
+  int oflags;
+  if (flags & ~(EFD_SEMAPHORE_LINUX | EFD_NONBLOCK_LINUX | EFD_CLOEXEC_LINUX)) {
+    return einval();
+  }
+  oflags = XlatOpenFlags(flags & (EFD_NONBLOCK_LINUX | EFD_CLOEXEC_LINUX));
+#ifdef HAVE_EVENTFD
+  return AddHostEventFd(m,
+                        eventfd(initval,
+                                (flags & EFD_SEMAPHORE_LINUX ? EFD_SEMAPHORE
+                                                             : 0) |
+                                    (flags & EFD_NONBLOCK_LINUX ? EFD_NONBLOCK
+                                                                : 0) |
+                                    (flags & EFD_CLOEXEC_LINUX ? EFD_CLOEXEC
+                                                               : 0)),
+                        oflags);
+#else
+  return CreateEventFd(
+      m, flags & EFD_SEMAPHORE_LINUX ? kEventFdSemaphore : kEventFdCounter,
+      oflags, initval, 0);
+#endif
+}
+
+int SysEventfd(struct Machine *m, u32 initval) {
+  return SysEventfd2(m, initval, 0);
+}
+
+int SysTimerfdCreate(struct Machine *m, i32 clock, i32 flags) {
+  int oflags;
+#if !defined(HAVE_TIMERFD) && defined(HAVE_THREADS)
+  int fd;
+  struct EventFd *efd;
+#endif
+  clock_t sysclock;
+  if (flags & ~(TFD_NONBLOCK_LINUX | TFD_CLOEXEC_LINUX)) return einval();
+  if (clock != CLOCK_REALTIME_LINUX &&   //
+      clock != CLOCK_MONOTONIC_LINUX &&  //
+      clock != CLOCK_BOOTTIME_LINUX) {
+    LOGF("%s %d not supported yet", "timerfd clock", clock);
+    return einval();
+  }
+  if (XlatClock(clock, &sysclock) == -1) return -1;
+  oflags = XlatOpenFlags(flags);
+#ifdef HAVE_TIMERFD
+  return AddHostEventFd(
+      m,
+      timerfd_create(sysclock, (flags & TFD_NONBLOCK_LINUX ? TFD_NONBLOCK : 0) |
+                                   (flags & TFD_CLOEXEC_LINUX ? TFD_CLOEXEC : 0)),
+      oflags);
+#elif defined(HAVE_THREADS)
+  if ((fd = CreateEventFd(m, kEventFdTimer, oflags, 0, 0)) != -1) {
+    LockEventFds();
+    unassert(efd = FindEventFd(fd, kEventFdTimer));
+    efd->clock = sysclock;
+    UnlockEventFds();
+  }
+  return fd;
+#else
+  return enosys();
+#endif
+}
+
+int SysTimerfdSettime(struct Machine *m, i32 fildes, i32 flags, i64 valueaddr,
+                      i64 oldvalueaddr) {
+  struct timespec value, interval;
+#ifdef HAVE_TIMERFD
+  int rc, sysflags;
+  struct itimerspec its, old;
+#elif defined(HAVE_THREADS)
+  struct EventFd *efd;
+  struct timespec now, oldvalue, oldinterval;
+#endif
+  if (flags & ~(TFD_TIMER_ABSTIME_LINUX | TFD_TIMER_CANCEL_ON_SET_LINUX)) {
+    return einval();
+  }
+  if (LoadItimerspec(m, valueaddr, &interval, &value) == -1) return -1;
+  if (oldvalueaddr &&
+      !IsValidMemory(m, oldvalueaddr, sizeof(struct itimerspec_linux),
+                     PROT_WRITE)) {
+    return efault();
+  }
+#ifdef HAVE_TIMERFD
+  sysflags = 0;
+  if (flags & TFD_TIMER_ABSTIME_LINUX) sysflags |= TFD_TIMER_ABSTIME;
+#ifdef TFD_TIMER_CANCEL_ON_SET
+  if (flags & TFD_TIMER_CANCEL_ON_SET_LINUX) sysflags |= TFD_TIMER_CANCEL_ON_SET;
+#endif
+  its.it_value = value;
+  its.it_interval = interval;
+  if ((rc = timerfd_settime(fildes, sysflags, &its, &old)) != -1 &&
+      oldvalueaddr) {
+    StoreItimerspec(m, oldvalueaddr, old.it_interval, old.it_value);
+  }
+  return rc;
+#elif defined(HAVE_THREADS)
+  LockEventFds();
+  if (!(efd = FindEventFd(fildes, kEventFdTimer))) {
+    UnlockEventFds();
+    return -1;
+  }
+  unassert(!clock_gettime(efd->clock, &now));
+  oldinterval = efd->interval;
+  if (IsZeroTime(efd->value)) {
+    oldvalue = efd->value;
+  } else if (CompareTime(now, efd->value) < 0) {
+    oldvalue = SubtractTime(efd->value, now);
+  } else {
+    oldvalue = FromNanoseconds(1);
+  }
+  efd->count = 0;
+  Drain(efd);
+  efd->interval = interval;
+  if (IsZeroTime(value) || (flags & TFD_TIMER_ABSTIME_LINUX)) {
+    efd->value = value;
+  } else {
+    efd->value = AddTime(now, value);
+  }
+  if (!IsZeroTime(efd->value) && StartTimerWorker() == -1) {
+    efd->value = GetZeroTime();
+    UnlockEventFds();
+    return -1;
+  }
+  unassert(!pthread_cond_signal(&g_eventfds.cond));
+  UnlockEventFds();
+  if (oldvalueaddr) StoreItimerspec(m, oldvalueaddr, oldinterval, oldvalue);
+  return 0;
+#else
+  return enosys();
+#endif
+}
+
+int SysTimerfdGettime(struct Machine *m, i32 fildes, i64 valueaddr) {
+#ifdef HAVE_TIMERFD
+  int rc;
+  struct itimerspec its;
+  if ((rc = timerfd_gettime(fildes, &its)) != -1) {
+    rc = StoreItimerspec(m, valueaddr, its.it_interval, its.it_value);
+  }
+  return rc;
+#elif defined(HAVE_THREADS)
+  struct EventFd *efd;
+  struct timespec now, value, interval;
+  LockEventFds();
+  if (!(efd = FindEventFd(fildes, kEventFdTimer))) {
+    UnlockEventFds();
+    return -1;
+  }
+  unassert(!clock_gettime(efd->clock, &now));
+  interval = efd->interval;
+  if (IsZeroTime(efd->value)) {
+    value = efd->value;
+  } else if (CompareTime(now, efd->value) < 0) {
+    value = SubtractTime(efd->value, now);
+  } else {
+    value = FromNanoseconds(1);
+  }
+  UnlockEventFds();
+  return StoreItimerspec(m, valueaddr, interval, value);
+#else
+  return enosys();
+#endif
+}
+
+// ensures monitored signals reach us, even if they'd be fatal by default
+static void HookSignalFdSignals(struct Machine *m, u64 mask) {
+  int sig, syssig;
+  struct sigaction sa;
+  LOCK(&m->system->sig_lock);
+  for (sig = 1; sig <= 64; ++sig) {
+    if ((mask & ((u64)1 << (sig - 1))) && !IsBlinkSig(m->system, sig) &&
+        Read64(m->system->hands[sig - 1].handler) == SIG_DFL_LINUX &&
+        (syssig = XlatSignal(sig)) != -1) {
+      sigfillset(&sa.sa_mask);
+      sa.sa_flags = SA_SIGINFO;
+      sa.sa_sigaction = OnSignal;
+      if (sigaction(syssig, &sa, 0)) {
+        LOGF("system sigaction(%s) returned %s", DescribeSignal(sig),
+             DescribeHostErrno(errno));
+      }
+    }
+  }
+  UNLOCK(&m->system->sig_lock);
+}
+
+int SysSignalfd4(struct Machine *m, i32 fildes, i64 maskaddr, u64 sigsetsize,
+                 i32 flags) {
+  u64 mask;
+  bool more;
+  const u8 *p;
+  struct EventFd *efd;
+  if (sigsetsize != 8) return einval();
+  if (flags & ~(SFD_NONBLOCK_LINUX | SFD_CLOEXEC_LINUX)) return einval();
+  if (!(p = (const u8 *)SchlepR(m, maskaddr, 8))) return -1;
+  mask = Read64(p);
+  mask &= ~((u64)1 << (SIGKILL_LINUX - 1) | (u64)1 << (SIGSTOP_LINUX - 1));
+  if (fildes == -1) {
+    fildes = CreateEventFd(m, kEventFdSignal, XlatOpenFlags(flags), 0, mask);
+    if (fildes == -1) return -1;
+  } else {
+    LockEventFds();
+    if (!(efd = FindEventFd(fildes, kEventFdSignal))) {
+      UnlockEventFds();
+      return -1;
+    }
+    atomic_store(&efd->sigmask, mask);
+    UnlockEventFds();
+  }
+  HookSignalFdSignals(m, mask);
+  // signals which were already pending need to make the fd readable
+  CollectSignals(m, mask, 0, 0, &more);
+  if (more) {
+    LockEventFds();
+    if ((efd = FindEventFd(fildes, kEventFdSignal))) Notify(efd);
+    UnlockEventFds();
+  }
+  return fildes;
+}
+
+int SysSignalfd(struct Machine *m, i32 fildes, i64 maskaddr, u64 sigsetsize) {
+  return SysSignalfd4(m, fildes, maskaddr, sigsetsize, 0);
+}
+
+// returns set of signals monitored by any signalfd
+u64 GetSignalFdMask(void) {
+  int i;
+  u64 mask;
+  for (mask = i = 0; i < kMaxEventFds; ++i) {
+    mask |= atomic_load_explicit(&g_eventfds.fds[i].sigmask,
+                                 memory_order_relaxed);
+  }
+  return mask;
+}
+
+// wakes signalfd readers, which is safe to call from signal handlers
+void NotifySignalFds(int sig) {
+  int i;
+  unassert(1 <= sig && sig <= 64);
+  for (i = 0; i < kMaxEventFds; ++i) {
+    if (atomic_load_explicit(&g_eventfds.fds[i].sigmask,
+                             memory_order_relaxed) &
+        ((u64)1 << (sig - 1))) {
+      Notify(g_eventfds.fds + i);
+    }
+  }
+}
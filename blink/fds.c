@@ -34,16 +34,60 @@
 #include "blink/log.h"
 #include "blink/macros.h"
 #include "blink/thread.h"
+#include "blink/tunables.h"
 #include "blink/vfs.h"
 
+/**
+ * @fileoverview File Descriptor Table
+ *
+ * Descriptors are kept on a list, for operations like close-on-exec that
+ * need to visit all of them, as well as a dense table indexed by the fd
+ * number, so the lookup that every i/o system call performs takes O(1)
+ * time no matter how many descriptors are open. The table only grows,
+ * and the table it replaces is freed right away.
+ *
+ * Callers must hold the fds lock while they look up descriptors and use
+ * what GetFd() has returned, since descriptors aren't reference counted
+ * and the table may be reallocated by any call to AddFd(). Counting would
+ * let lookups go without the lock, but a close() racing a read() would
+ * then have to put off closing the host fd until the read let go of it,
+ * and guest fd numbers are host fd numbers, so the guest's next open()
+ * wouldn't get the lowest free number the way it would on Linux.
+ */
+
 void InitFds(struct Fds *fds) {
   fds->list = 0;
+  fds->table = 0;
   unassert(!pthread_mutex_init(&fds->lock, 0));
 }
 
+// grows descriptor table so it has a slot for `fildes`
+static bool ReserveFd(struct Fds *fds, int fildes) {
+  int i, n;
+  struct FdTable *t, *t2;
+  t = fds->table;
+  if (t && fildes < t->size) return true;
+  n = t ? t->size : kMinFdTable;
+  while (n <= fildes) n *= 2;
+  if (!(t2 = (struct FdTable *)calloc(
+            1, sizeof(*t2) + (size_t)n * sizeof(t2->fds[0])))) {
+    return false;
+  }
+  t2->size = n;
+  if (t) {
+    for (i = 0; i < t->size; ++i) {
+      t2->fds[i] = t->fds[i];
+    }
+    free(t);
+  }
+  fds->table = t2;
+  return true;
+}
+
 struct Fd *AddFd(struct Fds *fds, int fildes, int oflags) {
   struct Fd *fd;
   if (fildes >= 0) {
+    if (!ReserveFd(fds, fildes)) return 0;
     if ((fd = (struct Fd *)calloc(1, sizeof(*fd)))) {
       dll_init(&fd->elem);
       fd->cb = &kFdCbHost;
@@ -51,6 +95,7 @@ struct Fd *AddFd(struct Fds *fds, int fildes, int oflags) {
       fd->oflags = oflags;
       unassert(!pthread_mutex_init(&fd->lock, 0));
       dll_make_first(&fds->list, &fd->elem);
+      fds->table->fds[fildes] = fd;
     }
     return fd;
   } else {
@@ -63,6 +108,7 @@ struct Fd *ForkFd(struct Fds *fds, struct Fd *fd, int fildes, int oflags) {
   struct Fd *fd2;
   if ((fd2 = AddFd(fds, fildes, oflags))) {
     if (fd) {
+      fd2->cb = fd->cb;
       fd2->path = fd->path ? strdup(fd->path) : 0;
       fd2->socktype = fd->socktype;
       fd2->norestart = fd->norestart;
@@ -73,25 +119,35 @@ struct Fd *ForkFd(struct Fds *fds, struct Fd *fd, int fildes, int oflags) {
 }
 
 struct Fd *GetFd(struct Fds *fds, int fildes) {
-  bool lru;
-  struct Dll *e;
-  if (fildes >= 0) {
-    lru = false;
-    for (e = dll_first(fds->list); e; e = dll_next(fds->list, e)) {
-      if (FD_CONTAINER(e)->fildes == fildes) {
-        if (lru) {
-          dll_remove(&fds->list, e);
-          dll_make_first(&fds->list, e);
-        }
-        return FD_CONTAINER(e);
-      }
-      lru = true;
-    }
+  struct Fd *fd;
+  struct FdTable *t;
+  if (fildes >= 0 && (t = fds->table) && fildes < t->size &&
+      (fd = t->fds[fildes])) {
+    return fd;
   }
   ebadf();
   return 0;
 }
 
+// unlinks descriptor, which the caller should then close or free
+void RemoveFd(struct Fds *fds, struct Fd *fd) {
+  struct FdTable *t;
+  dll_remove(&fds->list, &fd->elem);
+  if ((t = fds->table) && fd->fildes < t->size && t->fds[fd->fildes] == fd) {
+    t->fds[fd->fildes] = 0;
+  }
+}
+
+// transfers all descriptors to an empty table, e.g. upon execve()
+void MoveFds(struct Fds *to, struct Fds *from) {
+  unassert(!to->list);
+  unassert(!to->table);
+  to->list = from->list;
+  to->table = from->table;
+  from->list = 0;
+  from->table = 0;
+}
+
 void LockFd(struct Fd *fd) {
   LOCK(&fd->lock);
 }
@@ -125,6 +181,8 @@ void DestroyFds(struct Fds *fds) {
     FreeFd(FD_CONTAINER(e));
   }
   unassert(!fds->list);
+  free(fds->table);
+  fds->table = 0;
   unassert(!pthread_mutex_destroy(&fds->lock));
 }
 
@@ -45,8 +45,14 @@ struct Fd {
   } saddr;
 };
 
+struct FdTable {
+  int size;          // number of slots, which is a two-power
+  struct Fd *fds[];  // indexed by file descriptor number
+};
+
 struct Fds {
   struct Dll *list;
+  struct FdTable *table;
   pthread_mutex_t_ lock;
 };
 
@@ -56,6 +62,8 @@ void InitFds(struct Fds *);
 struct Fd *AddFd(struct Fds *, int, int);
 struct Fd *ForkFd(struct Fds *, struct Fd *, int, int);
 struct Fd *GetFd(struct Fds *, int);
+void RemoveFd(struct Fds *, struct Fd *);
+void MoveFds(struct Fds *, struct Fds *);
 void LockFd(struct Fd *);
 void UnlockFd(struct Fd *);
 int CountFds(struct Fds *);
@@ -21,6 +21,7 @@
 #include "blink/builtin.h"
 
 bool FLAG_zero;
+bool FLAG_keepaslr;
 bool FLAG_wantjit;
 bool FLAG_nolinear;
 bool FLAG_noconnect;
@@ -49,4 +50,6 @@ const char *FLAG_overlays;
 #ifndef DISABLE_VFS
 const char *FLAG_prefix;
 #endif
+const char *FLAG_prefetch;
+const char *FLAG_linkcache;
 const char *FLAG_bios;
@@ -5,6 +5,7 @@
 #include "blink/types.h"
 
 extern bool FLAG_zero;
+extern bool FLAG_keepaslr;
 extern bool FLAG_wantjit;
 extern bool FLAG_nolinear;
 extern bool FLAG_noconnect;
@@ -28,6 +29,8 @@ extern u64 FLAG_dyninterpaddr;
 extern const char *FLAG_logpath;
 extern const char *FLAG_overlays;
 extern const char *FLAG_prefix;
+extern const char *FLAG_prefetch;
+extern const char *FLAG_linkcache;
 extern const char *FLAG_bios;
 
 #endif /* BLINK_FLAG_H_ */
@@ -0,0 +1,807 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "blink/futex.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "blink/assert.h"
+#include "blink/atomic.h"
+#include "blink/bus.h"
+#include "blink/dll.h"
+#include "blink/errno.h"
+#include "blink/linux.h"
+#include "blink/log.h"
+#include "blink/macros.h"
+#include "blink/syscall.h"
+#include "blink/thread.h"
+#include "blink/timespec.h"
+#include "blink/tunables.h"
+#include "blink/util.h"
+
+#ifdef HAVE_FUTEX
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @fileoverview Futex Wait Queues
+ *
+ * Guest threads that wait on private futexes are put in a process-local
+ * hash table, whose buckets each have their own lock. Every waiter has
+ * a word of its own, which is what the host kernel is actually asked to
+ * sleep upon. Having a word of our own means wakeups, signals, and kill
+ * requests can all be delivered by changing it, so there's no window in
+ * which a signal could arrive after checking for interrupts but before
+ * going to sleep. Since the table is process-local, it's reinitialized
+ * in the child after fork().
+ *
+ * Requeue operations move waiters to another address without waking
+ * them, so broadcasting a condition variable doesn't cause a thundering
+ * herd of threads that would immediately go back to sleep on its mutex.
+ * Since requeue may change the address of a sleeping waiter, a waiter
+ * must use LockFutexBucket() to find the bucket it's currently in.
+ *
+ * Priority inheritance locks use the same table. Unlocking hands over
+ * ownership directly to the first waiter, in the order they arrived. We
+ * aren't able to boost the priority of host threads, so these are just
+ * fair locks which speak the protocol that glibc and musl expect.
+ *
+ * Shared futexes may be waited upon by other processes having the same
+ * MAP_SHARED memory, so we wait on the guest word's host address using
+ * a process-shared host futex instead. When the host supports it, our
+ * own word is watched too by using futex_waitv(). Otherwise we have to
+ * wake up every kPollingMs to check for signals. Shared waiters can't
+ * be requeued by other processes, so they're woken up instead.
+ *
+ * On hosts without futexes, waiters sleep on condition variables which
+ * can't be signalled by signal handlers, so we poll for interrupts. The
+ * shared waiters sleep on process-shared condition variables in g_bus,
+ * hashed by address, which wakers broadcast from whichever process.
+ */
+
+#define kFutexWaiting     0
+#define kFutexWoken       1
+#define kFutexInterrupted 2
+
+struct FutexBucket {
+  _Alignas(kSemSize) pthread_mutex_t_ lock;
+  struct Dll *waiters;
+};
+
+static struct FutexBucket g_futexes[kFutexBuckets];
+
+#if defined(HAVE_FUTEX) && defined(SYS_futex_waitv)
+#define kFutex2SizeU32 0x02
+#define kFutex2Private 0x80
+struct FutexWaitv {
+  u64 val;
+  u64 uaddr;
+  u32 flags;
+  u32 reserved;
+};
+static bool g_nowaitv;
+#endif
+
+void InitFutexes(void) {
+  int i;
+  _Static_assert(IS2POW(kFutexBuckets), "futex buckets must be two-power");
+  for (i = 0; i < kFutexBuckets; ++i) {
+    unassert(!pthread_mutex_init(&g_futexes[i].lock, 0));
+    g_futexes[i].waiters = 0;
+  }
+}
+
+static struct FutexBucket *GetFutexBucket(i64 addr) {
+  u64 h = (u64)addr * 0x9e3779b97f4a7c15;
+  return g_futexes + (h >> 32) % kFutexBuckets;
+}
+
+static i64 GetFutexAddr(struct Futex *f) {
+  return atomic_load_explicit(&f->addr, memory_order_acquire);
+}
+
+// locks bucket that futex is currently in, which requeue may change
+static struct FutexBucket *LockFutexBucket(struct Futex *f) {
+  i64 addr;
+  struct FutexBucket *b;
+  for (;;) {
+    addr = GetFutexAddr(f);
+    b = GetFutexBucket(addr);
+    LOCK(&b->lock);
+    if (GetFutexAddr(f) == addr) return b;
+    UNLOCK(&b->lock);
+  }
+}
+
+// locks two buckets in a consistent order to avoid deadlock
+static void LockFutexBuckets(struct FutexBucket *b1, struct FutexBucket *b2) {
+  if (b1 == b2) {
+    LOCK(&b1->lock);
+  } else if (b1 < b2) {
+    LOCK(&b1->lock);
+    LOCK(&b2->lock);
+  } else {
+    LOCK(&b2->lock);
+    LOCK(&b1->lock);
+  }
+}
+
+static void UnlockFutexBuckets(struct FutexBucket *b1,
+                               struct FutexBucket *b2) {
+  UNLOCK(&b1->lock);
+  if (b2 != b1) UNLOCK(&b2->lock);
+}
+
+// returns time at which we should next check for signals if polling
+static struct timespec GetPollDeadline(struct timespec deadline) {
+  struct timespec tick;
+  tick = AddTime(GetTime(), FromMilliseconds(kPollingMs));
+  return CompareTime(tick, deadline) < 0 ? tick : deadline;
+}
+
+/**
+ * Interrupts futex wait of calling thread.
+ *
+ * This is called by our signal handlers. It's safe to call from any
+ * asynchronous context, but only for the machine of the current thread.
+ */
+void InterruptFutex(struct Machine *m) {
+  struct Futex *f;
+  u32 expect = kFutexWaiting;
+  if (m && (f = atomic_load_explicit(&m->futex, memory_order_acquire))) {
+    atomic_compare_exchange_strong_explicit(&f->word, &expect,
+                                            kFutexInterrupted,
+                                            memory_order_release,
+                                            memory_order_relaxed);
+  }
+}
+
+#ifdef HAVE_FUTEX
+static int HostFutexWait(void *addr, u32 expect, u32 bitset, bool shared,
+                         struct timespec deadline) {
+  return syscall(SYS_futex, addr,
+                 FUTEX_WAIT_BITSET | FUTEX_CLOCK_REALTIME |
+                     (shared ? 0 : FUTEX_PRIVATE_FLAG),
+                 expect, CompareTime(deadline, GetMaxTime()) ? &deadline : 0,
+                 0, bitset);
+}
+
+static int HostFutexWake(void *addr, int count, u32 bitset, bool shared) {
+  return syscall(SYS_futex, addr,
+                 FUTEX_WAKE_BITSET | (shared ? 0 : FUTEX_PRIVATE_FLAG), count,
+                 0, 0, bitset);
+}
+#endif
+
+static void WakeFutex(struct Futex *f) {
+  atomic_store_explicit(&f->word, kFutexWoken, memory_order_release);
+#ifdef HAVE_FUTEX
+  HostFutexWake(&f->word, 1, FUTEX_BITSET_MATCH_ANY_LINUX, false);
+#else
+  unassert(!pthread_cond_signal(&f->cond));
+#endif
+}
+
+// wakes up to `count` waiters at `addr`, with bucket locked
+static int WakeFutexes(struct FutexBucket *b, i64 addr, int count,
+                       u32 bitset) {
+  int n;
+  struct Futex *f;
+  struct Dll *e, *g;
+  for (n = 0, e = dll_first(b->waiters); e && n < count; e = g) {
+    g = dll_next(b->waiters, e);
+    f = FUTEX_CONTAINER(e);
+    if (!f->tid && (f->bitset & bitset) && GetFutexAddr(f) == addr) {
+      dll_remove(&b->waiters, e);
+      WakeFutex(f);
+      ++n;
+    }
+  }
+  return n;
+}
+
+// sleeps until futex is woken, interrupted, or `deadline` is reached
+static void SleepOnFutex(struct Futex *f, struct timespec deadline) {
+#ifdef HAVE_FUTEX
+  HostFutexWait(&f->word, kFutexWaiting, FUTEX_BITSET_MATCH_ANY_LINUX, false,
+                deadline);
+#else
+  struct FutexBucket *b;
+  b = LockFutexBucket(f);
+  if (atomic_load_explicit(&f->word, memory_order_relaxed) == kFutexWaiting) {
+    deadline = GetPollDeadline(deadline);
+    pthread_cond_timedwait(&f->cond, &b->lock, &deadline);
+  }
+  UNLOCK(&b->lock);
+#endif
+}
+
+// returns true if we should stop waiting due to interrupts or timeout
+static bool ShouldStopWaiting(struct Machine *m, struct Futex *f,
+                              struct timespec deadline, bool interruptible,
+                              int *rc) {
+  u32 word = kFutexInterrupted;
+  if (!atomic_compare_exchange_strong_explicit(&f->word, &word, kFutexWaiting,
+                                               memory_order_acquire,
+                                               memory_order_acquire) &&
+      word == kFutexWoken) {
+    *rc = 0;
+    return true;
+  }
+  if (atomic_load_explicit(&m->killed, memory_order_acquire)) {
+    *rc = EAGAIN;
+    return true;
+  }
+  if (CheckInterrupt(m, true) && interruptible) {
+    *rc = EINTR;
+    return true;
+  }
+  if (CompareTime(GetTime(), deadline) >= 0) {
+    *rc = ETIMEDOUT;
+    return true;
+  }
+  return false;
+}
+
+#ifndef HAVE_FUTEX
+static struct BusFutex *GetBusFutex(i64 addr) {
+  u64 h = (u64)addr * 0x9e3779b97f4a7c15;
+  return g_bus->futexes + (h >> 32) % kBusFutexes;
+}
+
+// wakes shared waiters in all processes. everyone sleeping in the same
+// bus futex gets woken, since we can't tell which address they're at.
+static void WakeBusFutex(i64 addr) {
+  struct BusFutex *s;
+  s = GetBusFutex(addr);
+  LOCK(&s->lock);
+  ++s->seq;
+  unassert(!pthread_cond_broadcast(&s->cond));
+  UNLOCK(&s->lock);
+}
+
+static int FutexWaitShared(struct Machine *m, struct Futex *f, u8 *mem,
+                           u32 expect, struct timespec deadline) {
+  int rc;
+  u32 seq;
+  bool woken;
+  struct BusFutex *s;
+  struct timespec tick;
+  s = GetBusFutex(GetFutexAddr(f));
+  LOCK(&s->lock);
+  seq = s->seq;
+  woken = Load32(mem) != expect;
+  UNLOCK(&s->lock);
+  if (woken) return 0;
+  while (!ShouldStopWaiting(m, f, deadline, true, &rc)) {
+    LOCK(&s->lock);
+    if (s->seq == seq && Load32(mem) == expect) {
+      tick = GetPollDeadline(deadline);
+      pthread_cond_timedwait(&s->cond, &s->lock, &tick);
+    }
+    woken = s->seq != seq || Load32(mem) != expect;
+    UNLOCK(&s->lock);
+    if (woken) return 0;
+  }
+  return rc;
+}
+#else
+static int FutexWaitShared(struct Machine *m, struct Futex *f, u8 *mem,
+                           u32 expect, struct timespec deadline) {
+  int rc;
+#ifdef SYS_futex_waitv
+  struct FutexWaitv wv[2];
+#endif
+  while (!ShouldStopWaiting(m, f, deadline, true, &rc)) {
+#ifdef SYS_futex_waitv
+    if (!g_nowaitv && f->bitset == FUTEX_BITSET_MATCH_ANY_LINUX) {
+      wv[0].val = expect;
+      wv[0].uaddr = (uintptr_t)mem;
+      wv[0].flags = kFutex2SizeU32;
+      wv[0].reserved = 0;
+      wv[1].val = kFutexWaiting;
+      wv[1].uaddr = (uintptr_t)&f->word;
+      wv[1].flags = kFutex2SizeU32 | kFutex2Private;
+      wv[1].reserved = 0;
+      switch (syscall(SYS_futex_waitv, wv, 2, 0,
+                      CompareTime(deadline, GetMaxTime()) ? &deadline : 0,
+                      CLOCK_REALTIME)) {
+        case 0:
+          return 0;
+        case -1:
+          if (errno == ENOSYS) {
+            g_nowaitv = true;
+            break;
+          }
+          if (errno == EAGAIN && Load32(mem) != expect) {
+            return 0;  // changed since we started waiting
+          }
+          continue;
+        default:
+          continue;
+      }
+    }
+#endif
+    // old kernels can't watch our own word too, so poll for signals
+    if (!HostFutexWait(mem, expect, f->bitset, true,
+                       GetPollDeadline(deadline)) ||
+        errno == EAGAIN) {
+      return 0;
+    }
+  }
+  return rc;
+}
+#endif
+
+/**
+ * Waits for futex to be woken.
+ *
+ * @param bitset must overlap the bitset of the waker
+ * @param deadline is absolute realtime, or GetMaxTime() to wait forever
+ * @param shared is true if other processes might wake this futex
+ * @return 0 on success, or -1 w/ errno
+ * @raise EAGAIN if `*uaddr` isn't `expect`, or the thread was killed
+ * @raise ETIMEDOUT if `deadline` was reached
+ * @raise EINTR if a guest signal handler was invoked
+ */
+int FutexWait(struct Machine *m, i64 uaddr, u32 expect, u32 bitset,
+              struct timespec deadline, bool shared) {
+  int rc;
+  u8 *mem;
+  struct Futex f;
+  struct FutexBucket *b;
+  if (!(mem = LookupAddress(m, uaddr))) return -1;
+  f.addr = uaddr;
+  f.word = kFutexWaiting;
+  f.bitset = bitset;
+  f.tid = 0;
+  dll_init(&f.elem);
+  if (shared) {
+    if (Load32(mem) != expect) return eagain();
+    THR_LOGF("pid=%d tid=%d is waiting at shared address %#" PRIx64,
+             m->system->pid, m->tid, uaddr);
+    atomic_store_explicit(&m->futex, &f, memory_order_release);
+    rc = FutexWaitShared(m, &f, mem, expect, deadline);
+    atomic_store_explicit(&m->futex, 0, memory_order_release);
+    goto Finished;
+  }
+#ifndef HAVE_FUTEX
+  unassert(!pthread_cond_init(&f.cond, 0));
+#endif
+  b = GetFutexBucket(uaddr);
+  LOCK(&b->lock);
+  if (Load32(mem) != expect) {
+    UNLOCK(&b->lock);
+#ifndef HAVE_FUTEX
+    unassert(!pthread_cond_destroy(&f.cond));
+#endif
+    return eagain();
+  }
+  dll_make_last(&b->waiters, &f.elem);
+  atomic_store_explicit(&m->futex, &f, memory_order_release);
+  UNLOCK(&b->lock);
+  THR_LOGF("pid=%d tid=%d is waiting at address %#" PRIx64, m->system->pid,
+           m->tid, uaddr);
+  while (!ShouldStopWaiting(m, &f, deadline, true, &rc)) {
+    SleepOnFutex(&f, deadline);
+  }
+  atomic_store_explicit(&m->futex, 0, memory_order_release);
+  b = LockFutexBucket(&f);
+  if (atomic_load_explicit(&f.word, memory_order_acquire) != kFutexWoken) {
+    dll_remove(&b->waiters, &f.elem);
+  } else if (rc == ETIMEDOUT) {
+    rc = 0;
+  } else if (rc) {
+    // we were woken after a signal got delivered, so pass it along
+    WakeFutexes(b, GetFutexAddr(&f), 1, FUTEX_BITSET_MATCH_ANY_LINUX);
+  }
+  UNLOCK(&b->lock);
+#ifndef HAVE_FUTEX
+  unassert(!pthread_cond_destroy(&f.cond));
+#endif
+Finished:
+  if (rc) {
+    THR_LOGF("futex wait returned %s", DescribeHostErrno(rc));
+    errno = rc;
+    rc = -1;
+  }
+  return rc;
+}
+
+/**
+ * Wakes futex waiters.
+ *
+ * @param count is the maximum number of waiters to wake
+ * @param bitset must overlap the bitset of the waiters
+ * @param shared is true if waiters in other processes should be woken
+ * @return number of waiters woken
+ */
+int FutexWake(struct Machine *m, i64 uaddr, u32 count, u32 bitset,
+              bool shared) {
+  int rc;
+  struct FutexBucket *b;
+#ifdef HAVE_FUTEX
+  int n;
+  u8 *mem;
+#endif
+  if (!count) return 0;
+  count = MIN(count, INT_MAX);
+  b = GetFutexBucket(uaddr);
+  LOCK(&b->lock);
+  rc = WakeFutexes(b, uaddr, (int)count, bitset);
+  UNLOCK(&b->lock);
+#ifdef HAVE_FUTEX
+  if (shared && rc < (int)count && (mem = LookupAddress(m, uaddr)) &&
+      (n = HostFutexWake(mem, (int)count - rc, bitset, true)) > 0) {
+    rc += n;
+  }
+#else
+  if (shared) WakeBusFutex(uaddr);
+#endif
+  THR_LOGF("pid=%d tid=%d woke %d waiters at address %#" PRIx64,
+           m->system->pid, m->tid, rc, uaddr);
+  return rc;
+}
+
+/**
+ * Wakes futex waiters and moves the rest to a different address.
+ *
+ * @param count is the maximum number of waiters to wake
+ * @param count2 is the maximum number of waiters to move to `uaddr2`
+ * @param expect if non-null is the value `*uaddr` must have
+ * @param shared is true if waiters in other processes should be woken
+ * @return number of waiters woken or requeued, or -1 w/ errno
+ * @raise EAGAIN if `*uaddr` isn't `*expect`
+ */
+int FutexRequeue(struct Machine *m, i64 uaddr, u32 count, i64 uaddr2,
+                 u32 count2, const u32 *expect, bool shared) {
+  u8 *mem;
+  struct Futex *f;
+  int woken, moved;
+  struct Dll *e, *g, *list;
+  struct FutexBucket *b1, *b2;
+#ifdef HAVE_FUTEX
+  int n, total;
+#endif
+  if (!(mem = LookupAddress(m, uaddr))) return -1;
+  count = MIN(count, INT_MAX);
+  count2 = MIN(count2, INT_MAX);
+  b1 = GetFutexBucket(uaddr);
+  b2 = GetFutexBucket(uaddr2);
+  LockFutexBuckets(b1, b2);
+  if (expect && Load32(mem) != *expect) {
+    UnlockFutexBuckets(b1, b2);
+    return eagain();
+  }
+  woken = WakeFutexes(b1, uaddr, (int)count, FUTEX_BITSET_MATCH_ANY_LINUX);
+  for (list = 0, moved = 0, e = dll_first(b1->waiters);
+       e && moved < (int)count2; e = g) {
+    g = dll_next(b1->waiters, e);
+    f = FUTEX_CONTAINER(e);
+    if (!f->tid && GetFutexAddr(f) == uaddr) {
+      dll_remove(&b1->waiters, e);
+      atomic_store_explicit(&f->addr, uaddr2, memory_order_release);
+      dll_make_last(&list, e);
+      ++moved;
+    }
+  }
+  while ((e = dll_first(list))) {
+    dll_remove(&list, e);
+    dll_make_last(&b2->waiters, e);
+  }
+  UnlockFutexBuckets(b1, b2);
+#ifdef HAVE_FUTEX
+  // waiters in other processes can only be woken
+  total = MIN((u64)count + count2, INT_MAX);
+  if (shared && woken + moved < total &&
+      (n = HostFutexWake(mem, total - woken - moved,
+                         FUTEX_BITSET_MATCH_ANY_LINUX, true)) > 0) {
+    woken += n;
+  }
+#else
+  if (shared) WakeBusFutex(uaddr);
+#endif
+  THR_LOGF("pid=%d tid=%d woke %d and requeued %d waiters from %#" PRIx64
+           " to %#" PRIx64,
+           m->system->pid, m->tid, woken, moved, uaddr, uaddr2);
+  return woken + moved;
+}
+
+static u32 ApplyFutexOp(int op, u32 x, u32 y) {
+  switch (op) {
+    case FUTEX_OP_SET_LINUX:
+      return y;
+    case FUTEX_OP_ADD_LINUX:
+      return x + y;
+    case FUTEX_OP_OR_LINUX:
+      return x | y;
+    case FUTEX_OP_ANDN_LINUX:
+      return x & ~y;
+    case FUTEX_OP_XOR_LINUX:
+      return x ^ y;
+    default:
+      __builtin_unreachable();
+  }
+}
+
+static bool CompareFutexOp(int cmp, i32 x, i32 y) {
+  switch (cmp) {
+    case FUTEX_OP_CMP_EQ_LINUX:
+      return x == y;
+    case FUTEX_OP_CMP_NE_LINUX:
+      return x != y;
+    case FUTEX_OP_CMP_LT_LINUX:
+      return x < y;
+    case FUTEX_OP_CMP_LE_LINUX:
+      return x <= y;
+    case FUTEX_OP_CMP_GT_LINUX:
+      return x > y;
+    case FUTEX_OP_CMP_GE_LINUX:
+      return x >= y;
+    default:
+      __builtin_unreachable();
+  }
+}
+
+/**
+ * Modifies `*uaddr2` and wakes waiters at both addresses.
+ *
+ * The waiters at `uaddr2` are only woken if the old value of `*uaddr2`
+ * passes the comparison encoded in `encoded`. Both buckets stay locked
+ * the whole time, so no waiter can slip in between changing the value
+ * and being woken up.
+ *
+ * @param encoded has op, cmp, oparg, and cmparg in the linux format
+ * @return number of waiters woken, or -1 w/ errno
+ * @raise ENOSYS if `encoded` has an unknown op or cmp
+ */
+int FutexWakeOp(struct Machine *m, i64 uaddr, u32 count, i64 uaddr2,
+                u32 count2, u32 encoded, bool shared) {
+  u32 old;
+  bool pass;
+  int op, cmp, woken, woken2;
+  i32 oparg, cmparg;
+  _Atomic(u32) *word;
+  struct FutexBucket *b1, *b2;
+#ifdef HAVE_FUTEX
+  int n;
+  u8 *mem;
+#endif
+  op = encoded >> 28 & 7;
+  cmp = encoded >> 24 & 15;
+  oparg = (i32)(encoded << 8) >> 20;
+  cmparg = (i32)(encoded << 20) >> 20;
+  if (op > FUTEX_OP_XOR_LINUX || cmp > FUTEX_OP_CMP_GE_LINUX) return enosys();
+  if (encoded & (u32)FUTEX_OP_OPARG_SHIFT_LINUX << 28) {
+    oparg = 1u << (oparg & 31);
+  }
+  if (!(word = (_Atomic(u32) *)SchlepRW(m, uaddr2, 4))) return -1;
+  count = MIN(count, INT_MAX);
+  count2 = MIN(count2, INT_MAX);
+  b1 = GetFutexBucket(uaddr);
+  b2 = GetFutexBucket(uaddr2);
+  LockFutexBuckets(b1, b2);
+  old = atomic_load_explicit(word, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(
+      word, &old, ApplyFutexOp(op, old, oparg), memory_order_acq_rel,
+      memory_order_relaxed)) {
+  }
+  pass = CompareFutexOp(cmp, old, cmparg);
+  woken = WakeFutexes(b1, uaddr, (int)count, FUTEX_BITSET_MATCH_ANY_LINUX);
+  woken2 = pass ? WakeFutexes(b2, uaddr2, (int)count2,
+                              FUTEX_BITSET_MATCH_ANY_LINUX)
+                : 0;
+  UnlockFutexBuckets(b1, b2);
+#ifdef HAVE_FUTEX
+  if (shared) {
+    if (woken < (int)count && (mem = LookupAddress(m, uaddr)) &&
+        (n = HostFutexWake(mem, (int)count - woken,
+                           FUTEX_BITSET_MATCH_ANY_LINUX, true)) > 0) {
+      woken += n;
+    }
+    if (pass && woken2 < (int)count2 &&
+        (n = HostFutexWake(word, (int)count2 - woken2,
+                           FUTEX_BITSET_MATCH_ANY_LINUX, true)) > 0) {
+      woken2 += n;
+    }
+  }
+#else
+  if (shared) {
+    WakeBusFutex(uaddr);
+    if (pass) WakeBusFutex(uaddr2);
+  }
+#endif
+  THR_LOGF("pid=%d tid=%d woke %d waiters at %#" PRIx64 " and %d at %#" PRIx64,
+           m->system->pid, m->tid, woken, uaddr, woken2, uaddr2);
+  return woken + woken2;
+}
+
+// returns first priority inheritance waiter at `addr` other than `skip`
+static struct Futex *FindPiWaiter(struct FutexBucket *b, i64 addr,
+                                  struct Futex *skip) {
+  struct Dll *e;
+  struct Futex *f;
+  for (e = dll_first(b->waiters); e; e = dll_next(b->waiters, e)) {
+    f = FUTEX_CONTAINER(e);
+    if (f != skip && f->tid && GetFutexAddr(f) == addr) {
+      return f;
+    }
+  }
+  return 0;
+}
+
+// takes ownership of priority inheritance lock if it has no owner
+static bool TryLockPi(struct FutexBucket *b, _Atomic(u32) *word, i64 addr,
+                      u32 tid, struct Futex *self, u32 *old) {
+  u32 want;
+  while (!(*old & FUTEX_TID_MASK_LINUX)) {
+    want = tid | (*old & FUTEX_OWNER_DIED_LINUX);
+    if (FindPiWaiter(b, addr, self)) want |= FUTEX_WAITERS_LINUX;
+    if (atomic_compare_exchange_weak_explicit(word, old, want,
+                                              memory_order_acquire,
+                                              memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Acquires priority inheritance futex lock.
+ *
+ * Unlike other futex waits, this is restarted after signal handlers are
+ * invoked, since the libc mutex code assumes it can't fail with EINTR.
+ *
+ * @param deadline is absolute realtime, or GetMaxTime() to wait forever
+ * @param trylock is true if we shouldn't wait if it's owned
+ * @param shared is true if the owner could be in another process
+ * @return 0 on success, or -1 w/ errno
+ * @raise EDEADLK if the calling thread already owns the lock
+ * @raise EAGAIN if `trylock` and it's owned, or the thread was killed
+ * @raise ETIMEDOUT if `deadline` was reached
+ */
+int FutexLockPi(struct Machine *m, i64 uaddr, struct timespec deadline,
+                bool trylock, bool shared) {
+  int rc;
+  u32 old, tid;
+  struct Futex f;
+  _Atomic(u32) *word;
+  struct FutexBucket *b;
+  if (!(word = (_Atomic(u32) *)SchlepRW(m, uaddr, 4))) return -1;
+  tid = m->tid & FUTEX_TID_MASK_LINUX;
+  b = GetFutexBucket(uaddr);
+  LOCK(&b->lock);
+  for (old = atomic_load_explicit(word, memory_order_relaxed);;) {
+    if ((old & FUTEX_TID_MASK_LINUX) == tid) {
+      UNLOCK(&b->lock);
+      return edeadlk();
+    }
+    if (TryLockPi(b, word, uaddr, tid, 0, &old)) {
+      UNLOCK(&b->lock);
+      return 0;
+    }
+    if (trylock) {
+      UNLOCK(&b->lock);
+      return eagain();
+    }
+    if ((old & FUTEX_WAITERS_LINUX) ||
+        atomic_compare_exchange_weak_explicit(word, &old,
+                                              old | FUTEX_WAITERS_LINUX,
+                                              memory_order_relaxed,
+                                              memory_order_relaxed)) {
+      break;
+    }
+  }
+  f.addr = uaddr;
+  f.word = kFutexWaiting;
+  f.bitset = FUTEX_BITSET_MATCH_ANY_LINUX;
+  f.tid = tid;
+  dll_init(&f.elem);
+#ifndef HAVE_FUTEX
+  unassert(!pthread_cond_init(&f.cond, 0));
+#endif
+  dll_make_last(&b->waiters, &f.elem);
+  atomic_store_explicit(&m->futex, &f, memory_order_release);
+  UNLOCK(&b->lock);
+  THR_LOGF("pid=%d tid=%d is waiting on pi lock at %#" PRIx64,
+           m->system->pid, m->tid, uaddr);
+  while (!ShouldStopWaiting(m, &f, deadline, false, &rc)) {
+    if (shared) {
+      // owners in other processes can't hand the lock over to us
+      LOCK(&b->lock);
+      old = atomic_load_explicit(word, memory_order_relaxed);
+      if (atomic_load_explicit(&f.word, memory_order_relaxed) ==
+              kFutexWaiting &&
+          TryLockPi(b, word, uaddr, tid, &f, &old)) {
+        dll_remove(&b->waiters, &f.elem);
+        atomic_store_explicit(&f.word, kFutexWoken, memory_order_relaxed);
+      }
+      UNLOCK(&b->lock);
+      SleepOnFutex(&f, GetPollDeadline(deadline));
+    } else {
+      SleepOnFutex(&f, deadline);
+    }
+  }
+  atomic_store_explicit(&m->futex, 0, memory_order_release);
+  LOCK(&b->lock);
+  if (atomic_load_explicit(&f.word, memory_order_acquire) != kFutexWoken) {
+    dll_remove(&b->waiters, &f.elem);
+  } else {
+    rc = 0;  // ownership was handed over to us
+  }
+  UNLOCK(&b->lock);
+#ifndef HAVE_FUTEX
+  unassert(!pthread_cond_destroy(&f.cond));
+#endif
+  if (rc) {
+    THR_LOGF("futex lock pi returned %s", DescribeHostErrno(rc));
+    errno = rc;
+    rc = -1;
+  }
+  return rc;
+}
+
+/**
+ * Releases priority inheritance futex lock.
+ *
+ * If other threads are waiting, then ownership is handed over to the
+ * one that's been waiting longest. Otherwise the lock word becomes 0.
+ *
+ * @return 0 on success, or -1 w/ errno
+ * @raise EPERM if the calling thread doesn't own the lock
+ */
+int FutexUnlockPi(struct Machine *m, i64 uaddr) {
+  u32 old, tid, want;
+  struct Futex *f;
+  _Atomic(u32) *word;
+  struct FutexBucket *b;
+  if (!(word = (_Atomic(u32) *)SchlepRW(m, uaddr, 4))) return -1;
+  tid = m->tid & FUTEX_TID_MASK_LINUX;
+  b = GetFutexBucket(uaddr);
+  LOCK(&b->lock);
+  if ((f = FindPiWaiter(b, uaddr, 0))) {
+    want = f->tid;
+    if (FindPiWaiter(b, uaddr, f)) want |= FUTEX_WAITERS_LINUX;
+  } else {
+    want = 0;
+  }
+  for (old = atomic_load_explicit(word, memory_order_relaxed);;) {
+    if ((old & FUTEX_TID_MASK_LINUX) != tid) {
+      UNLOCK(&b->lock);
+      return eperm();
+    }
+    if (atomic_compare_exchange_weak_explicit(word, &old, want,
+                                              memory_order_release,
+                                              memory_order_relaxed)) {
+      break;
+    }
+  }
+  if (f) {
+    dll_remove(&b->waiters, &f->elem);
+    WakeFutex(f);
+  }
+  UNLOCK(&b->lock);
+  THR_LOGF("pid=%d tid=%d handed pi lock at %#" PRIx64 " to tid=%d",
+           m->system->pid, m->tid, uaddr, want & FUTEX_TID_MASK_LINUX);
+  return 0;
+}
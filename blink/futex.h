@@ -0,0 +1,32 @@
+#ifndef BLINK_FUTEX_H_
+#define BLINK_FUTEX_H_
+#include <stdbool.h>
+#include <time.h>
+
+#include "blink/dll.h"
+#include "blink/machine.h"
+#include "blink/types.h"
+
+#define FUTEX_CONTAINER(e) DLL_CONTAINER(struct Futex, elem, e)
+
+struct Futex {
+  _Atomic(i64) addr;   // guest virtual address being waited upon
+  _Atomic(u32) word;   // kFutexWaiting, kFutexWoken, or kFutexInterrupted
+  u32 bitset;          // wakers must share at least one of these bits
+  int tid;             // guest thread id if waiting on priority inheritance
+  struct Dll elem;     // linked into bucket while waiting
+#ifndef HAVE_FUTEX
+  pthread_cond_t_ cond;
+#endif
+};
+
+void InitFutexes(void);
+void InterruptFutex(struct Machine *);
+int FutexWake(struct Machine *, i64, u32, u32, bool);
+int FutexWait(struct Machine *, i64, u32, u32, struct timespec, bool);
+int FutexRequeue(struct Machine *, i64, u32, i64, u32, const u32 *, bool);
+int FutexWakeOp(struct Machine *, i64, u32, i64, u32, u32, bool);
+int FutexLockPi(struct Machine *, i64, struct timespec, bool, bool);
+int FutexUnlockPi(struct Machine *, i64);
+
+#endif /* BLINK_FUTEX_H_ */
@@ -1938,6 +1938,7 @@ cleananddie:
 
 struct VfsSystem g_hostfs = {.name = "hostfs",
                              .nodev = true,
+                             .dcache = true,
                              .ops = {
                                  .Init = HostfsInit,
                                  .Freeinfo = HostfsFreeInfo,
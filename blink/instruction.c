@@ -45,7 +45,7 @@ static bool IsOpcodeEqual(struct XedDecodedInst *xedd, u8 *a) {
 
 static int ReadInstruction(struct Machine *m, u8 *p, unsigned n) {
   struct XedDecodedInst xedd[1];
-  STATISTIC(++instructions_decoded);
+  STATISTIC(++g_stats.instructions_decoded);
   if (!DecodeInstruction(xedd, p, n, m->mode.omode)) {
     memcpy(m->xedd, xedd, kInstructionBytes);
     return 0;
@@ -59,7 +59,7 @@ static int LoadInstructionSlow(struct Machine *m, u64 ip) {
   unsigned i;
   u8 copy[15], *toil;
   i = 4096 - (ip & 4095);
-  STATISTIC(++page_overlaps);
+  STATISTIC(++g_stats.page_overlaps);
   if ((addr = LookupAddress2(m, ip, PAGE_XD, 0))) {
     if ((toil = LookupAddress2(m, ip + i, PAGE_XD, 0))) {
       memcpy(copy, addr, i);
@@ -94,7 +94,7 @@ int LoadInstruction2(struct Machine *m, u64 pc) {
       return kMachineSegmentationFault;
     }
     if (IsOpcodeEqual(m->xedd, addr)) {
-      STATISTIC(++instructions_cached);
+      STATISTIC(++g_stats.instructions_cached);
       return 0;
     } else {
       return ReadInstruction(m, addr, 15);
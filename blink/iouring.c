@@ -0,0 +1,1756 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blink/assert.h"
+#include "blink/atomic.h"
+#include "blink/bitscan.h"
+#include "blink/dll.h"
+#include "blink/endian.h"
+#include "blink/errno.h"
+#include "blink/fds.h"
+#include "blink/iovs.h"
+#include "blink/linux.h"
+#include "blink/log.h"
+#include "blink/machine.h"
+#include "blink/macros.h"
+#include "blink/syscall.h"
+#include "blink/thread.h"
+#include "blink/timespec.h"
+#include "blink/tunables.h"
+#include "blink/util.h"
+#include "blink/vfs.h"
+#include "blink/xlat.h"
+
+/**
+ * @fileoverview Linux asynchronous i/o rings.
+ *
+ * Each io_uring instance is backed by an anonymous memory file holding
+ * the submission ring at IORING_OFF_SQ_RING, the completion ring at
+ * IORING_OFF_CQ_RING and the submission entries at IORING_OFF_SQES, so
+ * guests map them with mmap() just like they would on Linux, and Blink
+ * maps the same pages into its own address space to service them.
+ *
+ * Entries are validated, and have their guest buffers translated into
+ * host memory, by the thread calling io_uring_enter(). The operations
+ * are then performed by a pool of worker threads owned by the ring so
+ * guests may keep many reads and writes in flight using a single trap.
+ * Workers wait for sockets and pipes to become ready using ppoll() with
+ * host signals blocked, and get kicked with SIGSYS when their operation
+ * is canceled or the ring is closed, so they notice immediately. Guest
+ * threads waiting for completions sleep the same way, and are kicked by
+ * the worker posting a completion.
+ * Opening and closing files needs a guest machine, so those operations
+ * happen immediately while the submission ring is being consumed.
+ *
+ * Buffers are translated while holding the system's mmap_lock, and the
+ * guest ranges are remembered, so if the guest unmaps or mprotects them
+ * before the operation completes, the operation is canceled and memory
+ * isn't changed until the worker is done using it. Worker threads don't
+ * survive fork() so the child forgets about operations that were in
+ * flight.
+ */
+
+#ifdef HAVE_THREADS
+#ifndef DISABLE_NONPOSIX
+
+#define kSqHead    0
+#define kSqTail    64
+#define kSqMask    128
+#define kSqEntries 132
+#define kSqFlags   136
+#define kSqDropped 140
+#define kSqArray   192
+
+#define kCqHead     0
+#define kCqTail     64
+#define kCqMask     128
+#define kCqEntries  132
+#define kCqOverflow 136
+#define kCqFlags    140
+#define kCqCqes     192
+
+#define kOpQueued  0
+#define kOpRunning 1
+#define kOpWaiting 2
+#define kOpDone    3
+
+#define IOURING_CONTAINER(e)       DLL_CONTAINER(struct IoUring, elem, e)
+#define IOURINGOP_CONTAINER(e)     DLL_CONTAINER(struct IoUringOp, elem, e)
+#define IOURINGWAITER_CONTAINER(e) DLL_CONTAINER(struct IoUringWaiter, elem, e)
+
+struct IoUringBuf {
+  i64 addr;
+  u64 size;
+};
+
+struct IoUringOp {
+  struct Dll elem;         // queue or running list, if head of chain
+  struct IoUringOp *next;  // next operation in IOSQE_IO_LINK chain
+  int state;               // kOpXXX guarded by ring lock
+  bool canceled;           // guarded by ring lock
+  u8 opcode;               // IORING_OP_XXX_LINUX
+  u8 flags;                // IOSQE_XXX_LINUX
+  int err;                 // host errno if entry couldn't be prepared
+  int fildes;              // guest file descriptor
+  int msgflags;            // host MSG_XXX flags for send and recv
+  u32 events;              // poll() events or fsync() flags
+  i64 off;                 // file offset or -1 for current position
+  u64 size;                // number of bytes requested
+  u64 count;               // completions which satisfy a timeout
+  u64 seq;                 // completions seen when timeout was submitted
+  u64 user_data;
+  pthread_t waiter;        // thread to kick while state is kOpWaiting
+  struct timespec deadline;
+  struct Iovs iv;
+  int prot;                // access worker needs to guest buffers
+  unsigned nbufs;          // guest ranges iv was translated from
+  struct IoUringBuf *bufs;
+  ssize_t (*readv)(int, const struct iovec *, int);
+  ssize_t (*writev)(int, const struct iovec *, int);
+  int (*poll)(struct pollfd *, nfds_t, int);
+};
+
+struct IoUringWaiter {
+  struct Dll elem;  // in ring's waiters list while asleep
+  pthread_t thread;
+};
+
+struct IoUring {
+  struct Dll elem;      // in g_iourings.list, or .closed once closed
+  dev_t dev;            // identifies memfd, since guest may dup()
+  ino_t ino;            // identifies memfd, since guest may dup()
+  int refs;             // number of workers and callers using ring
+  int workers;          // number of worker threads
+  int idle;             // number of workers waiting for work
+  int queued;           // number of chains in queue
+  bool closing;         // set once guest closes last descriptor
+  u32 sqentries;        // two-power size of submission ring
+  u32 cqentries;        // two-power size of completion ring
+  u8 *sq, *cq, *sqes;   // host mappings of memfd
+  size_t sqsize, cqsize, sqessize;
+  u64 completions;      // total number of completions posted
+  struct Dll *queue;    // chains waiting for a worker
+  struct Dll *running;  // chains being performed by workers
+  struct IoUringOp *pending;  // chain being built by SubmitSqes()
+  struct Dll *waiters;  // guest threads sleeping until ring changes
+  size_t overflows;     // completions that didn't fit in ring
+  struct io_uring_cqe_linux *overflow;
+  unsigned nbufs;       // IORING_REGISTER_BUFFERS
+  struct IoUringBuf *bufs;
+  unsigned nfiles;      // IORING_REGISTER_FILES
+  i32 *files;
+  int notify;           // IORING_REGISTER_EVENTFD handle, or -1
+  ssize_t (*notify_writev)(int, const struct iovec *, int);
+  pthread_mutex_t_ sqlock;  // serializes consumption of submissions
+  pthread_mutex_t_ lock;    // guards everything else
+  pthread_cond_t_ cond;     // broadcast when completions are posted
+  pthread_cond_t_ work;     // signaled when chains are queued
+};
+
+static struct IoUrings {
+  pthread_once_t_ once;
+  pthread_mutex_t_ lock;
+  struct Dll *list;
+  struct Dll *closed;  // rings whose workers are still winding down
+} g_iourings = {PTHREAD_ONCE_INIT_};
+
+static const u8 kIoUringOps[] = {
+    IORING_OP_NOP_LINUX,          IORING_OP_READV_LINUX,
+    IORING_OP_WRITEV_LINUX,       IORING_OP_FSYNC_LINUX,
+    IORING_OP_READ_FIXED_LINUX,   IORING_OP_WRITE_FIXED_LINUX,
+    IORING_OP_POLL_ADD_LINUX,     IORING_OP_POLL_REMOVE_LINUX,
+    IORING_OP_TIMEOUT_LINUX,      IORING_OP_TIMEOUT_REMOVE_LINUX,
+    IORING_OP_ASYNC_CANCEL_LINUX, IORING_OP_OPENAT_LINUX,
+    IORING_OP_CLOSE_LINUX,        IORING_OP_READ_LINUX,
+    IORING_OP_WRITE_LINUX,        IORING_OP_SEND_LINUX,
+    IORING_OP_RECV_LINUX,
+};
+
+static void InitIoUrings(void) {
+  unassert(!pthread_mutex_init(&g_iourings.lock, 0));
+}
+
+static void LockIoUrings(void) {
+  pthread_once_(&g_iourings.once, InitIoUrings);
+  LOCK(&g_iourings.lock);
+}
+
+static void UnlockIoUrings(void) {
+  UNLOCK(&g_iourings.lock);
+}
+
+static _Atomic(u32) *GetSqField(struct IoUring *ring, int off) {
+  return (_Atomic(u32) *)(ring->sq + off);
+}
+
+static _Atomic(u32) *GetCqField(struct IoUring *ring, int off) {
+  return (_Atomic(u32) *)(ring->cq + off);
+}
+
+static u32 LoadRing(_Atomic(u32) *p) {
+  return Little32(atomic_load_explicit(p, memory_order_acquire));
+}
+
+static void StoreRing(_Atomic(u32) *p, u32 x) {
+  atomic_store_explicit(p, Little32(x), memory_order_release);
+}
+
+static u32 RoundUpTwoPow(u32 x) {
+  return x > 1 ? 2u << bsr(x - 1) : 1;
+}
+
+// maps memfd into blink, bypassing the vfs since it's a host fd
+static u8 *MapRing(int fildes, size_t size, off_t off) {
+  void *p;
+  p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fildes, off);
+  return p != MAP_FAILED ? (u8 *)p : 0;
+}
+
+static void UnmapRing(u8 *p, size_t size) {
+  if (p) unassert(!munmap(p, size));
+}
+
+static void FreeOps(struct IoUringOp *op) {
+  struct IoUringOp *next;
+  for (; op; op = next) {
+    next = op->next;
+    FreeIovs(&op->iv);
+    free(op->bufs);
+    free(op);
+  }
+}
+
+static void FreeOpList(struct Dll *list) {
+  struct Dll *e, *e2;
+  for (e = dll_first(list); e; e = e2) {
+    e2 = dll_next(list, e);
+    FreeOps(IOURINGOP_CONTAINER(e));
+  }
+}
+
+static void FreeIoUring(struct IoUring *ring) {
+  FreeOpList(ring->queue);
+  FreeOpList(ring->running);
+  UnmapRing(ring->sq, ring->sqsize);
+  UnmapRing(ring->cq, ring->cqsize);
+  UnmapRing(ring->sqes, ring->sqessize);
+  if (ring->notify != -1) close(ring->notify);
+  unassert(!pthread_cond_destroy(&ring->work));
+  unassert(!pthread_cond_destroy(&ring->cond));
+  unassert(!pthread_mutex_destroy(&ring->lock));
+  unassert(!pthread_mutex_destroy(&ring->sqlock));
+  free(ring->overflow);
+  free(ring->files);
+  free(ring->bufs);
+  free(ring);
+}
+
+// drops reference to ring, destroying it if it's been closed
+static void ReleaseIoUring(struct IoUring *ring) {
+  bool destroy;
+  LOCK(&ring->lock);
+  unassert(ring->refs > 0);
+  destroy = !--ring->refs && ring->closing;
+  UNLOCK(&ring->lock);
+  if (destroy) {
+    LockIoUrings();
+    dll_remove(&g_iourings.closed, &ring->elem);
+    UnlockIoUrings();
+    FreeIoUring(ring);
+  }
+}
+
+static struct IoUring *NewIoUring(int fildes, u32 sqentries, u32 cqentries) {
+  struct stat st;
+  struct IoUring *ring;
+  if (!(ring = (struct IoUring *)calloc(1, sizeof(*ring)))) return 0;
+  ring->notify = -1;
+  ring->sqentries = sqentries;
+  ring->cqentries = cqentries;
+  ring->sqsize = kSqArray + sqentries * 4;
+  ring->cqsize = kCqCqes + cqentries * sizeof(struct io_uring_cqe_linux);
+  ring->sqessize = sqentries * sizeof(struct io_uring_sqe_linux);
+  dll_init(&ring->elem);
+  unassert(!pthread_mutex_init(&ring->sqlock, 0));
+  unassert(!pthread_mutex_init(&ring->lock, 0));
+  unassert(!pthread_cond_init(&ring->cond, 0));
+  unassert(!pthread_cond_init(&ring->work, 0));
+  if (fstat(fildes, &st) ||
+      ftruncate(fildes, IORING_OFF_SQES_LINUX + ring->sqessize) ||
+      !(ring->sq = MapRing(fildes, ring->sqsize, IORING_OFF_SQ_RING_LINUX)) ||
+      !(ring->cq = MapRing(fildes, ring->cqsize, IORING_OFF_CQ_RING_LINUX)) ||
+      !(ring->sqes = MapRing(fildes, ring->sqessize, IORING_OFF_SQES_LINUX))) {
+    FreeIoUring(ring);
+    return 0;
+  }
+  ring->dev = st.st_dev;
+  ring->ino = st.st_ino;
+  StoreRing(GetSqField(ring, kSqMask), sqentries - 1);
+  StoreRing(GetSqField(ring, kSqEntries), sqentries);
+  StoreRing(GetCqField(ring, kCqMask), cqentries - 1);
+  StoreRing(GetCqField(ring, kCqEntries), cqentries);
+  return ring;
+}
+
+static const struct FdCb kFdCbIoUring;
+
+// returns ring backed by memfd, with g_iourings locked
+static struct IoUring *FindIoUring(dev_t dev, ino_t ino) {
+  struct Dll *e;
+  for (e = dll_first(g_iourings.list); e; e = dll_next(g_iourings.list, e)) {
+    if (IOURING_CONTAINER(e)->dev == dev && IOURING_CONTAINER(e)->ino == ino) {
+      return IOURING_CONTAINER(e);
+    }
+  }
+  return 0;
+}
+
+// wakes guest threads sleeping in SleepOnRing(), with ring locked
+static void KickWaiters(struct IoUring *ring) {
+  struct Dll *e;
+  for (e = dll_first(ring->waiters); e; e = dll_next(ring->waiters, e)) {
+    pthread_kill(IOURINGWAITER_CONTAINER(e)->thread, SIGSYS);
+  }
+}
+
+// wakes worker if it's waiting on operation, with ring locked
+static void KickOp(struct IoUringOp *op) {
+  if (op->state == kOpWaiting) {
+    pthread_kill(op->waiter, SIGSYS);
+  }
+}
+
+static bool IsIoUringReferenced(dev_t dev, ino_t ino) {
+  struct Fd *fd;
+  struct Dll *e;
+  struct stat st;
+  bool res = false;
+  if (!g_machine) return false;
+  LOCK(&g_machine->system->fds.lock);
+  for (e = dll_first(g_machine->system->fds.list); e;
+       e = dll_next(g_machine->system->fds.list, e)) {
+    fd = FD_CONTAINER(e);
+    if (fd->cb == &kFdCbIoUring && !fstat(fd->fildes, &st) &&
+        st.st_dev == dev && st.st_ino == ino) {
+      res = true;
+      break;
+    }
+  }
+  UNLOCK(&g_machine->system->fds.lock);
+  return res;
+}
+
+static int CloseIoUring(int fildes) {
+  int rc;
+  struct Dll *e;
+  struct stat st;
+  struct IoUring *ring;
+  struct IoUringOp *op;
+  if (fstat(fildes, &st)) return close(fildes);
+  rc = close(fildes);
+  if (!IsIoUringReferenced(st.st_dev, st.st_ino)) {
+    LockIoUrings();
+    if ((ring = FindIoUring(st.st_dev, st.st_ino))) {
+      dll_remove(&g_iourings.list, &ring->elem);
+      dll_make_last(&g_iourings.closed, &ring->elem);
+    }
+    UnlockIoUrings();
+    if (ring) {
+      // the last worker or caller to leave the ring will free it
+      LOCK(&ring->lock);
+      ring->closing = true;
+      ++ring->refs;
+      unassert(!pthread_cond_broadcast(&ring->work));
+      unassert(!pthread_cond_broadcast(&ring->cond));
+      for (e = dll_first(ring->running); e; e = dll_next(ring->running, e)) {
+        for (op = IOURINGOP_CONTAINER(e); op; op = op->next) {
+          KickOp(op);
+        }
+      }
+      KickWaiters(ring);
+      UNLOCK(&ring->lock);
+      ReleaseIoUring(ring);
+    }
+  }
+  return rc;
+}
+
+// returns ring for guest fd with its reference count incremented
+static struct IoUring *AcquireIoUring(struct Machine *m, int fildes) {
+  struct Fd *fd;
+  struct stat st;
+  const struct FdCb *cb;
+  struct IoUring *ring;
+  LOCK(&m->system->fds.lock);
+  if ((fd = GetFd(&m->system->fds, fildes))) {
+    cb = fd->cb;
+  } else {
+    cb = 0;
+  }
+  UNLOCK(&m->system->fds.lock);
+  if (!fd) return 0;
+  if (cb != &kFdCbIoUring) {
+    eopnotsupp();
+    return 0;
+  }
+  if (fstat(fildes, &st)) return 0;
+  LockIoUrings();
+  if ((ring = FindIoUring(st.st_dev, st.st_ino))) {
+    LOCK(&ring->lock);
+    ++ring->refs;
+    UNLOCK(&ring->lock);
+  }
+  UnlockIoUrings();
+  if (!ring) ebadf();
+  return ring;
+}
+
+static u32 CountCqes(struct IoUring *ring) {
+  return Little32(atomic_load_explicit(GetCqField(ring, kCqTail),
+                                       memory_order_relaxed)) -
+         LoadRing(GetCqField(ring, kCqHead));
+}
+
+// appends completion to ring if there's room, with ring locked
+static bool PushCqe(struct IoUring *ring,
+                    const struct io_uring_cqe_linux *cqe) {
+  u32 tail;
+  if (CountCqes(ring) >= ring->cqentries) return false;
+  tail = Little32(atomic_load_explicit(GetCqField(ring, kCqTail),
+                                       memory_order_relaxed));
+  memcpy(ring->cq + kCqCqes + (tail & (ring->cqentries - 1)) * sizeof(*cqe),
+         cqe, sizeof(*cqe));
+  StoreRing(GetCqField(ring, kCqTail), tail + 1);
+  return true;
+}
+
+// moves overflowed completions into ring, returning true if all fit
+static bool FlushOverflow(struct IoUring *ring) {
+  size_t i;
+  if (!ring->overflows) return true;
+  for (i = 0; i < ring->overflows; ++i) {
+    if (!PushCqe(ring, ring->overflow + i)) break;
+  }
+  memmove(ring->overflow, ring->overflow + i,
+          (ring->overflows - i) * sizeof(*ring->overflow));
+  if ((ring->overflows -= i)) return false;
+  atomic_fetch_and_explicit(GetSqField(ring, kSqFlags),
+                            Little32(~IORING_SQ_CQ_OVERFLOW_LINUX),
+                            memory_order_release);
+  return true;
+}
+
+static void Overflow(struct IoUring *ring,
+                     const struct io_uring_cqe_linux *cqe) {
+  struct io_uring_cqe_linux *p;
+  if ((p = (struct io_uring_cqe_linux *)realloc(
+           ring->overflow, (ring->overflows + 1) * sizeof(*p)))) {
+    ring->overflow = p;
+    p[ring->overflows++] = *cqe;
+    atomic_fetch_or_explicit(GetSqField(ring, kSqFlags),
+                             Little32(IORING_SQ_CQ_OVERFLOW_LINUX),
+                             memory_order_release);
+  } else {
+    LOGF("io_uring dropped completion");
+    StoreRing(GetCqField(ring, kCqOverflow),
+              LoadRing(GetCqField(ring, kCqOverflow)) + 1);
+  }
+}
+
+static void Notify(struct IoUring *ring) {
+  u8 buf[8];
+  ssize_t rc;
+  struct iovec iov;
+  Write64(buf, 1);
+  iov.iov_base = buf;
+  iov.iov_len = sizeof(buf);
+  rc = ring->notify_writev(ring->notify, &iov, 1);
+  (void)rc;
+}
+
+// posts completion event, with ring locked
+static void PostCqe(struct IoUring *ring, u64 user_data, i64 res) {
+  struct io_uring_cqe_linux cqe;
+  Write64(cqe.user_data, user_data);
+  Write32(cqe.res, res);
+  Write32(cqe.flags, 0);
+  if (!FlushOverflow(ring) || !PushCqe(ring, &cqe)) {
+    Overflow(ring, &cqe);
+  }
+  ++ring->completions;
+  unassert(!pthread_cond_broadcast(&ring->cond));
+  KickWaiters(ring);
+  if (ring->notify != -1) Notify(ring);
+}
+
+static i64 GetLinuxError(int err) {
+  return -XlatErrno(err);
+}
+
+// cancels operations matching `user_data`, with ring locked
+static i64 CancelOps(struct IoUring *ring, u64 user_data, int opcode) {
+  int i;
+  struct Dll *e, *list;
+  struct IoUringOp *op;
+  for (i = 0; i < 2; ++i) {
+    list = i ? ring->running : ring->queue;
+    for (e = dll_first(list); e; e = dll_next(list, e)) {
+      for (op = IOURINGOP_CONTAINER(e); op; op = op->next) {
+        if (op->user_data != user_data || op->state == kOpDone ||
+            (opcode != -1 && op->opcode != opcode)) {
+          continue;
+        }
+        if (op->state == kOpRunning) {
+          return -EALREADY_LINUX;
+        }
+        op->canceled = true;
+        unassert(!pthread_cond_broadcast(&ring->cond));
+        KickOp(op);
+        return 0;
+      }
+    }
+  }
+  return -ENOENT_LINUX;
+}
+
+static bool IsUsingMemory(struct IoUringOp *op, i64 virt, i64 size) {
+  unsigned i;
+  for (i = 0; i < op->nbufs; ++i) {
+    if (op->bufs[i].size && op->bufs[i].addr < virt + size &&
+        virt < op->bufs[i].addr + (i64)op->bufs[i].size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// cancels operations in chain whose buffers overlap memory that's being
+// reduced to `prot` access, with ring locked
+//
+// @return true if a worker might still be using the memory
+static bool CancelChainMemory(struct IoUringOp *op, i64 virt, i64 size,
+                              int prot) {
+  bool busy;
+  for (busy = false; op; op = op->next) {
+    if (op->state == kOpDone || (op->prot & prot) == op->prot ||
+        !IsUsingMemory(op, virt, size)) {
+      continue;
+    }
+    if (!op->canceled) {
+      op->canceled = true;
+      KickOp(op);
+    }
+    if (op->state != kOpQueued) {
+      busy = true;
+    }
+  }
+  return busy;
+}
+
+// cancels operations using memory that's losing access, with ring locked
+static bool CancelRingMemory(struct IoUring *ring, i64 virt, i64 size,
+                             int prot) {
+  int i;
+  bool busy;
+  struct Dll *e, *list;
+  busy = CancelChainMemory(ring->pending, virt, size, prot);
+  for (i = 0; i < 2; ++i) {
+    list = i ? ring->running : ring->queue;
+    for (e = dll_first(list); e; e = dll_next(list, e)) {
+      if (CancelChainMemory(IOURINGOP_CONTAINER(e), virt, size, prot)) {
+        busy = true;
+      }
+    }
+  }
+  return busy;
+}
+
+// waits for operation's file to become ready without holding locks
+//
+// Host signals stay blocked except while we're asleep in ppoll(), so a
+// kick from CancelOps() or CloseIoUring() can't slip in between seeing
+// the operation isn't canceled and going to sleep. Files that have no
+// host fd, e.g. other rings, are checked again every kPollingMs.
+//
+// @return revents if ready, or negative linux errno if canceled/failed
+static i64 WaitForOp(struct IoUring *ring, struct IoUringOp *op, int events) {
+  int rc, err, hostfd;
+  struct pollfd pfd;
+  struct timespec wait;
+  sigset_t block, oldmask, kick;
+  hostfd = op->poll == VfsPoll ? VfsGetHostFd(op->fildes) : -1;
+  unassert(!sigfillset(&block));
+  unassert(!pthread_sigmask(SIG_BLOCK, &block, &oldmask));
+  kick = oldmask;
+  sigdelset(&kick, SIGSYS);
+  LOCK(&ring->lock);
+  op->state = kOpWaiting;
+  op->waiter = pthread_self();
+  for (rc = err = 0;;) {
+    if (op->canceled || ring->closing) {
+      rc = -ECANCELED_LINUX;
+      break;
+    } else if (rc == -1 && err != EINTR) {
+      rc = GetLinuxError(err);
+      break;
+    } else if (rc > 0) {
+      rc = pfd.revents;
+      break;
+    }
+    UNLOCK(&ring->lock);
+    pfd.fd = hostfd != -1 ? hostfd : op->fildes;
+    pfd.events = events;
+    pfd.revents = 0;
+    if (hostfd != -1) {
+#ifdef HAVE_PPOLL
+      rc = ppoll(&pfd, 1, 0, &kick);
+#else
+      unassert(!pthread_sigmask(SIG_SETMASK, &kick, 0));
+      rc = poll(&pfd, 1, kPollingMs);
+      unassert(!pthread_sigmask(SIG_BLOCK, &block, 0));
+#endif
+    } else if (!(rc = op->poll(&pfd, 1, 0))) {
+      wait = FromMilliseconds(kPollingMs);
+#ifdef HAVE_PPOLL
+      ppoll(0, 0, &wait, &kick);
+#else
+      unassert(!pthread_sigmask(SIG_SETMASK, &kick, 0));
+      nanosleep(&wait, 0);
+      unassert(!pthread_sigmask(SIG_BLOCK, &block, 0));
+#endif
+    }
+    err = errno;
+    LOCK(&ring->lock);
+  }
+  op->state = kOpRunning;
+  UNLOCK(&ring->lock);
+  unassert(!pthread_sigmask(SIG_SETMASK, &oldmask, 0));
+  return rc;
+}
+
+static i64 WaitForTimeout(struct IoUring *ring, struct IoUringOp *op) {
+  i64 rc;
+  LOCK(&ring->lock);
+  op->state = kOpWaiting;
+  op->waiter = pthread_self();
+  for (;;) {
+    if (op->canceled || ring->closing) {
+      rc = -ECANCELED_LINUX;
+      break;
+    }
+    if (op->count && ring->completions - op->seq >= op->count) {
+      rc = 0;
+      break;
+    }
+    if (CompareTime(GetTime(), op->deadline) >= 0) {
+      rc = -ETIME_LINUX;
+      break;
+    }
+    pthread_cond_timedwait(&ring->cond, &ring->lock, &op->deadline);
+  }
+  op->state = kOpRunning;
+  UNLOCK(&ring->lock);
+  return rc;
+}
+
+static i64 TransferOp(struct IoUring *ring, struct IoUringOp *op) {
+  i64 rc;
+  bool reading;
+  struct msghdr msg;
+  reading = op->opcode == IORING_OP_READV_LINUX ||
+            op->opcode == IORING_OP_READ_LINUX ||
+            op->opcode == IORING_OP_READ_FIXED_LINUX ||
+            op->opcode == IORING_OP_RECV_LINUX;
+  if (!op->iv.i) return 0;
+  if (!(op->msgflags & MSG_DONTWAIT) &&
+      (rc = WaitForOp(ring, op, reading ? POLLIN : POLLOUT)) < 0) {
+    return rc;
+  }
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = op->iv.p;
+  msg.msg_iovlen = op->iv.i;
+  do {
+    switch (op->opcode) {
+      case IORING_OP_RECV_LINUX:
+        rc = VfsRecvmsg(op->fildes, &msg, op->msgflags);
+        break;
+      case IORING_OP_SEND_LINUX:
+        rc = VfsSendmsg(op->fildes, &msg, op->msgflags);
+        break;
+      default:
+        if (op->off == -1) {
+          rc = reading ? op->readv(op->fildes, op->iv.p, op->iv.i)
+                       : op->writev(op->fildes, op->iv.p, op->iv.i);
+        } else {
+          rc = reading ? VfsPreadv(op->fildes, op->iv.p, op->iv.i, op->off)
+                       : VfsPwritev(op->fildes, op->iv.p, op->iv.i, op->off);
+        }
+        break;
+    }
+  } while (rc == -1 && errno == EINTR);
+  return rc != -1 ? rc : GetLinuxError(errno);
+}
+
+// performs operation on worker thread without holding locks
+static i64 PerformOp(struct IoUring *ring, struct IoUringOp *op) {
+  int rc;
+  switch (op->opcode) {
+    case IORING_OP_NOP_LINUX:
+      return 0;
+    case IORING_OP_FSYNC_LINUX:
+      if (op->events & IORING_FSYNC_DATASYNC_LINUX) {
+        rc = VfsFdatasync(op->fildes);
+      } else {
+        rc = VfsFsync(op->fildes);
+      }
+      return rc != -1 ? rc : GetLinuxError(errno);
+    case IORING_OP_POLL_ADD_LINUX:
+      return WaitForOp(ring, op, op->events);
+    case IORING_OP_TIMEOUT_LINUX:
+      return WaitForTimeout(ring, op);
+    default:
+      return TransferOp(ring, op);
+  }
+}
+
+static bool IsShortTransfer(struct IoUringOp *op, i64 res) {
+  switch (op->opcode) {
+    case IORING_OP_READV_LINUX:
+    case IORING_OP_WRITEV_LINUX:
+    case IORING_OP_READ_FIXED_LINUX:
+    case IORING_OP_WRITE_FIXED_LINUX:
+    case IORING_OP_READ_LINUX:
+    case IORING_OP_WRITE_LINUX:
+    case IORING_OP_SEND_LINUX:
+    case IORING_OP_RECV_LINUX:
+      return (u64)res < op->size;
+    default:
+      return false;
+  }
+}
+
+// performs chain of linked operations, posting their completions. a
+// failed operation cancels the rest of its chain unless it's hardlinked
+static void PerformChain(struct IoUring *ring, struct IoUringOp *op) {
+  i64 res;
+  bool broken, canceled;
+  for (broken = false; op; op = op->next) {
+    LOCK(&ring->lock);
+    canceled = op->canceled;
+    op->state = kOpRunning;
+    UNLOCK(&ring->lock);
+    if (broken || canceled) {
+      res = -ECANCELED_LINUX;
+    } else if (op->err) {
+      res = GetLinuxError(op->err);
+    } else {
+      res = PerformOp(ring, op);
+    }
+    if (!(op->flags & IOSQE_IO_HARDLINK_LINUX) &&
+        (res < 0 || IsShortTransfer(op, res))) {
+      broken = true;
+    }
+    LOCK(&ring->lock);
+    op->state = kOpDone;
+    PostCqe(ring, op->user_data, res);
+    UNLOCK(&ring->lock);
+  }
+}
+
+// takes chain off queue and performs it, with ring locked
+static void PerformQueuedChain(struct IoUring *ring) {
+  struct Dll *e;
+  struct IoUringOp *op;
+  unassert(e = dll_first(ring->queue));
+  dll_remove(&ring->queue, e);
+  dll_make_last(&ring->running, e);
+  --ring->queued;
+  UNLOCK(&ring->lock);
+  op = IOURINGOP_CONTAINER(e);
+  PerformChain(ring, op);
+  LOCK(&ring->lock);
+  dll_remove(&ring->running, e);
+  KickWaiters(ring);
+  UNLOCK(&ring->lock);
+  FreeOps(op);
+  LOCK(&ring->lock);
+}
+
+static void *IoUringWorker(void *arg) {
+  struct IoUring *ring = (struct IoUring *)arg;
+  LOCK(&ring->lock);
+  for (;;) {
+    ++ring->idle;
+    while (!ring->queue && !ring->closing) {
+      unassert(!pthread_cond_wait(&ring->work, &ring->lock));
+    }
+    --ring->idle;
+    if (ring->closing) break;
+    PerformQueuedChain(ring);
+  }
+  --ring->workers;
+  UNLOCK(&ring->lock);
+  ReleaseIoUring(ring);
+  return 0;
+}
+
+// launches another worker thread, with ring locked
+static int StartIoUringWorker(struct IoUring *ring) {
+  int err;
+  pthread_t th;
+  pthread_attr_t attr;
+  sigset_t block, oldmask;
+  unassert(!sigfillset(&block));
+  unassert(!pthread_sigmask(SIG_BLOCK, &block, &oldmask));
+  unassert(!pthread_attr_init(&attr));
+  unassert(!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED));
+  err = pthread_create(&th, &attr, IoUringWorker, ring);
+  unassert(!pthread_attr_destroy(&attr));
+  unassert(!pthread_sigmask(SIG_SETMASK, &oldmask, 0));
+  if (err) {
+    LOGF("failed to create io_uring thread: %s", DescribeHostErrno(err));
+    errno = err;
+    return -1;
+  }
+  ++ring->workers;
+  ++ring->refs;
+  return 0;
+}
+
+// hands chain of linked operations to the worker pool
+static void QueueChain(struct IoUring *ring, struct IoUringOp *chain) {
+  LOCK(&ring->lock);
+  ring->pending = 0;
+  if (ring->closing) {
+    UNLOCK(&ring->lock);
+    FreeOps(chain);
+    return;
+  }
+  dll_init(&chain->elem);
+  dll_make_last(&ring->queue, &chain->elem);
+  ++ring->queued;
+  if (ring->queued > ring->idle && ring->workers < kMaxIoWorkers &&
+      StartIoUringWorker(ring) == -1 && !ring->workers) {
+    PerformQueuedChain(ring);
+  } else {
+    unassert(!pthread_cond_signal(&ring->work));
+  }
+  UNLOCK(&ring->lock);
+}
+
+// sleeps until deadline, a completion is posted, a chain finishes, the
+// ring is closed, or there's an interrupt to handle, with ring locked
+//
+// This works like SleepHost(). We're put on the ring's waiters list so
+// KickWaiters() knows to send us SIGSYS, and since host signals remain
+// blocked until ppoll() atomically unblocks them, no kick can get lost.
+//
+// @return 0 on wakeup, or -1 w/ EINTR if the caller needs to use
+//     CheckInterrupt() or notice it's been killed
+static int SleepOnRing(struct Machine *m, struct IoUring *ring,
+                       struct timespec deadline) {
+  int rc = 0;
+  sigset_t block, oldmask;
+  struct IoUringWaiter w;
+  struct timespec now, waitfor;
+  unassert(!sigfillset(&block));
+  unassert(!pthread_sigmask(SIG_BLOCK, &block, &oldmask));
+  if (atomic_load_explicit(&m->killed, memory_order_acquire) ||
+      (!m->metal && (m->signals & ~m->sigmask))) {
+    rc = eintr();
+  } else if (CompareTime((now = GetTime()), deadline) < 0) {
+    w.thread = pthread_self();
+    dll_init(&w.elem);
+    dll_make_last(&ring->waiters, &w.elem);
+    UNLOCK(&ring->lock);
+    waitfor = SubtractTime(deadline, now);
+#ifdef HAVE_PPOLL
+    ppoll(0, 0, &waitfor, &oldmask);
+#else
+    if (CompareTime(waitfor, FromMilliseconds(kPollingMs)) > 0) {
+      waitfor = FromMilliseconds(kPollingMs);
+    }
+    unassert(!pthread_sigmask(SIG_SETMASK, &oldmask, 0));
+    nanosleep(&waitfor, 0);
+#endif
+    LOCK(&ring->lock);
+    dll_remove(&ring->waiters, &w.elem);
+  }
+  unassert(!pthread_sigmask(SIG_SETMASK, &oldmask, 0));
+  return rc;
+}
+
+// waits for all operations that were submitted earlier to complete
+static void DrainIoUring(struct Machine *m, struct IoUring *ring) {
+  LOCK(&ring->lock);
+  while ((ring->queue || ring->running) && !ring->closing) {
+    if (SleepOnRing(m, ring, GetMaxTime()) == -1) {
+      UNLOCK(&ring->lock);
+      if (atomic_load_explicit(&m->killed, memory_order_acquire)) return;
+      if (CheckInterrupt(m, false)) return;
+      LOCK(&ring->lock);
+    }
+  }
+  UNLOCK(&ring->lock);
+}
+
+static int PrepareFd(struct Machine *m, struct IoUringOp *op, int prot) {
+  int oflags;
+  struct Fd *fd;
+  LOCK(&m->system->fds.lock);
+  if ((fd = GetFd(&m->system->fds, op->fildes))) {
+    unassert(fd->cb);
+    op->readv = fd->cb->readv;
+    op->writev = fd->cb->writev;
+    op->poll = fd->cb->poll;
+    oflags = fd->oflags;
+    if (op->opcode == IORING_OP_SEND_LINUX &&
+        (op->msgflags = XlatSendFlags(op->msgflags, fd->socktype)) != -1) {
+#ifdef MSG_NOSIGNAL
+      op->msgflags |= MSG_NOSIGNAL;
+#endif
+    }
+  } else {
+    oflags = 0;
+  }
+  UNLOCK(&m->system->fds.lock);
+  if (!fd) return -1;
+  if (op->msgflags == -1) return -1;
+  if (((prot & PROT_WRITE) && (oflags & O_ACCMODE) == O_WRONLY) ||
+      ((prot & PROT_READ) && (oflags & O_ACCMODE) == O_RDONLY)) {
+    return ebadf();
+  }
+  return 0;
+}
+
+// remembers which guest memory the worker is going to use, so it can't
+// be unmapped from under the worker (see CancelIoUringMemory)
+static int SaveBufs(struct Machine *m, struct IoUringOp *op, i64 addr,
+                    u32 len, int prot, bool vectored) {
+  unsigned i, n;
+  const struct iovec_linux *iov;
+  if (vectored) {
+    if (!(n = len)) return 0;
+    if (!(iov = (const struct iovec_linux *)SchlepR(m, addr,
+                                                    n * sizeof(*iov)))) {
+      return -1;
+    }
+  } else {
+    n = 1;
+    iov = 0;
+  }
+  if (!(op->bufs = (struct IoUringBuf *)calloc(n, sizeof(*op->bufs)))) {
+    return enomem();
+  }
+  for (i = 0; i < n; ++i) {
+    if (iov) {
+      op->bufs[i].addr = Read64(iov[i].base);
+      op->bufs[i].size = Read64(iov[i].len);
+    } else {
+      op->bufs[i].addr = addr;
+      op->bufs[i].size = len;
+    }
+  }
+  op->nbufs = n;
+  op->prot = prot;
+  return 0;
+}
+
+static int PrepareIovs(struct Machine *m, struct IoUringOp *op, i64 addr,
+                       u32 len, int prot, bool vectored) {
+  unsigned i;
+  if (op->off < -1) return einval();
+  if (PrepareFd(m, op, prot) == -1) return -1;
+  if (vectored) {
+    if (AppendIovsGuest(m, &op->iv, addr, len, prot) == -1) return -1;
+  } else {
+    if (AppendIovsReal(m, &op->iv, addr, len, prot) == -1) return -1;
+  }
+  if (SaveBufs(m, op, addr, len, prot, vectored) == -1) return -1;
+  for (op->size = i = 0; i < op->iv.i; ++i) {
+    op->size += op->iv.p[i].iov_len;
+  }
+  return 0;
+}
+
+static int PrepareFixedBuffer(struct Machine *m, struct IoUring *ring,
+                              struct IoUringOp *op,
+                              const struct io_uring_sqe_linux *sqe, int prot) {
+  i64 addr;
+  u32 len, index;
+  struct IoUringBuf buf;
+  addr = Read64(sqe->addr);
+  len = Read32(sqe->len);
+  index = Read16(sqe->buf_index);
+  LOCK(&ring->lock);
+  if (index < ring->nbufs) {
+    buf = ring->bufs[index];
+  } else {
+    buf.addr = 0;
+    buf.size = 0;
+  }
+  UNLOCK(&ring->lock);
+  if (!buf.size) return efault();
+  if (addr < buf.addr || addr + len < addr ||
+      addr + len > buf.addr + (i64)buf.size) {
+    return efault();
+  }
+  return PrepareIovs(m, op, addr, len, prot, false);
+}
+
+static int PrepareTimeout(struct Machine *m, struct IoUring *ring,
+                          struct IoUringOp *op,
+                          const struct io_uring_sqe_linux *sqe) {
+  u32 flags;
+  struct timespec ts, now;
+  const struct timespec_linux *gt;
+  flags = Read32(sqe->op_flags);
+  if (Read32(sqe->len) != 1) return einval();
+  if (flags & ~IORING_TIMEOUT_ABS_LINUX) {
+    LOGF("unsupported %s flags %#" PRIx32, "io_uring timeout", flags);
+    return einval();
+  }
+  if (!(gt = (const struct timespec_linux *)SchlepR(m, Read64(sqe->addr),
+                                                    sizeof(*gt)))) {
+    return -1;
+  }
+  ts.tv_sec = Read64(gt->sec);
+  ts.tv_nsec = Read64(gt->nsec);
+  if (ts.tv_sec < 0 || !(0 <= ts.tv_nsec && ts.tv_nsec < 1000000000)) {
+    return einval();
+  }
+  // absolute timeouts are relative to the monotonic clock
+  now = GetTime();
+  if (flags & IORING_TIMEOUT_ABS_LINUX) {
+    if (CompareTime(ts, GetMonotonic()) > 0) {
+      op->deadline = AddTime(now, SubtractTime(ts, GetMonotonic()));
+    } else {
+      op->deadline = now;
+    }
+  } else {
+    op->deadline = AddTime(now, ts);
+  }
+  op->count = Read64(sqe->off);
+  LOCK(&ring->lock);
+  op->seq = ring->completions;
+  UNLOCK(&ring->lock);
+  return 0;
+}
+
+// validates entry and translates guest memory for the worker threads
+static int PrepareOp(struct Machine *m, struct IoUring *ring,
+                     struct IoUringOp *op,
+                     const struct io_uring_sqe_linux *sqe) {
+  u32 index;
+  i64 addr;
+  u32 len;
+  addr = Read64(sqe->addr);
+  len = Read32(sqe->len);
+  if (op->flags & ~(IOSQE_FIXED_FILE_LINUX | IOSQE_IO_DRAIN_LINUX |
+                    IOSQE_IO_LINK_LINUX | IOSQE_IO_HARDLINK_LINUX |
+                    IOSQE_ASYNC_LINUX)) {
+    LOGF("unsupported %s flags %#x", "io_uring sqe", op->flags);
+    return einval();
+  }
+  if (op->flags & IOSQE_FIXED_FILE_LINUX) {
+    index = op->fildes;
+    LOCK(&ring->lock);
+    op->fildes = index < ring->nfiles ? ring->files[index] : -1;
+    UNLOCK(&ring->lock);
+    if (op->fildes == -1) return ebadf();
+  }
+  switch (op->opcode) {
+    case IORING_OP_NOP_LINUX:
+      return 0;
+    case IORING_OP_READV_LINUX:
+      return PrepareIovs(m, op, addr, len, PROT_WRITE, true);
+    case IORING_OP_WRITEV_LINUX:
+      return PrepareIovs(m, op, addr, len, PROT_READ, true);
+    case IORING_OP_READ_LINUX:
+      return PrepareIovs(m, op, addr, len, PROT_WRITE, false);
+    case IORING_OP_WRITE_LINUX:
+      return PrepareIovs(m, op, addr, len, PROT_READ, false);
+    case IORING_OP_READ_FIXED_LINUX:
+      return PrepareFixedBuffer(m, ring, op, sqe, PROT_WRITE);
+    case IORING_OP_WRITE_FIXED_LINUX:
+      return PrepareFixedBuffer(m, ring, op, sqe, PROT_READ);
+    case IORING_OP_RECV_LINUX:
+      op->off = -1;
+      if ((op->msgflags = XlatRecvFlags(Read32(sqe->op_flags))) == -1) {
+        return -1;
+      }
+      return PrepareIovs(m, op, addr, len, PROT_WRITE, false);
+    case IORING_OP_SEND_LINUX:
+      op->off = -1;
+      op->msgflags = Read32(sqe->op_flags);
+      return PrepareIovs(m, op, addr, len, PROT_READ, false);
+    case IORING_OP_FSYNC_LINUX:
+      if ((op->events = Read32(sqe->op_flags)) &
+          ~IORING_FSYNC_DATASYNC_LINUX) {
+        return einval();
+      }
+      return PrepareFd(m, op, 0);
+    case IORING_OP_POLL_ADD_LINUX:
+      if (len) {
+        LOGF("multishot io_uring poll not supported yet");
+        return einval();
+      }
+      op->events = Read32(sqe->op_flags) & 0xffff;
+      return PrepareFd(m, op, 0);
+    case IORING_OP_TIMEOUT_LINUX:
+      return PrepareTimeout(m, ring, op, sqe);
+    default:
+      LOGF("unsupported io_uring opcode %d", op->opcode);
+      return einval();
+  }
+}
+
+static bool IsImmediateOp(int opcode) {
+  return opcode == IORING_OP_OPENAT_LINUX ||
+         opcode == IORING_OP_CLOSE_LINUX ||
+         opcode == IORING_OP_ASYNC_CANCEL_LINUX ||
+         opcode == IORING_OP_POLL_REMOVE_LINUX ||
+         opcode == IORING_OP_TIMEOUT_REMOVE_LINUX;
+}
+
+// performs operation which can't be linked, on the submitting thread
+static i64 PerformImmediateOp(struct Machine *m, struct IoUring *ring,
+                              const struct io_uring_sqe_linux *sqe) {
+  i64 rc;
+  u64 user_data;
+  if (sqe->flags & ~IOSQE_ASYNC_LINUX) return -EINVAL_LINUX;
+  switch (sqe->opcode) {
+    case IORING_OP_OPENAT_LINUX:
+      rc = SysOpenat(m, Read32(sqe->fd), Read64(sqe->addr),
+                     Read32(sqe->op_flags), Read32(sqe->len));
+      return rc != -1 ? rc : GetLinuxError(errno);
+    case IORING_OP_CLOSE_LINUX:
+      rc = SysClose(m, Read32(sqe->fd));
+      return rc != -1 ? rc : GetLinuxError(errno);
+    default:
+      user_data = Read64(sqe->addr);
+      LOCK(&ring->lock);
+      rc = CancelOps(ring, user_data,
+                     sqe->opcode == IORING_OP_POLL_REMOVE_LINUX
+                         ? IORING_OP_POLL_ADD_LINUX
+                     : sqe->opcode == IORING_OP_TIMEOUT_REMOVE_LINUX
+                         ? IORING_OP_TIMEOUT_LINUX
+                         : -1);
+      UNLOCK(&ring->lock);
+      return rc;
+  }
+}
+
+// consumes up to `want` entries from the submission ring
+static u32 SubmitSqes(struct Machine *m, struct IoUring *ring, u32 want) {
+  i64 res;
+  u32 n, head, tail, index;
+  struct io_uring_sqe_linux sqe;
+  struct IoUringOp *op, *chain, *last;
+  LOCK(&ring->sqlock);
+  head = LoadRing(GetSqField(ring, kSqHead));
+  tail = LoadRing(GetSqField(ring, kSqTail));
+  for (chain = last = 0, n = 0; n < want && head != tail; ++head) {
+    index = Little32(((u32 *)(ring->sq + kSqArray))[head &
+                                                      (ring->sqentries - 1)]);
+    if (index >= ring->sqentries) {
+      StoreRing(GetSqField(ring, kSqDropped),
+                LoadRing(GetSqField(ring, kSqDropped)) + 1);
+      continue;
+    }
+    memcpy(&sqe, ring->sqes + index * sizeof(sqe), sizeof(sqe));
+    ++n;
+    if ((sqe.flags & IOSQE_IO_DRAIN_LINUX) && !chain) {
+      DrainIoUring(m, ring);
+    }
+    if (IsImmediateOp(sqe.opcode)) {
+      res = PerformImmediateOp(m, ring, &sqe);
+      LOCK(&ring->lock);
+      PostCqe(ring, Read64(sqe.user_data), res);
+      UNLOCK(&ring->lock);
+      continue;
+    }
+    if (!(op = (struct IoUringOp *)calloc(1, sizeof(*op)))) {
+      LOCK(&ring->lock);
+      PostCqe(ring, Read64(sqe.user_data), -ENOMEM_LINUX);
+      UNLOCK(&ring->lock);
+      continue;
+    }
+    InitIovs(&op->iv);
+    op->opcode = sqe.opcode;
+    op->flags = sqe.flags;
+    op->fildes = (i32)Read32(sqe.fd);
+    op->off = Read64(sqe.off);
+    op->user_data = Read64(sqe.user_data);
+    // the guest can't unmap the buffers we're translating until the op
+    // is somewhere CancelIoUringMemory() will find it. from then on it
+    // protects the buffers, so the page locks taken while translating
+    // are released, since munmap() waits on them with mmap_lock held
+    LOCK(&m->system->mmap_lock);
+    ++m->sysdepth;
+    if (PrepareOp(m, ring, op, &sqe) == -1) {
+      op->err = errno;
+    }
+    LOCK(&ring->lock);
+    if (chain) {
+      last->next = op;
+    } else {
+      chain = op;
+    }
+    ring->pending = chain;
+    UNLOCK(&ring->lock);
+    --m->sysdepth;
+    CollectPageLocks(m);
+    UNLOCK(&m->system->mmap_lock);
+    last = op;
+    if (!(op->flags & (IOSQE_IO_LINK_LINUX | IOSQE_IO_HARDLINK_LINUX))) {
+      QueueChain(ring, chain);
+      chain = 0;
+    }
+  }
+  if (chain) QueueChain(ring, chain);
+  StoreRing(GetSqField(ring, kSqHead), head);
+  UNLOCK(&ring->sqlock);
+  return n;
+}
+
+// waits for at least `want` completions to be available in the ring
+static int WaitCqes(struct Machine *m, struct IoUring *ring, u32 want,
+                    struct timespec deadline) {
+  int rc = 0;
+  LOCK(&ring->lock);
+  for (;;) {
+    if (FlushOverflow(ring) && CountCqes(ring) >= want) break;
+    if (ring->overflows) break;
+    if (ring->closing) {
+      rc = ebadf();
+      break;
+    }
+    if (CompareTime(GetTime(), deadline) >= 0) {
+#ifdef ETIME
+      errno = ETIME;
+#else
+      errno = ETIMEDOUT;
+#endif
+      rc = -1;
+      break;
+    }
+    if (SleepOnRing(m, ring, deadline) == -1) {
+      UNLOCK(&ring->lock);
+      if (atomic_load_explicit(&m->killed, memory_order_acquire)) {
+        return eintr();
+      }
+      if (CheckInterrupt(m, false)) return -1;
+      LOCK(&ring->lock);
+    }
+  }
+  UNLOCK(&ring->lock);
+  return rc;
+}
+
+static ssize_t IoUringReadv(int fildes, const struct iovec *iov, int iovlen) {
+  return einval();
+}
+
+static ssize_t IoUringWritev(int fildes, const struct iovec *iov,
+                             int iovlen) {
+  return einval();
+}
+
+// reports ring as readable when completions are waiting to be reaped
+// and writable when the submission ring has room, just like on linux,
+// since polling the memfd itself would say it's always ready for both
+static int IoUringPoll(struct pollfd *fds, nfds_t nfds, int timeout) {
+  int rc;
+  nfds_t i;
+  struct stat st;
+  struct IoUring *ring;
+  unassert(!timeout);
+  for (rc = i = 0; i < nfds; ++i) {
+    fds[i].revents = 0;
+    if (fstat(fds[i].fd, &st)) {
+      fds[i].revents = POLLNVAL;
+    } else {
+      LockIoUrings();
+      if ((ring = FindIoUring(st.st_dev, st.st_ino))) {
+        LOCK(&ring->lock);
+        if (CountCqes(ring) || ring->overflows) {
+          fds[i].revents |= POLLIN | POLLRDNORM;
+        }
+        if (LoadRing(GetSqField(ring, kSqTail)) -
+                LoadRing(GetSqField(ring, kSqHead)) <
+            ring->sqentries) {
+          fds[i].revents |= POLLOUT | POLLWRNORM;
+        }
+        UNLOCK(&ring->lock);
+      } else {
+        fds[i].revents = POLLNVAL;
+      }
+      UnlockIoUrings();
+      fds[i].revents &= fds[i].events | POLLNVAL;
+    }
+    rc += !!fds[i].revents;
+  }
+  return rc;
+}
+
+static int NoTcgetwinsize(int fildes, struct winsize *ws) {
+  errno = ENOTTY;
+  return -1;
+}
+
+static int NoTcsetwinsize(int fildes, const struct winsize *ws) {
+  errno = ENOTTY;
+  return -1;
+}
+
+static const struct FdCb kFdCbIoUring = {
+    .close = CloseIoUring,
+    .readv = IoUringReadv,
+    .writev = IoUringWritev,
+    .poll = IoUringPoll,
+    .tcgetattr = VfsTcgetattr,
+    .tcsetattr = VfsTcsetattr,
+    .tcgetwinsize = NoTcgetwinsize,
+    .tcsetwinsize = NoTcsetwinsize,
+};
+
+int SysIoUringSetup(struct Machine *m, u32 entries, i64 paramsaddr) {
+  unsigned i;
+  int lim, fildes;
+  struct Fd *fd;
+  u32 flags, cqentries;
+  struct IoUring *ring;
+  struct io_uring_params_linux p;
+  if (CopyFromUserRead(m, &p, paramsaddr, sizeof(p)) == -1) return -1;
+  if ((flags = Read32(p.flags)) &
+      ~(IORING_SETUP_CQSIZE_LINUX | IORING_SETUP_CLAMP_LINUX)) {
+    LOGF("unsupported %s flags %#" PRIx32, "io_uring_setup", flags);
+    return einval();
+  }
+  for (i = 0; i < sizeof(p.resv); ++i) {
+    if (p.resv[i]) return einval();
+  }
+  if (!entries) return einval();
+  if (entries > IORING_MAX_ENTRIES_LINUX) {
+    if (!(flags & IORING_SETUP_CLAMP_LINUX)) return einval();
+    entries = IORING_MAX_ENTRIES_LINUX;
+  }
+  entries = RoundUpTwoPow(entries);
+  if (flags & IORING_SETUP_CQSIZE_LINUX) {
+    if (!(cqentries = Read32(p.cq_entries))) return einval();
+    if (cqentries > IORING_MAX_CQ_ENTRIES_LINUX) {
+      if (!(flags & IORING_SETUP_CLAMP_LINUX)) return einval();
+      cqentries = IORING_MAX_CQ_ENTRIES_LINUX;
+    }
+    if ((cqentries = RoundUpTwoPow(cqentries)) < entries) return einval();
+  } else {
+    cqentries = entries * 2;
+  }
+  if (!(lim = GetFileDescriptorLimit(m->system))) return emfile();
+  if ((fildes = OpenMemfd("[io_uring]", MFD_CLOEXEC_LINUX)) == -1) return -1;
+  if (fildes >= lim) {
+    close(fildes);
+    return emfile();
+  }
+  if (!(ring = NewIoUring(fildes, entries, cqentries))) {
+    close(fildes);
+    return -1;
+  }
+  Write32(p.sq_entries, entries);
+  Write32(p.cq_entries, cqentries);
+  Write32(p.features, IORING_FEAT_NODROP_LINUX |         //
+                          IORING_FEAT_SUBMIT_STABLE_LINUX |  //
+                          IORING_FEAT_RW_CUR_POS_LINUX |     //
+                          IORING_FEAT_POLL_32BITS_LINUX |    //
+                          IORING_FEAT_EXT_ARG_LINUX);
+  memset(&p.sq_off, 0, sizeof(p.sq_off));
+  Write32(p.sq_off.head, kSqHead);
+  Write32(p.sq_off.tail, kSqTail);
+  Write32(p.sq_off.ring_mask, kSqMask);
+  Write32(p.sq_off.ring_entries, kSqEntries);
+  Write32(p.sq_off.flags, kSqFlags);
+  Write32(p.sq_off.dropped, kSqDropped);
+  Write32(p.sq_off.array, kSqArray);
+  memset(&p.cq_off, 0, sizeof(p.cq_off));
+  Write32(p.cq_off.head, kCqHead);
+  Write32(p.cq_off.tail, kCqTail);
+  Write32(p.cq_off.ring_mask, kCqMask);
+  Write32(p.cq_off.ring_entries, kCqEntries);
+  Write32(p.cq_off.overflow, kCqOverflow);
+  Write32(p.cq_off.cqes, kCqCqes);
+  Write32(p.cq_off.flags, kCqFlags);
+  if (CopyToUserWrite(m, paramsaddr, &p, sizeof(p)) == -1) {
+    FreeIoUring(ring);
+    close(fildes);
+    return -1;
+  }
+  LockIoUrings();
+  dll_make_last(&g_iourings.list, &ring->elem);
+  UnlockIoUrings();
+  LOCK(&m->system->fds.lock);
+  unassert(fd = AddFd(&m->system->fds, fildes, O_RDWR | O_CLOEXEC));
+  fd->cb = &kFdCbIoUring;
+  // this is how linux describes io_uring mappings in /proc/self/maps
+  fd->path = strdup("anon_inode:[io_uring]");
+  UNLOCK(&m->system->fds.lock);
+  return fildes;
+}
+
+int SysIoUringEnter(struct Machine *m, i32 fildes, u32 to_submit,
+                    u32 min_complete, u32 flags, i64 argaddr, u64 argsz) {
+  int rc;
+  u64 sigmask, oldmask;
+  struct IoUring *ring;
+  struct timespec deadline;
+  i64 sigmaskaddr, tsaddr;
+  const struct timespec_linux *gt;
+  const struct io_uring_getevents_arg_linux *ga;
+  if (flags &
+      ~(IORING_ENTER_GETEVENTS_LINUX | IORING_ENTER_SQ_WAKEUP_LINUX |
+        IORING_ENTER_SQ_WAIT_LINUX | IORING_ENTER_EXT_ARG_LINUX)) {
+    LOGF("unsupported %s flags %#" PRIx32, "io_uring_enter", flags);
+    return einval();
+  }
+  tsaddr = 0;
+  sigmask = 0;
+  sigmaskaddr = 0;
+  deadline = GetMaxTime();
+  if (flags & IORING_ENTER_EXT_ARG_LINUX) {
+    if (argsz != sizeof(*ga)) return einval();
+    if (argaddr) {
+      if (!(ga = (const struct io_uring_getevents_arg_linux *)SchlepR(
+                m, argaddr, sizeof(*ga)))) {
+        return -1;
+      }
+      if ((sigmaskaddr = Read64(ga->sigmask)) && Read32(ga->sigmask_sz) != 8) {
+        return einval();
+      }
+      tsaddr = Read64(ga->ts);
+    }
+  } else if ((sigmaskaddr = argaddr) && argsz != 8) {
+    return einval();
+  }
+  if (sigmaskaddr) {
+    if (CopyFromUserRead(m, &sigmask, sigmaskaddr, 8) == -1) return -1;
+    sigmask = Little64(sigmask);
+  }
+  if (tsaddr) {
+    if (!(gt = (const struct timespec_linux *)SchlepR(m, tsaddr,
+                                                      sizeof(*gt)))) {
+      return -1;
+    }
+    deadline.tv_sec = Read64(gt->sec);
+    deadline.tv_nsec = Read64(gt->nsec);
+    if (deadline.tv_sec < 0 ||
+        !(0 <= deadline.tv_nsec && deadline.tv_nsec < 1000000000)) {
+      return einval();
+    }
+    deadline = AddTime(GetTime(), deadline);
+  }
+  if (!(ring = AcquireIoUring(m, fildes))) return -1;
+  rc = SubmitSqes(m, ring, to_submit);
+  if (flags & IORING_ENTER_GETEVENTS_LINUX) {
+    if (sigmaskaddr) {
+      oldmask = m->sigmask;
+      m->sigmask = sigmask;
+      SIG_LOGF("sigmask push %" PRIx64, m->sigmask);
+    }
+    if (WaitCqes(m, ring, min_complete, deadline) == -1 && !rc) {
+      rc = -1;
+    }
+    if (sigmaskaddr) {
+      m->sigmask = oldmask;
+      SIG_LOGF("sigmask pop %" PRIx64, m->sigmask);
+    }
+  } else {
+    LOCK(&ring->lock);
+    FlushOverflow(ring);
+    UNLOCK(&ring->lock);
+  }
+  ReleaseIoUring(ring);
+  return rc;
+}
+
+static int RegisterBuffers(struct Machine *m, struct IoUring *ring,
+                           i64 argaddr, u32 nargs) {
+  u32 i;
+  struct IoUringBuf *bufs;
+  const struct iovec_linux *iov;
+  if (!nargs || nargs > IOV_MAX_LINUX * 16) return einval();
+  if (!(iov = (const struct iovec_linux *)SchlepR(m, argaddr,
+                                                  nargs * sizeof(*iov)))) {
+    return -1;
+  }
+  if (!(bufs = (struct IoUringBuf *)calloc(nargs, sizeof(*bufs)))) return -1;
+  for (i = 0; i < nargs; ++i) {
+    bufs[i].addr = Read64(iov[i].base);
+    bufs[i].size = Read64(iov[i].len);
+    if (!bufs[i].size || bufs[i].size > 1024 * 1024 * 1024 ||
+        !IsValidMemory(m, bufs[i].addr, bufs[i].size, PROT_READ)) {
+      free(bufs);
+      return efault();
+    }
+  }
+  LOCK(&ring->lock);
+  if (!ring->nbufs) {
+    ring->bufs = bufs;
+    ring->nbufs = nargs;
+    bufs = 0;
+  }
+  UNLOCK(&ring->lock);
+  if (bufs) {
+    free(bufs);
+    errno = EBUSY;
+    return -1;
+  }
+  return 0;
+}
+
+static int RegisterFiles(struct Machine *m, struct IoUring *ring, i64 argaddr,
+                         u32 nargs) {
+  u32 i;
+  i32 *files;
+  const u8 *p;
+  if (!nargs || nargs > 65536) return einval();
+  if (!(p = (const u8 *)SchlepR(m, argaddr, nargs * 4))) return -1;
+  if (!(files = (i32 *)calloc(nargs, sizeof(*files)))) return -1;
+  for (i = 0; i < nargs; ++i) {
+    files[i] = Read32(p + i * 4);
+  }
+  LOCK(&ring->lock);
+  if (!ring->nfiles) {
+    ring->files = files;
+    ring->nfiles = nargs;
+    files = 0;
+  }
+  UNLOCK(&ring->lock);
+  if (files) {
+    free(files);
+    errno = EBUSY;
+    return -1;
+  }
+  return 0;
+}
+
+static int RegisterEventfd(struct Machine *m, struct IoUring *ring,
+                           i64 argaddr, u32 nargs) {
+  u8 buf[4];
+  int fildes;
+  struct Fd *fd;
+  ssize_t (*writev_impl)(int, const struct iovec *, int);
+  if (nargs != 1) return einval();
+  if (CopyFromUserRead(m, buf, argaddr, 4) == -1) return -1;
+  LOCK(&m->system->fds.lock);
+  if ((fd = GetFd(&m->system->fds, Read32(buf)))) {
+    writev_impl = fd->cb->writev;
+  } else {
+    writev_impl = 0;
+  }
+  UNLOCK(&m->system->fds.lock);
+  if (!fd) return -1;
+  // we need our own handle, since the guest is free to close its own
+  if ((fildes = fcntl(Read32(buf), F_DUPFD_CLOEXEC, kMinBlinkFd)) == -1) {
+    return -1;
+  }
+  LOCK(&ring->lock);
+  if (ring->notify == -1) {
+    ring->notify = fildes;
+    ring->notify_writev = writev_impl;
+    fildes = -1;
+  }
+  UNLOCK(&ring->lock);
+  if (fildes != -1) {
+    close(fildes);
+    errno = EBUSY;
+    return -1;
+  }
+  return 0;
+}
+
+static int Unregister(struct IoUring *ring, u32 opcode) {
+  int rc = 0;
+  LOCK(&ring->lock);
+  switch (opcode) {
+    case IORING_UNREGISTER_BUFFERS_LINUX:
+      if (ring->nbufs) {
+        free(ring->bufs);
+        ring->bufs = 0;
+        ring->nbufs = 0;
+      } else {
+        rc = -1;
+      }
+      break;
+    case IORING_UNREGISTER_FILES_LINUX:
+      if (ring->nfiles) {
+        free(ring->files);
+        ring->files = 0;
+        ring->nfiles = 0;
+      } else {
+        rc = -1;
+      }
+      break;
+    case IORING_UNREGISTER_EVENTFD_LINUX:
+      if (ring->notify != -1) {
+        close(ring->notify);
+        ring->notify = -1;
+      } else {
+        rc = -1;
+      }
+      break;
+    default:
+      __builtin_unreachable();
+  }
+  UNLOCK(&ring->lock);
+  if (rc == -1) errno = ENXIO;
+  return rc;
+}
+
+static int RegisterProbe(struct Machine *m, i64 argaddr, u32 nargs) {
+  int rc;
+  size_t i, size;
+  struct io_uring_probe_linux *probe;
+  if (nargs > 256) return einval();
+  size = sizeof(*probe) + nargs * sizeof(probe->ops[0]);
+  if (!(probe = (struct io_uring_probe_linux *)calloc(1, size))) return -1;
+  if ((rc = CopyFromUserRead(m, probe, argaddr, size)) != -1) {
+    for (i = 0; i < size; ++i) {
+      if (((u8 *)probe)[i]) {
+        free(probe);
+        return einval();
+      }
+    }
+    probe->last_op = IORING_OP_LAST_LINUX - 1;
+    probe->ops_len = MIN(nargs, IORING_OP_LAST_LINUX);
+    for (i = 0; i < probe->ops_len; ++i) {
+      probe->ops[i].op = i;
+    }
+    for (i = 0; i < ARRAYLEN(kIoUringOps); ++i) {
+      if (kIoUringOps[i] < probe->ops_len) {
+        Write16(probe->ops[kIoUringOps[i]].flags, IO_URING_OP_SUPPORTED_LINUX);
+      }
+    }
+    rc = CopyToUserWrite(m, argaddr, probe, size);
+  }
+  free(probe);
+  return rc;
+}
+
+int SysIoUringRegister(struct Machine *m, i32 fildes, u32 opcode, i64 argaddr,
+                       u32 nargs) {
+  int rc;
+  struct IoUring *ring;
+  if (!(ring = AcquireIoUring(m, fildes))) return -1;
+  switch (opcode) {
+    case IORING_REGISTER_BUFFERS_LINUX:
+      rc = RegisterBuffers(m, ring, argaddr, nargs);
+      break;
+    case IORING_REGISTER_FILES_LINUX:
+      rc = RegisterFiles(m, ring, argaddr, nargs);
+      break;
+    case IORING_REGISTER_EVENTFD_LINUX:
+      rc = RegisterEventfd(m, ring, argaddr, nargs);
+      break;
+    case IORING_UNREGISTER_BUFFERS_LINUX:
+    case IORING_UNREGISTER_FILES_LINUX:
+    case IORING_UNREGISTER_EVENTFD_LINUX:
+      rc = nargs || argaddr ? einval() : Unregister(ring, opcode);
+      break;
+    case IORING_REGISTER_PROBE_LINUX:
+      rc = RegisterProbe(m, argaddr, nargs);
+      break;
+    default:
+      LOGF("unsupported %s opcode %" PRIu32, "io_uring_register", opcode);
+      rc = einval();
+      break;
+  }
+  ReleaseIoUring(ring);
+  return rc;
+}
+
+// cancels i/o operations whose buffers overlap [virt,virt+size) unless
+// `prot` still grants them the access they need, and waits for workers
+// to stop using that memory. the caller must hold the mmap_lock, which
+// keeps new operations from translating the memory in the meantime
+void CancelIoUringMemory(i64 virt, i64 size, int prot) {
+  int i;
+  struct Dll *e, *list;
+  struct IoUring *ring;
+  LockIoUrings();
+  for (i = 0; i < 2; ++i) {
+    list = i ? g_iourings.closed : g_iourings.list;
+    for (e = dll_first(list); e; e = dll_next(list, e)) {
+      ring = IOURING_CONTAINER(e);
+      LOCK(&ring->lock);
+      while (CancelRingMemory(ring, virt, size, prot)) {
+        unassert(!pthread_cond_wait(&ring->cond, &ring->lock));
+      }
+      UNLOCK(&ring->lock);
+    }
+  }
+  UnlockIoUrings();
+}
+
+// forgets about worker threads in forked child process
+void ResetIoUrings(void) {
+  struct Dll *e;
+  struct IoUring *ring;
+  unassert(!pthread_mutex_init(&g_iourings.lock, 0));
+  for (e = dll_first(g_iourings.list); e; e = dll_next(g_iourings.list, e)) {
+    ring = IOURING_CONTAINER(e);
+    unassert(!pthread_mutex_init(&ring->sqlock, 0));
+    unassert(!pthread_mutex_init(&ring->lock, 0));
+    unassert(!pthread_cond_init(&ring->cond, 0));
+    unassert(!pthread_cond_init(&ring->work, 0));
+    FreeOpList(ring->queue);
+    FreeOpList(ring->running);
+    ring->queue = 0;
+    ring->running = 0;
+    ring->pending = 0;
+    ring->queued = 0;
+    ring->workers = 0;
+    ring->idle = 0;
+    ring->refs = 0;
+  }  // closed rings have no workers left that could touch guest memory
+  g_iourings.closed = 0;
+}
+
+#else /* DISABLE_NONPOSIX */
+void CancelIoUringMemory(i64 virt, i64 size, int prot) {
+}
+void ResetIoUrings(void) {
+}
+#endif /* DISABLE_NONPOSIX */
+#else /* HAVE_THREADS */
+void CancelIoUringMemory(i64 virt, i64 size, int prot) {
+}
+void ResetIoUrings(void) {
+}
+#endif /* HAVE_THREADS */
@@ -45,10 +45,59 @@ void FreeIovs(struct Iovs *ib) {
   }
 }
 
+/**
+ * Initializes i/o vector builder using memory cached by machine.
+ *
+ * System calls like read() are issued frequently enough that it's worth
+ * holding on to the array a previous call had to allocate, so programs
+ * performing large i/o on fragmented memory don't call malloc() each time.
+ */
+void BorrowIovs(struct Machine *m, struct Iovs *ib) {
+  if (m->iovcache.p) {
+    ib->p = m->iovcache.p;
+    ib->i = 0;
+    ib->n = m->iovcache.n;
+    m->iovcache.p = 0;
+    m->iovcache.n = 0;
+  } else {
+    InitIovs(ib);
+  }
+}
+
+/**
+ * Destroys i/o vector builder, giving its memory back to the machine.
+ */
+void ReturnIovs(struct Machine *m, struct Iovs *ib) {
+  if (ib->p != ib->init) {
+    if (ib->n > m->iovcache.n) {
+      free(m->iovcache.p);
+      m->iovcache.p = ib->p;
+      m->iovcache.n = ib->n;
+    } else {
+      free(ib->p);
+    }
+  }
+}
+
+/**
+ * Returns number of bytes described by i/o vector builder.
+ */
+u64 CountIovs(const struct Iovs *ib) {
+  u64 n;
+  unsigned i;
+  for (n = i = 0; i < ib->i; ++i) {
+    n += ib->p[i].iov_len;
+  }
+  return n;
+}
+
 /**
  * Appends memory region to i/o vector builder.
+ *
+ * @param more is how many more fragments the caller expects to add,
+ *     so the array only needs to be grown once for huge transfers
  */
-static int AppendIovs(struct Iovs *ib, void *base, size_t len) {
+static int AppendIovs(struct Iovs *ib, void *base, size_t len, u64 more) {
   unsigned i, n;
   struct iovec *p;
   if (len) {
@@ -57,19 +106,20 @@ static int AppendIovs(struct Iovs *ib, void *base, size_t len) {
     n = ib->n;
     if (i &&
         (uintptr_t)base == (uintptr_t)p[i - 1].iov_base + p[i - 1].iov_len) {
-      STATISTIC(++iov_stretches);
+      STATISTIC(++g_stats.iov_stretches);
       if (p[i - 1].iov_len + len > NUMERIC_MAX(ssize_t)) return einval();
       p[i - 1].iov_len += len;
     } else {
       if (i < n) {
         if (!i) {
-          STATISTIC(++iov_created);
+          STATISTIC(++g_stats.iov_created);
         } else {
-          STATISTIC(++iov_fragments);
+          STATISTIC(++g_stats.iov_fragments);
         }
       } else {
-        STATISTIC(++iov_reallocs);
+        STATISTIC(++g_stats.iov_reallocs);
         n += n >> 1;
+        n = MAX(n, MIN(i + 1 + more, GetIovMax()));
         if (p == ib->init) {
           if (!(p = (struct iovec *)malloc(sizeof(*p) * n))) return -1;
           memcpy(p, ib->init, sizeof(ib->init));
@@ -87,6 +137,14 @@ static int AppendIovs(struct Iovs *ib, void *base, size_t len) {
   return 0;
 }
 
+/**
+ * Appends guest memory region to i/o vector builder.
+ *
+ * Adjacent guest pages whose host memory is also adjacent are merged
+ * into a single iovec. No more than GetIovMax() entries will be added,
+ * in which case the caller should perform the i/o and then call this
+ * again for the remainder, which CountIovs() can help determine.
+ */
 int AppendIovsReal(struct Machine *m, struct Iovs *ib, i64 addr, u64 size,
                    int prot) {
   void *real;
@@ -107,7 +165,9 @@ int AppendIovsReal(struct Machine *m, struct Iovs *ib, i64 addr, u64 size,
     if (!(real = LookupAddress2(m, addr, mask, need))) return efault();
     have = 4096 - (addr & 4095);
     got = MIN(size, have);
-    if (AppendIovs(ib, real, got) == -1) return -1;
+    if (AppendIovs(ib, real, got, (size - got + 4095) / 4096) == -1) {
+      return -1;
+    }
     addr += got;
     size -= got;
   }
@@ -15,6 +15,9 @@ struct Iovs {
 
 void FreeIovs(struct Iovs *);
 void InitIovs(struct Iovs *);
+void BorrowIovs(struct Machine *, struct Iovs *);
+void ReturnIovs(struct Machine *, struct Iovs *);
+u64 CountIovs(const struct Iovs *);
 int AppendIovsReal(struct Machine *, struct Iovs *, i64, u64, int);
 int AppendIovsGuest(struct Machine *, struct Iovs *, i64, int, int);
 
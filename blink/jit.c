@@ -131,6 +131,7 @@ static struct JitGlobals {
   pthread_mutex_t_ lock;
   _Atomic(long) prot;
   int freecount;
+  long brk;
   struct Dll *freeblocks;
 } g_jit = {
     PTHREAD_MUTEX_INITIALIZER_,
@@ -231,20 +232,20 @@ static void pthread_jit_write_protect_np_workaround(int enabled) {
 }
 
 static void *Calloc(size_t nmemb, size_t size) {
-  STATISTIC(++jit_callocs);
+  STATISTIC(++g_stats.jit_callocs);
   return calloc(nmemb, size);
 #define calloc please_use_Calloc
 }
 
 static void *Realloc(void *p, size_t n) {
-  STATISTIC(++jit_reallocs);
+  STATISTIC(++g_stats.jit_reallocs);
   return realloc(p, n);
 #define realloc please_use_Realloc
 }
 
 static void Free(void *ptr) {
   if (!ptr) return;
-  STATISTIC(++jit_frees);
+  STATISTIC(++g_stats.jit_frees);
   free(ptr);
 #define free please_use_Free
 }
@@ -253,11 +254,11 @@ static struct JitJump *NewJitJump(struct Dll **freejumps) {
   struct Dll *e;
   struct JitJump *jj;
   if ((e = dll_first(*freejumps))) {
-    STATISTIC(++jit_jump_alloc_freelist);
+    STATISTIC(++g_stats.jit_jump_alloc_freelist);
     dll_remove(freejumps, e);
     jj = JITJUMP_CONTAINER(e);
   } else if ((jj = (struct JitJump *)Calloc(1, sizeof(struct JitJump)))) {
-    STATISTIC(++jit_jump_alloc_system);
+    STATISTIC(++g_stats.jit_jump_alloc_system);
     dll_init(&jj->elem);
   }
   return jj;
@@ -297,6 +298,14 @@ static struct JitFreed *NewJitFreed(void) {
   return jf;
 }
 
+static struct JitPooled *NewJitPooled(void) {
+  struct JitPooled *jp;
+  if ((jp = (struct JitPooled *)Calloc(1, sizeof(struct JitPooled)))) {
+    dll_init(&jp->elem);
+  }
+  return jp;
+}
+
 static struct JitIntsSlab *NewJitIntsSlab(void) {
   struct JitIntsSlab *jis;
   if ((jis = (struct JitIntsSlab *)Calloc(1, sizeof(struct JitIntsSlab)))) {
@@ -338,6 +347,12 @@ static void FreeJitStage(struct JitStage *js) {
   Free(js);
 }
 
+static void FreeJitPooled(struct JitPooled *jp) {
+  DestroyInts(&jp->hooks);
+  DestroyInts(&jp->edges);
+  Free(jp);
+}
+
 static void DestroyIntsAllocator(struct JitIntsAllocator *jia) {
   int i;
   struct Dll *e, *e2;
@@ -377,11 +392,11 @@ static struct JitInts *NewInts(struct JitIntsAllocator *jia) {
   struct JitInts *ji;
   struct JitIntsSlab *slab;
   if (jia->i) {
-    STATISTIC(++jit_ints_alloc_freelist);
+    STATISTIC(++g_stats.jit_ints_alloc_freelist);
     return jia->p[--jia->i];
   }
   if ((e = dll_first(jia->slabs))) {
-    STATISTIC(++jit_ints_alloc_slab);
+    STATISTIC(++g_stats.jit_ints_alloc_slab);
     slab = JIASLAB_CONTAINER(e);
     if (slab->i < ARRAYLEN(slab->p)) {
       ji = slab->p + slab->i++;
@@ -391,7 +406,7 @@ static struct JitInts *NewInts(struct JitIntsAllocator *jia) {
     }
   }
   if ((slab = NewJitIntsSlab())) {
-    STATISTIC(++jit_ints_alloc_system);
+    STATISTIC(++g_stats.jit_ints_alloc_system);
     dll_make_first(&jia->slabs, &slab->elem);
     return slab->p + slab->i++;
   }
@@ -703,7 +718,7 @@ static void RetireJitBlock(struct Jit *jit, struct JitBlock *jb) {
   unassert(!jb->isprotected);
   unassert(dll_is_empty(jb->jumps));
   unassert(dll_is_empty(jb->staged));
-  STATISTIC(++jit_blocks_retired);
+  STATISTIC(++g_stats.jit_blocks_retired);
   dll_remove(&jit->blocks, &jb->elem);
   dll_remove(&jit->agedblocks, &jb->aged);
   jb->start = 0;
@@ -771,14 +786,28 @@ int InitJit(struct Jit *jit, uintptr_t opt_staging_function) {
   unassert(funcs = (_Atomic(int) *)Calloc(n, sizeof(*funcs)));
   atomic_store_explicit(&jit->hooks.virts, virts, memory_order_relaxed);
   atomic_store_explicit(&jit->hooks.funcs, funcs, memory_order_relaxed);
-  for (brk = 0; (jb = InitJitBlock(jit, &brk));) {
+  // jit memory is carved into blocks once, since a block may outlive
+  // the jit that made it, e.g. when AdoptJit() is used by execve()
+  LOCK(&g_jit.lock);
+  for (brk = g_jit.brk; (jb = InitJitBlock(jit, &brk));) {
     dll_make_last(&g_jit.freeblocks, &jb->elem);
     ++g_jit.freecount;
   }
+  g_jit.brk = brk;
+  UNLOCK(&g_jit.lock);
   JIT_LOGF("initialized jit %p", jit);
   return 0;
 }
 
+// @assume jit->lock
+static void FreeJitPool(struct Jit *jit) {
+  struct Dll *e;
+  while ((e = dll_first(jit->pool))) {
+    dll_remove(&jit->pool, e);
+    FreeJitPooled(JITPOOLED_CONTAINER(e));
+  }
+}
+
 /**
  * Destroys initialized JIT object.
  *
@@ -807,6 +836,7 @@ int DestroyJit(struct Jit *jit) {
     e2 = dll_next(jit->pages, e);
     FreeJitPage(JITPAGE_CONTAINER(e));
   }
+  FreeJitPool(jit);
   UnlockJit(jit);
   unassert(!pthread_mutex_destroy(&jit->lock));
   DestroyEdges(&jit->redges);
@@ -875,9 +905,9 @@ static struct JitPage *GetJitPage(struct Jit *jit, i64 addr) {
     jp = JITPAGE_CONTAINER(e);
     if (jp->page == page) {
       if (!lru) {
-        STATISTIC(++jit_pages_hits_1);
+        STATISTIC(++g_stats.jit_pages_hits_1);
       } else {
-        STATISTIC(++jit_pages_hits_2);
+        STATISTIC(++g_stats.jit_pages_hits_2);
         dll_remove(&jit->pages, e);
         dll_make_first(&jit->pages, e);
       }
@@ -1040,9 +1070,9 @@ static bool SetJitHookUnlocked(struct Jit *jit, u64 virt, int cas,
   oldfunc = atomic_load_explicit(funcs + spot, memory_order_relaxed);
   if (jit->staging) {
     if (func == jit->staging) {
-      STATISTIC(++jit_hooks_staged);
+      STATISTIC(++g_stats.jit_hooks_staged);
       if (key && oldfunc != jit->staging) {
-        STATISTIC(++jit_hooks_deleted);
+        STATISTIC(++g_stats.jit_hooks_deleted);
       }
     } else {
       if (key && cas && oldfunc != cas) {
@@ -1050,22 +1080,23 @@ static bool SetJitHookUnlocked(struct Jit *jit, u64 virt, int cas,
         // then some other thread must have won the race to install this
         return false;
       }
-      STATISTIC(--jit_hooks_staged);
+      STATISTIC(--g_stats.jit_hooks_staged);
       if (func) {
-        STATISTIC(++jit_hooks_installed);
+        STATISTIC(++g_stats.jit_hooks_installed);
       }
     }
   } else {
     if (key && oldfunc) {
-      STATISTIC(++jit_hooks_deleted);
+      STATISTIC(++g_stats.jit_hooks_deleted);
     }
     if (func) {
-      STATISTIC(++jit_hooks_installed);
+      STATISTIC(++g_stats.jit_hooks_installed);
     }
   }
   if (!key) {
     ++jit->hooks.i;
-    STATISTIC(jit_hash_elements = MAX(jit_hash_elements, jit->hooks.i));
+    STATISTIC(g_stats.jit_hash_elements =
+                  MAX(g_stats.jit_hash_elements, jit->hooks.i));
   }
   if (func && (jp = GetOrCreateJitPage(jit, virt))) {
     jp->bitset |= (u64)1 << ((virt & 4095) >> 6);
@@ -1098,7 +1129,7 @@ uintptr_t GetJitHook(struct Jit *jit, u64 virt) {
   _Atomic(int) *funcs;
   _Atomic(uintptr_t) *virts;
   unsigned n, kgen, hash, spot, step;
-  COSTLY_STATISTIC(++jit_hash_lookups);
+  COSTLY_STATISTIC(++g_stats.jit_hash_lookups);
   hash = HASH(virt);
   do {
     kgen = atomic_load_explicit(&jit->keygen, memory_order_relaxed);
@@ -1116,7 +1147,7 @@ uintptr_t GetJitHook(struct Jit *jit, u64 virt) {
       if (!key) {
         return 0;
       }
-      COSTLY_STATISTIC(++jit_hash_collisions);
+      COSTLY_STATISTIC(++g_stats.jit_hash_collisions);
     }
   } while (ShallNotPass(kgen, &jit->keygen));
   return res;
@@ -1146,10 +1177,10 @@ static void DeleteJitPath(struct Jit *jit, i64 virt) {
       if (old) {
         atomic_store_explicit(funcs + spot, 0, memory_order_release);
         if (old == jit->staging) {
-          STATISTIC(--jit_hooks_staged);
+          STATISTIC(--g_stats.jit_hooks_staged);
         } else {
-          STATISTIC(--jit_hooks_installed);
-          STATISTIC(++jit_hooks_deleted);
+          STATISTIC(--g_stats.jit_hooks_installed);
+          STATISTIC(++g_stats.jit_hooks_deleted);
         }
       }
       break;
@@ -1177,7 +1208,7 @@ static void ResetJitPageHooks(struct Jit *jit, i64 page) {
   unsigned i, boff;
   struct JitPage *jp;
   if (!(jp = GetJitPage(jit, page))) return;
-  STATISTIC(AVERAGE(jit_page_average_bits, popcount(jp->bitset)));
+  STATISTIC(AVERAGE(g_stats.jit_page_average_bits, popcount(jp->bitset)));
   while (jp->bitset) {
     boff = bsr(jp->bitset);
     virt = page + boff * (4096 / 64);
@@ -1195,7 +1226,7 @@ static int ResetJitPageUnlocked(struct Jit *jit, i64 virt) {
   i64 page;
   unsigned gen;
   page = virt & -4096;
-  STATISTIC(++jit_page_resets);
+  STATISTIC(++g_stats.jit_page_resets);
   JIT_LOGF("resetting jit page %#" PRIx64, page);
   gen = BeginUpdate(&jit->pagegen);
   ResetJitPageHooks(jit, page);
@@ -1254,9 +1285,250 @@ static void ForceJitBlocksToRetire(struct Jit *jit) {
   jit->hooks.i = 0;
   ClearEdges(&jit->redges);
   ClearEdges(&jit->edges);
+  FreeJitPool(jit);
   EndUpdate(&jit->pagegen, pgen);
 }
 
+// page of jit paths and the pool entry it was classified into
+struct JitPoolPage {
+  i64 page;
+  struct JitPooled *jp;
+};
+
+static int CompareJitPoolPages(const void *a, const void *b) {
+  const struct JitPoolPage *x = (const struct JitPoolPage *)a;
+  const struct JitPoolPage *y = (const struct JitPoolPage *)b;
+  return x->page < y->page ? -1 : x->page > y->page;
+}
+
+static struct JitPooled *GetJitPoolOwner(const struct JitPoolPage *pages,
+                                         long n, i64 virt) {
+  i64 page;
+  long l, r, m;
+  page = virt & -4096;
+  for (l = 0, r = n; l < r;) {
+    m = l + (r - l) / 2;
+    if (pages[m].page < page) {
+      l = m + 1;
+    } else if (pages[m].page > page) {
+      r = m;
+    } else {
+      return pages[m].jp;
+    }
+  }
+  return 0;
+}
+
+// returns true if generated code is installed for path at address
+static bool IsJitPathInstalled(struct Jit *jit, i64 virt) {
+  uintptr_t f;
+  return (f = GetJitHook(jit, virt)) && EncodeJitFunc(f) != jit->staging;
+}
+
+// @assume jit->lock
+static struct JitPooled *GetFreshJitPooled(struct Dll **fresh,
+                                           const struct JitPoolKey *key) {
+  struct Dll *e;
+  struct JitPooled *jp;
+  for (e = dll_first(*fresh); e; e = dll_next(*fresh, e)) {
+    jp = JITPOOLED_CONTAINER(e);
+    if (!memcmp(&jp->key, key, sizeof(*key))) {
+      return jp;
+    }
+  }
+  if ((jp = NewJitPooled())) {
+    jp->key = *key;
+    dll_make_last(fresh, &jp->elem);
+  }
+  return jp;
+}
+
+/**
+ * Sets aside JIT paths that were translated from files.
+ *
+ * This is intended to be called by execve() before the old program's
+ * memory is unmapped, so the next program can reuse the translations
+ * of any shared objects it has in common. Each page having paths gets
+ * passed to `classify`, which returns false if its paths can't be kept
+ * or otherwise fills `key` with the identity of the file and where it
+ * was mapped. Paths that jump directly into some other file's paths,
+ * or into paths that can't be kept, are deleted. Entries stay in the
+ * pool until UnpoolJit() is called for the same key, or the JIT needs
+ * to reclaim its memory.
+ *
+ * @return number of jit paths that were set aside
+ */
+long PoolJit(struct Jit *jit, bool classify(void *, i64, struct JitPoolKey *),
+             void *ctx) {
+  int func;
+  unsigned hn;
+  long i, j, n, count;
+  i64 src, dst, virt, end;
+  struct Dll *e, *e2, *fresh;
+  struct JitPage *jpg;
+  struct JitPooled *jp;
+  struct JitPoolKey key;
+  struct JitPoolPage *pages;
+  struct JitInts doomed = {0};
+  LockJit(jit);
+  // group the pages having paths by the file they were translated from
+  fresh = 0;
+  for (n = 0, e = dll_first(jit->pages); e; e = dll_next(jit->pages, e)) ++n;
+  if (!(pages = (struct JitPoolPage *)Calloc(n + 1, sizeof(*pages)))) {
+    UnlockJit(jit);
+    return 0;
+  }
+  for (n = 0, e = dll_first(jit->pages); e; e = dll_next(jit->pages, e)) {
+    jpg = JITPAGE_CONTAINER(e);
+    memset(&key, 0, sizeof(key));
+    if (!jpg->bitset || !classify(ctx, jpg->page, &key)) continue;
+    if (!(jp = GetFreshJitPooled(&fresh, &key))) continue;
+    if (jp->size) {
+      end = MAX(jp->virt + jp->size, jpg->page + 4096);
+      jp->virt = MIN(jp->virt, jpg->page);
+      jp->size = end - jp->virt;
+    } else {
+      jp->virt = jpg->page;
+      jp->size = 4096;
+    }
+    pages[n].page = jpg->page;
+    pages[n].jp = jp;
+    ++n;
+  }
+  qsort(pages, n, sizeof(*pages), CompareJitPoolPages);
+  // delete paths whose code jumps directly into paths we won't keep
+  for (i = 0; i < jit->edges.n; ++i) {
+    if (!jit->edges.dst[i]) continue;
+    src = jit->edges.src[i];
+    if (!(jp = GetJitPoolOwner(pages, n, src))) continue;
+    for (j = 0; j < jit->edges.dst[i]->i; ++j) {
+      dst = jit->edges.dst[i]->p[j];
+      if (GetJitPoolOwner(pages, n, dst) != jp &&
+          IsJitPathInstalled(jit, dst)) {
+        if (!AddInt(&doomed, src)) jp->size = 0;
+        break;
+      }
+    }
+  }
+  for (i = 0; i < doomed.i; ++i) {
+    DeleteJitPath(jit, doomed.p[i]);
+  }
+  DestroyInts(&doomed);
+  // copy the surviving hooks and the edges between them
+  hn = atomic_load_explicit(&jit->hooks.n, memory_order_relaxed);
+  for (i = 0; i < hn; ++i) {
+    virt = atomic_load_explicit(jit->hooks.virts + i, memory_order_relaxed);
+    func = atomic_load_explicit(jit->hooks.funcs + i, memory_order_relaxed);
+    if (!virt || !func || func == jit->staging) continue;
+    if (!(jp = GetJitPoolOwner(pages, n, virt))) continue;
+    if (!AddInt(&jp->hooks, virt) || !AddInt(&jp->hooks, func)) jp->size = 0;
+  }
+  for (i = 0; i < jit->edges.n; ++i) {
+    if (!jit->edges.dst[i]) continue;
+    src = jit->edges.src[i];
+    if (!(jp = GetJitPoolOwner(pages, n, src))) continue;
+    for (j = 0; j < jit->edges.dst[i]->i; ++j) {
+      dst = jit->edges.dst[i]->p[j];
+      if (!IsJitPathInstalled(jit, dst)) continue;
+      if (!AddInt(&jp->edges, src) || !AddInt(&jp->edges, dst)) jp->size = 0;
+    }
+  }
+  // entries that ran out of memory can't be trusted to be complete
+  for (count = 0, e = dll_first(fresh); e; e = e2) {
+    e2 = dll_next(fresh, e);
+    jp = JITPOOLED_CONTAINER(e);
+    dll_remove(&fresh, e);
+    if (jp->size && jp->hooks.i) {
+      JIT_LOGF("pooling %d jit paths in [%#" PRIx64 ",%#" PRIx64 ")",
+               jp->hooks.i / 2, jp->virt, jp->virt + jp->size);
+      count += jp->hooks.i / 2;
+      dll_make_last(&jit->pool, e);
+    } else {
+      FreeJitPooled(jp);
+    }
+  }
+  UnlockJit(jit);
+  Free(pages);
+  STATISTIC(g_stats.jit_paths_pooled += count);
+  return count;
+}
+
+/**
+ * Reinstalls pooled JIT paths of file that's been mapped.
+ *
+ * @param virt is address of new read-only executable file mapping
+ * @param size is number of bytes in mapping
+ * @param key identifies the file and the bias of the mapping
+ * @return number of jit paths that were reinstalled
+ */
+long UnpoolJit(struct Jit *jit, i64 virt, i64 size,
+               const struct JitPoolKey *key) {
+  long i, count;
+  bool ok;
+  struct Dll *e, *e2;
+  struct JitPooled *jp;
+  if (IsJitDisabled(jit)) return 0;
+  LockJit(jit);
+  for (count = 0, e = dll_first(jit->pool); e; e = e2) {
+    e2 = dll_next(jit->pool, e);
+    jp = JITPOOLED_CONTAINER(e);
+    if (memcmp(&jp->key, key, sizeof(*key)) ||  //
+        jp->virt < virt || jp->virt + jp->size > virt + size) {
+      continue;
+    }
+    dll_remove(&jit->pool, e);
+    // edges go first so a path can't be reset without its dependents
+    for (ok = true, i = 0; ok && i < jp->edges.i; i += 2) {
+      ok = AddEdge(&jit->edges, jp->edges.p[i], jp->edges.p[i + 1]) &&
+           AddEdge(&jit->redges, jp->edges.p[i + 1], jp->edges.p[i]);
+    }
+    for (i = 0; ok && i < jp->hooks.i; i += 2) {
+      // hooks are staged first so installing them is counted normally
+      ok = (!jit->staging ||
+            SetJitHookUnlocked(jit, jp->hooks.p[i], 0,
+                               DecodeJitFunc(jit->staging))) &&
+           SetJitHookUnlocked(jit, jp->hooks.p[i], jit->staging,
+                              DecodeJitFunc(jp->hooks.p[i + 1]));
+      count += ok;
+    }
+    JIT_LOGF("unpooled jit paths in [%#" PRIx64 ",%#" PRIx64 ")", jp->virt,
+             jp->virt + jp->size);
+    FreeJitPooled(jp);
+  }
+  UnlockJit(jit);
+  STATISTIC(g_stats.jit_paths_unpooled += count);
+  return count;
+}
+
+/**
+ * Moves JIT memory of old program into JIT of new program.
+ *
+ * This is intended to be called by execve() after PoolJit(), so the
+ * code of pooled paths stays valid. The old jit may only be destroyed
+ * after this call, since its hooks still point into moved blocks.
+ */
+void AdoptJit(struct Jit *jit, struct Jit *old) {
+  unsigned gen;
+  LockJit(old);
+  LockJit(jit);
+  dll_make_first(&old->freejumps, old->jumps);
+  old->jumps = 0;
+  dll_make_last(&jit->blocks, old->blocks);
+  old->blocks = 0;
+  dll_make_last(&jit->agedblocks, old->agedblocks);
+  old->agedblocks = 0;
+  dll_make_last(&jit->freejumps, old->freejumps);
+  old->freejumps = 0;
+  dll_make_last(&jit->pool, old->pool);
+  old->pool = 0;
+  // hooks staged by the old program's blocks must never be committed
+  gen = MAX(atomic_load_explicit(&jit->pagegen, memory_order_relaxed),
+            atomic_load_explicit(&old->pagegen, memory_order_relaxed));
+  atomic_store_explicit(&jit->pagegen, gen + 2, memory_order_release);
+  UnlockJit(jit);
+  UnlockJit(old);
+}
+
 static bool CheckMmapResult(void *want, void *got) {
   if (got == MAP_FAILED) {
     LOGF("failed to mmap() jit block: %s", DescribeHostErrno(errno));
@@ -1420,8 +1692,8 @@ static void FixupJitJumps(struct JitBlock *jb, struct Dll *list,
   struct Dll *e;
   struct JitJump *jj;
   for (e = dll_first(list); e; e = dll_next(list, e)) {
-    STATISTIC(++jumps_applied);
-    STATISTIC(++path_connected_directly);
+    STATISTIC(++g_stats.jumps_applied);
+    STATISTIC(++g_stats.path_connected_directly);
     jj = JITJUMP_CONTAINER(e);
     u.q = 0;
     n = MakeJitJump(u.b, (uintptr_t)jj->code, addr + jj->addend);
@@ -1585,7 +1857,7 @@ bool RecordJitJump(struct JitBlock *jb, u64 virt, int addend) {
   jj->code = (u8 *)GetJitPc(jb);
   jj->addend = addend;
   dll_make_first(&jb->jumps, &jj->elem);
-  STATISTIC(++jumps_recorded);
+  STATISTIC(++g_stats.jumps_recorded);
   return true;
 }
 
@@ -1595,7 +1867,7 @@ static bool RecordJitEdgeImpl(struct Jit *jit, i64 src, i64 dst) {
   if (src == dst) return false;
   visits[0] = src;
   if (IsCyclic(&jit->edges, visits, 1, dst)) {
-    STATISTIC(++jit_cycles_avoided);
+    STATISTIC(++g_stats.jit_cycles_avoided);
     return false;
   }
   if (!AddEdge(&jit->edges, src, dst)) {
@@ -1682,14 +1954,14 @@ bool FinishJit(struct Jit *jit, struct JitBlock *jb) {
     // if there's only a tiny bit left we advance to end
     if (jb->index + kJitFit > kJitBlockSize) {
       JIT_LOGF("ending jit block %p due to pretty good fit", jb);
-      STATISTIC(AVERAGE(jit_average_block, jb->index));
+      STATISTIC(AVERAGE(g_stats.jit_average_block, jb->index));
       jb->index = kJitBlockSize;
     }
     jb->start = jb->index;
     ok = true;
   } else {
     // we ran out of jit memory in block while generating the function
-    STATISTIC(++path_ooms);
+    STATISTIC(++g_stats.path_ooms);
     AbandonJitJumps(jb);
     if (jb->index - jb->start < (kJitBlockSize >> 1)) {
       // we ran out of block space when trying to create a path that's
@@ -1733,7 +2005,7 @@ bool FinishJit(struct Jit *jit, struct JitBlock *jb) {
  */
 bool AbandonJit(struct Jit *jit, struct JitBlock *jb) {
   JIT_LOGF("abandoning jit path in block %p at %#" PRIx64, jb, jb->virt);
-  STATISTIC(++path_abandoned);
+  STATISTIC(++g_stats.path_abandoned);
   AbandonJitJumps(jb);
   AbandonJitHook(jit, jb->virt);
   DiscardGeneratedJitCode(jb);
@@ -120,6 +120,7 @@
 #define JITFREED_CONTAINER(e)  DLL_CONTAINER(struct JitFreed, elem, e)
 #define AGEDBLOCK_CONTAINER(e) DLL_CONTAINER(struct JitBlock, aged, e)
 #define JIASLAB_CONTAINER(e)   DLL_CONTAINER(struct JitIntsSlab, elem, e)
+#define JITPOOLED_CONTAINER(e) DLL_CONTAINER(struct JitPooled, elem, e)
 
 struct JitInts {
   int i, n;
@@ -179,6 +180,26 @@ struct JitPage {
   struct Dll elem;
 };
 
+// identifies the file contents a page of jit paths was translated from
+struct JitPoolKey {
+  u64 dev;      // st_dev of mapped file
+  u64 ino;      // st_ino of mapped file
+  i64 size;     // st_size of mapped file
+  i64 mtime;    // st_mtim of mapped file in nanoseconds
+  i64 bias;     // virtual address minus file offset
+  bool linear;  // HasLinearMapping()
+};
+
+// jit paths set aside until their file is mapped at the same place
+struct JitPooled {
+  struct JitPoolKey key;
+  i64 virt;              // address of first page with paths
+  i64 size;              // bytes between first and last page with paths
+  struct JitInts hooks;  // pairs of path address and encoded function
+  struct JitInts edges;  // pairs of source and destination path address
+  struct Dll elem;
+};
+
 struct JitBlock {
   u8 *addr;
   i64 virt;
@@ -216,6 +237,7 @@ struct Jit {
   struct Dll *jumps;
   struct Dll *freejumps;
   struct Dll *pages;
+  struct Dll *pool;
   pthread_mutex_t_ lock;
   _Alignas(kSemSize) _Atomic(unsigned) keygen;
   _Alignas(kSemSize) _Atomic(unsigned) pagegen;
@@ -250,6 +272,9 @@ bool RecordJitJump(struct JitBlock *, u64, int);
 bool RecordJitEdge(struct Jit *, i64, i64);
 uintptr_t GetJitHook(struct Jit *, u64);
 int ResetJitPage(struct Jit *, i64);
+long PoolJit(struct Jit *, bool (*)(void *, i64, struct JitPoolKey *), void *);
+long UnpoolJit(struct Jit *, i64, i64, const struct JitPoolKey *);
+void AdoptJit(struct Jit *, struct Jit *);
 
 int CommitJit_(struct Jit *, struct JitBlock *);
 void ReinsertJitBlock_(struct Jit *, struct JitBlock *);
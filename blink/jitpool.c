@@ -0,0 +1,175 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "blink/jitpool.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "blink/builtin.h"
+#include "blink/bus.h"
+#include "blink/flag.h"
+#include "blink/jit.h"
+#include "blink/machine.h"
+#include "blink/vfs.h"
+
+#if defined(__APPLE__) || defined(__NetBSD__)
+#define st_mtim st_mtimespec
+#endif
+
+/**
+ * @fileoverview jit translation reuse across execve()
+ *
+ * Programs launched by shell scripts and build tools tend to have most
+ * of their code in common, e.g. ld.so and libc. When execve() is done
+ * inside the same blink process, the translations of the old program's
+ * read-only file mappings are pooled rather than thrown away. They're
+ * keyed by the identity of the file and the bias it was mapped at, and
+ * reinstalled as soon as the new program maps the same file at the same
+ * bias. Since generated code embeds guest addresses, the new program
+ * also inherits the old program's layout randomization, so libraries
+ * land in the same places when they're mapped in the same order.
+ */
+
+#ifdef HAVE_JIT
+
+#define kJitPoolFiles 8
+
+struct JitPoolFile {
+  int fd;
+  struct stat st;
+  struct FileMap *fm;
+};
+
+struct JitPoolContext {
+  int n, next;
+  struct System *s;
+  struct JitPoolFile files[kJitPoolFiles];
+  u8 page[4096];
+};
+
+static void GetJitPoolKey(struct JitPoolKey *key, const struct stat *st,
+                          i64 bias) {
+  memset(key, 0, sizeof(*key));
+  key->dev = st->st_dev;
+  key->ino = st->st_ino;
+  key->size = st->st_size;
+  key->mtime = st->st_mtim.tv_sec * 1000000000ll + st->st_mtim.tv_nsec;
+  key->bias = bias;
+  key->linear = HasLinearMapping();
+}
+
+static struct JitPoolFile *OpenJitPoolFile(struct JitPoolContext *c,
+                                           struct FileMap *fm) {
+  int i;
+  struct JitPoolFile *f;
+  for (i = 0; i < c->n; ++i) {
+    if (c->files[i].fm == fm) {
+      return c->files[i].fd != -1 ? c->files + i : 0;
+    }
+  }
+  if (c->n < kJitPoolFiles) {
+    f = c->files + c->n++;
+  } else {
+    f = c->files + c->next++ % kJitPoolFiles;
+    if (f->fd != -1) VfsClose(f->fd);
+  }
+  f->fm = fm;
+  if ((f->fd = VfsOpen(AT_FDCWD, fm->path, O_RDONLY | O_CLOEXEC, 0)) != -1 &&
+      VfsFstat(f->fd, &f->st)) {
+    VfsClose(f->fd);
+    f->fd = -1;
+  }
+  return f->fd != -1 ? f : 0;
+}
+
+static u64 GetJitPoolPte(struct System *s, i64 virt) {
+  u64 pt;
+  unsigned level;
+  for (pt = s->cr3, level = 39;; level -= 9) {
+    pt = LoadPte(GetPageAddress(s, pt, level == 39) +
+                 ((virt >> level) & 511) * 8);
+    if (level == 12 || !(pt & PAGE_V)) return pt;
+  }
+}
+
+// paths may only be kept if their page is unchanged from the file
+static bool ClassifyJitPage(void *ctx, i64 page, struct JitPoolKey *key) {
+  u8 *host;
+  u64 entry;
+  ssize_t got;
+  struct FileMap *fm;
+  struct JitPoolFile *f;
+  struct JitPoolContext *c = (struct JitPoolContext *)ctx;
+  if (!(fm = GetFileMap(c->s, page)) || fm->offset == -1) return false;
+  entry = GetJitPoolPte(c->s, page);
+  if ((entry & (PAGE_V | PAGE_U | PAGE_RW | PAGE_XD | PAGE_HOST |
+                PAGE_RSRV)) != (PAGE_V | PAGE_U | PAGE_HOST) ||
+      !(host = GetPageAddress(c->s, entry, false))) {
+    return false;
+  }
+  if (!(f = OpenJitPoolFile(c, fm))) return false;
+  got = VfsPread(f->fd, c->page, 4096, fm->offset + (page - fm->virt));
+  if (got == -1) return false;
+  memset(c->page + got, 0, 4096 - got);
+  if (memcmp(host, c->page, 4096)) return false;
+  GetJitPoolKey(key, &f->st, fm->virt - fm->offset);
+  return true;
+}
+
+/**
+ * Carries JIT paths of the old program's file mappings into a new one.
+ *
+ * This must be called by execve() before the old program's memory is
+ * freed, and before the new program is loaded. It only happens if the
+ * user opted in with `BLINK_KEEPASLR`, because paths can only be used
+ * again if the new program keeps the old one's layout randomization.
+ */
+void InheritJit(struct System *s, struct System *old) {
+  int i;
+  struct JitPoolContext *c;
+  if (!FLAG_keepaslr) return;
+  if (IsJitDisabled(&s->jit) || !CanJitForImmediateEffect()) return;
+  if (!(c = (struct JitPoolContext *)calloc(1, sizeof(*c)))) return;
+  c->s = old;
+  PoolJit(&old->jit, ClassifyJitPage, c);
+  for (i = 0; i < c->n; ++i) {
+    if (c->files[i].fd != -1) {
+      VfsClose(c->files[i].fd);
+    }
+  }
+  free(c);
+  AdoptJit(&s->jit, &old->jit);
+  s->ender = old->ender;
+  s->aslr = old->aslr;
+}
+
+/**
+ * Reinstalls pooled JIT paths for read-only executable file mapping.
+ */
+void ReuseJit(struct System *s, i64 virt, i64 size, int fd, i64 offset) {
+  struct stat st;
+  struct JitPoolKey key;
+  if (VfsFstat(fd, &st)) return;
+  GetJitPoolKey(&key, &st, virt - offset);
+  UnpoolJit(&s->jit, virt, size, &key);
+}
+
+#endif /* HAVE_JIT */
@@ -0,0 +1,9 @@
+#ifndef BLINK_JITPOOL_H_
+#define BLINK_JITPOOL_H_
+#include "blink/types.h"
+
+struct System;
+void InheritJit(struct System *, struct System *);
+void ReuseJit(struct System *, i64, i64, int, i64);
+
+#endif /* BLINK_JITPOOL_H_ */
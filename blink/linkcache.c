@@ -0,0 +1,268 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "blink/linkcache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blink/buffer.h"
+#include "blink/endian.h"
+#include "blink/flag.h"
+#include "blink/linux.h"
+#include "blink/log.h"
+#include "blink/machine.h"
+#include "blink/snapshot.h"
+#include "blink/tunables.h"
+#include "blink/util.h"
+#include "blink/vfs.h"
+
+#if defined(__APPLE__) || defined(__NetBSD__)
+#define st_mtim st_mtimespec
+#endif
+
+/**
+ * @fileoverview dynamic link cache
+ *
+ * Dynamically linked programs spend much of their startup time in the
+ * guest's ld.so, which opens and maps every shared object, then binds
+ * symbols and applies relocations. The dynamic linker can't be told to
+ * skip any of that, so when `BLINK_LINKCACHE` names a directory, blink
+ * memoizes the whole link phase instead. The first time a program runs
+ * with some particular set of inputs, a snapshot is saved when it makes
+ * its first system call from outside the interpreter, i.e. once ld.so
+ * has handed control to the program. Later runs with identical inputs
+ * resume from that snapshot instead of loading the program, as long as
+ * none of the files it mapped have changed since.
+ *
+ * The inputs are the program path, arguments, environment, directory,
+ * ignored signals, resource limits, and the status of the files ld.so
+ * consults before searching for libraries.
+ *
+ * A restored program gets the same `AT_RANDOM` bytes as the run which
+ * saved it, and libc has already derived its stack protector canary
+ * and pointer guard from them, so every run from one entry shares the
+ * same secrets. The directory is kept under kLinkCacheMax megabytes by
+ * deleting the entries which were least recently saved or restored.
+ */
+
+struct LinkCacheEntry {
+  i64 used;
+  i64 size;
+  char *name;
+};
+
+static void AddKeyData(struct Buffer *b, const void *p, u32 n) {
+  AppendData(b, (const char *)&n, sizeof(n));
+  AppendData(b, (const char *)p, n);
+}
+
+static void AddKeyString(struct Buffer *b, const char *s) {
+  AddKeyData(b, s, strlen(s) + 1);
+}
+
+static void AddKeyStrings(struct Buffer *b, char **list) {
+  u32 i;
+  for (i = 0; list[i]; ++i) {
+  }
+  AppendData(b, (const char *)&i, sizeof(i));
+  for (i = 0; list[i]; ++i) {
+    AddKeyString(b, list[i]);
+  }
+}
+
+static void AddKeyFile(struct Buffer *b, const char *path) {
+  i64 id[4];
+  struct stat st;
+  memset(id, 0, sizeof(id));
+  if (!VfsStat(AT_FDCWD, path, &st, 0)) {
+    id[0] = st.st_dev;
+    id[1] = st.st_ino;
+    id[2] = st.st_size;
+    id[3] = (i64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  }
+  AddKeyData(b, id, sizeof(id));
+}
+
+static bool MakeLinkCacheKey(struct System *s, struct Buffer *b, char *execfn,
+                             char *prog, char **argv, char **envp) {
+  int sig;
+  u64 ignored;
+  char cwd[PATH_MAX];
+  if (!VfsGetcwd(cwd, sizeof(cwd))) return false;
+  for (ignored = 0, sig = 1; sig <= 64; ++sig) {
+    if (Read64(s->hands[sig - 1].handler) == SIG_IGN_LINUX) {
+      ignored |= (u64)1 << (sig - 1);
+    }
+  }
+  AddKeyString(b, execfn);
+  AddKeyString(b, prog);
+  AddKeyStrings(b, argv);
+  AddKeyStrings(b, envp);
+  AddKeyString(b, cwd);
+  AddKeyData(b, &ignored, sizeof(ignored));
+  AddKeyData(b, s->rlim, sizeof(s->rlim));
+  AddKeyFile(b, "/etc/ld.so.cache");
+  AddKeyFile(b, "/etc/ld.so.preload");
+  return !!b->p;
+}
+
+static char *GetLinkCachePath(const char *key, u32 keysize) {
+  u32 i;
+  u64 hash;
+  char *path;
+  size_t size;
+  for (hash = 0xcbf29ce484222325, i = 0; i < keysize; ++i) {
+    hash ^= (u8)key[i];
+    hash *= 0x100000001b3;  // fnv-1a
+  }
+  size = strlen(FLAG_linkcache) + 32;
+  if ((path = (char *)malloc(size))) {
+    snprintf(path, size, "%s/%016" PRIx64 ".link", FLAG_linkcache, hash);
+  }
+  return path;
+}
+
+static int CompareLinkCacheEntries(const void *a, const void *b) {
+  const struct LinkCacheEntry *x = (const struct LinkCacheEntry *)a;
+  const struct LinkCacheEntry *y = (const struct LinkCacheEntry *)b;
+  return (x->used > y->used) - (x->used < y->used);
+}
+
+// deletes least recently used entries until cache fits in its budget
+static void TrimLinkCache(const char *keep) {
+  DIR *dir;
+  size_t i, n;
+  i64 total;
+  struct stat st;
+  struct dirent *ent;
+  char path[PATH_MAX];
+  struct LinkCacheEntry *p, *list;
+  if (!(dir = opendir(FLAG_linkcache))) return;
+  for (total = 0, list = 0, n = 0; (ent = readdir(dir));) {
+    if (!EndsWith(ent->d_name, ".link")) continue;
+    snprintf(path, sizeof(path), "%s/%s", FLAG_linkcache, ent->d_name);
+    if (stat(path, &st) || !S_ISREG(st.st_mode)) continue;
+    if (!(p = (struct LinkCacheEntry *)realloc(list, (n + 1) * sizeof(*p)))) {
+      break;
+    }
+    list = p;
+    if (!(list[n].name = strdup(path))) break;
+    list[n].used = (i64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    list[n].size = st.st_size;
+    total += st.st_size;
+    ++n;
+  }
+  closedir(dir);
+  if (total > (i64)kLinkCacheMax * 1024 * 1024) {
+    qsort(list, n, sizeof(*list), CompareLinkCacheEntries);
+    for (i = 0; i < n && total > (i64)kLinkCacheMax * 1024 * 1024; ++i) {
+      if (strcmp(list[i].name, keep) && !unlink(list[i].name)) {
+        LOGF("evicted %s from link cache", list[i].name);
+        total -= list[i].size;
+      }
+    }
+  }
+  for (i = 0; i < n; ++i) free(list[i].name);
+  free(list);
+}
+
+/**
+ * Resumes program from its link cache entry, if one exists.
+ *
+ * This is called on a freshly created machine instead of LoadProgram()
+ * and takes the same arguments. If nothing usable has been cached, the
+ * inputs are remembered so the link can be saved by SaveLinkCache().
+ *
+ * @return true if program is ready to run, or false to load it
+ */
+bool RestoreLinkCache(struct Machine *m, char *execfn, char *prog,
+                      char **argv, char **envp) {
+  bool ok;
+  char *path;
+  struct Buffer b = {0};
+  struct System *s = m->system;
+  if (!FLAG_linkcache || !*FLAG_linkcache) return false;
+  if (!MakeLinkCacheKey(s, &b, execfn, prog, argv, envp)) {
+    free(b.p);
+    return false;
+  }
+  ok = false;
+  if ((path = GetLinkCachePath(b.p, b.i))) {
+    if (!RestoreSnapshot(m, path, b.p, b.i)) {
+      LOGF("restored %s from link cache %s", prog, path);
+      utimensat(AT_FDCWD, path, 0, 0);  // for TrimLinkCache()
+      ok = true;
+    } else if (errno != ENOENT) {
+      LOGF("%s: link cache entry unusable: %s", path,
+           DescribeHostErrno(errno));
+    }
+    free(path);
+  }
+  if (ok) {
+    free(b.p);
+  } else {
+    s->linkcache.key = b.p;
+    s->linkcache.keysize = b.i;
+  }
+  return ok;
+}
+
+/**
+ * Saves link cache entry once the dynamic linker is done.
+ *
+ * This is called by OpSyscall() before each system call that happens
+ * while a link is pending. Nothing is saved for programs that had no
+ * interpreter, and the inputs are forgotten after the first attempt.
+ */
+void SaveLinkCache(struct Machine *m) {
+  char *path;
+  struct FileMap *fm;
+  struct System *s = m->system;
+  if (s->elf.interpreter && !s->isfork) {
+    if ((fm = GetFileMap(s, m->ip - m->oplen)) &&
+        !strcmp(fm->path, s->elf.interpreter)) {
+      return;  // ld.so is still linking
+    }
+    if ((path = GetLinkCachePath(s->linkcache.key, s->linkcache.keysize))) {
+      if (!SaveSnapshot(m, path, s->linkcache.key, s->linkcache.keysize)) {
+        LOGF("saved link of %s to %s", s->elf.prog, path);
+        TrimLinkCache(path);
+      } else {
+        LOGF("%s: failed to save link cache entry: %s", path,
+             DescribeHostErrno(errno));
+      }
+      free(path);
+    }
+  }
+  FreeLinkCache(s);
+}
+
+void FreeLinkCache(struct System *s) {
+  free(s->linkcache.key);
+  s->linkcache.key = 0;
+  s->linkcache.keysize = 0;
+}
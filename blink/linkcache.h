@@ -0,0 +1,19 @@
+#ifndef BLINK_LINKCACHE_H_
+#define BLINK_LINKCACHE_H_
+#include <stdbool.h>
+
+#include "blink/types.h"
+
+// inputs of a dynamic link that hasn't finished yet
+struct LinkCache {
+  char *key;    // serialized inputs, or null if nothing will be saved
+  u32 keysize;  // bytes in key
+};
+
+struct Machine;
+struct System;
+bool RestoreLinkCache(struct Machine *, char *, char *, char **, char **);
+void SaveLinkCache(struct Machine *);
+void FreeLinkCache(struct System *);
+
+#endif /* BLINK_LINKCACHE_H_ */
@@ -105,6 +105,7 @@
 #define AT_SYMLINK_FOLLOW_LINUX   0x0400
 #define AT_NO_AUTOMOUNT_LINUX     0x0800
 #define AT_EMPTY_PATH_LINUX       0x1000
+#define AT_STATX_SYNC_TYPE_LINUX  0x6000
 
 #define O_RDONLY_LINUX  0
 #define O_WRONLY_LINUX  1
@@ -159,6 +160,18 @@
 #define F_OWNER_PID_LINUX     1
 #define F_OWNER_PGRP_LINUX    2
 
+#define F_ADD_SEALS_LINUX         1033
+#define F_GET_SEALS_LINUX         1034
+#define F_SEAL_SEAL_LINUX         1
+#define F_SEAL_SHRINK_LINUX       2
+#define F_SEAL_GROW_LINUX         4
+#define F_SEAL_WRITE_LINUX        8
+#define F_SEAL_FUTURE_WRITE_LINUX 16
+
+#define MFD_CLOEXEC_LINUX       1
+#define MFD_ALLOW_SEALING_LINUX 2
+#define MFD_HUGETLB_LINUX       4
+
 #define SOCK_CLOEXEC_LINUX  O_CLOEXEC_LINUX
 #define SOCK_NONBLOCK_LINUX O_NDELAY_LINUX
 
@@ -229,11 +242,35 @@
 #define CLONE_NEWNET_LINUX         0x40000000
 #define CLONE_IO_LINUX             0x80000000
 
-#define FUTEX_WAIT_LINUX           0
-#define FUTEX_WAKE_LINUX           1
-#define FUTEX_WAIT_BITSET_LINUX    9
-#define FUTEX_PRIVATE_FLAG_LINUX   128
-#define FUTEX_CLOCK_REALTIME_LINUX 256
+#define FUTEX_WAIT_LINUX             0
+#define FUTEX_WAKE_LINUX             1
+#define FUTEX_REQUEUE_LINUX          3
+#define FUTEX_CMP_REQUEUE_LINUX      4
+#define FUTEX_WAKE_OP_LINUX          5
+#define FUTEX_LOCK_PI_LINUX          6
+#define FUTEX_UNLOCK_PI_LINUX        7
+#define FUTEX_TRYLOCK_PI_LINUX       8
+#define FUTEX_WAIT_BITSET_LINUX      9
+#define FUTEX_WAKE_BITSET_LINUX      10
+#define FUTEX_WAIT_REQUEUE_PI_LINUX  11
+#define FUTEX_CMP_REQUEUE_PI_LINUX   12
+#define FUTEX_LOCK_PI2_LINUX         13
+#define FUTEX_PRIVATE_FLAG_LINUX     128
+#define FUTEX_CLOCK_REALTIME_LINUX   256
+#define FUTEX_BITSET_MATCH_ANY_LINUX 0xffffffff
+
+#define FUTEX_OP_SET_LINUX         0
+#define FUTEX_OP_ADD_LINUX         1
+#define FUTEX_OP_OR_LINUX          2
+#define FUTEX_OP_ANDN_LINUX        3
+#define FUTEX_OP_XOR_LINUX         4
+#define FUTEX_OP_OPARG_SHIFT_LINUX 8
+#define FUTEX_OP_CMP_EQ_LINUX      0
+#define FUTEX_OP_CMP_NE_LINUX      1
+#define FUTEX_OP_CMP_LT_LINUX      2
+#define FUTEX_OP_CMP_LE_LINUX      3
+#define FUTEX_OP_CMP_GT_LINUX      4
+#define FUTEX_OP_CMP_GE_LINUX      5
 
 #define DT_UNKNOWN_LINUX 0
 #define DT_FIFO_LINUX    1
@@ -324,6 +361,7 @@
 #define AT_RANDOM_LINUX        25
 #define AT_HWCAP2_LINUX        26
 #define AT_EXECFN_LINUX        31
+#define AT_SYSINFO_EHDR_LINUX  33
 #define AT_MINSIGSTKSZ_LINUX   51
 
 #define IFNAMSIZ_LINUX 16
@@ -859,6 +897,90 @@
 #define EPOLLONESHOT_LINUX   0x40000000u
 #define EPOLLET_LINUX        0x80000000u
 
+#define EFD_SEMAPHORE_LINUX 1
+#define EFD_NONBLOCK_LINUX  O_NDELAY_LINUX
+#define EFD_CLOEXEC_LINUX   O_CLOEXEC_LINUX
+
+#define TFD_NONBLOCK_LINUX            O_NDELAY_LINUX
+#define TFD_CLOEXEC_LINUX             O_CLOEXEC_LINUX
+#define TFD_TIMER_ABSTIME_LINUX       1
+#define TFD_TIMER_CANCEL_ON_SET_LINUX 2
+
+#define SFD_NONBLOCK_LINUX O_NDELAY_LINUX
+#define SFD_CLOEXEC_LINUX  O_CLOEXEC_LINUX
+
+#define SPLICE_F_MOVE_LINUX     1
+#define SPLICE_F_NONBLOCK_LINUX 2
+#define SPLICE_F_MORE_LINUX     4
+#define SPLICE_F_GIFT_LINUX     8
+
+#define IORING_SETUP_IOPOLL_LINUX     1
+#define IORING_SETUP_SQPOLL_LINUX     2
+#define IORING_SETUP_SQ_AFF_LINUX     4
+#define IORING_SETUP_CQSIZE_LINUX     8
+#define IORING_SETUP_CLAMP_LINUX      16
+#define IORING_SETUP_ATTACH_WQ_LINUX  32
+#define IORING_SETUP_R_DISABLED_LINUX 64
+#define IORING_MAX_ENTRIES_LINUX      32768
+#define IORING_MAX_CQ_ENTRIES_LINUX   (2 * IORING_MAX_ENTRIES_LINUX)
+
+#define IORING_FEAT_SINGLE_MMAP_LINUX   1
+#define IORING_FEAT_NODROP_LINUX        2
+#define IORING_FEAT_SUBMIT_STABLE_LINUX 4
+#define IORING_FEAT_RW_CUR_POS_LINUX    8
+#define IORING_FEAT_POLL_32BITS_LINUX   64
+#define IORING_FEAT_EXT_ARG_LINUX       256
+
+#define IORING_OFF_SQ_RING_LINUX 0x00000000
+#define IORING_OFF_CQ_RING_LINUX 0x08000000
+#define IORING_OFF_SQES_LINUX    0x10000000
+
+#define IORING_ENTER_GETEVENTS_LINUX 1
+#define IORING_ENTER_SQ_WAKEUP_LINUX 2
+#define IORING_ENTER_SQ_WAIT_LINUX   4
+#define IORING_ENTER_EXT_ARG_LINUX   8
+
+#define IORING_SQ_NEED_WAKEUP_LINUX 1
+#define IORING_SQ_CQ_OVERFLOW_LINUX 2
+
+#define IOSQE_FIXED_FILE_LINUX    1
+#define IOSQE_IO_DRAIN_LINUX      2
+#define IOSQE_IO_LINK_LINUX       4
+#define IOSQE_IO_HARDLINK_LINUX   8
+#define IOSQE_ASYNC_LINUX         16
+#define IOSQE_BUFFER_SELECT_LINUX 32
+
+#define IORING_OP_NOP_LINUX            0
+#define IORING_OP_READV_LINUX          1
+#define IORING_OP_WRITEV_LINUX         2
+#define IORING_OP_FSYNC_LINUX          3
+#define IORING_OP_READ_FIXED_LINUX     4
+#define IORING_OP_WRITE_FIXED_LINUX    5
+#define IORING_OP_POLL_ADD_LINUX       6
+#define IORING_OP_POLL_REMOVE_LINUX    7
+#define IORING_OP_TIMEOUT_LINUX        11
+#define IORING_OP_TIMEOUT_REMOVE_LINUX 12
+#define IORING_OP_ASYNC_CANCEL_LINUX   14
+#define IORING_OP_OPENAT_LINUX         18
+#define IORING_OP_CLOSE_LINUX          19
+#define IORING_OP_READ_LINUX           22
+#define IORING_OP_WRITE_LINUX          23
+#define IORING_OP_SEND_LINUX           26
+#define IORING_OP_RECV_LINUX           27
+#define IORING_OP_LAST_LINUX           48
+
+#define IORING_FSYNC_DATASYNC_LINUX 1
+#define IORING_TIMEOUT_ABS_LINUX    1
+
+#define IORING_REGISTER_BUFFERS_LINUX   0
+#define IORING_UNREGISTER_BUFFERS_LINUX 1
+#define IORING_REGISTER_FILES_LINUX     2
+#define IORING_UNREGISTER_FILES_LINUX   3
+#define IORING_REGISTER_EVENTFD_LINUX   4
+#define IORING_UNREGISTER_EVENTFD_LINUX 5
+#define IORING_REGISTER_PROBE_LINUX     8
+#define IO_URING_OP_SUPPORTED_LINUX     1
+
 #define MS_RDONLY_LINUX       1
 #define MS_NOSUID_LINUX       2
 #define MS_NODEV_LINUX        4
@@ -987,6 +1109,53 @@ struct stat_linux {
   struct timespec_linux ctim;
 };
 
+#define STATX_TYPE_LINUX        0x0001
+#define STATX_MODE_LINUX        0x0002
+#define STATX_NLINK_LINUX       0x0004
+#define STATX_UID_LINUX         0x0008
+#define STATX_GID_LINUX         0x0010
+#define STATX_ATIME_LINUX       0x0020
+#define STATX_MTIME_LINUX       0x0040
+#define STATX_CTIME_LINUX       0x0080
+#define STATX_INO_LINUX         0x0100
+#define STATX_SIZE_LINUX        0x0200
+#define STATX_BLOCKS_LINUX      0x0400
+#define STATX_BASIC_STATS_LINUX 0x07ff
+#define STATX__RESERVED_LINUX   0x80000000u
+
+struct statx_timestamp_linux {
+  u8 sec[8];
+  u8 nsec[4];
+  u8 pad_[4];
+};
+
+struct statx_linux {
+  u8 mask[4];  // STATX_XXX fields which were filled in
+  u8 blksize[4];
+  u8 attributes[8];
+  u8 nlink[4];
+  u8 uid[4];
+  u8 gid[4];
+  u8 mode[2];
+  u8 pad1_[2];
+  u8 ino[8];
+  u8 size[8];
+  u8 blocks[8];
+  u8 attributes_mask[8];
+  struct statx_timestamp_linux atime;
+  struct statx_timestamp_linux btime;
+  struct statx_timestamp_linux ctime;
+  struct statx_timestamp_linux mtime;
+  u8 rdev_major[4];
+  u8 rdev_minor[4];
+  u8 dev_major[4];
+  u8 dev_minor[4];
+  u8 mnt_id[8];
+  u8 dio_mem_align[4];
+  u8 dio_offset_align[4];
+  u8 spare_[96];
+};
+
 struct itimerval_linux {
   struct timeval_linux interval;
   struct timeval_linux value;
@@ -1278,6 +1447,118 @@ struct epoll_event_linux {
   u8 data[8];
 };
 
+struct itimerspec_linux {
+  struct timespec_linux interval;
+  struct timespec_linux value;
+};
+
+struct signalfd_siginfo_linux {
+  u8 signo[4];
+  u8 errno_[4];
+  u8 code[4];
+  u8 pid[4];
+  u8 uid[4];
+  u8 fd[4];
+  u8 tid[4];
+  u8 band[4];
+  u8 overrun[4];
+  u8 trapno[4];
+  u8 status[4];
+  u8 int_[4];
+  u8 ptr[8];
+  u8 utime[8];
+  u8 stime[8];
+  u8 addr[8];
+  u8 addr_lsb[2];
+  u8 pad2_[2];
+  u8 syscall[4];
+  u8 call_addr[8];
+  u8 arch[4];
+  u8 pad_[28];
+};
+
+struct io_sqring_offsets_linux {
+  u8 head[4];
+  u8 tail[4];
+  u8 ring_mask[4];
+  u8 ring_entries[4];
+  u8 flags[4];
+  u8 dropped[4];
+  u8 array[4];
+  u8 resv1[4];
+  u8 user_addr[8];
+};
+
+struct io_cqring_offsets_linux {
+  u8 head[4];
+  u8 tail[4];
+  u8 ring_mask[4];
+  u8 ring_entries[4];
+  u8 overflow[4];
+  u8 cqes[4];
+  u8 flags[4];
+  u8 resv1[4];
+  u8 user_addr[8];
+};
+
+struct io_uring_params_linux {
+  u8 sq_entries[4];
+  u8 cq_entries[4];
+  u8 flags[4];
+  u8 sq_thread_cpu[4];
+  u8 sq_thread_idle[4];
+  u8 features[4];
+  u8 wq_fd[4];
+  u8 resv[12];
+  struct io_sqring_offsets_linux sq_off;
+  struct io_cqring_offsets_linux cq_off;
+};
+
+struct io_uring_sqe_linux {
+  u8 opcode;
+  u8 flags;
+  u8 ioprio[2];
+  u8 fd[4];
+  u8 off[8];
+  u8 addr[8];
+  u8 len[4];
+  u8 op_flags[4];
+  u8 user_data[8];
+  u8 buf_index[2];
+  u8 personality[2];
+  u8 file_index[4];
+  u8 addr3[8];
+  u8 pad_[8];
+};
+
+struct io_uring_cqe_linux {
+  u8 user_data[8];
+  u8 res[4];
+  u8 flags[4];
+};
+
+struct io_uring_getevents_arg_linux {
+  u8 sigmask[8];
+  u8 sigmask_sz[4];
+  u8 pad[4];
+  u8 ts[8];
+};
+
+struct io_uring_probe_op_linux {
+  u8 op;
+  u8 resv;
+  u8 flags[2];
+  u8 resv2[4];
+};
+
+struct io_uring_probe_linux {
+  u8 last_op;
+  u8 ops_len;
+  u8 resv[2];
+  u8 resv2[12];
+  struct io_uring_probe_op_linux ops[];
+};
+
 int sysinfo_linux(struct sysinfo_linux *);
 
 #endif /* BLINK_LINUX_H_ */
@@ -40,10 +40,12 @@
 #include "blink/macros.h"
 #include "blink/map.h"
 #include "blink/overlays.h"
+#include "blink/prefetch.h"
 #include "blink/procfs.h"
 #include "blink/random.h"
 #include "blink/tunables.h"
 #include "blink/util.h"
+#include "blink/vdso.h"
 #include "blink/vfs.h"
 #include "blink/x86.h"
 
@@ -705,6 +707,7 @@ void LoadProgram(struct Machine *m, char *execfn, char *prog, char **args,
     elf->at_phdr = 0;
     elf->at_base = -1;
     elf->at_phent = 56;
+    elf->at_sysinfo_ehdr = 0;
     free(g_progname);
     g_progname = strdup(prog);
     SYS_LOGF("LoadProgram %s", prog);
@@ -745,14 +748,21 @@ error: unsupported executable; we need:\n\
       __builtin_unreachable();
     }
   }
+  PrefetchProgram(m->system, map, &st);
   ResetCpu(m);
   m->system->codesize = 0;
   m->system->codestart = 0;
   m->system->brk = FLAG_imagestart;
   m->system->automap = FLAG_automapstart;
   if (HasLinearMapping()) {
-    m->system->brk ^= Read64(elf->rng) & FLAG_aslrmask;
-    m->system->automap ^= (Read64(elf->rng) & FLAG_aslrmask);
+    // execve() may keep the old program's bits so its jit paths are
+    // still valid for any shared objects that are mapped at the same
+    // addresses (see jitpool.c)
+    if (!m->system->aslr) {
+      m->system->aslr = Read64(elf->rng) & FLAG_aslrmask;
+    }
+    m->system->brk ^= m->system->aslr;
+    m->system->automap ^= m->system->aslr;
   }
   if (m->mode.genmode == XED_GEN_MODE_REAL) {
     LoadBios(m, biosprog);
@@ -799,6 +809,10 @@ error: unsupported executable; we need:\n\
       LOGF("failed to reserve stack memory");
       exit(127);
     }
+    if (LoadVdso(m) == -1) {
+      LOGF("failed to reserve vdso memory");
+      exit(127);
+    }
     m->system->loaded = true;  // in case rwx stack is smc write-protected :'(
     LoadArgv(m, execfn, prog, args, vars, elf->rng);
   }
@@ -53,6 +53,7 @@
 #include "blink/thread.h"
 #include "blink/time.h"
 #include "blink/util.h"
+#include "blink/vdso.h"
 #include "blink/x86.h"
 #include "blink/xlat.h"
 
@@ -237,10 +238,57 @@ static void OpXchgZvqp(P) {
   WriteRegister(rde, RegRexbSrm(m, rde), x);
 }
 
+#if defined(__x86_64__) || (defined(HAVE_INT128) &&                   \
+                             defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16) && \
+                             __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define HAVE_CAS128
+// atomically swaps aligned 16-byte p with new if it equals *lo/*hi,
+// otherwise loads the current value of p into *lo and *hi
+static bool CompareAndSwap128(u8 *p, u64 *lo, u64 *hi, u64 newlo,
+                              u64 newhi) {
+#ifdef __x86_64__
+  bool ok;
+  asm volatile("lock cmpxchg16b\t%1\n\t"
+               "sete\t%0"
+               : "=q"(ok), "+m"(*(char(*)[16])p), "+a"(*lo), "+d"(*hi)
+               : "b"(newlo), "c"(newhi)
+               : "memory", "cc");
+  return ok;
+#else
+  unsigned __int128 x, z;
+  x = (unsigned __int128)*hi << 64 | *lo;
+  z = (unsigned __int128)newhi << 64 | newlo;
+  z = __sync_val_compare_and_swap((unsigned __int128 *)p, x, z);
+  if (z == x) return true;
+  *lo = z;
+  *hi = z >> 64;
+  return false;
+#endif
+}
+#endif
+
 static void OpCmpxchg8b(P) {
   uint8_t *p;
   uint32_t d, a;
-  p = GetModrmRegisterXmmPointerRead8(A);
+  p = GetModrmRegisterXmmPointerWrite8(A);
+#if CAN_64BIT
+  if (Lock(rde) && !((uintptr_t)p & 7)) {
+    u64 x, z;
+    x = Little64((u64)Read32(m->dx) << 32 | Read32(m->ax));
+    z = Little64((u64)Read32(m->cx) << 32 | Read32(m->bx));
+    if (atomic_compare_exchange_strong_explicit(
+            (_Atomic(u64) *)p, &x, z, memory_order_acq_rel,
+            memory_order_acquire)) {
+      m->flags = SetFlag(m->flags, FLAGS_ZF, true);
+    } else {
+      m->flags = SetFlag(m->flags, FLAGS_ZF, false);
+      x = Little64(x);
+      Write32(m->ax, x);
+      Write32(m->dx, x >> 32);
+    }
+    return;
+  }
+#endif
   if (Lock(rde)) LockBus(p);
   a = Read32(p + 0);
   d = Read32(p + 4);
@@ -259,7 +307,21 @@ static void OpCmpxchg8b(P) {
 static void OpCmpxchg16b(P) {
   uint8_t *p;
   uint64_t d, a;
-  p = GetModrmRegisterXmmPointerRead16(A);
+  p = GetModrmRegisterXmmPointerWrite16(A);
+#ifdef HAVE_CAS128
+  if (Lock(rde) && !((uintptr_t)p & 15)) {
+    a = Read64(m->ax);
+    d = Read64(m->dx);
+    if (CompareAndSwap128(p, &a, &d, Read64(m->bx), Read64(m->cx))) {
+      m->flags = SetFlag(m->flags, FLAGS_ZF, true);
+    } else {
+      m->flags = SetFlag(m->flags, FLAGS_ZF, false);
+      Write64(m->ax, a);
+      Write64(m->dx, d);
+    }
+    return;
+  }
+#endif
   if (Lock(rde)) LockBus(p);
   a = Read64(p + 0);
   d = Read64(p + 8);
@@ -434,7 +496,7 @@ void Connect(P, u64 pc, bool avoid_cycles) {
 #ifdef HAVE_JIT
   void *jump;
   uintptr_t f;
-  STATISTIC(++path_connected_total);
+  STATISTIC(++g_stats.path_connected_total);
   // 1. cyclic paths can block asynchronous sigs & deadlock exit
   // 2. we don't want to stitch together paths on separate pages
   if ((!avoid_cycles && m->path.start == pc) ||
@@ -444,9 +506,9 @@ void Connect(P, u64 pc, bool avoid_cycles) {
         f != (uintptr_t)JitlessDispatch) {
       // tail call into the other generated jit path function
       jump = (u8 *)f + GetPrologueSize();
-      STATISTIC(++path_connected_directly);
+      STATISTIC(++g_stats.path_connected_directly);
     } else {
-      STATISTIC(++path_connected_lazily);
+      STATISTIC(++g_stats.path_connected_lazily);
       // generate assembly to drop back into main interpreter
       // then apply an smc fixup later on, if dest is created
       if (!FLAG_noconnect) {
@@ -456,7 +518,7 @@ void Connect(P, u64 pc, bool avoid_cycles) {
     }
   } else {
     // generate assembly to drop back into main interpreter
-    STATISTIC(++path_connected_interpreter);
+    STATISTIC(++g_stats.path_connected_interpreter);
     jump = (void *)m->system->ender;
   }
   AppendJitJump(m->path.jb, jump);
@@ -468,12 +530,12 @@ static void AluRo(P, const aluop_f ops[4], const aluop_f fops[4]) {
                     ReadRegisterBW(rde, RegLog2(rde) ? RegRexrReg(m, rde)
                                                      : ByteRexrReg(m, rde)));
   if (IsMakingPath(m)) {
-    STATISTIC(++alu_ops);
+    STATISTIC(++g_stats.alu_ops);
     LoadAluArgs(A);
     switch (GetNeededFlags(m, m->ip, CF | ZF | SF | OF | AF | PF)) {
       case 0:
       CASE_ALU_FAST:
-        STATISTIC(++alu_simplified);
+        STATISTIC(++g_stats.alu_simplified);
         Jitter(A,
                "q"   // arg0 = sav0 (machine)
                "m",  // call micro-op
@@ -518,11 +580,11 @@ static void OpAluFlip(P) {
                   op(m, ReadRegisterBW(rde, q),
                      ReadRegisterOrMemoryBW(rde, GetModrmReadBW(A))));
   if (IsMakingPath(m)) {
-    STATISTIC(++alu_ops);
+    STATISTIC(++g_stats.alu_ops);
     LoadAluFlipArgs(A);
     switch (GetNeededFlags(m, m->ip, CF | ZF | SF | OF | AF | PF)) {
       case 0:
-        STATISTIC(++alu_unflagged);
+        STATISTIC(++g_stats.alu_unflagged);
         if (GetFlagDeps(rde)) Jitter(A, "q");  // arg0 = sav0 (machine)
         Jitter(A,
                "m"     // call micro-op
@@ -530,7 +592,7 @@ static void OpAluFlip(P) {
                kJustAlu[(Opcode(rde) & 070) >> 3]);
         break;
       CASE_ALU_FAST:
-        STATISTIC(++alu_simplified);
+        STATISTIC(++g_stats.alu_simplified);
         Jitter(A,
                "q"     // arg0 = sav0 (machine)
                "m"     // call micro-op
@@ -553,12 +615,12 @@ static void OpAluFlipCmp(P) {
   u8 *q = RegLog2(rde) ? RegRexrReg(m, rde) : ByteRexrReg(m, rde);
   op(m, ReadRegisterBW(rde, q), ReadRegisterOrMemoryBW(rde, GetModrmReadBW(A)));
   if (IsMakingPath(m)) {
-    STATISTIC(++alu_ops);
+    STATISTIC(++g_stats.alu_ops);
     LoadAluFlipArgs(A);
     switch (GetNeededFlags(m, m->ip, CF | ZF | SF | OF | AF | PF)) {
       case 0:
       CASE_ALU_FAST:
-        STATISTIC(++alu_simplified);
+        STATISTIC(++g_stats.alu_simplified);
         Jitter(A,
                "q"   // arg0 = sav0 (machine)
                "m",  // call micro-op
@@ -582,7 +644,7 @@ static void OpAluAxImm(P) {
     switch (GetNeededFlags(m, m->ip, CF | ZF | SF | OF | AF | PF)) {
       case 0:
       CASE_ALU_FAST:
-        STATISTIC(++alu_simplified);
+        STATISTIC(++g_stats.alu_simplified);
         Jitter(A,
                "G"      // res0 = %ax
                "r0a1="  // arg1 = res0
@@ -609,11 +671,11 @@ static void OpAluAxImm(P) {
 static void OpRoAxImm(P, const aluop_f ops[4], const aluop_f fops[4]) {
   ops[RegLog2(rde)](m, ReadRegisterBW(rde, m->ax), uimm0);
   if (IsMakingPath(m)) {
-    STATISTIC(++alu_ops);
+    STATISTIC(++g_stats.alu_ops);
     switch (GetNeededFlags(m, m->ip, CF | ZF | SF | OF | AF | PF)) {
       case 0:
       CASE_ALU_FAST:
-        STATISTIC(++alu_simplified);
+        STATISTIC(++g_stats.alu_simplified);
         Jitter(A,
                "G"      // r0 = GetReg(AX)
                "a2i"    // arg2 = uimm0
@@ -693,10 +755,10 @@ static void BsuwiConstant(P, u64 y) {
       case BSU_SHR:
       case BSU_SAL:
       case BSU_SAR:
-        STATISTIC(++alu_ops);
+        STATISTIC(++g_stats.alu_ops);
         if (!GetNeededFlags(m, m->ip, GetFlagClobbers(rde))) {
           if (Rexw(rde) && (y &= 63)) {
-            STATISTIC(++alu_unflagged);
+            STATISTIC(++g_stats.alu_unflagged);
             Jitter(A,
                    "B"     // res0 = GetRegOrMem(RexbRm)
                    "a3i"   // arg3 = shift amount
@@ -708,7 +770,7 @@ static void BsuwiConstant(P, u64 y) {
                    y, kJustBsu[ModrmReg(rde)]);
             return;
           } else if (!Osz(rde) && (y &= 31)) {
-            STATISTIC(++alu_unflagged);
+            STATISTIC(++g_stats.alu_unflagged);
             Jitter(A,
                    "B"     // res0 = GetRegOrMem(RexbRm)
                    "a3i"   // arg3 = shift amount
@@ -1421,6 +1483,18 @@ static void OpNopEv(P) {
   }
 }
 
+static void OpUd0User(P) {
+  // our [vdso] calls back into blink using `hvcall ±disp8`, which we
+  // only permit in ring3 when it's executed from within its own page
+  if ((Rep(rde) << 9 | ModrmMod(rde) << 6 | ModrmReg(rde) << 3 |
+       ModrmRm(rde)) == 00177 &&
+      IsVdsoCall(m)) {
+    OpVdsocall(m, disp);
+  } else {
+    OpUd(A);
+  }
+}
+
 #ifndef DISABLE_METAL
 static void OpHvcall(P) {
   HaltMachine(m, disp);
@@ -1433,7 +1507,7 @@ static void OpHvtailcall(P) {
 
 static void OpUd0GvqpEvqp(P) {
   if (Cpl(m) == 3) {
-    OpUd(A);
+    OpUd0User(A);
   } else {
     // define `hvcall` & `hvtailcall` instructions which trap to our Blink
     // hypervisor; these are encoded as x86 "invalid opcodes" in 16-bit mode:
@@ -1516,7 +1590,7 @@ static void OpEmms(P) {
 #define OpInto        OpUd
 #define OpIret        OpUd
 #define OpWrmsr       OpUd
-#define OpUd0GvqpEvqp OpUd
+#define OpUd0GvqpEvqp OpUd0User
 #endif
 
 #ifdef DISABLE_X87
@@ -2097,7 +2171,7 @@ static bool CanJit(struct Machine *m) {
 void JitlessDispatch(P) {
   ASM_LOGF("decoding [%s] at address %" PRIx64, DescribeOp(m, GetPc(m)),
            GetPc(m));
-  COSTLY_STATISTIC(++instructions_dispatched);
+  COSTLY_STATISTIC(++g_stats.instructions_dispatched);
   LoadInstruction(m, GetPc(m));
   rde = m->xedd->op.rde;
   disp = m->xedd->op.disp;
@@ -2141,7 +2215,7 @@ static void GeneralDispatch(P) {
     // begin adding this op to the jit path
     unassert(opclass == kOpNormal || opclass == kOpBranching);
     ++m->path.elements;
-    STATISTIC(++path_elements);
+    STATISTIC(++g_stats.path_elements);
     AddPath_StartOp(A);
     jitpc = GetJitPc(m->path.jb);
     JIP_LOGF("adding [%s] from address %" PRIx64
@@ -2169,7 +2243,7 @@ static void GeneralDispatch(P) {
       // otherwise generate "one size fits all" assembly code
       AddPath(A);
       AddPath_EndOp(A);
-      STATISTIC(++path_elements_auto);
+      STATISTIC(++g_stats.path_elements_auto);
     }
     if (opclass == kOpBranching) {
       // branches, calls, and jumps always force end of path
@@ -2207,12 +2281,12 @@ void ExecuteInstruction(struct Machine *m) {
                  m->path.start, func, m->ip);
         FlushSkew(DISPATCH_NOTHING);
         AppendJitSetReg(m->path.jb, kJitArg0, kJitSav0);
-        STATISTIC(++path_spliced);
+        STATISTIC(++g_stats.path_spliced);
         if (RecordJitEdge(&m->system->jit, m->path.start, m->ip)) {
           dst = (u8 *)(uintptr_t)func + GetPrologueSize();
-          STATISTIC(++path_connected_directly);
+          STATISTIC(++g_stats.path_connected_directly);
         } else {
-          STATISTIC(++path_connected_interpreter);
+          STATISTIC(++g_stats.path_connected_interpreter);
           dst = (u8 *)m->system->ender;
         }
         AppendJitJump(m->path.jb, dst);
@@ -2239,7 +2313,7 @@ void Actor(struct Machine *mm) {
 #endif
   for (g_machine = mm, m = mm;;) {
 #ifndef __CYGWIN__
-    STATISTIC(++interps);
+    STATISTIC(++g_stats.interps);
 #endif
     if (!atomic_load_explicit(&m->attention, memory_order_acquire)) {
       ExecuteInstruction(m);
@@ -16,8 +16,10 @@
 #include "blink/elf.h"
 #include "blink/fds.h"
 #include "blink/jit.h"
+#include "blink/linkcache.h"
 #include "blink/linux.h"
 #include "blink/log.h"
+#include "blink/prefetch.h"
 #include "blink/thread.h"
 #include "blink/tsan.h"
 #include "blink/tunables.h"
@@ -95,6 +97,7 @@
 #define PAGE_HOST  0x0000000000000400  // PAGE_TA bits point to system memory
 #define PAGE_MAP   0x0000000000000800  // PAGE_TA bits are a linear host mmap
 #define PAGE_TA    0x0000fffffffff000  // bits used for host, or real address
+#define PAGE_ZERO  0x0008000000000000  // PAGE_TA bits point to shared zero page
 #define PAGE_GROW  0x0010000000000000  // for future support of MAP_GROWSDOWN
 #define PAGE_MUG   0x0020000000000000  // host page magic mapped individually
 #define PAGE_FILE  0x0040000000000000  // page has tracking bit in s->filemap
@@ -156,6 +159,11 @@ struct FreeList {
   void **p;
 };
 
+struct IovCache {
+  unsigned n;
+  struct iovec *p;
+};
+
 struct HostPage {
   u8 *page;
   struct HostPage *next;
@@ -240,6 +248,7 @@ struct Elf {
   i64 at_phent;
   i64 at_entry;
   i64 at_phnum;
+  i64 at_sysinfo_ehdr;
 };
 
 struct OpCache {
@@ -277,6 +286,7 @@ struct System {
   u64 cr4;
   i64 brk;
   i64 automap;
+  i64 aslr;  // random bits that were xor'd into brk and automap
   i64 memchurn;
   i64 codestart;
   long codesize;
@@ -290,6 +300,8 @@ struct System {
   struct Jit jit;
   struct Fds fds;
   struct Elf elf;
+  struct Prefetch prefetch;
+  struct LinkCache linkcache;
   sigset_t exec_sigmask;
   struct sigaction_linux hands[64];
   u64 blinksigs;  // signals blink itself handles
@@ -329,6 +341,21 @@ struct MachineTlb {
   u64 entry;
 };
 
+// state of a vfork() parent, whose machine is lent to the child until
+// the child calls execve() or _exit(), or does something else needing
+// a process of its own
+struct Vfork {
+  u64 ip;
+  u32 flags;
+  u32 mxcsr;
+  u64 sigmask;
+  u8 beg[128];
+  _Alignas(16) u8 xmm[16][16];
+  struct DescriptorCache seg[8];
+  struct MachineFpu fpu;
+  struct sigaction_linux hands[64];
+};
+
 struct Machine {               //
   u64 ip;                      // instruction pointer
   u8 oplen;                    // length of operation
@@ -405,6 +432,7 @@ struct Machine {               //
   u32 mxcsr;                             // SIMD status control register
   pthread_t thread;                      // POSIX thread of this machine
   struct FreeList freelist;              // to make system calls simpler
+  struct IovCache iovcache;              // reused by read(), write(), etc.
   struct PageLocks pagelocks;            // track page table entry locks
   struct JitPath path;                   // under construction jit route
   _Atomicish(u64) signals;               // [attention] pending delivery
@@ -415,6 +443,7 @@ struct Machine {               //
   int sigdepth;                          //
   int sysdepth;                          //
   _Atomic(bool) killed;                  // [attention] slay this thread
+  _Atomic(struct Futex *) futex;         // futex being waited upon
   _Atomic(bool) invalidated;             // the tlb must be flushed
   bool restored;                         // [attention] rt_sigreturn()'d
   bool selfmodifying;                    // [attention] need usmc restore
@@ -436,6 +465,7 @@ struct Machine {               //
   i64 robust_list;                       //
   i64 ctid;                              //
   int tid;                               //
+  struct Vfork *vfork;                   // parent suspended by vfork()
   sigset_t spawn_sigmask;                //
   struct Dll elem;                       //
   struct SmcQueue smcqueue;              //
@@ -471,14 +501,17 @@ int LoadInstruction2(struct Machine *, u64);
 void ExecuteInstruction(struct Machine *);
 u64 AllocatePageTable(struct System *);
 u64 AllocateAnonymousPage(struct System *);
+u64 AllocateZeroPage(void);
 void FreeAnonymousPage(struct System *, u8 *);
-u64 FindPageTableEntry(struct Machine *, u64);
+u64 FindPageTableEntry(struct Machine *, u64, bool);
 bool CheckMemoryInvariants(struct System *) nosideeffect dontdiscard;
 i64 ReserveVirtual(struct System *, i64, i64, u64, int, i64, bool, bool);
 char *FormatPml4t(struct Machine *);
 i64 FindVirtual(struct System *, i64, i64);
 int FreeVirtual(struct System *, i64, i64);
 void CleanseMemory(struct System *, size_t);
+void SetMemoryForkable(struct System *, bool);
+void ReserveUnforkedMemory(struct System *);
 void LoadArgv(struct Machine *, char *, char *, char **, char **, u8[16]);
 _Noreturn void HaltMachine(struct Machine *, int);
 _Noreturn void RaiseDivideError(struct Machine *);
@@ -554,7 +587,7 @@ bool IsSelfModifyingCodeSegfault(struct Machine *, const siginfo_t *);
 int FixXnuSignal(struct Machine *, int, siginfo_t *);
 int FixPpcSignal(struct Machine *, int, siginfo_t *);
 
-void CountOp(long *);
+void CountOp(void);
 void FastPush(struct Machine *, long);
 void FastPop(struct Machine *, long);
 void FastCall(struct Machine *, u64);
@@ -0,0 +1,155 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "blink/assert.h"
+#include "blink/errno.h"
+#include "blink/fds.h"
+#include "blink/linux.h"
+#include "blink/log.h"
+#include "blink/machine.h"
+#include "blink/syscall.h"
+#include "blink/thread.h"
+
+#define kMemfdNameMax 249
+
+/**
+ * @fileoverview Anonymous memory files.
+ *
+ * These are backed by the host's memfd_create() when it's available,
+ * which is also able to support file sealing. Otherwise we use a file
+ * that's unlinked from the temporary directory right after creation.
+ * Mapping these with MAP_SHARED goes through the normal file mapping
+ * path, which lets forked guest processes share memory with each other.
+ */
+
+int OpenMemfd(const char *name, int flags) {
+#ifdef HAVE_MEMFD_CREATE
+  return memfd_create(name, (flags & MFD_CLOEXEC_LINUX ? MFD_CLOEXEC : 0) |
+                                (flags & MFD_ALLOW_SEALING_LINUX
+                                     ? MFD_ALLOW_SEALING
+                                     : 0));
+#else
+  int fd, e;
+  const char *tmpdir;
+  char path[PATH_MAX];
+  if (flags & MFD_ALLOW_SEALING_LINUX) {
+    LOGF("memfd_create(MFD_ALLOW_SEALING) needs host memfd support");
+    return einval();
+  }
+  if (!(tmpdir = getenv("TMPDIR")) || !*tmpdir) tmpdir = "/tmp";
+  snprintf(path, sizeof(path), "%s/blink.memfd.XXXXXX", tmpdir);
+  if ((fd = mkstemp(path)) != -1) {
+    unlink(path);
+    if ((flags & MFD_CLOEXEC_LINUX) && fcntl(fd, F_SETFD, FD_CLOEXEC)) {
+      e = errno;
+      close(fd);
+      errno = e;
+      fd = -1;
+    }
+  }
+  return fd;
+#endif
+}
+
+int SysMemfdCreate(struct Machine *m, i64 nameaddr, u32 flags) {
+  int lim, fildes;
+  struct Fd *fd;
+  const char *name;
+  if (flags & ~(MFD_CLOEXEC_LINUX | MFD_ALLOW_SEALING_LINUX)) {
+    LOGF("unsupported %s flags: %#x", "memfd_create", flags);
+    return einval();
+  }
+  if (!(name = LoadStr(m, nameaddr))) return -1;
+  if (strlen(name) > kMemfdNameMax) return einval();
+  if (!(lim = GetFileDescriptorLimit(m->system))) return emfile();
+  if ((fildes = OpenMemfd(name, flags)) != -1) {
+    if (fildes >= lim) {
+      close(fildes);
+      fildes = emfile();
+    } else {
+      LOCK(&m->system->fds.lock);
+      unassert(fd = AddFd(&m->system->fds, fildes,
+                          O_RDWR | (flags & MFD_CLOEXEC_LINUX ? O_CLOEXEC : 0)));
+      // this is how linux describes memfd objects in /proc/self/maps
+      if ((fd->path = (char *)malloc(strlen(name) + 18))) {
+        stpcpy(stpcpy(stpcpy(fd->path, "/memfd:"), name), " (deleted)");
+      }
+      UNLOCK(&m->system->fds.lock);
+    }
+  }
+  return fildes;
+}
+
+#ifdef HAVE_MEMFD_CREATE
+static int XlatSeals(int x) {
+  int res = 0;
+  if (x & F_SEAL_SEAL_LINUX) res |= F_SEAL_SEAL, x &= ~F_SEAL_SEAL_LINUX;
+  if (x & F_SEAL_SHRINK_LINUX) res |= F_SEAL_SHRINK, x &= ~F_SEAL_SHRINK_LINUX;
+  if (x & F_SEAL_GROW_LINUX) res |= F_SEAL_GROW, x &= ~F_SEAL_GROW_LINUX;
+  if (x & F_SEAL_WRITE_LINUX) res |= F_SEAL_WRITE, x &= ~F_SEAL_WRITE_LINUX;
+#ifdef F_SEAL_FUTURE_WRITE
+  if (x & F_SEAL_FUTURE_WRITE_LINUX) {
+    res |= F_SEAL_FUTURE_WRITE;
+    x &= ~F_SEAL_FUTURE_WRITE_LINUX;
+  }
+#endif
+  if (x) {
+    LOGF("unsupported seals %#x", x);
+    return einval();
+  }
+  return res;
+}
+
+static int UnXlatSeals(int x) {
+  int res = 0;
+  if (x & F_SEAL_SEAL) res |= F_SEAL_SEAL_LINUX;
+  if (x & F_SEAL_SHRINK) res |= F_SEAL_SHRINK_LINUX;
+  if (x & F_SEAL_GROW) res |= F_SEAL_GROW_LINUX;
+  if (x & F_SEAL_WRITE) res |= F_SEAL_WRITE_LINUX;
+#ifdef F_SEAL_FUTURE_WRITE
+  if (x & F_SEAL_FUTURE_WRITE) res |= F_SEAL_FUTURE_WRITE_LINUX;
+#endif
+  return res;
+}
+#endif
+
+// implements fcntl(F_ADD_SEALS) and fcntl(F_GET_SEALS)
+int SysFcntlSeals(int fildes, int cmd, i64 arg) {
+#ifdef HAVE_MEMFD_CREATE
+  int rc, seals;
+  if (cmd == F_ADD_SEALS_LINUX) {
+    if ((seals = XlatSeals(arg)) == -1) return -1;
+    return fcntl(fildes, F_ADD_SEALS, seals);
+  } else {
+    if ((rc = fcntl(fildes, F_GET_SEALS)) != -1) rc = UnXlatSeals(rc);
+    return rc;
+  }
+#else
+  // files which don't support sealing report EINVAL on linux
+  return einval();
+#endif
+}
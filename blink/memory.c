@@ -68,9 +68,9 @@ u8 *GetPageAddress(struct System *s, u64 entry, bool is_cr3) {
   }
 }
 
-u64 HandlePageFault(struct Machine *m, u8 *pslot, u64 entry) {
+u64 HandlePageFault(struct Machine *m, u8 *pslot, u64 entry, bool reading) {
   u64 x, page;
-  unassert(entry & PAGE_RSRV);
+  unassert(entry & (PAGE_RSRV | PAGE_ZERO));
   unassert(!HasLinearMapping());
   if (m->nofault) {
     m->segvcode = SEGV_MAPERR_LINUX;
@@ -78,7 +78,29 @@ u64 HandlePageFault(struct Machine *m, u8 *pslot, u64 entry) {
     return 0;
   }
   do {
-    if (entry & (PAGE_HOST | PAGE_MAP | PAGE_MUG)) {
+    if (entry & PAGE_ZERO) {
+      // the shared zero page is being written for the first time
+      if ((page = AllocateAnonymousPage(m->system)) == -1) {
+        m->segvcode = SEGV_MAPERR_LINUX;
+        entry = 0;
+        break;
+      }
+      x = (page & (PAGE_TA | PAGE_HOST)) | (entry & ~(PAGE_TA | PAGE_ZERO));
+      if (CasPte(pslot, entry, x)) {
+        STATISTIC(++g_stats.zero_page_copies);
+        m->system->memstat.committed += 1;
+        m->system->memstat.reserved -= 1;
+        // other threads may still have the zero page in their tlb
+        if (m->threaded || !(entry & PAGE_XD)) {
+          InvalidateSystem(m->system, m->threaded, !(entry & PAGE_XD));
+        }
+        entry = x;
+      } else {
+        FreeAnonymousPage(m->system, (u8 *)(uintptr_t)(page & PAGE_TA));
+        entry = LoadPte(pslot);
+        m->system->rss -= 1;
+      }
+    } else if (entry & (PAGE_HOST | PAGE_MAP | PAGE_MUG)) {
       // a file-mapped page is being accessed for the first time
       unassert((entry & (PAGE_HOST | PAGE_MAP)) == (PAGE_HOST | PAGE_MAP));
       x = entry & ~PAGE_RSRV;
@@ -90,6 +112,16 @@ u64 HandlePageFault(struct Machine *m, u8 *pslot, u64 entry) {
       } else {
         entry = LoadPte(pslot);
       }
+    } else if (reading && (page = AllocateZeroPage()) != -1) {
+      // an anonymous page is being read for the first time, so we can
+      // defer allocating memory for it until the guest stores to it
+      x = page | (entry & ~(PAGE_TA | PAGE_RSRV));
+      if (CasPte(pslot, entry, x)) {
+        STATISTIC(++g_stats.zero_page_maps);
+        entry = x;
+      } else {
+        entry = LoadPte(pslot);
+      }
     } else {
       // an anonymous page is being accessed for the first time
       if ((page = AllocateAnonymousPage(m->system)) == -1) {
@@ -108,7 +140,7 @@ u64 HandlePageFault(struct Machine *m, u8 *pslot, u64 entry) {
         m->system->rss -= 1;
       }
     }
-  } while (entry & PAGE_RSRV);
+  } while ((entry & PAGE_RSRV) || (!reading && (entry & PAGE_ZERO)));
   return entry;
 }
 
@@ -145,7 +177,7 @@ static bool RecordPageLock(struct Machine *m, i64 page, u8 *pslot) {
   m->pagelocks.p[m->pagelocks.i].pslot = pslot;
   m->pagelocks.p[m->pagelocks.i].sysdepth = m->sysdepth;
   ++m->pagelocks.i;
-  STATISTIC(++page_locks);
+  STATISTIC(++g_stats.page_locks);
   return true;
 }
 
@@ -174,11 +206,13 @@ void CollectPageLocks(struct Machine *m) {
 }
 
 // returns page directory entry associated with virtual address
+// @param reading is true if caller promises to not store to page,
+//     which lets untouched anonymous memory share the zero page
 // @return raw page directory entry contents, or zero w/ errno
 // @raise EFAULT if a valid 4096 page didn't exist at address
 // @raise ENOMEM if memory couldn't be allocated internally
 // @raise EAGAIN if too many locks are held on a page
-u64 FindPageTableEntry(struct Machine *m, u64 page) {
+u64 FindPageTableEntry(struct Machine *m, u64 page, bool reading) {
   u8 *pslot;
   i64 table;
   u64 entry;
@@ -190,11 +224,12 @@ u64 FindPageTableEntry(struct Machine *m, u64 page) {
   }
   tlbkey = (page >> 12) & (ARRAYLEN(m->tlb) - 1);
   if (LIKELY(m->tlb[tlbkey].page == page &&
-             ((entry = m->tlb[tlbkey].entry) & PAGE_V))) {
-    STATISTIC(++tlb_hits);
+             ((entry = m->tlb[tlbkey].entry) & PAGE_V) &&
+             (reading || !(entry & PAGE_ZERO)))) {
+    STATISTIC(++g_stats.tlb_hits);
     return entry;
   }
-  STATISTIC(++tlb_misses);
+  STATISTIC(++g_stats.tlb_misses);
   unassert(!(page & 4095));
   if (!(-0x800000000000 <= (i64)page && (i64)page < 0x800000000000)) {
     m->segvcode = SEGV_MAPERR_LINUX;
@@ -212,7 +247,7 @@ TryAgain:
     if (!(entry & PAGE_V)) goto MapError;
     if (m->metal) {
       entry &= ~(u64)(PAGE_RSRV | PAGE_HOST | PAGE_MAP | PAGE_GROW | PAGE_MUG |
-                      PAGE_FILE);
+                      PAGE_FILE | PAGE_ZERO);
     }
     if ((entry & PAGE_PS) && level > 12) {
       // huge (1 GiB or 2 MiB) page; "rewrite" the TLB copy of the page table
@@ -226,7 +261,8 @@ TryAgain:
       break;
     }
   } while ((level -= 9) >= 12);
-  if ((entry & PAGE_RSRV) && !(entry = HandlePageFault(m, pslot, entry))) {
+  if (((entry & PAGE_RSRV) || (!reading && (entry & PAGE_ZERO))) &&
+      !(entry = HandlePageFault(m, pslot, entry, reading))) {
     return 0;
   }
   // system calls lock the pages they access
@@ -260,12 +296,13 @@ MapError:
   return (uintptr_t)efault0();
 }
 
-u8 *LookupAddress2(struct Machine *m, i64 virt, u64 mask, u64 need) {
+static u8 *LookupAddress3(struct Machine *m, i64 virt, u64 mask, u64 need,
+                          bool reading) {
   u8 *host;
   u64 entry;
   if (!m->metal || m->mode.omode == XED_MODE_LONG ||
       (m->mode.genmode != XED_GEN_MODE_REAL && (m->system->cr0 & CR0_PG))) {
-    if (!(entry = FindPageTableEntry(m, virt & -4096))) {
+    if (!(entry = FindPageTableEntry(m, virt & -4096, reading))) {
       return 0;
     }
   } else if (virt >= 0 && virt <= 0xffffffff &&
@@ -295,10 +332,22 @@ u8 *LookupAddress2(struct Machine *m, i64 virt, u64 mask, u64 need) {
   }
 }
 
+// translates virtual address into pointer for loads if PAGE_RW isn't
+// in need, otherwise the returned memory is fit for loads and stores
+u8 *LookupAddress2(struct Machine *m, i64 virt, u64 mask, u64 need) {
+  return LookupAddress3(m, virt, mask, need, !(need & PAGE_RW));
+}
+
 u8 *LookupAddress(struct Machine *m, i64 virt) {
   u64 need = 0;
   if (Cpl(m) == 3) need = PAGE_U;
-  return LookupAddress2(m, virt, need, need);
+  return LookupAddress3(m, virt, need, need, false);
+}
+
+static u8 *LookupAddressRead(struct Machine *m, i64 virt) {
+  u64 need = 0;
+  if (Cpl(m) == 3) need = PAGE_U;
+  return LookupAddress3(m, virt, need, need, true);
 }
 
 flattencalls u8 *GetAddress(struct Machine *m, i64 v) {
@@ -332,6 +381,13 @@ u8 *ResolveAddress(struct Machine *m, i64 v) {
   ThrowSegmentationFault(m, v);
 }
 
+static u8 *ResolveAddressRead(struct Machine *m, i64 v) {
+  u8 *r;
+  if (HasLinearMapping()) return ToHost(v);
+  if ((r = LookupAddressRead(m, v))) return r;
+  ThrowSegmentationFault(m, v);
+}
+
 bool IsValidMemory(struct Machine *m, i64 virt, i64 size, int prot) {
   i64 p, pe;
   u64 pte, mask, need;
@@ -356,7 +412,7 @@ bool IsValidMemory(struct Machine *m, i64 virt, i64 size, int prot) {
     return false;
   }
   for (p = virt; p < pe; p += 4096) {
-    if (!(pte = FindPageTableEntry(m, p))) {
+    if (!(pte = FindPageTableEntry(m, p, !(prot & PROT_WRITE)))) {
       return false;
     }
     if ((pte & mask) != need) {
@@ -373,7 +429,7 @@ int VirtualCopy(struct Machine *m, i64 v, char *r, u64 n, bool d) {
   k = 4096 - (v & 4095);
   while (n) {
     k = MIN(k, n);
-    if (!(p = LookupAddress(m, v))) return -1;
+    if (!(p = d ? LookupAddressRead(m, v) : LookupAddress(m, v))) return -1;
     if (d) {
       memcpy(r, p, k);
     } else if (!IsRomAddress(m, p)) {
@@ -456,7 +512,7 @@ u8 *ReserveAddress(struct Machine *m, i64 v, size_t n, bool writable) {
       ThrowSegmentationFault(m, v);
     }
   }
-  STATISTIC(++page_overlaps);
+  STATISTIC(++g_stats.page_overlaps);
   unassert(n <= 4096);
   m->stashaddr = v;
   m->opcache->stashsize = n;
@@ -482,19 +538,21 @@ static u8 *AccessRam2(struct Machine *m, i64 v, size_t n, void *p[2], u8 *tmp,
                       bool copy, bool protect_rom) {
   u8 *a, *b;
   unsigned k;
+  u8 *(*resolve)(struct Machine *, i64);
   unassert(n <= 4096);
+  resolve = copy ? ResolveAddressRead : ResolveAddress;
   if ((v & 4095) + n <= 4096) {
-    a = ResolveAddress(m, v);
+    a = resolve(m, v);
     if (!protect_rom || !IsRomAddress(m, a)) return a;
     if (copy) memcpy(tmp, a, n);
     return tmp;
   }
-  STATISTIC(++page_overlaps);
+  STATISTIC(++g_stats.page_overlaps);
   k = 4096;
   k -= v & 4095;
   unassert(k <= 4096);
-  a = ResolveAddress(m, v);
-  b = ResolveAddress(m, v + k);
+  a = resolve(m, v);
+  b = resolve(m, v + k);
   if (copy) {
     memcpy(tmp, a, k);
     memcpy(tmp + k, b, n - k);
@@ -563,7 +621,7 @@ void *AddToFreeList(struct Machine *m, void *mem) {
   p = m->freelist.p;
   n = m->freelist.n + 1;
   if ((p = realloc(p, n * sizeof(*m->freelist.p)))) {
-    STATISTIC(++freelisted);
+    STATISTIC(++g_stats.freelisted);
     m->freelist.p = (void **)p;
     m->freelist.n = n;
     m->freelist.p[n - 1] = mem;
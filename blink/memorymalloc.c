@@ -30,13 +30,19 @@
 #include "blink/errno.h"
 #include "blink/fds.h"
 #include "blink/jit.h"
+#include "blink/jitpool.h"
+#include "blink/linkcache.h"
 #include "blink/linux.h"
 #include "blink/log.h"
 #include "blink/machine.h"
 #include "blink/macros.h"
 #include "blink/map.h"
 #include "blink/pml4t.h"
+#include "blink/prefetch.h"
 #include "blink/random.h"
+#include "blink/stats.h"
+#include "blink/syscall.h"
+#include "blink/systrace.h"
 #include "blink/thread.h"
 #include "blink/timespec.h"
 #include "blink/types.h"
@@ -50,6 +56,13 @@ struct Allocator {
     PTHREAD_MUTEX_INITIALIZER_,
 };
 
+struct ZeroPage {
+  pthread_once_t_ once;
+  u8 *page;
+} g_zeropage = {
+    PTHREAD_ONCE_INIT_,
+};
+
 struct Machine g_bssmachine;
 
 static void FillPage(void *p, int c) {
@@ -254,6 +267,7 @@ static void FreeMachineUnlocked(struct Machine *m) {
   CollectGarbage(m, 0);
   free(m->pagelocks.p);
   free(m->freelist.p);
+  free(m->iovcache.p);
   free(m);
   if (g_machine == m) {
     g_machine = 0;
@@ -282,6 +296,8 @@ void KillOtherThreads(struct System *s) {
   struct timespec deadline;
   if (atomic_exchange(&s->killer, true)) {
     FreeMachine(g_machine);
+    UnregisterSysTrace();
+    UnregisterStats();
     pthread_exit(0);
   }
 StartOver:
@@ -334,6 +350,8 @@ void RemoveOtherThreads(struct System *s) {
 void FreeSystem(struct System *s) {
   THR_LOGF("pid=%d FreeSystem", s->pid);
   unassert(dll_is_empty(s->machines));  // Use KillOtherThreads & FreeMachine
+  SavePrefetchProfile(s);
+  FreeLinkCache(s);
   FreeHostPages(s);
   unassert(!pthread_mutex_destroy(&s->machines_lock));
   unassert(!pthread_cond_destroy(&s->machines_cond));
@@ -369,6 +387,7 @@ struct Machine *NewMachine(struct System *system, struct Machine *parent) {
     memcpy(m, parent, sizeof(*m));
     memset(&m->path, 0, sizeof(m->path));
     memset(&m->freelist, 0, sizeof(m->freelist));
+    memset(&m->iovcache, 0, sizeof(m->iovcache));
     memset(&m->pagelocks, 0, sizeof(m->pagelocks));
     ResetInstructionCache(m);
     m->insyscall = false;
@@ -464,6 +483,24 @@ Finished:
   return real | PAGE_HOST | PAGE_U | PAGE_RW | PAGE_V;
 }
 
+static void InitZeroPage(void) {
+  // this page is shared by every untouched anonymous page that the
+  // guest has only read so far. it's made read-only on the host so a
+  // store which failed to break sharing crashes rather than corrupts
+  g_zeropage.page = (u8 *)AllocateBig(FLAG_pagesize, PROT_READ,
+                                      MAP_ANONYMOUS_ | MAP_PRIVATE, -1, 0);
+}
+
+// returns page table entry bits for the shared zero page, or -1
+u64 AllocateZeroPage(void) {
+  uintptr_t real;
+  unassert(!pthread_once_(&g_zeropage.once, InitZeroPage));
+  if (!g_zeropage.page) return -1;
+  real = (uintptr_t)g_zeropage.page;
+  unassert(!(real & ~PAGE_TA));
+  return real | PAGE_ZERO | PAGE_HOST;
+}
+
 u64 AllocatePageTable(struct System *s) {
   u64 res;
   if ((res = AllocateAnonymousPage(s)) != -1) {
@@ -620,7 +657,12 @@ static bool FreePage(struct System *s, i64 virt, u64 entry, u64 size,
     }
 #endif
   }
-  if ((entry & (PAGE_HOST | PAGE_MAP | PAGE_MUG)) == PAGE_HOST) {
+  if (entry & PAGE_ZERO) {
+    // the shared zero page is never freed
+    unassert(~entry & PAGE_RSRV);
+    s->memstat.reserved -= 1;
+    return false;
+  } else if ((entry & (PAGE_HOST | PAGE_MAP | PAGE_MUG)) == PAGE_HOST) {
     unassert(~entry & PAGE_RSRV);
     s->memstat.committed -= 1;
     ClearPage((page = (u8 *)(uintptr_t)(entry & PAGE_TA)));
@@ -687,6 +729,7 @@ static void RemoveVirtual(struct System *s, i64 virt, i64 size,
   unsigned pi, p1;
   unassert(!(virt & 4095));
   MEM_LOGF("RemoveVirtual(%#" PRIx64 ", %#" PRIx64 ")", virt, size);
+  CancelIoUringMemory(virt, size, 0);
   for (pde = 0, end = virt + size; virt < end; virt += (u64)1 << i) {
     for (pt = s->cr3, i = 39;; i -= 9) {
       pi = p1 = (virt >> i) & 511;
@@ -775,16 +818,18 @@ static int DetermineHostProtection(int prot) {
 
 i64 ReserveVirtual(struct System *s, i64 virt, i64 size, u64 flags, int fd,
                    i64 offset, bool shared, bool fixedmap) {
-  u8 *mi;
+  u8 *mi, *bulk;
   int demand;
   int method;
   i64 result;
+  int bulkflags;
+  long bulksize;
   bool mutated;
   void *got, *want;
   long i, pagesize;
   int prot, sysprot;
   long vss_delta, rss_delta;
-  i64 ti, pt, end, pages, level, entry;
+  i64 ti, pt, end, pages, level, entry, fileoff;
   bool executable_code_was_made_non_executable;
   struct ContiguousMemoryRanges ranges;
 
@@ -814,6 +859,7 @@ i64 ReserveVirtual(struct System *s, i64 virt, i64 size, u64 flags, int fd,
   }
 
   pagesize = FLAG_pagesize;
+  fileoff = offset;
 
   if (HasLinearMapping()) {
     if (virt & (pagesize - 1)) {
@@ -927,6 +973,28 @@ i64 ReserveVirtual(struct System *s, i64 virt, i64 size, u64 flags, int fd,
     AddFileMapViaMap(s, virt, size, fd, offset);
   }
 
+  // when host pages are the same size as guest pages, the interval can
+  // be mugged using one host mapping rather than one mmap() per page.
+  // the host kernel's page cache already shares file pages between all
+  // the processes mapping them, copying them only when they're stored,
+  // so this mostly saves system calls and host vmas on each load. its
+  // pages may still be unmapped or protected individually later on.
+  bulk = 0;
+  if ((flags & PAGE_MUG) && pagesize == 4096) {
+    bulksize = ROUNDUP(size, 4096);
+    bulkflags = (shared ? MAP_SHARED : MAP_PRIVATE) |
+                (fd == -1 ? MAP_ANONYMOUS_ : 0);
+    if (!(bulk = (u8 *)AllocateBig(bulksize, sysprot, bulkflags, fd,
+                                   fd != -1 ? offset : 0))) {
+      ERRF("mmap(virt=%" PRIx64 ", size=%ld, flags=%#x, fd=%d, offset=%#" PRIx64
+           ") crisis: %s",
+           virt, bulksize, bulkflags, fd, (u64)offset,
+           DescribeHostErrno(errno));
+      PanicDueToMmap();
+    }
+    STATISTIC(++g_stats.mug_bulk_maps);
+  }
+
   // add pml4t entries ensuring intermediary tables exist
   for (result = virt, end = virt + size;;) {
     for (pt = s->cr3, level = 39; level >= 12; level -= 9) {
@@ -946,7 +1014,9 @@ i64 ReserveVirtual(struct System *s, i64 virt, i64 size, u64 flags, int fd,
       for (;;) {
         uintptr_t real;
         if (flags & PAGE_MAP) {
-          if (flags & PAGE_MUG) {
+          if (bulk) {
+            real = (uintptr_t)bulk + (virt - result);
+          } else if (flags & PAGE_MUG) {
             void *mug;
             off_t mugoff;
             int mugflags;
@@ -1005,6 +1075,11 @@ i64 ReserveVirtual(struct System *s, i64 virt, i64 size, u64 flags, int fd,
 #endif
           InvalidateSystem(s, !!rss_delta,
                            executable_code_was_made_non_executable);
+#ifdef HAVE_JIT
+          if (fd != -1 && !(flags & (PAGE_RW | PAGE_XD))) {
+            ReuseJit(s, result, size, fd, fileoff);
+          }
+#endif
           return result;
         }
         if (++ti == 512) break;
@@ -1078,6 +1153,87 @@ int FreeVirtual(struct System *s, i64 virt, i64 size) {
   return rc;
 }
 
+static void FindWritableRanges(struct System *s,
+                               struct ContiguousMemoryRanges *ranges,
+                               i64 addr, unsigned level, u64 pt) {
+  u8 *mi;
+  u64 entry;
+  i64 i, page;
+  mi = GetPageAddress(s, pt, level == 39);
+  for (i = 0; i < 512; ++i) {
+    entry = LoadPte(mi + i * 8);
+    if (!(entry & PAGE_V)) continue;
+    page = (i64)((u64)(addr | i << level) << 16) >> 16;
+    if (level > 12) {
+      FindWritableRanges(s, ranges, page, level - 9, entry);
+    } else if ((entry & (PAGE_RW | PAGE_HOST | PAGE_MAP | PAGE_MUG)) ==
+               (PAGE_RW | PAGE_HOST | PAGE_MAP)) {
+      AddPageToRanges(ranges, page, page + 4096);
+    }
+  }
+}
+
+// Changes whether or not host fork() copies writable guest memory.
+//
+// A vfork() child that's about to call execve() or _exit() won't ever
+// touch guest memory again, so it's a waste for the kernel to copy the
+// page tables of a big heap and then make the parent fault on writes.
+// Only linear memory can be left behind, since blink reads and clears
+// its own anonymous pages when it frees them. Read-only pages are kept
+// for the child, because execve() looks at them for jit translations.
+// The child needs to call ReserveUnforkedMemory() right after fork().
+void SetMemoryForkable(struct System *s, bool forkable) {
+#ifdef MADV_DONTFORK
+  long i;
+  i64 a, b, pagesize;
+  struct ContiguousMemoryRanges ranges;
+  if (!HasLinearMapping() || !s->cr3) return;
+  memset(&ranges, 0, sizeof(ranges));
+  FindWritableRanges(s, &ranges, 0, 39, s->cr3);
+  pagesize = FLAG_pagesize;
+  for (i = 0; i < ranges.i; ++i) {
+    a = ROUNDUP(ranges.p[i].a, pagesize);
+    b = ROUNDDOWN(ranges.p[i].b, pagesize);
+    if (a < b &&
+        madvise(ToHost(a), b - a, forkable ? MADV_DOFORK : MADV_DONTFORK)) {
+      LOGF("madvise(%#" PRIx64 ", %#" PRIx64 ", %s) failed: %s", a, b - a,
+           forkable ? "MADV_DOFORK" : "MADV_DONTFORK",
+           DescribeHostErrno(errno));
+    }
+  }
+  free(ranges.p);
+#endif
+}
+
+// Fills the holes that SetMemoryForkable(false) left in a forked child.
+//
+// The page table still says the guest owns these addresses, which is
+// how execve() knows to unmap them later, so an empty mapping must go
+// there in the meantime, otherwise the host could hand them out again
+// to malloc() and then have them pulled out from under it.
+void ReserveUnforkedMemory(struct System *s) {
+#ifdef MADV_DONTFORK
+  long i;
+  i64 a, b, pagesize;
+  struct ContiguousMemoryRanges ranges;
+  if (!HasLinearMapping() || !s->cr3) return;
+  memset(&ranges, 0, sizeof(ranges));
+  FindWritableRanges(s, &ranges, 0, 39, s->cr3);
+  pagesize = FLAG_pagesize;
+  for (i = 0; i < ranges.i; ++i) {
+    a = ROUNDUP(ranges.p[i].a, pagesize);
+    b = ROUNDDOWN(ranges.p[i].b, pagesize);
+    if (a < b && Mmap(ToHost(a), b - a, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS_ | MAP_FIXED, -1, 0,
+                      "unforked") == MAP_FAILED) {
+      LOGF("failed to reserve unforked memory at %#" PRIx64 ": %s", a,
+           DescribeHostErrno(errno));
+    }
+  }
+  free(ranges.p);
+#endif
+}
+
 int GetProtection(u64 key) {
   int prot = 0;
   if (key & PAGE_U) prot |= PROT_READ;
@@ -1164,6 +1320,9 @@ int ProtectVirtual(struct System *s, i64 virt, i64 size, int prot,
          virt, size);
     return enomem();
   }
+  if (!hostonly) {
+    CancelIoUringMemory(virt, size, prot);
+  }
   key = SetProtection(prot);
   sysprot = DetermineHostProtection(prot);
   // in linear mode, the guest might try to do something like
@@ -1368,7 +1527,8 @@ static i64 FindGuestAddr(struct System *s, uintptr_t hp, u64 pt, long lvl,
     for (i = 0; i < 512; ++i) {
       if ((pte = LoadPte(mi + i * 8)) & PAGE_V) {
         if (lvl == 4) {
-          if ((pte & PAGE_HOST) && (pte & PAGE_TA) == hp) {
+          if ((pte & (PAGE_HOST | PAGE_ZERO)) == PAGE_HOST &&
+              (pte & PAGE_TA) == hp) {
             if (out_pte) {
               *out_pte = pte;
             }
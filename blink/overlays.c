@@ -34,13 +34,31 @@
 #include "blink/log.h"
 #include "blink/syscall.h"
 #include "blink/thompike.h"
+#include "blink/thread.h"
+#include "blink/timespec.h"
+#include "blink/tunables.h"
 #include "blink/util.h"
 
 #ifndef DISABLE_OVERLAYS
 
 #define UNREACHABLE "(unreachable)"
 
+// how an operation resolves its path, when it doesn't create names
+#define FOLLOW   1
+#define NOFOLLOW 2
+
+struct OverlaysLookup {
+  char *path;
+  int how;
+  int layer;  // first overlay where path was found, or -1 if none
+  struct timespec expires;
+};
+
 static char **g_overlays;
+static int *g_overlayfds;  // root directory of each overlay, opened once
+static int g_fragile;      // lookups which new names could make wrong
+static pthread_mutex_t_ g_lookups_lock = PTHREAD_MUTEX_INITIALIZER_;
+static struct OverlaysLookup g_lookups[kOverlayMemo];
 
 static void FreeStrings(char **ss) {
   size_t i;
@@ -75,10 +93,75 @@ static char **SplitString(const char *s, int c) {
 }
 
 static void FreeOverlays(void) {
+  size_t i;
+  OverlaysFlushLookups();
+  if (g_overlayfds) {
+    for (i = 0; g_overlays[i]; ++i) {
+      if (g_overlayfds[i] >= 0) {
+        unassert(!close(g_overlayfds[i]));
+      }
+    }
+    free(g_overlayfds);
+    g_overlayfds = 0;
+  }
   FreeStrings(g_overlays);
   g_overlays = 0;
 }
 
+static void OverlaysBeforeFork(void) {
+  LOCK(&g_lookups_lock);
+}
+
+static void OverlaysAfterFork(void) {
+  UNLOCK(&g_lookups_lock);
+}
+
+// if we get these failures when opening a dirfd of a user supplied
+// overlay path, then it's definitely not a user error, and therefore
+// not safe to continue.
+static bool IsUnrecoverableErrno(void) {
+  return errno == EINTR || errno == EMFILE || errno == ENFILE;
+}
+
+// opens the root directory of each overlay, so that paths can be looked
+// up relative to them without reopening them for every system call.
+static int *OpenOverlays(char **paths) {
+  int fd, *fds;
+  size_t i, n;
+  for (n = 0; paths[n]; ++n) {
+  }
+  if (!(fds = (int *)malloc(n * sizeof(*fds)))) {
+    return 0;
+  }
+  for (i = 0; i < n; ++i) {
+    if (!*paths[i]) {
+      fds[i] = AT_FDCWD;
+    } else if ((fd = open(paths[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0)) ==
+               -1) {
+      if (IsUnrecoverableErrno()) {
+        goto Failure;
+      }
+      LOGF("bad overlay %s: %s", paths[i], DescribeHostErrno(errno));
+      fds[i] = -1;
+    } else {
+      fds[i] = fcntl(fd, F_DUPFD_CLOEXEC, kMinBlinkFd);
+      unassert(!close(fd));
+      if (fds[i] == -1) {
+        goto Failure;
+      }
+    }
+  }
+  return fds;
+Failure:
+  while (i--) {
+    if (fds[i] >= 0) {
+      unassert(!close(fds[i]));
+    }
+  }
+  free(fds);
+  return 0;
+}
+
 // if the user only specified a single overlay, then we treat it as
 // chroot would unless of course the specified root is the real one
 static bool IsRestrictedRoot(char **paths) {
@@ -86,6 +169,7 @@ static bool IsRestrictedRoot(char **paths) {
 }
 
 int SetOverlays(const char *config, bool cd_into_chroot) {
+  int *fds;
   size_t i, j;
   static int once;
   bool has_real_root;
@@ -137,22 +221,126 @@ int SetOverlays(const char *config, bool cd_into_chroot) {
       return -1;
     }
   }
+  if (!(fds = OpenOverlays(paths))) {
+    FreeStrings(paths);
+    return -1;
+  }
   if (!once) {
     atexit(FreeOverlays);
+    unassert(!pthread_atfork(OverlaysBeforeFork,  //
+                             OverlaysAfterFork,   //
+                             OverlaysAfterFork));
     once = 1;
   }
   FreeOverlays();
   g_overlays = paths;
+  g_overlayfds = fds;
   return 0;
 }
 
-// if we get these failures when opening a temporary dirfd of a user
-// supplied overlay path, then it's definitely not a user error, and
-// therefore not safe to continue.
-static bool IsUnrecoverableErrno(void) {
-  return errno == EINTR || errno == EMFILE || errno == ENFILE;
+// returns directory that absolute paths are resolved from in overlay `i`
+static int GetOverlayDirfd(size_t i) {
+  return g_overlayfds[i];
+}
+
+// returns what absolute `path` is called relative to overlay `i`
+static const char *GetOverlayPath(size_t i, const char *path) {
+  if (!*g_overlays[i]) return path;
+  return !path[1] ? "." : path + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// which overlay each path was found in is remembered, so that paths in
+// the lower layers don't cost a failed system call for every layer above
+// them, and paths that don't exist anywhere cost nothing. if a path gets
+// removed, then the next operation fails in the overlay we remembered,
+// and we go back to searching them all. creating a path could make what
+// we remember wrong, unless the path was found in the topmost overlay,
+// so those are the only entries that survive blink creating a new name.
+// changes made by other processes are noticed once the entries expire.
+
+static u64 HashLookup(const char *path, int how) {
+  u64 hash = how;
+  while (*path) {
+    hash = (hash ^ (unsigned char)*path++) * 0x100000001b3;
+  }
+  return hash;
+}
+
+static bool IsRememberingLookups(void) {
+  return kDentryTtlMs && g_overlays[1];
+}
+
+static void DropLookup(struct OverlaysLookup *l) {
+  if (l->layer) --g_fragile;
+  free(l->path);
+  l->path = 0;
 }
 
+// returns overlay where `path` was found before, -1 if it wasn't found
+// in any of them, or -2 if we don't know
+static int RecallLookup(const char *path, int how) {
+  int layer;
+  struct OverlaysLookup *l;
+  if (!IsRememberingLookups()) return -2;
+  layer = -2;
+  l = g_lookups + (HashLookup(path, how) & (kOverlayMemo - 1));
+  LOCK(&g_lookups_lock);
+  if (l->path && l->how == how && !strcmp(l->path, path)) {
+    if (CompareTime(GetMonotonic(), l->expires) < 0) {
+      layer = l->layer;
+    } else {
+      DropLookup(l);
+    }
+  }
+  UNLOCK(&g_lookups_lock);
+  return layer;
+}
+
+static void RememberLookup(const char *path, int how, int layer) {
+  char *copy;
+  struct OverlaysLookup *l;
+  if (!IsRememberingLookups()) return;
+  if (!(copy = strdup(path))) return;
+  l = g_lookups + (HashLookup(path, how) & (kOverlayMemo - 1));
+  LOCK(&g_lookups_lock);
+  if (l->path) DropLookup(l);
+  l->path = copy;
+  l->how = how;
+  l->layer = layer;
+  l->expires = AddTime(GetMonotonic(), FromMilliseconds(kDentryTtlMs));
+  if (layer) ++g_fragile;
+  UNLOCK(&g_lookups_lock);
+}
+
+// forgets lookups which could be wrong now that a name was created
+static void OverlaysCreated(void) {
+  int i, err;
+  if (!IsRememberingLookups()) return;
+  err = errno;
+  LOCK(&g_lookups_lock);
+  for (i = 0; g_fragile && i < kOverlayMemo; ++i) {
+    if (g_lookups[i].path && g_lookups[i].layer) {
+      DropLookup(g_lookups + i);
+    }
+  }
+  UNLOCK(&g_lookups_lock);
+  errno = err;
+}
+
+void OverlaysFlushLookups(void) {
+  int i;
+  LOCK(&g_lookups_lock);
+  for (i = 0; i < kOverlayMemo; ++i) {
+    if (g_lookups[i].path) {
+      DropLookup(g_lookups + i);
+    }
+  }
+  UNLOCK(&g_lookups_lock);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 char *OverlaysGetcwd(char *output, size_t size) {
   size_t n, m;
   char *cwd, buf[PATH_MAX];
@@ -206,108 +394,90 @@ int OverlaysChdir(const char *path) {
   return Chdir(path);
 }
 
-int OverlaysOpen(int dirfd, const char *path, int flags, int mode) {
-  int fd;
-  size_t i;
-  int err = -1;
-  if (!path) return efault();
-  if (!*path) return enoent();
-  if (path[0] != '/' && path[0]) {
-    return openat(dirfd, path, flags, mode);
-  }
-  for (i = 0; g_overlays[i]; ++i) {
-    if (!*g_overlays[i]) {
-      if ((fd = open(path, flags, mode)) != -1) {
-        return fd;
-      }
-      if (errno != ENOENT && errno != ENOTDIR) {
-        return -1;
-      }
-      if (err == -1) {
-        err = errno;
-      }
-    } else {
-      dirfd = open(g_overlays[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0);
-      if (dirfd == -1) {
-        if (IsUnrecoverableErrno()) {
-          return -1;
-        } else {
-          LOGF("bad overlay %s: %s", g_overlays[i], DescribeHostErrno(errno));
-          continue;
-        }
-      }
-      if ((fd = openat(dirfd, !path[1] ? "." : path + 1, flags, mode)) != -1) {
-        unassert(dup2(fd, dirfd) == dirfd);
-        if (flags & O_CLOEXEC) {
-          unassert(!fcntl(dirfd, F_SETFD, FD_CLOEXEC));
-        }
-        unassert(!close(fd));
-        return dirfd;
-      }
-      if (err == -1) {
-        err = errno;
-      }
-      unassert(!close(dirfd));
-      if (errno != ENOENT && errno != ENOTDIR) {
-        return -1;
-      }
-    }
-  }
-  unassert(err != -1);
-  errno = err;
-  return -1;
-}
-
 static ssize_t OverlaysGeneric(int dirfd, const char *path, void *args,
-                               ssize_t fgenericat(int, const char *, void *)) {
+                               ssize_t fgenericat(int, const char *, void *),
+                               int how) {
   _Static_assert(sizeof(ssize_t) >= sizeof(int), "");
   size_t i;
   ssize_t rc;
   int err = -1;
+  int layer;
+  bool absent;
   if (!path) return efault();
   if (!*path) return enoent();
   if (path[0] != '/' && path[0]) {
     return fgenericat(dirfd, path, args);
   }
+  if (how && (layer = RecallLookup(path, how)) != -2) {
+    if (layer == -1) {
+      return enoent();
+    }
+    if ((rc = fgenericat(GetOverlayDirfd(layer), GetOverlayPath(layer, path),
+                         args)) != -1) {
+      return rc;
+    }
+    if (errno != ENOENT && errno != ENOTDIR) {
+      return -1;
+    }
+  }
+  absent = true;
   for (i = 0; g_overlays[i]; ++i) {
-    if (!*g_overlays[i]) {
-      if ((rc = fgenericat(AT_FDCWD, path, args)) != -1) {
-        return rc;
-      }
-      if (err == -1) {
-        err = errno;
-      }
-      if (err != ENOENT && err != ENOTDIR) {
-        return -1;
-      }
-    } else {
-      dirfd = open(g_overlays[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0);
-      if (dirfd == -1) {
-        if (IsUnrecoverableErrno()) {
-          return -1;
-        } else {
-          LOGF("bad overlay %s: %s", g_overlays[i], DescribeHostErrno(errno));
-          continue;
-        }
-      }
-      if ((rc = fgenericat(dirfd, !path[1] ? "." : path + 1, args)) != -1) {
-        unassert(!close(dirfd));
-        return rc;
-      }
-      if (err == -1) {
-        err = errno;
-      }
-      unassert(!close(dirfd));
-      if (errno != ENOENT && errno != ENOTDIR) {
-        return -1;
+    if (GetOverlayDirfd(i) == -1) {
+      continue;
+    }
+    if ((rc = fgenericat(GetOverlayDirfd(i), GetOverlayPath(i, path), args)) !=
+        -1) {
+      if (how && absent) {
+        RememberLookup(path, how, i);
       }
+      return rc;
+    }
+    if (err == -1) {
+      err = errno;
+    }
+    if (errno != ENOENT && errno != ENOTDIR) {
+      return -1;
+    }
+    if (errno != ENOENT) {
+      absent = false;
     }
   }
+  if (how && absent) {
+    RememberLookup(path, how, -1);
+  }
   unassert(err != -1);
   errno = err;
   return -1;
 }
 
+static int GetHow(int flags) {
+  return flags & AT_SYMLINK_NOFOLLOW ? NOFOLLOW : FOLLOW;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+struct Open {
+  int flags;
+  int mode;
+};
+
+static ssize_t Open(int dirfd, const char *path, void *vargs) {
+  struct Open *args = (struct Open *)vargs;
+  return openat(dirfd, path, args->flags, args->mode);
+}
+
+int OverlaysOpen(int dirfd, const char *path, int flags, int mode) {
+  int rc;
+  struct Open args = {flags, mode};
+  if (!(flags & O_CREAT)) {
+    return OverlaysGeneric(dirfd, path, &args, Open,
+                           flags & O_NOFOLLOW ? NOFOLLOW : FOLLOW);
+  }
+  rc = OverlaysGeneric(dirfd, path, &args, Open, 0);
+  OverlaysCreated();
+  return rc;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 struct Stat {
@@ -322,9 +492,30 @@ static ssize_t Stat(int dirfd, const char *path, void *vargs) {
 
 int OverlaysStat(int dirfd, const char *path, struct stat *st, int flags) {
   struct Stat args = {st, flags};
-  return OverlaysGeneric(dirfd, path, &args, Stat);
+  return OverlaysGeneric(dirfd, path, &args, Stat, GetHow(flags));
+}
+
+#ifdef HAVE_STATX
+
+struct Statx {
+  int flags;
+  unsigned mask;
+  struct statx *stx;
+};
+
+static ssize_t Statx(int dirfd, const char *path, void *vargs) {
+  struct Statx *args = (struct Statx *)vargs;
+  return statx(dirfd, path, args->flags, args->mask, args->stx);
 }
 
+int OverlaysStatx(int dirfd, const char *path, int flags, unsigned mask,
+                  struct statx *stx) {
+  struct Statx args = {flags, mask, stx};
+  return OverlaysGeneric(dirfd, path, &args, Statx, GetHow(flags));
+}
+
+#endif /* HAVE_STATX */
+
 ////////////////////////////////////////////////////////////////////////////////
 
 struct Access {
@@ -339,7 +530,7 @@ static ssize_t Access(int dirfd, const char *path, void *vargs) {
 
 int OverlaysAccess(int dirfd, const char *path, mode_t mode, int flags) {
   struct Access args = {mode, flags};
-  return OverlaysGeneric(dirfd, path, &args, Access);
+  return OverlaysGeneric(dirfd, path, &args, Access, GetHow(flags));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -355,7 +546,7 @@ static ssize_t Unlink(int dirfd, const char *path, void *vargs) {
 
 int OverlaysUnlink(int dirfd, const char *path, int flags) {
   struct Unlink args = {flags};
-  return OverlaysGeneric(dirfd, path, &args, Unlink);
+  return OverlaysGeneric(dirfd, path, &args, Unlink, NOFOLLOW);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -371,7 +562,9 @@ static ssize_t Mkdir(int dirfd, const char *path, void *vargs) {
 
 int OverlaysMkdir(int dirfd, const char *path, mode_t mode) {
   struct Mkdir args = {mode};
-  return OverlaysGeneric(dirfd, path, &args, Mkdir);
+  int rc = OverlaysGeneric(dirfd, path, &args, Mkdir, 0);
+  OverlaysCreated();
+  return rc;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -387,7 +580,9 @@ static ssize_t Mkfifo(int dirfd, const char *path, void *vargs) {
 
 int OverlaysMkfifo(int dirfd, const char *path, mode_t mode) {
   struct Mkfifo args = {mode};
-  return OverlaysGeneric(dirfd, path, &args, Mkfifo);
+  int rc = OverlaysGeneric(dirfd, path, &args, Mkfifo, 0);
+  OverlaysCreated();
+  return rc;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -404,7 +599,7 @@ static ssize_t Chmod(int dirfd, const char *path, void *vargs) {
 
 int OverlaysChmod(int dirfd, const char *path, mode_t mode, int flags) {
   struct Chmod args = {mode, flags};
-  return OverlaysGeneric(dirfd, path, &args, Chmod);
+  return OverlaysGeneric(dirfd, path, &args, Chmod, GetHow(flags));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -423,7 +618,7 @@ static ssize_t Chown(int dirfd, const char *path, void *vargs) {
 int OverlaysChown(int dirfd, const char *path, uid_t uid, gid_t gid,
                   int flags) {
   struct Chown args = {uid, gid, flags};
-  return OverlaysGeneric(dirfd, path, &args, Chown);
+  return OverlaysGeneric(dirfd, path, &args, Chown, GetHow(flags));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -439,7 +634,9 @@ static ssize_t Symlink(int dirfd, const char *path, void *vargs) {
 
 int OverlaysSymlink(const char *target, int dirfd, const char *path) {
   struct Symlink args = {target};
-  return OverlaysGeneric(dirfd, path, &args, Symlink);
+  int rc = OverlaysGeneric(dirfd, path, &args, Symlink, 0);
+  OverlaysCreated();
+  return rc;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -456,7 +653,7 @@ static ssize_t Readlink(int dirfd, const char *path, void *vargs) {
 
 ssize_t OverlaysReadlink(int dirfd, const char *path, char *buf, size_t size) {
   struct Readlink args = {buf, size};
-  return OverlaysGeneric(dirfd, path, &args, Readlink);
+  return OverlaysGeneric(dirfd, path, &args, Readlink, NOFOLLOW);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -474,7 +671,7 @@ static ssize_t Utime(int dirfd, const char *path, void *vargs) {
 int OverlaysUtime(int dirfd, const char *path, const struct timespec times[2],
                   int flags) {
   struct Utime args = {times, flags};
-  return OverlaysGeneric(dirfd, path, &args, Utime);
+  return OverlaysGeneric(dirfd, path, &args, Utime, GetHow(flags));
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -487,69 +684,36 @@ static ssize_t OverlaysGeneric2(int srcdirfd, const char *srcpath, int dstdirfd,
   int err = -1;
   ssize_t i, j;
   const char *sp, *dp;
-  int srccloseme, dstcloseme;
   if (!srcpath || !dstpath) return efault();
   if (!*srcpath || !*dstpath) return enoent();
   for (j = 0; j >= 0 && g_overlays[j]; ++j) {
     if (srcpath[0] != '/' && srcpath[0]) {
       j = -2;
       sp = srcpath;
-      srccloseme = -1;
-    } else if (!*g_overlays[j]) {
-      srcdirfd = AT_FDCWD;
-      srccloseme = -1;
-      sp = srcpath;
+    } else if ((srcdirfd = GetOverlayDirfd(j)) == -1) {
+      continue;
     } else {
-      sp = !srcpath[1] ? "." : srcpath + 1;
-      srccloseme = srcdirfd =
-          open(g_overlays[j], O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0);
-      if (srcdirfd == -1) {
-        if (IsUnrecoverableErrno()) {
-          return -1;
-        } else {
-          LOGF("bad overlay %s: %s", g_overlays[j], DescribeHostErrno(errno));
-          continue;
-        }
-      }
+      sp = GetOverlayPath(j, srcpath);
     }
     for (i = 0; i >= 0 && g_overlays[i]; ++i) {
       if (dstpath[0] != '/' && dstpath[0]) {
         i = -2;
         dp = dstpath;
-        dstcloseme = -1;
-      } else if (!*g_overlays[i]) {
-        dstdirfd = AT_FDCWD;
-        dstcloseme = -1;
-        dp = dstpath;
+      } else if ((dstdirfd = GetOverlayDirfd(i)) == -1) {
+        continue;
       } else {
-        dp = !dstpath[1] ? "." : dstpath + 1;
-        dstcloseme = dstdirfd =
-            open(g_overlays[i], O_RDONLY | O_DIRECTORY | O_CLOEXEC, 0);
-        if (dstdirfd == -1) {
-          if (IsUnrecoverableErrno()) {
-            if (srccloseme != -1) close(srccloseme);
-            return -1;
-          } else {
-            LOGF("bad overlay %s: %s", g_overlays[i], DescribeHostErrno(errno));
-            continue;
-          }
-        }
+        dp = GetOverlayPath(i, dstpath);
       }
       if ((rc = fgenericat(srcdirfd, sp, dstdirfd, dp, args)) != -1) {
-        if (dstcloseme != -1) close(dstcloseme);
-        if (srccloseme != -1) close(srccloseme);
         return rc;
       }
       if (err == -1) {
         err = errno;
       }
-      if (dstcloseme != -1) close(dstcloseme);
       if (errno != ENOENT && errno != ENOTDIR) {
-        if (srccloseme != -1) close(srccloseme);
         return -1;
       }
     }
-    if (srccloseme != -1) close(srccloseme);
   }
   unassert(err != -1);
   errno = err;
@@ -565,7 +729,9 @@ static ssize_t Rename(int srcdirfd, const char *srcpath, int dstdirfd,
 
 int OverlaysRename(int srcdirfd, const char *srcpath, int dstdirfd,
                    const char *dstpath) {
-  return OverlaysGeneric2(srcdirfd, srcpath, dstdirfd, dstpath, 0, Rename);
+  int rc = OverlaysGeneric2(srcdirfd, srcpath, dstdirfd, dstpath, 0, Rename);
+  OverlaysCreated();
+  return rc;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -583,7 +749,9 @@ static ssize_t Link(int srcdirfd, const char *srcpath, int dstdirfd,
 int OverlaysLink(int srcdirfd, const char *srcpath, int dstdirfd,
                  const char *dstpath, int flags) {
   struct Link args = {flags};
-  return OverlaysGeneric2(srcdirfd, srcpath, dstdirfd, dstpath, &args, Link);
+  int rc = OverlaysGeneric2(srcdirfd, srcpath, dstdirfd, dstpath, &args, Link);
+  OverlaysCreated();
+  return rc;
 }
 
 #endif /* DISABLE_OVERLAYS */
@@ -7,8 +7,11 @@
 
 #define DEFAULT_OVERLAYS ":o"
 
+struct statx;
+
 int OverlaysChdir(const char *);
 int SetOverlays(const char *, bool);
+void OverlaysFlushLookups(void);
 char *OverlaysGetcwd(char *, size_t);
 int OverlaysUnlink(int, const char *, int);
 int OverlaysMkdir(int, const char *, mode_t);
@@ -18,6 +21,7 @@ int OverlaysChmod(int, const char *, mode_t, int);
 int OverlaysAccess(int, const char *, mode_t, int);
 int OverlaysSymlink(const char *, int, const char *);
 int OverlaysStat(int, const char *, struct stat *, int);
+int OverlaysStatx(int, const char *, int, unsigned, struct statx *);
 int OverlaysChown(int, const char *, uid_t, gid_t, int);
 int OverlaysRename(int, const char *, int, const char *);
 ssize_t OverlaysReadlink(int, const char *, char *, size_t);
@@ -596,13 +596,16 @@ void CompletePath(P) {
 void FinishPath(struct Machine *m) {
   unassert(IsMakingPath(m));
   FlushCod(m->path.jb);
-  STATISTIC(path_longest_bytes =
-                MAX(path_longest_bytes, m->path.jb->index - m->path.jb->start));
-  STATISTIC(path_longest = MAX(path_longest, m->path.elements));
-  STATISTIC(AVERAGE(path_average_elements, m->path.elements));
-  STATISTIC(AVERAGE(path_average_bytes, m->path.jb->index - m->path.jb->start));
+  STATISTIC(g_stats.path_longest_bytes =
+                MAX(g_stats.path_longest_bytes,
+                    m->path.jb->index - m->path.jb->start));
+  STATISTIC(g_stats.path_longest =
+                MAX(g_stats.path_longest, m->path.elements));
+  STATISTIC(AVERAGE(g_stats.path_average_elements, m->path.elements));
+  STATISTIC(AVERAGE(g_stats.path_average_bytes,
+                    m->path.jb->index - m->path.jb->start));
   if (FinishJit(&m->system->jit, m->path.jb)) {
-    STATISTIC(++path_count);
+    STATISTIC(++g_stats.path_count);
     JIP_LOGF("staged path to %" PRIx64, m->path.start);
   } else {
     JIP_LOGF("path starting at %" PRIx64 " couldn't be installed",
@@ -641,10 +644,7 @@ void AddPath_StartOp(P) {
   BeginCod(m, GetPc(m));
 #ifndef NDEBUG
   if (FLAG_statistics) {
-    Jitter(A,
-           "a0i"  // arg0 = &instructions_jitted
-           "m",   // call micro-op (CountOp)
-           &instructions_jitted, CountOp);
+    Jitter(A, "m", CountOp);  // call micro-op
   }
 #endif
   if (AddPath_StartOp_Hook) {
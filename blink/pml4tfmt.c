@@ -197,7 +197,7 @@ static void FormatPdeOrPte(struct Machine *m, struct MapMaker *u, u64 entry,
     u->flags = entry & INTERESTING_FLAGS;
   }
   u->count += n;
-  if (~entry & PAGE_RSRV) {
+  if (!(entry & (PAGE_RSRV | PAGE_ZERO))) {
     u->committed += n;
   }
 }
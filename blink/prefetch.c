@@ -0,0 +1,261 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "blink/prefetch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "blink/bus.h"
+#include "blink/dll.h"
+#include "blink/flag.h"
+#include "blink/log.h"
+#include "blink/machine.h"
+#include "blink/macros.h"
+#include "blink/stats.h"
+
+#if defined(__APPLE__) || defined(__NetBSD__)
+#define st_mtim st_mtimespec
+#endif
+
+/**
+ * @fileoverview program image read-ahead
+ *
+ * Program images are mapped into guest memory lazily, so the host only
+ * reads pages from disk as they're touched. That keeps startup cheap
+ * but it means a huge executable which isn't in the page cache is read
+ * one fault at a time. When `BLINK_PREFETCH` names a directory, blink
+ * will remember which pages of the program image were touched once it
+ * exits, and the next run of the same file will ask the host to start
+ * reading those pages in the background before the first instruction.
+ */
+
+// pages whose presence is read from the host pagemap at a time
+#define kPagemapBatch 512
+
+struct Pagemap {
+  int fd;
+  uintptr_t base;
+  u64 entries[kPagemapBatch];
+};
+
+static bool IsPageUsed(const u64 *used, i64 page) {
+  return (used[page / 64] >> (page % 64)) & 1;
+}
+
+static char *GetPrefetchPath(const struct PrefetchHeader *key) {
+  char *path;
+  size_t size;
+  size = strlen(FLAG_prefetch) + 64;
+  if ((path = (char *)malloc(size))) {
+    snprintf(path, size, "%s/%" PRIx64 "-%" PRIx64 ".prefetch", FLAG_prefetch,
+             key->dev, key->ino);
+  }
+  return path;
+}
+
+static bool IsSameProgram(const struct PrefetchHeader *a,
+                          const struct PrefetchHeader *b) {
+  return !memcmp(a->magic, b->magic, sizeof(a->magic)) &&  //
+         a->dev == b->dev &&                                //
+         a->ino == b->ino &&                                //
+         a->size == b->size &&                              //
+         a->mtime == b->mtime;
+}
+
+/**
+ * Starts reading program image pages which were used by its last run.
+ *
+ * @param image is a host mapping of the whole executable
+ * @param st is its status, which identifies the file being loaded
+ */
+void PrefetchProgram(struct System *s, void *image, const struct stat *st) {
+  int fd;
+  u32 i;
+  char *path;
+  struct PrefetchHeader h;
+  struct PrefetchRange *r;
+  s->prefetch.on = false;
+  if (!FLAG_prefetch) return;
+  memset(&s->prefetch.key, 0, sizeof(s->prefetch.key));
+  memcpy(s->prefetch.key.magic, kPrefetchMagic, 8);
+  s->prefetch.key.dev = st->st_dev;
+  s->prefetch.key.ino = st->st_ino;
+  s->prefetch.key.size = st->st_size;
+  s->prefetch.key.mtime =
+      (i64)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+  s->prefetch.on = true;
+  if (!(path = GetPrefetchPath(&s->prefetch.key))) return;
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) != -1) {
+    if (read(fd, &h, sizeof(h)) == sizeof(h) &&
+        IsSameProgram(&h, &s->prefetch.key) &&
+        h.count <= ROUNDUP(h.size, 4096) / 4096 &&
+        (r = (struct PrefetchRange *)malloc(h.count * sizeof(*r)))) {
+      if (read(fd, r, h.count * sizeof(*r)) == h.count * sizeof(*r)) {
+        for (i = 0; i < h.count; ++i) {
+          if (r[i].page + (i64)r[i].pages > ROUNDUP(h.size, 4096) / 4096) {
+            LOGF("%s: prefetch range out of bounds", path);
+            break;
+          }
+          posix_madvise((u8 *)image + (i64)r[i].page * 4096,
+                        (i64)r[i].pages * 4096, POSIX_MADV_WILLNEED);
+          STATISTIC(g_stats.prefetch_pages += r[i].pages);
+        }
+      }
+      free(r);
+    }
+    close(fd);
+  }
+  free(path);
+}
+
+static u64 GetPrefetchPte(struct System *s, i64 virt) {
+  u64 pt;
+  unsigned level;
+  for (pt = s->cr3, level = 39;; level -= 9) {
+    pt = LoadPte(GetPageAddress(s, pt, level == 39) +
+                 ((virt >> level) & 511) * 8);
+    if (level == 12 || !(pt & PAGE_V)) return pt;
+  }
+}
+
+// asks the host if one of our pages has been faulted in
+static bool IsHostPagePresent(struct Pagemap *pm, uintptr_t real) {
+  uintptr_t page;
+  if (pm->fd == -1) return false;
+  page = real / FLAG_pagesize;
+  if (!(pm->base <= page && page < pm->base + kPagemapBatch)) {
+    pm->base = ROUNDDOWN(page, kPagemapBatch);
+    if (pread(pm->fd, pm->entries, sizeof(pm->entries),
+              pm->base * sizeof(u64)) != sizeof(pm->entries)) {
+      memset(pm->entries, 0, sizeof(pm->entries));
+    }
+  }
+  return (pm->entries[page - pm->base] >> 62) & 3;  // present or swapped
+}
+
+static bool IsPrefetchPageUsed(struct System *s, struct Pagemap *pm,
+                               i64 virt) {
+  u64 pte = GetPrefetchPte(s, virt);
+  if (!(pte & PAGE_V)) return false;
+  if (pte & PAGE_MUG) return !(pte & PAGE_RSRV);
+  if ((pte & (PAGE_HOST | PAGE_MAP)) == (PAGE_HOST | PAGE_MAP)) {
+    return IsHostPagePresent(pm, (uintptr_t)ToHost(virt));
+  }
+  return false;
+}
+
+static bool WritePrefetchProfile(const char *path, struct PrefetchHeader *h,
+                                 const u64 *used, i64 pages) {
+  int fd;
+  bool ok;
+  char *tmp;
+  size_t size;
+  i64 i, j, n;
+  struct PrefetchRange *r;
+  for (n = i = 0; i < pages; ++i) {
+    if (IsPageUsed(used, i) && (!i || !IsPageUsed(used, i - 1))) {
+      ++n;
+    }
+  }
+  if (!n) return true;
+  if (!(r = (struct PrefetchRange *)malloc(n * sizeof(*r)))) return false;
+  for (n = i = 0; i < pages;) {
+    if (IsPageUsed(used, i)) {
+      for (j = i; j < pages && IsPageUsed(used, j); ++j) {
+      }
+      r[n].page = i;
+      r[n].pages = j - i;
+      ++n;
+      i = j;
+    } else {
+      ++i;
+    }
+  }
+  h->count = n;
+  ok = false;
+  size = strlen(path) + 16;
+  if ((tmp = (char *)malloc(size))) {
+    snprintf(tmp, size, "%s.%d", path, getpid());
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) !=
+        -1) {
+      ok = write(fd, h, sizeof(*h)) == sizeof(*h) &&
+           write(fd, r, n * sizeof(*r)) == n * sizeof(*r);
+      ok &= !close(fd);
+      if (ok) {
+        ok = !rename(tmp, path);
+      } else {
+        unlink(tmp);
+      }
+    }
+    free(tmp);
+  }
+  free(r);
+  return ok;
+}
+
+/**
+ * Records which pages of the program image have been touched.
+ *
+ * This must be called before the guest address space is torn down. It
+ * only does something the first time it's called after the program was
+ * loaded with `BLINK_PREFETCH` defined.
+ */
+void SavePrefetchProfile(struct System *s) {
+  u64 *used;
+  char *path;
+  struct Dll *e;
+  struct FileMap *fm;
+  struct Pagemap pm;
+  i64 i, page, pages;
+  if (!s->prefetch.on) return;
+  s->prefetch.on = false;
+  // a forked child only has the pages it touched itself
+  if (s->isfork || !s->elf.execfn) return;
+  pages = ROUNDUP(s->prefetch.key.size, 4096) / 4096;
+  if (!(used = (u64 *)calloc(ROUNDUP(pages, 64) / 64, sizeof(u64)))) return;
+  pm.base = -1;
+  pm.fd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+  for (e = dll_first(s->filemaps); e; e = dll_next(s->filemaps, e)) {
+    fm = FILEMAP_CONTAINER(e);
+    if (fm->offset < 0 || (fm->offset & 4095)) continue;
+    if (strcmp(fm->path, s->elf.execfn)) continue;
+    for (i = 0; i < ROUNDUP(fm->size, 4096) / 4096; ++i) {
+      page = fm->offset / 4096 + i;
+      if (page >= pages) break;
+      if (IsPageUsed(fm->present, i) &&
+          IsPrefetchPageUsed(s, &pm, fm->virt + i * 4096)) {
+        used[page / 64] |= (u64)1 << (page % 64);
+      }
+    }
+  }
+  if (pm.fd != -1) close(pm.fd);
+  if ((path = GetPrefetchPath(&s->prefetch.key))) {
+    if (!WritePrefetchProfile(path, &s->prefetch.key, used, pages)) {
+      LOGF("%s: failed to save prefetch profile: %s", path, strerror(errno));
+    }
+    free(path);
+  }
+  free(used);
+}
@@ -0,0 +1,38 @@
+#ifndef BLINK_PREFETCH_H_
+#define BLINK_PREFETCH_H_
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "blink/types.h"
+
+#define kPrefetchMagic "blinkpf1"
+
+// a profile begins with this header, which identifies the executable
+struct PrefetchHeader {
+  char magic[8];  // kPrefetchMagic
+  u64 dev;        // st_dev of program image
+  u64 ino;        // st_ino of program image
+  i64 size;       // st_size of program image
+  i64 mtime;      // st_mtim of program image in nanoseconds
+  u32 count;      // number of ranges that follow
+  u32 pad;
+};
+
+// followed by the ranges of program image pages the last run touched
+struct PrefetchRange {
+  u32 page;   // file offset divided by 4096
+  u32 pages;  // number of pages in range
+};
+
+// program image whose page usage is being profiled
+struct Prefetch {
+  bool on;
+  struct PrefetchHeader key;
+};
+
+struct System;
+void PrefetchProgram(struct System *, void *, const struct stat *);
+void SavePrefetchProfile(struct System *);
+
+#endif /* BLINK_PREFETCH_H_ */
@@ -26,6 +26,9 @@
 #include "blink/errno.h"
 #include "blink/log.h"
 #include "blink/machine.h"
+#include "blink/macros.h"
+#include "blink/stats.h"
+#include "blink/systrace.h"
 #include "blink/timespec.h"
 #include "blink/vfs.h"
 
@@ -97,6 +100,7 @@ enum {
   PROCFS_SELF_INO,
   PROCFS_SYS_INO,
   PROCFS_UPTIME_INO,
+  PROCFS_BLINK_INO,
 
   PROCFS_FIRST_PID_INO
 };
@@ -109,6 +113,8 @@ enum {
   PROCFS_SELF_TYPE,
   PROCFS_SYS_TYPE,
   PROCFS_UPTIME_TYPE,
+  PROCFS_BLINK_TYPE,
+  PROCFS_BLINK_STATS_TYPE,
 
   PROCFS_PIDDIR_TYPE,
   PROCFS_PIDDIR_EXE_TYPE,
@@ -116,7 +122,18 @@ enum {
   PROCFS_PIDDIR_ROOT_TYPE,
   PROCFS_PIDDIR_MOUNTS_TYPE,
   PROCFS_PIDDIR_FDDIR_TYPE,
-  PROCFS_PIDDIR_LAST_TYPE = PROCFS_PIDDIR_FDDIR_TYPE
+  PROCFS_PIDDIR_TASKDIR_TYPE,
+  PROCFS_PIDDIR_LAST_TYPE = PROCFS_PIDDIR_TASKDIR_TYPE,
+
+  PROCFS_TASK_TYPE,
+  PROCFS_TASK_BLINK_TYPE,
+};
+
+// inode numbers after the pid directory; each thread gets two of them
+enum {
+  PROCFS_BLINK_STATS_INO = PROCFS_FIRST_PID_INO + PROCFS_PIDDIR_LAST_TYPE -
+                           PROCFS_PIDDIR_TYPE + 1,
+  PROCFS_FIRST_TID_INO
 };
 
 static int ProcfsRootReaddir(struct VfsInfo *, struct dirent *);
@@ -125,12 +142,18 @@ static ssize_t ProcfsToSelfReadlink(struct VfsInfo *, char **);
 static int ProcfsMeminfoRead(struct VfsInfo *, struct ProcfsOpenFile *);
 static int ProcfsUptimeRead(struct VfsInfo *, struct ProcfsOpenFile *);
 static int ProcfsFilesystemsRead(struct VfsInfo *, struct ProcfsOpenFile *);
+static int ProcfsBlinkReaddir(struct VfsInfo *, struct dirent *);
+static int ProcfsBlinkStatsRead(struct VfsInfo *, struct ProcfsOpenFile *);
 
 static int ProcfsPiddirReaddir(struct VfsInfo *, struct dirent *);
 static ssize_t ProcfsPiddirExeReadlink(struct VfsInfo *, char **);
 static ssize_t ProcfsPiddirCwdReadlink(struct VfsInfo *, char **);
 static ssize_t ProcfsPiddirRootReadlink(struct VfsInfo *, char **);
 static int ProcfsPiddirMountsRead(struct VfsInfo *, struct ProcfsOpenFile *);
+static int ProcfsPiddirTaskdirReaddir(struct VfsInfo *, struct dirent *);
+
+static int ProcfsTaskReaddir(struct VfsInfo *, struct dirent *);
+static int ProcfsTaskBlinkRead(struct VfsInfo *, struct ProcfsOpenFile *);
 
 static struct ProcfsInfo g_defaultinfos[] = {
     [PROCFS_ROOT_INO] = {PROCFS_ROOT_INO, S_IFDIR | 0555, 0, 0,
@@ -152,8 +175,15 @@ static struct ProcfsInfo g_defaultinfos[] = {
     [PROCFS_UPTIME_INO] = {PROCFS_UPTIME_INO, S_IFREG | 0444, 0, 0,
                            PROCFS_UPTIME_TYPE, "uptime",
                            .read = ProcfsUptimeRead},
+    [PROCFS_BLINK_INO] = {PROCFS_BLINK_INO, S_IFDIR | 0555, 0, 0,
+                          PROCFS_BLINK_TYPE, "blink",
+                          .readdir = ProcfsBlinkReaddir},
 };
 
+static struct ProcfsInfo g_blinkstatsinfo = {
+    PROCFS_BLINK_STATS_INO, S_IFREG | 0444, 0, 0, PROCFS_BLINK_STATS_TYPE,
+    "stats", .read = ProcfsBlinkStatsRead};
+
 static struct ProcfsInfo g_piddirinfos[] = {
     [PROCFS_PIDDIR_TYPE -
      PROCFS_PIDDIR_TYPE] = {0, S_IFDIR | 0555, 0, 0, PROCFS_PIDDIR_TYPE, "",
@@ -174,6 +204,19 @@ static struct ProcfsInfo g_piddirinfos[] = {
     [PROCFS_PIDDIR_FDDIR_TYPE - PROCFS_PIDDIR_TYPE] = {0, S_IFDIR | 0555, 0, 0,
                                                        PROCFS_PIDDIR_FDDIR_TYPE,
                                                        "fd"},
+    [PROCFS_PIDDIR_TASKDIR_TYPE -
+        PROCFS_PIDDIR_TYPE] = {0, S_IFDIR | 0555, 0, 0,
+                               PROCFS_PIDDIR_TASKDIR_TYPE, "task",
+                               .readdir = ProcfsPiddirTaskdirReaddir},
+};
+
+static struct ProcfsInfo g_taskinfos[] = {
+    [PROCFS_TASK_TYPE - PROCFS_TASK_TYPE] = {0, S_IFDIR | 0555, 0, 0,
+                                             PROCFS_TASK_TYPE, "",
+                                             .readdir = ProcfsTaskReaddir},
+    [PROCFS_TASK_BLINK_TYPE -
+        PROCFS_TASK_TYPE] = {0, S_IFREG | 0444, 0, 0, PROCFS_TASK_BLINK_TYPE,
+                             "blink", .read = ProcfsTaskBlinkRead},
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -230,6 +273,36 @@ static int ProcfsCreatePiddirInfo(struct ProcfsInfo **info,
   return 0;
 }
 
+static int ProcfsCreateBlinkStatsInfo(struct ProcfsInfo **info,
+                                      struct ProcfsDevice *device) {
+  *info = malloc(sizeof(struct ProcfsInfo));
+  if (*info == NULL) {
+    return enomem();
+  }
+  **info = g_blinkstatsinfo;
+  (*info)->time = device->mounttime;
+  return 0;
+}
+
+static int ProcfsCreateTaskInfo(struct ProcfsInfo **info,
+                                struct ProcfsInfo *parent, i32 tid, u32 type) {
+  *info = malloc(sizeof(struct ProcfsInfo));
+  if (*info == NULL) {
+    return enomem();
+  }
+  **info = g_taskinfos[type - PROCFS_TASK_TYPE];
+  if (type == PROCFS_TASK_TYPE) {
+    (*info)->ino = PROCFS_FIRST_TID_INO + (u64)tid * 2;
+    sprintf((*info)->name, "%d", tid);
+  } else {
+    (*info)->ino = parent->ino + 1;
+  }
+  (*info)->uid = parent->uid;
+  (*info)->gid = parent->gid;
+  (*info)->time = GetTime();
+  return 0;
+}
+
 static int ProcfsFreeInfo(void *info) {
   if (info == NULL) {
     return 0;
@@ -320,11 +393,43 @@ static int ProcfsReadmountentry(struct VfsDevice *device, char **spec,
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// returns true if `tid` is a thread of the emulated process
+static bool ProcfsIsThread(int tid) {
+  bool res = false;
+  struct Dll *e;
+  struct System *s = g_machine->system;
+  LOCK(&s->machines_lock);
+  for (e = dll_first(s->machines); e; e = dll_next(s->machines, e)) {
+    if (MACHINE_CONTAINER(e)->tid == tid) {
+      res = true;
+      break;
+    }
+  }
+  UNLOCK(&s->machines_lock);
+  return res;
+}
+
+// returns thread id of the `i`th thread of the process, or -1 if none
+static int ProcfsGetThread(size_t i) {
+  int tid = -1;
+  struct Dll *e;
+  struct System *s = g_machine->system;
+  LOCK(&s->machines_lock);
+  for (e = dll_first(s->machines); e; e = dll_next(s->machines, e)) {
+    if (!i--) {
+      tid = MACHINE_CONTAINER(e)->tid;
+      break;
+    }
+  }
+  UNLOCK(&s->machines_lock);
+  return tid;
+}
+
 static int ProcfsFinddir(struct VfsInfo *parent, const char *name,
                          struct VfsInfo **output) {
   struct ProcfsInfo *procparent = (struct ProcfsInfo *)parent->data;
   struct ProcfsInfo *procoutput = NULL;
-  int i, pid;
+  int i, pid, tid;
   VFS_LOGF("ProcfsFinddir(parent=%p (%s), name=\"%s\", output=%p)", parent,
            parent->name, name, output);
   if (strcmp(name, ".") == 0) {
@@ -367,6 +472,33 @@ static int ProcfsFinddir(struct VfsInfo *parent, const char *name,
         }
       }
       break;
+    case PROCFS_BLINK_TYPE:
+      if (!strcmp(name, g_blinkstatsinfo.name)) {
+        if (ProcfsCreateBlinkStatsInfo(
+                &procoutput, (struct ProcfsDevice *)parent->device->data) ==
+            -1) {
+          goto cleananddie;
+        }
+      }
+      break;
+    case PROCFS_PIDDIR_TASKDIR_TYPE:
+      tid = -1;
+      sscanf(name, "%d", &tid);
+      if (ProcfsIsThread(tid)) {
+        if (ProcfsCreateTaskInfo(&procoutput, procparent, tid,
+                                 PROCFS_TASK_TYPE) == -1) {
+          goto cleananddie;
+        }
+      }
+      break;
+    case PROCFS_TASK_TYPE:
+      if (!strcmp(name, g_taskinfos[1].name)) {
+        if (ProcfsCreateTaskInfo(&procoutput, procparent, -1,
+                                 PROCFS_TASK_BLINK_TYPE) == -1) {
+          goto cleananddie;
+        }
+      }
+      break;
   }
   if (procoutput == NULL) {
     enoent();
@@ -1098,6 +1230,74 @@ static int ProcfsPiddirReaddir(struct VfsInfo *info, struct dirent *de) {
   return ret;
 }
 
+// emits the .. and . entries which begin every directory
+static bool ProcfsDotsReaddir(struct VfsInfo *info, size_t index,
+                              struct dirent *de) {
+  if (index > 1) return false;
+  de->d_ino = index ? info->ino : info->parent->ino;
+#ifdef DT_DIR
+  de->d_type = DT_DIR;
+#endif
+  strcpy(de->d_name, index ? "." : "..");
+  return true;
+}
+
+static int ProcfsBlinkReaddir(struct VfsInfo *info, struct dirent *de) {
+  struct ProcfsInfo *procinfo = (struct ProcfsInfo *)info->data;
+  struct ProcfsOpenDir *dir = procinfo->opendir;
+  int ret = 0;
+  LOCK(&dir->lock);
+  if (!ProcfsDotsReaddir(info, dir->index, de)) {
+    if (dir->index == 2) {
+      ProcfsInfoToDirent(&g_blinkstatsinfo, de);
+    } else {
+      ret = enoent();
+    }
+  }
+  ++dir->index;
+  UNLOCK(&dir->lock);
+  return ret;
+}
+
+static int ProcfsPiddirTaskdirReaddir(struct VfsInfo *info, struct dirent *de) {
+  struct ProcfsInfo *procinfo = (struct ProcfsInfo *)info->data;
+  struct ProcfsOpenDir *dir = procinfo->opendir;
+  int tid, ret = 0;
+  LOCK(&dir->lock);
+  if (!ProcfsDotsReaddir(info, dir->index, de)) {
+    if ((tid = ProcfsGetThread(dir->index - 2)) != -1) {
+      de->d_ino = PROCFS_FIRST_TID_INO + (u64)tid * 2;
+#ifdef DT_DIR
+      de->d_type = DT_DIR;
+#endif
+      sprintf(de->d_name, "%d", tid);
+    } else {
+      ret = enoent();
+    }
+  }
+  ++dir->index;
+  UNLOCK(&dir->lock);
+  return ret;
+}
+
+static int ProcfsTaskReaddir(struct VfsInfo *info, struct dirent *de) {
+  struct ProcfsInfo *procinfo = (struct ProcfsInfo *)info->data;
+  struct ProcfsOpenDir *dir = procinfo->opendir;
+  int ret = 0;
+  LOCK(&dir->lock);
+  if (!ProcfsDotsReaddir(info, dir->index, de)) {
+    if (dir->index == 2) {
+      ProcfsInfoToDirent(&g_taskinfos[1], de);
+      de->d_ino = info->ino + 1;
+    } else {
+      ret = enoent();
+    }
+  }
+  ++dir->index;
+  UNLOCK(&dir->lock);
+  return ret;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 static ssize_t ProcfsSelfReadlink(struct VfsInfo *info, char **buf) {
@@ -1289,6 +1489,48 @@ static int ProcfsFilesystemsRead(struct VfsInfo *info,
   return 0;
 }
 
+// serves counters as text, which is rendered again for each chunk that
+// is read, since they keep changing while the program is running
+static int ProcfsStatsRead(const struct Stats *stats, int tid,
+                           struct ProcfsOpenFile *openfile) {
+  char *buf;
+  size_t len, size = PROCFS_READ_LEN * 16;
+  if (!(buf = (char *)malloc(size))) {
+    return enomem();
+  }
+  len = MIN(FormatStats(buf, size, stats), size - 1);
+  len += MIN(FormatSysStats(buf + len, size - len, tid), size - len - 1);
+  if (openfile->index >= len) {
+    openfile->readbufstart = sizeof(openfile->readbuf) + 1;
+    openfile->readbufend = sizeof(openfile->readbuf) + 1;
+  } else {
+    len = MIN(len - openfile->index, sizeof(openfile->readbuf));
+    memcpy(openfile->readbuf, buf + openfile->index, len);
+    openfile->readbufstart = 0;
+    openfile->readbufend = len;
+    openfile->index += len;
+  }
+  free(buf);
+  return 0;
+}
+
+static int ProcfsBlinkStatsRead(struct VfsInfo *info,
+                                struct ProcfsOpenFile *openfile) {
+  struct Stats stats;
+  SumStats(&stats);
+  return ProcfsStatsRead(&stats, 0, openfile);
+}
+
+static int ProcfsTaskBlinkRead(struct VfsInfo *info,
+                               struct ProcfsOpenFile *openfile) {
+  int tid;
+  struct Stats stats;
+  if (!GetThreadStats((tid = atoi(info->parent->name)), &stats)) {
+    return esrch();
+  }
+  return ProcfsStatsRead(&stats, tid, openfile);
+}
+
 static int ProcfsMountsStringEscape(char **str) {
   size_t len, len1;
   char *tmp;
@@ -224,6 +224,7 @@ static int ConsumeSignalImpl(struct Machine *m, int *delivered, bool *restart) {
   u64 signals;
   if (delivered) *delivered = 0;
   if (restart) *restart = true;
+  if (m->vfork) return 0;  // parent gets them once the child's gone
   // look for a pending signal that isn't currently masked
   while ((signals = m->signals & ~m->sigmask)) {
     sig = bsr(signals) + 1;
@@ -268,6 +269,13 @@ void EnqueueSignal(struct Machine *m, int sig) {
     m->signals |= 1ul << (sig - 1);
     if ((m->signals & ~m->sigmask)) {
       atomic_store_explicit(&m->attention, true, memory_order_release);
+#ifdef HAVE_THREADS
+      // kick the thread in case it's asleep in a system call
+      if (m != g_machine) pthread_kill(m->thread, SIGSYS);
+#endif
+    }
+    if (m->sigmask & (1ul << (sig - 1))) {
+      NotifySignalFds(sig);
     }
   }
 }
@@ -281,7 +289,7 @@ void CheckForSignals(struct Machine *m) {
     FlushSmcQueue(m);
     m->selfmodifying = false;
 #endif
-  } else if (m->signals & ~m->sigmask) {
+  } else if ((m->signals & ~m->sigmask) && !m->vfork) {
     if ((sig = ConsumeSignal(m, 0, 0))) {
       TerminateSignal(m, sig, 0);
     }
@@ -8,6 +8,9 @@ void SigRestore(struct Machine *);
 bool IsSignalIgnoredByDefault(int);
 void OnSignal(int, siginfo_t *, void *);
 void EnqueueSignal(struct Machine *, int);
+bool IsBlinkSig(struct System *, int);
+u64 GetSignalFdMask(void);
+void NotifySignalFds(int);
 void DeliverSignal(struct Machine *, int, int);
 void TerminateSignal(struct Machine *, int, int);
 int ConsumeSignal(struct Machine *, int *, bool *);
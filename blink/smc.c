@@ -56,7 +56,7 @@ bool IsPageInSmcQueue(struct Machine *m, i64 page) {
   int i;
   i64 tmp;
   page &= -4096;
-  STATISTIC(++smc_checks);
+  STATISTIC(++g_stats.smc_checks);
   for (i = 0; i < kSmcQueueSize; ++i) {
     if ((tmp = m->smcqueue.p[i]) == page) {
       if (i) {
@@ -75,7 +75,7 @@ void AddPageToSmcQueue(struct Machine *m, i64 page) {
   page &= -4096;
   for (i = 0; i < kSmcQueueSize; ++i) {
     if (!m->smcqueue.p[i]) {
-      STATISTIC(++smc_enqueued);
+      STATISTIC(++g_stats.smc_enqueued);
       m->smcqueue.p[i] = page;
       m->selfmodifying = true;
       atomic_store_explicit(&m->attention, true, memory_order_release);
@@ -90,7 +90,7 @@ void FlushSmcQueue(struct Machine *m) {
   int i;
   i64 page;
   unassert(m->selfmodifying);
-  STATISTIC(++smc_flushes);
+  STATISTIC(++g_stats.smc_flushes);
   for (i = 0; i < kSmcQueueSize; ++i) {
     if ((page = m->smcqueue.p[i])) {
       m->smcqueue.p[i] = 0;
@@ -141,7 +141,7 @@ bool IsSelfModifyingCodeSegfault(struct Machine *m, const siginfo_t *si) {
       (PAGE_V | PAGE_U | PAGE_RW)) {
     return false;
   }
-  STATISTIC(++smc_segfaults);
+  STATISTIC(++g_stats.smc_segfaults);
   if (UnprotectSelfModifyingCode(m->system, vaddr, 1)) {
     ERRF("failed to unprotect self modifying code");
     return false;
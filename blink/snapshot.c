@@ -0,0 +1,761 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "blink/snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "blink/assert.h"
+#include "blink/atomic.h"
+#include "blink/bitscan.h"
+#include "blink/buffer.h"
+#include "blink/bus.h"
+#include "blink/dll.h"
+#include "blink/endian.h"
+#include "blink/errno.h"
+#include "blink/fds.h"
+#include "blink/flag.h"
+#include "blink/linux.h"
+#include "blink/log.h"
+#include "blink/machine.h"
+#include "blink/macros.h"
+#include "blink/procfs.h"
+#include "blink/syscall.h"
+#include "blink/thread.h"
+#include "blink/util.h"
+#include "blink/vfs.h"
+#include "blink/x86.h"
+
+#if defined(__APPLE__) || defined(__NetBSD__)
+#define st_mtim st_mtimespec
+#endif
+
+/**
+ * @fileoverview guest process snapshots
+ *
+ * Programs often spend a long time linking, relocating, and initializing
+ * themselves before doing anything useful, and they'll do the same work
+ * each time they're run. When `-S SYSNO:PATH` is passed, blink will save
+ * the state of the guest to PATH the first time it issues the numbered
+ * system call, and then let it carry on running. Passing `-R PATH` will
+ * resume a new process from that point, where the system call happens
+ * again. Guest memory is mapped copy-on-write from the snapshot file so
+ * restoring takes about as long as mapping its regions, no matter how
+ * big the program is. Snapshots may only be taken of single-threaded
+ * programs that have nothing open besides files and directories. The
+ * standard file descriptors are taken from the restoring process.
+ */
+
+#define KEY_FLAGS (PAGE_U | PAGE_RW | PAGE_XD | PAGE_GROW | PAGE_FILE)
+
+struct Snapshotter {
+  long i, n;
+  struct System *s;
+  struct SnapshotRegion *p;
+};
+
+int g_snapshot_sysno = -1;
+static const char *g_snapshot_path;
+
+/**
+ * Parses `-S SYSNO:PATH` flag.
+ */
+int SetSnapshotSpec(const char *spec) {
+  long x;
+  char *end;
+  x = strtol(spec, &end, 0);
+  if (end == spec || *end != ':' || !end[1] || !(0 <= x && x <= 0xfff)) {
+    return einval();
+  }
+  g_snapshot_sysno = x;
+  g_snapshot_path = end + 1;
+  return 0;
+}
+
+static u64 GetSnapshotPte(struct System *s, i64 virt) {
+  u64 pt;
+  long level;
+  for (pt = s->cr3, level = 39;; level -= 9) {
+    pt = LoadPte(GetPageAddress(s, pt, level == 39) +
+                 ((virt >> level) & 511) * 8);
+    if (level == 12 || !(pt & PAGE_V)) return pt;
+  }
+}
+
+static bool HasPageData(u64 entry) {
+  if (!(entry & PAGE_HOST)) return false;  // reserved anonymous memory
+  if (entry & PAGE_ZERO) return false;     // shared zero page
+  return true;
+}
+
+// returns true if blink may read the page without risk of crashing. an
+// anonymous page that blink allocated can always be read, but whether
+// a host mapping can be depends on the protection and file size, which
+// is why we'll let pwrite() tell us about those using EFAULT
+static bool IsPageSafeToRead(struct System *s, i64 virt, u64 entry) {
+  struct FileMap *fm;
+  if (!HasLinearMapping()) return !(entry & PAGE_MUG);
+  if (FLAG_pagesize > 4096) return false;  // can't split host pages
+  if (!(entry & PAGE_U)) return false;
+  return !(entry & PAGE_FILE) || !(fm = GetFileMap(s, virt)) ||
+         fm->offset == -1;
+}
+
+static bool IsZeroPage(const u8 *p) {
+  long i;
+  for (i = 0; i < 4096; i += 8) {
+    if (Read64(p + i)) return false;
+  }
+  return true;
+}
+
+static int AddRegion(struct Snapshotter *u, i64 virt, u64 key, bool data) {
+  long n;
+  struct SnapshotRegion *r, *p;
+  if (u->i) {
+    r = u->p + u->i - 1;
+    if (r->virt + r->size == virt && r->key == key &&
+        (r->offset != -1) == data) {
+      r->size += 4096;
+      return 0;
+    }
+  }
+  if (u->i == u->n) {
+    n = MAX(64, u->n + (u->n >> 1));
+    if (!(p = (struct SnapshotRegion *)realloc(u->p, n * sizeof(*p)))) {
+      return -1;
+    }
+    u->p = p;
+    u->n = n;
+  }
+  r = u->p + u->i++;
+  r->virt = virt;
+  r->size = 4096;
+  r->key = key;
+  r->offset = data ? 0 : -1;
+  return 0;
+}
+
+static int AddPage(struct Snapshotter *u, i64 virt, u64 entry) {
+  bool data;
+  if ((data = HasPageData(entry)) && IsPageSafeToRead(u->s, virt, entry) &&
+      IsZeroPage((u8 *)(uintptr_t)(entry & PAGE_TA))) {
+    data = false;
+  }
+  return AddRegion(u, virt, entry & KEY_FLAGS, data);
+}
+
+// walks page tables the same way FormatPml4t() does, turning them into
+// intervals of pages sharing the same protection and having page data
+static int FindRegions(struct Snapshotter *u) {
+  u8 *pd[4];
+  u64 entry;
+  i64 virt;
+  unsigned a[4];
+  pd[0] = GetPageAddress(u->s, u->s->cr3, true);
+  for (a[0] = 0; a[0] < 512; ++a[0]) {
+    entry = LoadPte(pd[0] + a[0] * 8);
+    if (!(entry & PAGE_V)) continue;
+    pd[1] = GetPageAddress(u->s, entry, false);
+    for (a[1] = 0; a[1] < 512; ++a[1]) {
+      entry = LoadPte(pd[1] + a[1] * 8);
+      if (!(entry & PAGE_V)) continue;
+      pd[2] = GetPageAddress(u->s, entry, false);
+      for (a[2] = 0; a[2] < 512; ++a[2]) {
+        entry = LoadPte(pd[2] + a[2] * 8);
+        if (!(entry & PAGE_V)) continue;
+        pd[3] = GetPageAddress(u->s, entry, false);
+        for (a[3] = 0; a[3] < 512; ++a[3]) {
+          entry = LoadPte(pd[3] + a[3] * 8);
+          if (!(entry & PAGE_V)) continue;
+          virt = (i64)a[0] << 39 | (i64)a[1] << 30 | (i64)a[2] << 21 |
+                 (i64)a[3] << 12;
+          virt = (i64)((u64)virt << 16) >> 16;
+          if (AddPage(u, virt, entry) == -1) return -1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+static int AddFds(struct System *s, struct Buffer *b, u32 *count) {
+  int rc;
+  i64 pos;
+  struct Fd *fd;
+  struct Dll *e;
+  struct stat st;
+  struct SnapshotFd rec;
+  rc = 0;
+  LOCK(&s->fds.lock);
+  for (e = dll_first(s->fds.list); e; e = dll_next(s->fds.list, e)) {
+    fd = FD_CONTAINER(e);
+    if (fd->fildes < 3) continue;
+    if (!fd->path || fd->cb != &kFdCbHost || VfsFstat(fd->fildes, &st) ||
+        !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) {
+      LOGF("can't snapshot fd %d (%s) since it isn't a file or directory",
+           fd->fildes, fd->path ? fd->path : "?");
+      rc = einval();
+      break;
+    }
+    pos = S_ISREG(st.st_mode) ? VfsSeek(fd->fildes, 0, SEEK_CUR) : 0;
+    memset(&rec, 0, sizeof(rec));
+    rec.fildes = fd->fildes;
+    rec.oflags = fd->oflags & ~(O_CREAT | O_TRUNC | O_EXCL);
+    rec.offset = MAX(0, pos);
+    rec.pathlen = strlen(fd->path) + 1;
+    AppendData(b, (const char *)&rec, sizeof(rec));
+    AppendData(b, fd->path, rec.pathlen);
+    ++*count;
+  }
+  UNLOCK(&s->fds.lock);
+  return rc;
+}
+
+static void GetFileIdentity(const char *path, struct SnapshotFileMap *rec) {
+  struct stat st;
+  if (!VfsStat(AT_FDCWD, path, &st, 0)) {
+    rec->dev = st.st_dev;
+    rec->ino = st.st_ino;
+    rec->fsize = st.st_size;
+    rec->mtime = (i64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  }
+}
+
+static void AddFileMaps(struct System *s, struct Buffer *b, u32 *count) {
+  struct Dll *e;
+  struct FileMap *fm;
+  struct SnapshotFileMap rec;
+  for (e = dll_first(s->filemaps); e; e = dll_next(s->filemaps, e)) {
+    fm = FILEMAP_CONTAINER(e);
+    memset(&rec, 0, sizeof(rec));
+    rec.virt = fm->virt;
+    rec.size = fm->size;
+    rec.offset = fm->offset;
+    rec.pathlen = strlen(fm->path) + 1;
+    if (fm->offset != -1) GetFileIdentity(fm->path, &rec);
+    AppendData(b, (const char *)&rec, sizeof(rec));
+    AppendData(b, (const char *)fm->present,
+               ROUNDUP(ROUNDUP(fm->size, 4096) / 4096, 64) / 64 * 8);
+    AppendData(b, fm->path, rec.pathlen);
+    ++*count;
+  }
+}
+
+static void AddString(struct Buffer *b, u32 *len, const char *s) {
+  if (!s) s = "";
+  *len = strlen(s) + 1;
+  AppendData(b, s, *len);
+}
+
+static void SaveMachine(struct SnapshotHeader *h, struct Machine *m) {
+  struct System *s = m->system;
+  h->linear = HasLinearMapping();
+  h->iscosmo = s->iscosmo;
+  h->brkchanged = s->brkchanged;
+  h->brk = s->brk;
+  h->automap = s->automap;
+  h->codestart = s->codestart;
+  h->codesize = s->codesize;
+  h->elf_base = s->elf.base;
+  h->elf_aslr = s->elf.aslr;
+  memcpy(h->elf_rng, s->elf.rng, sizeof(h->elf_rng));
+  h->elf_at_base = s->elf.at_base;
+  h->elf_at_phdr = s->elf.at_phdr;
+  h->elf_at_phent = s->elf.at_phent;
+  h->elf_at_entry = s->elf.at_entry;
+  h->elf_at_phnum = s->elf.at_phnum;
+  h->elf_at_sysinfo_ehdr = s->elf.at_sysinfo_ehdr;
+  h->ip = m->ip - m->oplen;
+  h->flags = m->flags;
+  h->mxcsr = m->mxcsr;
+  memcpy(h->beg, m->beg, sizeof(h->beg));
+  memcpy(h->xmm, m->xmm, sizeof(h->xmm));
+  memcpy(h->seg, m->seg, sizeof(h->seg));
+  memcpy(&h->fpu, &m->fpu, sizeof(h->fpu));
+  h->sigmask = m->sigmask;
+  memcpy(&h->sigaltstack, &m->sigaltstack, sizeof(h->sigaltstack));
+  h->robust_list = m->robust_list;
+  h->ctid = m->ctid;
+  h->tid = m->tid;
+  memcpy(h->hands, s->hands, sizeof(h->hands));
+  memcpy(h->rlim, s->rlim, sizeof(h->rlim));
+}
+
+static int WritePages(struct System *s, int fd, struct SnapshotRegion *r) {
+  i64 i;
+  u64 entry;
+  ssize_t rc;
+  for (i = 0; i < r->size; i += 4096) {
+    entry = GetSnapshotPte(s, r->virt + i);
+    unassert(HasPageData(entry));
+    rc = pwrite(fd, (u8 *)(uintptr_t)(entry & PAGE_TA), 4096, r->offset + i);
+    if (rc == -1 && errno == EFAULT) {
+      // page is protected or past the end of its file, so its contents
+      // are left as a hole in the snapshot, which will read as zeroes
+      LOGF("snapshot of %#" PRIx64 " page faulted", r->virt + i);
+    } else if (rc != 4096) {
+      if (rc != -1) errno = ENOSPC;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int WriteSnapshot(struct Machine *m, int fd, const char *key,
+                         u32 keysize) {
+  int rc;
+  long i;
+  i64 off;
+  char cwd[PATH_MAX];
+  struct Buffer b = {0};
+  struct SnapshotHeader h;
+  struct System *s = m->system;
+  struct Snapshotter u = {.s = s};
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, kSnapshotMagic, sizeof(h.magic));
+  h.version = kSnapshotVersion;
+  h.size = sizeof(h);
+  if (!VfsGetcwd(cwd, sizeof(cwd))) return -1;
+  AddString(&b, h.strings + 0, s->elf.execfn);
+  AddString(&b, h.strings + 1, s->elf.prog);
+  AddString(&b, h.strings + 2, s->elf.interpreter);
+  AddString(&b, h.strings + 3, cwd);
+  AppendData(&b, key, h.keysize = keysize);
+  AddFileMaps(s, &b, &h.filemaps);
+  // keyed snapshots are restored into a process that keeps the files
+  // it inherited from its parent, so open files aren't saved for them
+  rc = key ? 0 : AddFds(s, &b, &h.fds);
+  if (rc != -1 && (rc = FindRegions(&u)) != -1) {
+    rc = -1;
+    h.regions = u.i;
+    off = sizeof(h) + u.i * sizeof(*u.p) + b.i;
+    if (!b.p || off > UINT_MAX) {
+      errno = ENOMEM;
+    } else {
+      // give page data the same alignment in the file as its address
+      // so regions can be mapped straight from the file on any host
+      h.metasize = off;
+      for (i = 0; i < u.i; ++i) {
+        if (u.p[i].offset != -1) {
+          off = ROUNDUP(off, 4096);
+          off += (u.p[i].virt - off) & (kSnapshotAlign - 1);
+          u.p[i].offset = off;
+          off += u.p[i].size;
+        }
+      }
+      SaveMachine(&h, m);
+      if (pwrite(fd, &h, sizeof(h), 0) == sizeof(h) &&
+          pwrite(fd, u.p, u.i * sizeof(*u.p), sizeof(h)) ==
+              u.i * sizeof(*u.p) &&
+          pwrite(fd, b.p, b.i, sizeof(h) + u.i * sizeof(*u.p)) == b.i) {
+        for (rc = i = 0; i < u.i; ++i) {
+          if (u.p[i].offset != -1 && (rc = WritePages(s, fd, u.p + i))) {
+            break;
+          }
+        }
+        if (!rc) rc = ftruncate(fd, off);
+      }
+    }
+  }
+  free(u.p);
+  free(b.p);
+  return rc;
+}
+
+static int CheckSnapshotable(struct Machine *m) {
+  struct Dll *e;
+  if (m->mode.omode != XED_MODE_LONG || m->metal) {
+    LOGF("only long mode programs can be snapshotted");
+    return einval();
+  }
+  LOCK(&m->system->machines_lock);
+  e = dll_first(m->system->machines);
+  e = dll_next(m->system->machines, e);
+  UNLOCK(&m->system->machines_lock);
+  if (e) {
+    LOGF("multi-threaded programs can't be snapshotted");
+    return einval();
+  }
+  return 0;
+}
+
+/**
+ * Saves state of guest process to file.
+ *
+ * This must be called by OpSyscall() before the system call is run. If
+ * `key` is non-null, then it's saved in the snapshot, and file handles
+ * aren't. The file is written under a temporary name first, so readers
+ * will either see a whole snapshot or none at all.
+ *
+ * @return 0 on success, or -1 w/ errno
+ */
+int SaveSnapshot(struct Machine *m, const char *path, const char *key,
+                 u32 keysize) {
+  int fd, rc;
+  char tmp[PATH_MAX];
+  if (CheckSnapshotable(m) == -1) return -1;
+  snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+  if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) == -1) {
+    return -1;
+  }
+  rc = WriteSnapshot(m, fd, key, keysize);
+  if (close(fd)) rc = -1;
+  if (!rc) rc = rename(tmp, path);
+  if (rc) unlink(tmp);
+  return rc;
+}
+
+/**
+ * Saves state of guest process for `-S SYSNO:PATH` flag.
+ *
+ * This is called by OpSyscall() the first time the guest issues the
+ * system call that was chosen. Failure is only reported, since the
+ * guest can keep on running either way.
+ */
+void TakeSnapshot(struct Machine *m) {
+  g_snapshot_sysno = -1;
+  if (SaveSnapshot(m, g_snapshot_path, 0, 0)) {
+    WriteErrorString(g_snapshot_path);
+    WriteErrorString(": failed to write snapshot: ");
+    WriteErrorString(DescribeHostErrno(errno));
+    WriteErrorString("\n");
+  } else {
+    LOGF("wrote snapshot %s at rip=%#" PRIx64, g_snapshot_path,
+         m->ip - m->oplen);
+  }
+}
+
+static void *Take(const char *meta, u32 *i, u32 n, u64 size) {
+  const char *p;
+  if (size > n - *i) return 0;
+  p = meta + *i;
+  *i += size;
+  return (void *)p;
+}
+
+static char *TakeString(const char *meta, u32 *i, u32 n, u32 size) {
+  char *p;
+  if (!size || !(p = (char *)Take(meta, i, n, size)) || p[size - 1]) return 0;
+  return p;
+}
+
+static bool IsSameFile(struct SnapshotFileMap *r, const char *path) {
+  struct SnapshotFileMap now;
+  if (r->offset == -1) return true;
+  memset(&now, 0, sizeof(now));
+  GetFileIdentity(path, &now);
+  return now.dev == r->dev && now.ino == r->ino && now.fsize == r->fsize &&
+         now.mtime == r->mtime;
+}
+
+// checks snapshot is well-formed and that the files it mapped haven't
+// changed, before anything about the machine is changed
+static int CheckSnapshot(const char *meta, u32 n,
+                         const struct SnapshotHeader *h, const char *key,
+                         u32 keysize) {
+  u32 i, j;
+  char *path, *k;
+  struct SnapshotFd *fd;
+  struct SnapshotFileMap *fm;
+  if (!h->linear && HasLinearMapping()) {
+    // guest may have been given addresses only possible without it
+    LOGF("snapshot was taken without linear memory, but system has it");
+    return einval();
+  }
+  i = sizeof(*h);
+  if (!Take(meta, &i, n, (u64)h->regions * sizeof(struct SnapshotRegion))) {
+    return enoexec();
+  }
+  for (j = 0; j < 4; ++j) {
+    if (!TakeString(meta, &i, n, h->strings[j])) return enoexec();
+  }
+  if (!(k = (char *)Take(meta, &i, n, h->keysize))) return enoexec();
+  if (key && (keysize != h->keysize || memcmp(key, k, keysize))) {
+    errno = ESTALE;
+    return -1;
+  }
+  for (j = 0; j < h->filemaps; ++j) {
+    if (!(fm = (struct SnapshotFileMap *)Take(meta, &i, n, sizeof(*fm))) ||
+        !Take(meta, &i, n,
+              ROUNDUP(ROUNDUP((u64)fm->size, 4096) / 4096, 64) / 64 * 8) ||
+        !(path = TakeString(meta, &i, n, fm->pathlen))) {
+      return enoexec();
+    }
+    if (!IsSameFile(fm, path)) {
+      LOGF("%s changed since snapshot was taken", path);
+      errno = ESTALE;
+      return -1;
+    }
+  }
+  for (j = 0; j < h->fds; ++j) {
+    if (!(fd = (struct SnapshotFd *)Take(meta, &i, n, sizeof(*fd))) ||
+        !TakeString(meta, &i, n, fd->pathlen) || fd->fildes < 3) {
+      return enoexec();
+    }
+  }
+  return 0;
+}
+
+static int RestoreFd(struct System *s, struct SnapshotFd *rec,
+                     const char *path) {
+  int fildes;
+  struct Fd *fd;
+  if ((fildes = VfsOpen(AT_FDCWD, path, rec->oflags, 0)) == -1) return -1;
+  if (fildes != rec->fildes) {
+    if (VfsDup3(fildes, rec->fildes, rec->oflags & O_CLOEXEC) == -1) {
+      VfsClose(fildes);
+      return -1;
+    }
+    VfsClose(fildes);
+    fildes = rec->fildes;
+  }
+  if (rec->offset && VfsSeek(fildes, rec->offset, SEEK_SET) == -1) return -1;
+  LOCK(&s->fds.lock);
+  if ((fd = AddFd(&s->fds, fildes, rec->oflags))) {
+    fd->path = strdup(path);
+  }
+  UNLOCK(&s->fds.lock);
+  return fd ? 0 : -1;
+}
+
+static void RestoreMachine(struct Machine *m, const struct SnapshotHeader *h) {
+  int sig;
+  _Atomic(i32) *tid;
+  struct System *s = m->system;
+  s->iscosmo = h->iscosmo;
+  s->brkchanged = h->brkchanged;
+  s->brk = h->brk;
+  s->automap = h->automap;
+  s->codestart = h->codestart;
+  s->codesize = h->codesize;
+  s->elf.base = h->elf_base;
+  s->elf.aslr = h->elf_aslr;
+  memcpy(s->elf.rng, h->elf_rng, sizeof(h->elf_rng));
+  s->elf.at_base = h->elf_at_base;
+  s->elf.at_phdr = h->elf_at_phdr;
+  s->elf.at_phent = h->elf_at_phent;
+  s->elf.at_entry = h->elf_at_entry;
+  s->elf.at_phnum = h->elf_at_phnum;
+  s->elf.at_sysinfo_ehdr = h->elf_at_sysinfo_ehdr;
+  m->ip = h->ip;
+  m->flags = h->flags;
+  m->mxcsr = h->mxcsr;
+  memcpy(m->beg, h->beg, sizeof(h->beg));
+  memcpy(m->xmm, h->xmm, sizeof(h->xmm));
+  memcpy(m->seg, h->seg, sizeof(h->seg));
+  memcpy(&m->fpu, &h->fpu, sizeof(h->fpu));
+  m->sigmask = h->sigmask;
+  memcpy(&m->sigaltstack, &h->sigaltstack, sizeof(h->sigaltstack));
+  m->robust_list = h->robust_list;
+  m->ctid = h->ctid;
+  if (h->tid != m->tid && !(h->ctid & 3) &&
+      (tid = (_Atomic(i32) *)LookupAddress(m, h->ctid)) &&
+      (i32)Little32(atomic_load_explicit(tid, memory_order_relaxed)) ==
+          h->tid) {
+    // libc will have remembered the thread id set_tid_address() gave it
+    atomic_store_explicit(tid, Little32(m->tid), memory_order_relaxed);
+  }
+  memcpy(s->hands, h->hands, sizeof(s->hands));
+  memcpy(s->rlim, h->rlim, sizeof(s->rlim));
+  for (sig = 1; sig <= 64; ++sig) {
+    if (Read64(s->hands[sig - 1].handler) != SIG_DFL_LINUX) {
+      InstallSigaction(s, sig);
+    }
+  }
+}
+
+static int RestoreMemory(struct System *s, int fd, const char *meta, u32 *i,
+                         u32 n, const struct SnapshotHeader *h) {
+  u32 j;
+  struct SnapshotRegion *r;
+  for (j = 0; j < h->regions; ++j) {
+    r = (struct SnapshotRegion *)Take(meta, i, n, sizeof(*r));
+    if (r->key & ~KEY_FLAGS) return enoexec();
+    if (r->offset == -1) {
+      if (ReserveVirtual(s, r->virt, r->size, r->key, -1, 0, false, false) ==
+          -1) {
+        return -1;
+      }
+    } else {
+      // PAGE_FILE stops this mapping from showing up as a file map,
+      // since the file maps the guest knows about are restored below
+      if (ReserveVirtual(s, r->virt, r->size, r->key | PAGE_FILE, fd,
+                         r->offset, false, false) == -1) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+static int RestoreFileMaps(struct System *s, const char *meta, u32 *i, u32 n,
+                           const struct SnapshotHeader *h) {
+  u32 j;
+  char *path;
+  u64 k, words, pages;
+  u64 *present;
+  struct FileMap *fm;
+  struct SnapshotFileMap *r;
+  for (j = 0; j < h->filemaps; ++j) {
+    r = (struct SnapshotFileMap *)Take(meta, i, n, sizeof(*r));
+    words = ROUNDUP(ROUNDUP((u64)r->size, 4096) / 4096, 64) / 64;
+    present = (u64 *)Take(meta, i, n, words * 8);
+    path = TakeString(meta, i, n, r->pathlen);
+    for (pages = k = 0; k < words; ++k) {
+      pages += popcount(present[k]);
+    }
+    if (!pages) continue;
+    if (!(fm = AddFileMap(s, r->virt, r->size, path, r->offset))) return -1;
+    memcpy(fm->present, present, words * 8);
+    fm->pages = pages;
+  }
+  return 0;
+}
+
+static int RestoreFds(struct System *s, const char *meta, u32 *i, u32 n,
+                      const struct SnapshotHeader *h) {
+  u32 j;
+  char *path;
+  struct SnapshotFd *r;
+  for (j = 0; j < h->fds; ++j) {
+    r = (struct SnapshotFd *)Take(meta, i, n, sizeof(*r));
+    path = TakeString(meta, i, n, r->pathlen);
+    if (RestoreFd(s, r, path) == -1) {
+      LOGF("failed to reopen fd %d (%s): %s", r->fildes, path,
+           DescribeHostErrno(errno));
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int RestoreSnapshotImpl(struct Machine *m, int fd, const char *meta,
+                               u32 n, const struct SnapshotHeader *h) {
+  u32 i, j;
+  char *str[4];
+  struct System *s = m->system;
+  s->loaded = false;
+  ResetCpu(m);
+  s->cr0 = CR0_PE | CR0_MP | CR0_ET | CR0_PG;
+  s->cr3 = AllocatePageTable(s);
+  i = sizeof(*h);
+  if (RestoreMemory(s, fd, meta, &i, n, h) == -1) return -1;
+  VfsClose(fd);  // guest memory still maps it, and its number may be used
+  for (j = 0; j < 4; ++j) {
+    str[j] = TakeString(meta, &i, n, h->strings[j]);
+  }
+  Take(meta, &i, n, h->keysize);
+  if (RestoreFileMaps(s, meta, &i, n, h) == -1) return -1;
+  if (VfsChdir(str[3]) == -1) return -1;
+  if (RestoreFds(s, meta, &i, n, h) == -1) return -1;
+  s->elf.execfn = strdup(str[0]);
+  s->elf.prog = strdup(str[1]);
+  s->elf.interpreter = *str[2] ? strdup(str[2]) : 0;
+  RestoreMachine(m, h);
+  s->loaded = true;
+#ifndef DISABLE_VFS
+  unassert(!ProcfsRegisterExe(getpid(), s->elf.prog));
+#endif
+  return 0;
+}
+
+/**
+ * Configures blink to be able to restore snapshot.
+ *
+ * This must be called before the system is created. A snapshot which
+ * was taken without linear memory may have given the guest addresses
+ * that can't be used with it, so linear memory gets disabled, as `-m`
+ * would. If the snapshot can't be read, RestoreSnapshot() will report
+ * the problem later on.
+ */
+void PrepareSnapshot(const char *path) {
+  int fd;
+  struct SnapshotHeader h;
+  if ((fd = VfsOpen(AT_FDCWD, path, O_RDONLY | O_CLOEXEC, 0)) == -1) return;
+  if (VfsPread(fd, &h, sizeof(h), 0) == sizeof(h) &&
+      !memcmp(h.magic, kSnapshotMagic, sizeof(h.magic)) &&
+      h.version == kSnapshotVersion && h.size == sizeof(h) && !h.linear) {
+    FLAG_nolinear = true;
+  }
+  VfsClose(fd);
+}
+
+/**
+ * Resumes guest process from snapshot.
+ *
+ * This takes the place of LoadProgram() on a freshly created machine,
+ * whose standard file descriptors should already have been added. The
+ * machine resumes at the system call the snapshot was taken during.
+ *
+ * If `key` is non-null, then the snapshot is only restored if it was
+ * saved with the same key, and its file handles are ignored.
+ *
+ * Failure is only returned if the snapshot couldn't be used, e.g. the
+ * files it mapped have changed since, in which case the machine wasn't
+ * modified. Errors that happen once restoring has begun are fatal.
+ *
+ * @return 0 on success, or -1 w/ errno
+ */
+int RestoreSnapshot(struct Machine *m, const char *path, const char *key,
+                    u32 keysize) {
+  int fd;
+  u32 n;
+  char *meta;
+  struct SnapshotHeader h;
+  if ((fd = VfsOpen(AT_FDCWD, path, O_RDONLY | O_CLOEXEC, 0)) == -1) {
+    return -1;
+  }
+  meta = 0;
+  if (VfsPread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+      memcmp(h.magic, kSnapshotMagic, sizeof(h.magic)) ||
+      h.version != kSnapshotVersion || h.size != sizeof(h) ||
+      h.metasize < sizeof(h)) {
+    LOGF("%s isn't a snapshot written by this build of blink", path);
+    errno = ENOEXEC;
+    goto Failure;
+  }
+  n = h.metasize;
+  if (!(meta = (char *)malloc(n))) goto Failure;
+  if (VfsPread(fd, meta, n, 0) != n) {
+    errno = ENOEXEC;
+    goto Failure;
+  }
+  if (CheckSnapshot(meta, n, &h, key, keysize) == -1) goto Failure;
+  if (RestoreSnapshotImpl(m, fd, meta, n, &h) == -1) {
+    WriteErrorString(path);
+    WriteErrorString(": failed to restore snapshot: ");
+    WriteErrorString(DescribeHostErrno(errno));
+    WriteErrorString("\n");
+    exit(127);
+  }
+  free(meta);
+  return 0;
+Failure:
+  free(meta);
+  VfsClose(fd);
+  return -1;
+}
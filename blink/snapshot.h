@@ -0,0 +1,98 @@
+#ifndef BLINK_SNAPSHOT_H_
+#define BLINK_SNAPSHOT_H_
+#include <stdbool.h>
+
+#include "blink/linux.h"
+#include "blink/machine.h"
+#include "blink/types.h"
+
+#define kSnapshotMagic   "blinkss1"
+#define kSnapshotVersion 2
+#define kSnapshotAlign   65536
+
+// a snapshot begins with this header, in host byte order, and it may
+// only be restored by the same build of blink that had written it out
+struct SnapshotHeader {
+  char magic[8];    // kSnapshotMagic
+  u32 version;      // kSnapshotVersion
+  u32 size;         // sizeof(struct SnapshotHeader)
+  u32 metasize;     // bytes of header and records before page data
+  u32 regions;      // number of SnapshotRegion records after header
+  u32 strings[4];   // bytes incl. nul of execfn, prog, interpreter, cwd
+  u32 keysize;      // bytes of key that follow the strings
+  u32 filemaps;     // number of SnapshotFileMap records after key
+  u32 fds;          // number of SnapshotFd records after file maps
+  bool linear;      // was memory linear when snapshot was taken
+  bool iscosmo;     // System::iscosmo
+  bool brkchanged;  // System::brkchanged
+  i64 brk;
+  i64 automap;
+  i64 codestart;
+  i64 codesize;
+  i64 elf_base;
+  i64 elf_aslr;
+  u8 elf_rng[16];
+  i64 elf_at_base;
+  i64 elf_at_phdr;
+  i64 elf_at_phent;
+  i64 elf_at_entry;
+  i64 elf_at_phnum;
+  i64 elf_at_sysinfo_ehdr;
+  u64 ip;  // address of the system call instruction
+  u32 flags;
+  u32 mxcsr;
+  u8 beg[128];
+  u8 xmm[16][16];
+  struct DescriptorCache seg[8];
+  struct MachineFpu fpu;
+  u64 sigmask;
+  struct sigaltstack_linux sigaltstack;
+  i64 robust_list;
+  i64 ctid;
+  i32 tid;  // thread id, which libc may have cached at ctid
+  i32 pad;
+  struct sigaction_linux hands[64];
+  struct rlimit_linux rlim[RLIM_NLIMITS_LINUX];
+};
+
+// followed by the intervals of guest memory
+struct SnapshotRegion {
+  i64 virt;    // guest address of first page
+  i64 size;    // bytes of memory in region
+  u64 key;     // page table entry bits, e.g. PAGE_U
+  i64 offset;  // snapshot file offset of page contents, or -1 if zeroes
+};
+
+// followed by the strings, the key, and the file map records, each of
+// which is followed by its present bits and path, so /proc/self/maps
+// and the debugger still know what's what
+struct SnapshotFileMap {
+  i64 virt;
+  i64 size;
+  i64 offset;
+  u32 pathlen;  // bytes of path that follow the present bits, incl. nul
+  u32 pad;
+  u64 dev;      // st_dev of file when snapshot was taken
+  u64 ino;      // st_ino of file when snapshot was taken
+  i64 fsize;    // st_size of file when snapshot was taken
+  i64 mtime;    // st_mtim of file in nanoseconds
+};
+
+// followed by the files that were open, each followed by its path
+struct SnapshotFd {
+  i32 fildes;   // guest file descriptor number
+  i32 oflags;   // host O_XXX flags
+  i64 offset;   // file position
+  u32 pathlen;  // bytes of path that follow, including nul
+  u32 pad;
+};
+
+extern int g_snapshot_sysno;
+
+int SetSnapshotSpec(const char *);
+void TakeSnapshot(struct Machine *);
+int SaveSnapshot(struct Machine *, const char *, const char *, u32);
+int RestoreSnapshot(struct Machine *, const char *, const char *, u32);
+void PrepareSnapshot(const char *);
+
+#endif /* BLINK_SNAPSHOT_H_ */
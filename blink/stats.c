@@ -18,28 +18,161 @@
 ╚─────────────────────────────────────────────────────────────────────────────*/
 #include "blink/stats.h"
 
+#include <stdio.h>
+#include <string.h>
+
+#include "blink/assert.h"
 #include "blink/log.h"
+#include "blink/macros.h"
+#include "blink/systrace.h"
+
+#define APPEND(...) o += snprintf(b + o, o > n ? 0 : n - o, __VA_ARGS__)
+
+pthread_mutex_t_ g_stats_lock = PTHREAD_MUTEX_INITIALIZER_;
+_Thread_local struct Stats g_stats;
+
+static struct {
+  struct Dll *live;    // counters of each running thread
+  struct Stats gone;   // what threads which exited had counted
+} g_statsreg;
 
-#define DEFINE_AVERAGE(S) struct Average S;
-#define DEFINE_COUNTER(S) long S;
+static void AddStats(struct Stats *x, const struct Stats *y) {
+#define DEFINE_COUNTER(S) x->S += y->S;
+#define DEFINE_MAXIMUM(S) x->S = MAX(x->S, y->S);
+#define DEFINE_AVERAGE(S)                                          \
+  if (y->S.i) {                                                    \
+    x->S.a = (x->S.a * x->S.i + y->S.a * y->S.i) / (x->S.i + y->S.i); \
+    x->S.i += y->S.i;                                              \
+  }
 #include "blink/stats.inc"
-#undef DEFINE_AVERAGE
 #undef DEFINE_COUNTER
+#undef DEFINE_MAXIMUM
+#undef DEFINE_AVERAGE
+}
 
-#define APPEND(...) o += snprintf(b + o, o > n ? 0 : n - o, __VA_ARGS__)
+// enrolls the calling thread's counters, so they can be read while the
+// thread is still running; it's fine to call this more than once
+void RegisterStats(int tid) {
+  LOCK(&g_stats_lock);
+  if (!g_stats.tid) {
+    dll_init(&g_stats.elem);
+    dll_make_last(&g_statsreg.live, &g_stats.elem);
+  }
+  g_stats.tid = tid;
+  UNLOCK(&g_stats_lock);
+}
 
-void PrintStats(void) {
-#ifndef NDEBUG
-  char b[4096];
-  int n = sizeof(b);
+// retires the calling thread's counters, which must happen before the
+// thread exits, since its thread-local storage goes away with it
+void UnregisterStats(void) {
+  LOCK(&g_stats_lock);
+  if (g_stats.tid) {
+    dll_remove(&g_statsreg.live, &g_stats.elem);
+    AddStats(&g_statsreg.gone, &g_stats);
+    g_stats.tid = 0;
+  }
+  UNLOCK(&g_stats_lock);
+}
+
+// called by the child of fork(), in which only the calling thread is
+// still running; what the other threads counted is kept as history
+void RemoveOtherStats(int tid) {
+  struct Dll *e, *e2;
+  unassert(!pthread_mutex_init(&g_stats_lock, 0));
+  for (e = dll_first(g_statsreg.live); e; e = e2) {
+    e2 = dll_next(g_statsreg.live, e);
+    if (e != &g_stats.elem) {
+      dll_remove(&g_statsreg.live, e);
+      AddStats(&g_statsreg.gone, DLL_CONTAINER(struct Stats, elem, e));
+    }
+  }
+  if (g_stats.tid) g_stats.tid = tid;
+}
+
+static void SumStatsLocked(struct Stats *out) {
+  struct Dll *e;
+  memset(out, 0, sizeof(*out));
+  AddStats(out, &g_statsreg.gone);
+  for (e = dll_first(g_statsreg.live); e; e = dll_next(g_statsreg.live, e)) {
+    IGNORE_RACES_START();
+    AddStats(out, DLL_CONTAINER(struct Stats, elem, e));
+    IGNORE_RACES_END();
+  }
+}
+
+// adds together the counters of every thread this process ever had
+void SumStats(struct Stats *out) {
+  LOCK(&g_stats_lock);
+  SumStatsLocked(out);
+  UNLOCK(&g_stats_lock);
+}
+
+// copies the counters of a single running thread
+bool GetThreadStats(int tid, struct Stats *out) {
+  struct Dll *e;
+  bool found = false;
+  memset(out, 0, sizeof(*out));
+  LOCK(&g_stats_lock);
+  for (e = dll_first(g_statsreg.live); e; e = dll_next(g_statsreg.live, e)) {
+    if (DLL_CONTAINER(struct Stats, elem, e)->tid == tid) {
+      IGNORE_RACES_START();
+      AddStats(out, DLL_CONTAINER(struct Stats, elem, e));
+      IGNORE_RACES_END();
+      found = true;
+      break;
+    }
+  }
+  UNLOCK(&g_stats_lock);
+  out->tid = tid;
+  return found;
+}
+
+// renders nonzero counters as text, returning the length it wanted
+int FormatStats(char *b, int n, const struct Stats *s) {
   int o = 0;
-  b[0] = 0;
+  if (n) b[0] = 0;
 #define DEFINE_COUNTER(S) \
-  if (S) APPEND("%-32s = %ld\n", #S, S);
+  if (s->S) APPEND("%-32s = %ld\n", #S, s->S);
+#define DEFINE_MAXIMUM(S) DEFINE_COUNTER(S)
 #define DEFINE_AVERAGE(S) \
-  if (S.a) APPEND("%-32s = %.6g\n", #S, S.a);
+  if (s->S.a) APPEND("%-32s = %.6g\n", #S, s->S.a);
 #include "blink/stats.inc"
-#undef S
+#undef DEFINE_COUNTER
+#undef DEFINE_MAXIMUM
+#undef DEFINE_AVERAGE
+  return o;
+}
+
+// prints counters, which only debug builds have, and the system call
+// latency histograms, which all builds keep if system calls are traced
+void PrintStats(void) {
+  char b[12288];
+#ifndef NDEBUG
+  struct Stats s;
+  SumStats(&s);
+  FormatStats(b, sizeof(b), &s);
+  WriteErrorString(b);
+#endif
+  if (g_systrace) {
+    FormatSysStats(b, sizeof(b), 0);
+    WriteErrorString(b);
+  }
+}
+
+// prints statistics from a signal handler, which may have interrupted
+// a thread that's holding the lock, in which case nothing is printed
+void PrintStatsFromSignal(void) {
+  char b[12288];
+#ifndef NDEBUG
+  struct Stats s;
+  if (pthread_mutex_trylock(&g_stats_lock)) return;
+  SumStatsLocked(&s);
+  UNLOCK(&g_stats_lock);
+  FormatStats(b, sizeof(b), &s);
   WriteErrorString(b);
 #endif
+  if (g_systrace) {
+    FormatSysStatsFromSignal(b, sizeof(b));
+    WriteErrorString(b);
+  }
 }
@@ -3,6 +3,8 @@
 #include <stdbool.h>
 
 #include "blink/builtin.h"
+#include "blink/dll.h"
+#include "blink/thread.h"
 #include "blink/tsan.h"
 
 #ifndef NDEBUG
@@ -42,19 +44,36 @@
 #define GET_COUNTER(S) 0L
 #endif
 
-#define DEFINE_COUNTER(S) extern long S;
-#define DEFINE_AVERAGE(S) extern struct Average S;
-#include "blink/stats.inc"
-#undef DEFINE_COUNTER
-#undef DEFINE_AVERAGE
-
 struct Average {
   double a;
   long i;
 };
 
+// counters are kept separately by each thread, so that bumping them
+// never bounces cache lines between cores; readers add them together
+struct Stats {
+#define DEFINE_COUNTER(S) long S;
+#define DEFINE_MAXIMUM(S) long S;
+#define DEFINE_AVERAGE(S) struct Average S;
+#include "blink/stats.inc"
+#undef DEFINE_COUNTER
+#undef DEFINE_MAXIMUM
+#undef DEFINE_AVERAGE
+  struct Dll elem;
+  int tid;
+};
+
 extern bool FLAG_statistics;
+extern pthread_mutex_t_ g_stats_lock;
+extern _Thread_local struct Stats g_stats;
 
 void PrintStats(void);
+void PrintStatsFromSignal(void);
+void UnregisterStats(void);
+void RegisterStats(int);
+void RemoveOtherStats(int);
+void SumStats(struct Stats *);
+bool GetThreadStats(int, struct Stats *);
+int FormatStats(char *, int, const struct Stats *);
 
 #endif /* BLINK_STATS_H_ */
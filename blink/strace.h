@@ -146,6 +146,7 @@
 #define STRACE_FSTAT        NORMAL  RC0    FD         O_STAT     UN        UN        UN       UN
 #define STRACE_LSTAT        NORMAL  RC0    PATH       O_STAT     UN        UN        UN       UN
 #define STRACE_FSTATAT      NORMAL  RC0    DIRFD      PATH       O_STAT    ATFLAGS   UN       UN
+#define STRACE_STATX        NORMAL  RC0    DIRFD      PATH       ATFLAGS   HEX       HEX      UN
 #define STRACE_UTIMENSAT    NORMAL  RC0    DIRFD      PATH       O_TIME2   ATFLAGS   UN       UN
 #define STRACE_POLL         TWOWAY  I32    IO_POLL    I32        UN        UN        UN       UN
 #define STRACE_PPOLL        TWOWAY  RC0    IO_POLL    IO_TIME    I_SIGSET  SSIZE_    UN       UN
@@ -60,8 +60,10 @@
 #include "blink/endian.h"
 #include "blink/errno.h"
 #include "blink/flag.h"
+#include "blink/futex.h"
 #include "blink/iovs.h"
 #include "blink/limits.h"
+#include "blink/linkcache.h"
 #include "blink/linux.h"
 #include "blink/loader.h"
 #include "blink/log.h"
@@ -74,17 +76,21 @@
 #include "blink/preadv.h"
 #include "blink/random.h"
 #include "blink/signal.h"
+#include "blink/snapshot.h"
 #include "blink/stats.h"
+#include "blink/systrace.h"
 #include "blink/strace.h"
 #include "blink/swap.h"
 #include "blink/thread.h"
 #include "blink/timespec.h"
 #include "blink/util.h"
+#include "blink/vdso.h"
 #include "blink/vfs.h"
 #include "blink/xlat.h"
 
 #ifdef __linux
 #include <sys/prctl.h>
+#include <sys/syscall.h>
 #endif
 
 #ifdef __EMSCRIPTEN__
@@ -131,6 +137,8 @@
     if (STRACE && FLAG_strace) {                                  \
       Strace(m, name, false, &(signature)[1], ax SYSARGS##arity); \
     }                                                             \
+    sysname = name;                                               \
+    syssig = signature;                                           \
     break
 
 char *g_blink_path;
@@ -222,7 +230,7 @@ const char *GetDirFildesPath(struct System *s, int fildes) {
 
 void SignalActor(struct Machine *m) {
   for (;;) {
-    STATISTIC(++interps);
+    STATISTIC(++g_stats.interps);
     JitlessDispatch(DISPATCH_NOTHING);
     if (atomic_load_explicit(&m->attention, memory_order_acquire)) {
       if (m->restored) break;
@@ -294,44 +302,63 @@ HandleSomeMoreInterrupts:
   return res;
 }
 
-static struct Futex *FindFutex(struct Machine *m, i64 addr) {
-  struct Dll *e;
-  for (e = dll_first(g_bus->futexes.active); e;
-       e = dll_next(g_bus->futexes.active, e)) {
-    if (FUTEX_CONTAINER(e)->addr == addr) {
-      return FUTEX_CONTAINER(e);
+/**
+ * Sleeps until `deadline` or until there's an interrupt to handle.
+ *
+ * Host signals stay blocked while we check for pending guest signals,
+ * and only get unblocked by the host kernel once we're asleep. So the
+ * SIGSYS kicks which EnqueueSignal() and KillOtherThreads() send to a
+ * thread that's waiting here wake it up immediately, and they can't
+ * slip in unnoticed between the check and the sleep.
+ *
+ * @return 0 once `deadline` passes, or -1 w/ EINTR if the caller needs
+ *     to use CheckInterrupt() or notice it's been killed
+ */
+int SleepHost(struct Machine *m, struct timespec deadline) {
+  int rc;
+  sigset_t block, oldmask;
+  struct timespec now, waitfor;
+  unassert(!sigfillset(&block));
+  unassert(!pthread_sigmask(SIG_BLOCK, &block, &oldmask));
+  for (;;) {
+    if (atomic_load_explicit(&m->killed, memory_order_acquire) ||
+        (!m->metal && (m->signals & ~m->sigmask))) {
+      rc = eintr();
+      break;
+    }
+    now = GetTime();
+    if (CompareTime(now, deadline) >= 0) {
+      rc = 0;
+      break;
+    }
+    waitfor = SubtractTime(deadline, now);
+#ifdef HAVE_PPOLL
+    ppoll(0, 0, &waitfor, &oldmask);
+#else
+    // without ppoll() a kick may slip in between unblocking and sleeping
+    // so we bound how long it could go unnoticed by waking up regularly
+    if (CompareTime(waitfor, FromMilliseconds(kPollingMs)) > 0) {
+      waitfor = FromMilliseconds(kPollingMs);
     }
+    unassert(!pthread_sigmask(SIG_SETMASK, &oldmask, 0));
+    nanosleep(&waitfor, 0);
+    unassert(!pthread_sigmask(SIG_BLOCK, &block, 0));
+#endif
   }
-  return 0;
+  unassert(!pthread_sigmask(SIG_SETMASK, &oldmask, 0));
+  return rc;
 }
 
-static int SysFutexWake(struct Machine *m, i64 uaddr, u32 count) {
-  int rc;
-  struct Futex *f;
-  if (!count) return 0;
-  LOCK(&g_bus->futexes.lock);
-  if ((f = FindFutex(m, uaddr))) {
-    LOCK(&f->lock);
-  }
-  UNLOCK(&g_bus->futexes.lock);
-  if (f && f->waiters) {
-    THR_LOGF("pid=%d tid=%d is waking %d waiters at address %#" PRIx64,
-             m->system->pid, m->tid, f->waiters, uaddr);
-    if (count == 1) {
-      unassert(!pthread_cond_signal(&f->cond));
-      rc = 1;
-    } else {
-      unassert(!pthread_cond_broadcast(&f->cond));
-      rc = f->waiters;
+// sleeps until deadline unless a signal handler is called or we're killed
+static int SleepGuest(struct Machine *m, struct timespec deadline) {
+  for (;;) {
+    if (!SleepHost(m, deadline)) return 0;
+    // this may run a guest signal handler before returning
+    if (CheckInterrupt(m, false)) return -1;
+    if (atomic_load_explicit(&m->killed, memory_order_acquire)) {
+      return eintr();
     }
-    UNLOCK(&f->lock);
-  } else {
-    if (f) UNLOCK(&f->lock);
-    THR_LOGF("pid=%d tid=%d is waking no one at address %#" PRIx64,
-             m->system->pid, m->tid, uaddr);
-    rc = 0;
   }
-  return rc;
 }
 
 static void ClearChildTid(struct Machine *m) {
@@ -344,8 +371,8 @@ static void ClearChildTid(struct Machine *m) {
     } else {
       THR_LOGF("invalid clear child tid address %#" PRIx64, m->ctid);
     }
+    FutexWake(m, m->ctid, INT_MAX, FUTEX_BITSET_MATCH_ANY_LINUX, true);
   }
-  SysFutexWake(m, m->ctid, INT_MAX);
 #endif
 }
 
@@ -353,11 +380,10 @@ _Noreturn void SysExitGroup(struct Machine *m, int rc) {
   THR_LOGF("pid=%d tid=%d SysExitGroup", m->system->pid, m->tid);
   ClearChildTid(m);
   if (m->system->isfork) {
-#ifndef NDEBUG
     if (FLAG_statistics) {
       PrintStats();
     }
-#endif
+    FlushSysTraces();
     THR_LOGF("calling _Exit(%d)", rc);
     _Exit(rc);
   } else {
@@ -375,11 +401,9 @@ _Noreturn void SysExitGroup(struct Machine *m, int rc) {
 #ifdef HAVE_JIT
     ShutdownJit();
 #endif
-#ifndef NDEBUG
     if (FLAG_statistics) {
       PrintStats();
     }
-#endif
     exit(rc);
   }
 }
@@ -392,6 +416,8 @@ _Noreturn void SysExit(struct Machine *m, int rc) {
   } else {
     ClearChildTid(m);
     FreeMachine(m);
+    UnregisterSysTrace();
+    UnregisterStats();
     pthread_exit(0);
   }
 #else
@@ -416,12 +442,13 @@ static int Fork(struct Machine *m, u64 flags, u64 stack, u64 ctid) {
     LOCK(&m->system->pagelocks_lock);
     LOCK(&m->system->fds.lock);
     LOCK(&m->system->machines_lock);
-#ifndef HAVE_PTHREAD_PROCESS_SHARED
-    LOCK(&g_bus->futexes.lock);
-#endif
 #ifdef HAVE_JIT
     LOCK(&m->system->jit.lock);
 #endif
+#ifndef DISABLE_VFS
+    LOCK(&g_vfs.dentrylock);
+#endif
+    LOCK(&g_stats_lock);
   }
   pid = fork();
 #ifdef __HAIKU__
@@ -430,11 +457,12 @@ static int Fork(struct Machine *m, u64 flags, u64 stack, u64 ctid) {
   if (!pid) g_machine = m;
 #endif
   if (m->threaded) {
+    UNLOCK(&g_stats_lock);
+#ifndef DISABLE_VFS
+    UNLOCK(&g_vfs.dentrylock);
+#endif
 #ifdef HAVE_JIT
     UNLOCK(&m->system->jit.lock);
-#endif
-#ifndef HAVE_PTHREAD_PROCESS_SHARED
-    UNLOCK(&g_bus->futexes.lock);
 #endif
     UNLOCK(&m->system->machines_lock);
     UNLOCK(&m->system->fds.lock);
@@ -451,11 +479,14 @@ static int Fork(struct Machine *m, u64 flags, u64 stack, u64 ctid) {
 #ifndef HAVE_PTHREAD_PROCESS_SHARED
     InitBus();
 #endif
+    InitFutexes();
+    ResetIoUrings();
     THR_LOGF("pid=%d tid=%d SysFork -> pid=%d tid=%d",  //
              m->system->pid, m->tid, newpid, newpid);
     m->tid = m->system->pid = newpid;
     m->system->isfork = true;
     RemoveOtherThreads(m->system);
+    RemoveOtherStats(newpid);
 #ifdef __CYGWIN__
     // Cygwin doesn't seem to properly set the PROT_EXEC
     // protection for JIT blocks after forking.
@@ -479,16 +510,121 @@ static int SysFork(struct Machine *m) {
   return Fork(m, 0, 0, 0);
 }
 
+// vfork() lends the parent's machine and memory to the child, like on
+// linux, so the common case of a child that only changes its signals
+// and then calls execve() won't need its own copy of blink until then
+static int Vfork(struct Machine *m, u64 flags, u64 stack, u64 ctid) {
+  struct Vfork *v;
+  if (m->threaded || m->sysdepth > 1 ||
+      (flags & (CLONE_CHILD_SETTID_LINUX | CLONE_CHILD_CLEARTID_LINUX)) ||
+      !(v = (struct Vfork *)malloc(sizeof(*v)))) {
+    return Fork(m, flags, stack, ctid);
+  }
+  THR_LOGF("pid=%d tid=%d SysVfork", m->system->pid, m->tid);
+  STATISTIC(++g_stats.vfork_borrows);
+  v->ip = m->ip;
+  v->flags = m->flags;
+  v->mxcsr = m->mxcsr;
+  v->sigmask = m->sigmask;
+  memcpy(v->beg, m->beg, sizeof(v->beg));
+  memcpy(v->xmm, m->xmm, sizeof(v->xmm));
+  memcpy(v->seg, m->seg, sizeof(v->seg));
+  memcpy(&v->fpu, &m->fpu, sizeof(v->fpu));
+  LOCK(&m->system->sig_lock);
+  memcpy(v->hands, m->system->hands, sizeof(v->hands));
+  UNLOCK(&m->system->sig_lock);
+  m->vfork = v;
+  if (stack) {
+    Put64(m->sp, stack);
+  }
+  return 0;
+}
+
+/**
+ * Gives the child of vfork() a process of its own.
+ *
+ * This is called when the child does something other than changing
+ * its signal handlers or signal mask. The parent's registers will be
+ * restored and vfork() returns the new pid to it. Any memory the child
+ * changed before now stays changed for the parent, as it would have on
+ * Linux. If `lean` is true, then the child promises it won't touch its
+ * writable guest memory ever again, so that needn't be copied.
+ *
+ * @return true if caller is the parent, or false if it's the child
+ */
+bool SplitVfork(struct Machine *m, bool lean) {
+  int i, pid;
+  struct Vfork *v;
+  unassert((v = m->vfork));
+  m->vfork = 0;
+  if (IsMakingPath(m)) {
+    AbandonPath(m);
+  }
+  if (lean) {
+    SetMemoryForkable(m->system, false);
+  }
+  if (!(pid = Fork(m, 0, 0, 0))) {
+    if (lean) {
+      ReserveUnforkedMemory(m->system);
+    }
+    m->ctid = 0;
+    m->robust_list = 0;
+    m->signals = 0;  // these were sent to the parent
+    free(v);
+    return false;
+  }
+  if (lean) {
+    SetMemoryForkable(m->system, true);
+    STATISTIC(++g_stats.vfork_lean_forks);
+  }
+  m->ip = v->ip;
+  m->flags = v->flags;
+  m->mxcsr = v->mxcsr;
+  m->sigmask = v->sigmask;
+  memcpy(m->beg, v->beg, sizeof(m->beg));
+  memcpy(m->xmm, v->xmm, sizeof(m->xmm));
+  memcpy(m->seg, v->seg, sizeof(m->seg));
+  memcpy(&m->fpu, &v->fpu, sizeof(m->fpu));
+  LOCK(&m->system->sig_lock);
+  for (i = 0; i < 64; ++i) {
+    if (memcmp(&m->system->hands[i], &v->hands[i], sizeof(v->hands[i]))) {
+      m->system->hands[i] = v->hands[i];
+      InstallSigaction(m->system, i + 1);
+    }
+  }
+  UNLOCK(&m->system->sig_lock);
+  Put64(m->ax, pid != -1 ? pid : -(XlatErrno(errno) & 0xfff));
+  // deliver whatever signals arrived while the child was running
+  atomic_store_explicit(&m->attention, true, memory_order_release);
+  free(v);
+  return true;
+}
+
+// returns true if a vfork() child may issue system call in its parent
+static bool IsVforkSafe(int sysno) {
+  switch (sysno) {
+    case 0x00D:  // rt_sigaction
+    case 0x00E:  // rt_sigprocmask
+    case 0x03B:  // execve
+      return true;
+    default:
+      return false;
+  }
+}
+
 static int SysVfork(struct Machine *m) {
-  // TODO: Parent should be stopped while child is running.
-  return SysFork(m);
+  return Vfork(m, 0, 0, 0);
 }
 
 static void *OnSpawn(void *arg) {
   int rc;
   struct Machine *m = (struct Machine *)arg;
   THR_LOGF("pid=%d tid=%d OnSpawn", m->system->pid, m->tid);
+  // wait for SysSpawn() to finish publishing our tid
+  LOCK(&m->system->machines_lock);
+  UNLOCK(&m->system->machines_lock);
   m->thread = pthread_self();
+  RegisterStats(m->tid);
   if (!(rc = sigsetjmp(m->onhalt, 1))) {
     m->canhalt = true;
     unassert(!pthread_sigmask(SIG_SETMASK, &m->spawn_sigmask, 0));
@@ -569,16 +705,20 @@ static int SysSpawn(struct Machine *m, u64 flags, u64 stack, u64 ptid, u64 ctid,
   m2->spawn_sigmask = oldss;
   unassert(!pthread_attr_init(&attr));
   unassert(!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED));
+  // ptid is often ctid, so it must be stored before the child can run,
+  // or a thread that exits quickly would have its cleared tid come back
+  LOCK(&m->system->machines_lock);
   err = pthread_create(&thread, &attr, OnSpawn, m2);
+  if (!err && (flags & CLONE_PARENT_SETTID_LINUX)) {
+    atomic_store_explicit(ptid_ptr, Little32(tid), memory_order_release);
+  }
+  UNLOCK(&m->system->machines_lock);
   unassert(!pthread_attr_destroy(&attr));
   if (err) {
     FreeMachine(m2);
     unassert(!pthread_sigmask(SIG_SETMASK, &oldss, 0));
     return eagain();
   }
-  if (flags & CLONE_PARENT_SETTID_LINUX) {
-    atomic_store_explicit(ptid_ptr, Little32(tid), memory_order_release);
-  }
   unassert(!pthread_sigmask(SIG_SETMASK, &oldss, 0));
   return tid;
 }
@@ -595,6 +735,9 @@ static int SysClone(struct Machine *m, u64 flags, u64 stack, u64 ptid, u64 ctid,
                     u64 tls, u64 func) {
   if (IsForkOrVfork(flags)) {
 #ifdef HAVE_FORK
+    if (flags & CLONE_VFORK_LINUX) {
+      return Vfork(m, flags, stack, ctid);
+    }
     return Fork(m, flags, stack, ctid);
 #else
     LOGF("forking support disabled");
@@ -609,25 +752,6 @@ static int SysClone(struct Machine *m, u64 flags, u64 stack, u64 ptid, u64 ctid,
 #endif
 }
 
-static struct Futex *NewFutex(i64 addr) {
-  struct Dll *e;
-  struct Futex *f;
-  if (!(e = dll_first(g_bus->futexes.free))) {
-    LOG_ONCE(LOGF("ran out of futexes"));
-    enomem();
-    return 0;
-  }
-  dll_remove(&g_bus->futexes.free, e);
-  f = FUTEX_CONTAINER(e);
-  f->waiters = 1;
-  f->addr = addr;
-  return f;
-}
-
-static void FreeFutex(struct Futex *f) {
-  dll_make_first(&g_bus->futexes.free, &f->elem);
-}
-
 static int LoadTimespec(struct Machine *m, i64 addr, struct timespec *ts,
                         u64 mask, u64 need) {
   const struct timespec_linux *gt;
@@ -653,97 +777,47 @@ static int LoadTimespecRW(struct Machine *m, i64 addr, struct timespec *ts) {
   return LoadTimespec(m, addr, ts, PAGE_U | PAGE_RW, PAGE_U | PAGE_RW);
 }
 
-static int SysFutexWait(struct Machine *m,  //
-                        i64 uaddr,          //
-                        i32 op,             //
-                        u32 expect,         //
-                        i64 timeout_addr) {
-  int rc;
-  u8 *mem;
-  struct Futex *f;
+// turns futex timeout into a realtime deadline, where the timeout is
+// relative for FUTEX_WAIT and otherwise absolute, using either clock
+static int GetFutexDeadline(struct Machine *m, i64 timeout_addr,
+                            bool relative, bool realtime,
+                            struct timespec *deadline) {
+  struct timespec now, timeout;
   const struct timespec_linux *gtimeout;
-  struct timespec now, tick, timeout, deadline;
-  now = tick = GetTime();
-  if (timeout_addr) {
-    if (!(gtimeout = (const struct timespec_linux *)SchlepR(
-              m, timeout_addr, sizeof(*gtimeout)))) {
-      return -1;
-    }
-    timeout.tv_sec = Read64(gtimeout->sec);
-    timeout.tv_nsec = Read64(gtimeout->nsec);
-    if (!(0 <= timeout.tv_nsec && timeout.tv_nsec < 1000000000)) {
-      return einval();
-    }
-    deadline = AddTime(now, timeout);
-  } else {
-    deadline = GetMaxTime();
+  if (!timeout_addr) {
+    *deadline = GetMaxTime();
+    return 0;
   }
-  if (!(mem = LookupAddress(m, uaddr))) return -1;
-  LOCK(&g_bus->futexes.lock);
-  if (Load32(mem) != expect) {
-    UNLOCK(&g_bus->futexes.lock);
-    return eagain();
+  if (!(gtimeout = (const struct timespec_linux *)SchlepR(
+            m, timeout_addr, sizeof(*gtimeout)))) {
+    return -1;
   }
-  if ((f = FindFutex(m, uaddr))) {
-    LOCK(&f->lock);
-    ++f->waiters;
-    UNLOCK(&f->lock);
+  timeout.tv_sec = Read64(gtimeout->sec);
+  timeout.tv_nsec = Read64(gtimeout->nsec);
+  if (timeout.tv_sec < 0 ||
+      !(0 <= timeout.tv_nsec && timeout.tv_nsec < 1000000000)) {
+    return einval();
   }
-  if (!f) {
-    if ((f = NewFutex(uaddr))) {
-      dll_make_first(&g_bus->futexes.active, &f->elem);
-    } else {
-      UNLOCK(&g_bus->futexes.lock);
-      return -1;
+  if (relative) {
+    now = GetTime();
+  } else if (realtime) {
+    *deadline = timeout;
+    return 0;
+  } else {
+    now = GetMonotonic();
+    if (CompareTime(timeout, now) <= 0) {
+      *deadline = GetZeroTime();
+      return 0;
     }
+    timeout = SubtractTime(timeout, now);
+    now = GetTime();
   }
-  UNLOCK(&g_bus->futexes.lock);
-  THR_LOGF("pid=%d tid=%d is waiting at address %#" PRIx64, m->system->pid,
-           m->tid, uaddr);
-  do {
-    if (m->killed) {
-      rc = EAGAIN;
-      break;
-    }
-    if (CheckInterrupt(m, true)) {
-      rc = EINTR;
-      break;
-    }
-    if (!(mem = LookupAddress(m, uaddr))) {
-      rc = errno;
-      break;
-    }
-    LOCK(&f->lock);
-    if (Load32(mem) != expect) {
-      rc = 0;
-    } else {
-      tick = AddTime(tick, FromMilliseconds(kPollingMs));
-      if (CompareTime(tick, deadline) > 0) tick = deadline;
-      rc = pthread_cond_timedwait(&f->cond, &f->lock, &tick);
-      if (rc == ETIMEDOUT) {
-        THR_LOGF("futex wait timed out");
-      } else {
-        THR_LOGF("futex wait returned %s", DescribeHostErrno(rc));
-      }
-    }
-    UNLOCK(&f->lock);
-  } while (rc == ETIMEDOUT && CompareTime(tick, deadline) < 0);
-  LOCK(&g_bus->futexes.lock);
-  LOCK(&f->lock);
-  if (!--f->waiters) {
-    dll_remove(&g_bus->futexes.active, &f->elem);
-    UNLOCK(&f->lock);
-    FreeFutex(f);
-    UNLOCK(&g_bus->futexes.lock);
+  if (timeout.tv_sec < NUMERIC_MAX(time_t) - now.tv_sec) {
+    *deadline = AddTime(now, timeout);
   } else {
-    UNLOCK(&f->lock);
-    UNLOCK(&g_bus->futexes.lock);
+    *deadline = GetMaxTime();
   }
-  if (rc) {
-    errno = rc;
-    rc = -1;
-  }
-  return rc;
+  return 0;
 }
 
 static int SysFutex(struct Machine *m,  //
@@ -753,23 +827,63 @@ static int SysFutex(struct Machine *m,  //
                     i64 timeout_addr,   //
                     i64 uaddr2,         //
                     u32 val3) {
+  int cmd;
+  bool shared, realtime;
+  struct timespec deadline;
   if (uaddr & 3) return efault();
-  op &= ~FUTEX_PRIVATE_FLAG_LINUX;
-  switch (op) {
+  cmd = op & ~(FUTEX_PRIVATE_FLAG_LINUX | FUTEX_CLOCK_REALTIME_LINUX);
+  shared = !(op & FUTEX_PRIVATE_FLAG_LINUX);
+  realtime = !!(op & FUTEX_CLOCK_REALTIME_LINUX);
+  if (realtime && cmd != FUTEX_WAIT_LINUX && cmd != FUTEX_WAIT_BITSET_LINUX &&
+      cmd != FUTEX_LOCK_PI2_LINUX) {
+    return enosys();
+  }
+  switch (cmd) {
     case FUTEX_WAIT_LINUX:
-      return SysFutexWait(m, uaddr, op, val, timeout_addr);
-    case FUTEX_WAKE_LINUX:
-      return SysFutexWake(m, uaddr, val);
+      if (GetFutexDeadline(m, timeout_addr, true, realtime, &deadline)) {
+        return -1;
+      }
+      return FutexWait(m, uaddr, val, FUTEX_BITSET_MATCH_ANY_LINUX, deadline,
+                       shared);
     case FUTEX_WAIT_BITSET_LINUX:
-    case FUTEX_WAIT_BITSET_LINUX | FUTEX_CLOCK_REALTIME_LINUX:
-      // will be supported soon
-      // avoid logging when cosmo feature checks this
-      if (!m->system->iscosmo) goto DefaultCase;
-      return einval();
+      if (!val3) return einval();
+      if (GetFutexDeadline(m, timeout_addr, false, realtime, &deadline)) {
+        return -1;
+      }
+      return FutexWait(m, uaddr, val, val3, deadline, shared);
+    case FUTEX_WAKE_LINUX:
+      return FutexWake(m, uaddr, val, FUTEX_BITSET_MATCH_ANY_LINUX, shared);
+    case FUTEX_WAKE_BITSET_LINUX:
+      if (!val3) return einval();
+      return FutexWake(m, uaddr, val, val3, shared);
+    case FUTEX_REQUEUE_LINUX:
+    case FUTEX_CMP_REQUEUE_LINUX:
+      // the requeue count is passed in the timeout argument
+      if ((i32)val < 0 || (i32)timeout_addr < 0) return einval();
+      if (uaddr2 & 3) return efault();
+      return FutexRequeue(m, uaddr, val, uaddr2, (u32)timeout_addr,
+                          cmd == FUTEX_CMP_REQUEUE_LINUX ? &val3 : 0, shared);
+    case FUTEX_WAKE_OP_LINUX:
+      if (uaddr2 & 3) return efault();
+      return FutexWakeOp(m, uaddr, val, uaddr2, (u32)timeout_addr, val3,
+                         shared);
+    case FUTEX_LOCK_PI_LINUX:
+    case FUTEX_LOCK_PI2_LINUX:
+      // FUTEX_LOCK_PI always measures its deadline using CLOCK_REALTIME
+      if (GetFutexDeadline(m, timeout_addr, false,
+                           realtime || cmd == FUTEX_LOCK_PI_LINUX,
+                           &deadline)) {
+        return -1;
+      }
+      return FutexLockPi(m, uaddr, deadline, false, shared);
+    case FUTEX_TRYLOCK_PI_LINUX:
+      return FutexLockPi(m, uaddr, GetMaxTime(), true, shared);
+    case FUTEX_UNLOCK_PI_LINUX:
+      return FutexUnlockPi(m, uaddr);
     default:
-    DefaultCase:
+      // FUTEX_WAIT_REQUEUE_PI and FUTEX_CMP_REQUEUE_PI aren't supported
       LOGF("unsupported %s op %#x", "futex", op);
-      return einval();
+      return enosys();
   }
 }
 
@@ -782,7 +896,7 @@ static void UnlockRobustFutex(struct Machine *m, u64 futex_addr,
     LOGF("robust futex isn't aligned");
     return;
   }
-  if (!(futex = (_Atomic(u32) *)SchlepR(m, futex_addr, 4))) {
+  if (!(futex = (_Atomic(u32) *)SchlepRW(m, futex_addr, 4))) {
     LOGF("encountered efault in robust futex list");
     return;
   }
@@ -790,7 +904,7 @@ static void UnlockRobustFutex(struct Machine *m, u64 futex_addr,
     owner = value & FUTEX_TID_MASK_LINUX;
     if (ispending && !owner) {
       THR_LOGF("unlocking pending ownerless futex");
-      SysFutexWake(m, futex_addr, 1);
+      FutexWake(m, futex_addr, 1, FUTEX_BITSET_MATCH_ANY_LINUX, true);
       return;
     }
     if (owner && owner != m->tid) {
@@ -806,7 +920,7 @@ static void UnlockRobustFutex(struct Machine *m, u64 futex_addr,
       THR_LOGF("successfully unlocked robust futex");
       if (value & FUTEX_WAITERS_LINUX) {
         THR_LOGF("waking robust futex waiters");
-        SysFutexWake(m, futex_addr, 1);
+        FutexWake(m, futex_addr, 1, FUTEX_BITSET_MATCH_ANY_LINUX, true);
       }
       return;
     } else {
@@ -1363,7 +1477,7 @@ static int SysDup2(struct Machine *m, i32 fildes, i32 newfildes) {
   } else if ((rc = Dup2(m, fildes, newfildes)) != -1) {
     LOCK(&m->system->fds.lock);
     if ((fd = GetFd(&m->system->fds, newfildes))) {
-      dll_remove(&m->system->fds.list, &fd->elem);
+      RemoveFd(&m->system->fds, fd);
       FreeFd(fd);
     }
     unassert(fd = GetFd(&m->system->fds, fildes));
@@ -1392,7 +1506,7 @@ static int SysDup3(struct Machine *m, i32 fildes, i32 newfildes, i32 flags) {
 #endif
     LOCK(&m->system->fds.lock);
     if ((fd = GetFd(&m->system->fds, newfildes))) {
-      dll_remove(&m->system->fds.list, &fd->elem);
+      RemoveFd(&m->system->fds, fd);
       FreeFd(fd);
     }
     unassert(fd = GetFd(&m->system->fds, fildes));
@@ -1691,7 +1805,7 @@ static int SysAccept4(struct Machine *m, i32 fildes, i64 sockaddr_addr,
   return newfd;
 }
 
-static int XlatSendFlags(int flags, int socktype) {
+int XlatSendFlags(int flags, int socktype) {
   int supported, hostflags;
   supported = MSG_OOB_LINUX |        //
               MSG_DONTROUTE_LINUX |  //
@@ -1719,7 +1833,7 @@ static int XlatSendFlags(int flags, int socktype) {
   return hostflags;
 }
 
-static int XlatRecvFlags(int flags) {
+int XlatRecvFlags(int flags) {
   int supported, hostflags;
   supported = MSG_OOB_LINUX |    //
               MSG_PEEK_LINUX |   //
@@ -1901,13 +2015,13 @@ static i64 SysSendto(struct Machine *m,  //
     }
     msg.msg_name = &ss;
   }
-  InitIovs(&iv);
+  BorrowIovs(m, &iv);
   if ((rc = AppendIovsReal(m, &iv, bufaddr, buflen, PROT_READ)) != -1) {
     msg.msg_iov = iv.p;
     msg.msg_iovlen = iv.i;
     INTERRUPTIBLE(!norestart, rc = VfsSendmsg(fildes, &msg, hostflags));
   }
-  FreeIovs(&iv);
+  ReturnIovs(m, &iv);
   return HandleSigpipe(m, rc, flags);
 }
 
@@ -1932,7 +2046,7 @@ static i64 SysRecvfrom(struct Machine *m,  //
     msg.msg_name = &addr;
     msg.msg_namelen = sizeof(addr);
   }
-  InitIovs(&iv);
+  BorrowIovs(m, &iv);
   if ((rc = AppendIovsReal(m, &iv, bufaddr, buflen, PROT_WRITE)) != -1) {
     msg.msg_iov = iv.p;
     msg.msg_iovlen = iv.i;
@@ -1942,15 +2056,50 @@ static i64 SysRecvfrom(struct Machine *m,  //
                     (struct sockaddr *)msg.msg_name, msg.msg_namelen);
     }
   }
-  FreeIovs(&iv);
+  ReturnIovs(m, &iv);
   return rc;
 }
 
-static i64 SysSendmsg(struct Machine *m, i32 fildes, i64 msgaddr, i32 flags) {
+// translates guest message for sendmsg(), except for its flags
+static int LoadSendmsg(struct Machine *m, i32 fildes, int socktype,
+                       const struct msghdr_linux *gm, struct msghdr *msg,
+                       struct sockaddr_storage *ss, struct Iovs *iv) {
   i32 len;
   u64 iovlen;
+  memset(msg, 0, sizeof(*msg));
+  if (socktype != SOCK_STREAM && (len = Read32(gm->namelen)) > 0) {
+    if ((len = LoadSockaddr(m, Read64(gm->name), len, ss)) == -1) {
+      return -1;
+    }
+    EnsureSockAddrHasDestination(m, fildes, ss);
+    msg->msg_name = ss;
+    msg->msg_namelen = len;
+  }
+#ifndef DISABLE_ANCILLARY
+  if (SendAncillary(m, msg, gm) == -1) {
+    return -1;
+  }
+#else
+  if (Read64(gm->controllen)) {
+    LOGF("ancillary support disabled");
+    return einval();
+  }
+#endif
+  iovlen = Read64(gm->iovlen);
+  if (!iovlen || iovlen > IOV_MAX_LINUX) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  if (AppendIovsGuest(m, iv, Read64(gm->iov), iovlen, PROT_READ) == -1) {
+    return -1;
+  }
+  msg->msg_iov = iv->p;
+  msg->msg_iovlen = iv->i;
+  return 0;
+}
+
+static i64 SysSendmsg(struct Machine *m, i32 fildes, i64 msgaddr, i32 flags) {
   ssize_t rc;
-  i64 iovaddr;
   int socktype;
   struct Fd *fd;
   struct Iovs iv;
@@ -1972,45 +2121,70 @@ static i64 SysSendmsg(struct Machine *m, i32 fildes, i64 msgaddr, i32 flags) {
   if (!(gm = (const struct msghdr_linux *)SchlepR(m, msgaddr, sizeof(*gm)))) {
     return -1;
   }
-  memset(&msg, 0, sizeof(msg));
-  if (socktype != SOCK_STREAM && (len = Read32(gm->namelen)) > 0) {
-    if ((len = LoadSockaddr(m, Read64(gm->name), len, &ss)) == -1) {
-      return -1;
-    }
-    EnsureSockAddrHasDestination(m, fildes, &ss);
-    msg.msg_name = &ss;
-    msg.msg_namelen = len;
+  BorrowIovs(m, &iv);
+  if ((rc = LoadSendmsg(m, fildes, socktype, gm, &msg, &ss, &iv)) != -1) {
+    INTERRUPTIBLE(!norestart, rc = VfsSendmsg(fildes, &msg, flags));
   }
-#ifndef DISABLE_ANCILLARY
-  if (SendAncillary(m, &msg, gm) == -1) {
+  ReturnIovs(m, &iv);
+  return HandleSigpipe(m, rc, flags);
+}
+
+// translates guest message for recvmsg(), except for its flags
+static int LoadRecvmsg(struct Machine *m, const struct msghdr_linux *gm,
+                       struct msghdr *msg, struct sockaddr_storage *addr,
+                       struct Iovs *iv) {
+  u64 iovlen;
+  memset(msg, 0, sizeof(*msg));
+  iovlen = Read64(gm->iovlen);
+  if (!iovlen || iovlen > IOV_MAX_LINUX) {
+    errno = EMSGSIZE;
     return -1;
   }
-#else
   if (Read64(gm->controllen)) {
+#ifndef DISABLE_ANCILLARY
+    if (!(msg->msg_control = AddToFreeList(m, calloc(1, kMaxAncillary)))) {
+      return -1;
+    }
+    msg->msg_controllen = kMaxAncillary;
+#else
     LOGF("ancillary support disabled");
     return einval();
-  }
 #endif
-  iovaddr = Read64(gm->iov);
-  iovlen = Read64(gm->iovlen);
-  if (!iovlen || iovlen > IOV_MAX_LINUX) {
-    errno = EMSGSIZE;
+  }
+  if (AppendIovsGuest(m, iv, Read64(gm->iov), iovlen, PROT_WRITE) == -1) {
     return -1;
   }
-  InitIovs(&iv);
-  if ((rc = AppendIovsGuest(m, &iv, iovaddr, iovlen, PROT_READ)) != -1) {
-    msg.msg_iov = iv.p;
-    msg.msg_iovlen = iv.i;
-    INTERRUPTIBLE(!norestart, rc = VfsSendmsg(fildes, &msg, flags));
+  msg->msg_iov = iv->p;
+  msg->msg_iovlen = iv->i;
+  if (Read64(gm->name)) {
+    memset(addr, 0, sizeof(*addr));
+    msg->msg_name = addr;
+    msg->msg_namelen = sizeof(*addr);
   }
-  FreeIovs(&iv);
-  return HandleSigpipe(m, rc, flags);
+  return 0;
+}
+
+// copies message received by recvmsg() back into guest memory
+static int StoreRecvmsg(struct Machine *m, i64 msgaddr,
+                        struct msghdr_linux *gm, struct msghdr *msg,
+                        int flags) {
+  Write32(gm->flags, UnXlatMsgFlags(msg->msg_flags));
+  unassert(CopyToUserWrite(m, msgaddr, gm, sizeof(*gm)) != -1);
+#ifndef DISABLE_ANCILLARY
+  if (ReceiveAncillary(m, gm, msg, flags) == -1) {
+    return -1;
+  }
+#endif
+  if (Read64(gm->name)) {
+    StoreSockaddr(m, Read64(gm->name),
+                  msgaddr + offsetof(struct msghdr_linux, namelen),
+                  (struct sockaddr *)msg->msg_name, msg->msg_namelen);
+  }
+  return 0;
 }
 
 static i64 SysRecvmsg(struct Machine *m, i32 fildes, i64 msgaddr, i32 flags) {
   ssize_t rc;
-  u64 iovlen;
-  i64 iovaddr;
   struct Iovs iv;
   struct msghdr msg;
   bool norestart = false;
@@ -2019,53 +2193,79 @@ static i64 SysRecvmsg(struct Machine *m, i32 fildes, i64 msgaddr, i32 flags) {
   if ((flags = XlatRecvFlags(flags)) == -1) return -1;
   if (GetNoRestart(m, fildes, &norestart) == -1) return -1;
   if (CopyFromUserRead(m, &gm, msgaddr, sizeof(gm)) == -1) return -1;
-  memset(&msg, 0, sizeof(msg));
-  iovaddr = Read64(gm.iov);
-  iovlen = Read64(gm.iovlen);
-  if (!iovlen || iovlen > IOV_MAX_LINUX) {
-    errno = EMSGSIZE;
-    return -1;
-  }
-  if (Read64(gm.controllen)) {
-#ifndef DISABLE_ANCILLARY
-    msg.msg_control = AddToFreeList(m, calloc(1, kMaxAncillary));
-    msg.msg_controllen = kMaxAncillary;
-#else
-    LOGF("ancillary support disabled");
-    return einval();
-#endif
-  }
-  InitIovs(&iv);
-  if ((rc = AppendIovsGuest(m, &iv, iovaddr, iovlen, PROT_WRITE)) != -1) {
-    msg.msg_iov = iv.p;
-    msg.msg_iovlen = iv.i;
-    if (Read64(gm.name)) {
-      memset(&addr, 0, sizeof(addr));
-      msg.msg_name = &addr;
-      msg.msg_namelen = sizeof(addr);
-    }
+  BorrowIovs(m, &iv);
+  if ((rc = LoadRecvmsg(m, &gm, &msg, &addr, &iv)) != -1) {
     INTERRUPTIBLE(!norestart, rc = VfsRecvmsg(fildes, &msg, flags));
-    if (rc != -1) {
-      Write32(gm.flags, UnXlatMsgFlags(msg.msg_flags));
-      unassert(CopyToUserWrite(m, msgaddr, &gm, sizeof(gm)) != -1);
-#ifndef DISABLE_ANCILLARY
-      if (ReceiveAncillary(m, &gm, &msg, flags) == -1) {
-        return -1;
-      }
-#endif
-      if (Read64(gm.name)) {
-        StoreSockaddr(m, Read64(gm.name),
-                      msgaddr + offsetof(struct msghdr_linux, namelen),
-                      (struct sockaddr *)&addr, msg.msg_namelen);
-      }
+    if (rc != -1 && StoreRecvmsg(m, msgaddr, &gm, &msg, flags) == -1) {
+      rc = -1;
     }
   }
-  FreeIovs(&iv);
+  ReturnIovs(m, &iv);
   return rc;
 }
 
-static i64 SysSendmmsg(struct Machine *m, i32 fildes, i64 msgsaddr, u32 msgcnt,
-                       i32 flags) {
+#if defined(HAVE_SENDMMSG) && defined(DISABLE_VFS)
+// sends batch of messages using a single host system call
+static i64 SendmmsgBatch(struct Machine *m, i32 fildes, i64 msgsaddr,
+                         u32 msgcnt, i32 flags) {
+  u32 i, n;
+  ssize_t rc;
+  u8 word[4];
+  struct Fd *fd;
+  bool norestart;
+  struct Iovs *ivs;
+  struct mmsghdr *hm;
+  int socktype, hostflags;
+  struct sockaddr_storage *ss;
+  const struct mmsghdr_linux *gm;
+  LOCK(&m->system->fds.lock);
+  if ((fd = GetFd(&m->system->fds, fildes))) {
+    socktype = fd->socktype;
+    norestart = fd->norestart;
+  } else {
+    socktype = 0;
+    norestart = false;
+  }
+  UNLOCK(&m->system->fds.lock);
+  if (!fd) return ebadf();
+  if ((hostflags = XlatSendFlags(flags, socktype)) == -1) return -1;
+  if (!(gm = (const struct mmsghdr_linux *)SchlepRW(m, msgsaddr,
+                                                    msgcnt * sizeof(*gm))) ||
+      !(hm = (struct mmsghdr *)AddToFreeList(m, calloc(msgcnt, sizeof(*hm)))) ||
+      !(ss = (struct sockaddr_storage *)AddToFreeList(
+            m, calloc(msgcnt, sizeof(*ss)))) ||
+      !(ivs = (struct Iovs *)AddToFreeList(m, calloc(msgcnt, sizeof(*ivs))))) {
+    return -1;
+  }
+  for (n = 0; n < msgcnt; ++n) {
+    InitIovs(ivs + n);
+    if (LoadSendmsg(m, fildes, socktype, &gm[n].hdr, &hm[n].msg_hdr, ss + n,
+                    ivs + n) == -1) {
+      FreeIovs(ivs + n);
+      break;
+    }
+  }
+  if (n) {
+    INTERRUPTIBLE(!norestart, rc = sendmmsg(fildes, hm, n, hostflags));
+    for (i = 0; rc != -1 && i < rc; ++i) {
+      Write32(word, hm[i].msg_len);
+      unassert(CopyToUserWrite(m,
+                               msgsaddr + i * sizeof(*gm) +
+                                   offsetof(struct mmsghdr_linux, len),
+                               word, 4) != -1);
+    }
+  } else {
+    rc = -1;
+  }
+  for (i = 0; i < n; ++i) {
+    FreeIovs(ivs + i);
+  }
+  return HandleSigpipe(m, rc, flags);
+}
+#else
+// sends batch of messages one at a time
+static i64 SendmmsgSerial(struct Machine *m, i32 fildes, i64 msgsaddr,
+                          u32 msgcnt, i32 flags) {
   u32 i;
   i64 rc;
   u8 word[4];
@@ -2092,24 +2292,95 @@ static i64 SysSendmmsg(struct Machine *m, i32 fildes, i64 msgsaddr, u32 msgcnt,
   }
   return i;
 }
+#endif
 
-static i64 SysRecvmmsg(struct Machine *m, i32 fildes, i64 msgsaddr, u32 msgcnt,
-                       i32 flags, i64 timeoutaddr) {
+static i64 SysSendmmsg(struct Machine *m, i32 fildes, i64 msgsaddr, u32 msgcnt,
+                       i32 flags) {
+  // linux silently truncates the batch size to UIO_MAXIOV
+  msgcnt = MIN(msgcnt, IOV_MAX_LINUX);
+  if (!msgcnt) return 0;
+#if defined(HAVE_SENDMMSG) && defined(DISABLE_VFS)
+  return SendmmsgBatch(m, fildes, msgsaddr, msgcnt, flags);
+#else
+  return SendmmsgSerial(m, fildes, msgsaddr, msgcnt, flags);
+#endif
+}
+
+#if defined(HAVE_SENDMMSG) && defined(DISABLE_VFS)
+// receives batch of messages using a single host system call
+static i64 RecvmmsgBatch(struct Machine *m, i32 fildes, i64 msgsaddr,
+                         u32 msgcnt, i32 flags, struct timespec *timeout) {
+  u32 i, n;
+  ssize_t rc;
+  u8 word[4];
+  int hostflags;
+  bool norestart = false;
+  struct Iovs *ivs;
+  struct mmsghdr *hm;
+  struct msghdr_linux *gms;
+  struct sockaddr_storage *addrs;
+  const struct mmsghdr_linux *gm;
+  if ((hostflags = XlatRecvFlags(flags & ~MSG_WAITFORONE_LINUX)) == -1) {
+    return -1;
+  }
+  if (flags & MSG_WAITFORONE_LINUX) hostflags |= MSG_WAITFORONE;
+  if (GetNoRestart(m, fildes, &norestart) == -1) return -1;
+  if (!(gm = (const struct mmsghdr_linux *)SchlepRW(m, msgsaddr,
+                                                    msgcnt * sizeof(*gm))) ||
+      !(gms = (struct msghdr_linux *)AddToFreeList(
+            m, malloc(msgcnt * sizeof(*gms)))) ||
+      !(hm = (struct mmsghdr *)AddToFreeList(m, calloc(msgcnt, sizeof(*hm)))) ||
+      !(addrs = (struct sockaddr_storage *)AddToFreeList(
+            m, calloc(msgcnt, sizeof(*addrs)))) ||
+      !(ivs = (struct Iovs *)AddToFreeList(m, calloc(msgcnt, sizeof(*ivs))))) {
+    return -1;
+  }
+  for (n = 0; n < msgcnt; ++n) {
+    gms[n] = gm[n].hdr;
+    InitIovs(ivs + n);
+    if (LoadRecvmsg(m, gms + n, &hm[n].msg_hdr, addrs + n, ivs + n) == -1) {
+      FreeIovs(ivs + n);
+      break;
+    }
+  }
+  if (n) {
+    INTERRUPTIBLE(!norestart,
+                  rc = recvmmsg(fildes, hm, n, hostflags, timeout));
+    for (i = 0; rc != -1 && i < rc; ++i) {
+      if (StoreRecvmsg(m, msgsaddr + i * sizeof(*gm), gms + i, &hm[i].msg_hdr,
+                       hostflags) == -1) {
+        LOGF("%s raised %s after doing work", "recvmmsg",
+             DescribeHostErrno(errno));
+        rc = i ? i : -1;
+        break;
+      }
+      Write32(word, hm[i].msg_len);
+      unassert(CopyToUserWrite(m,
+                               msgsaddr + i * sizeof(*gm) +
+                                   offsetof(struct mmsghdr_linux, len),
+                               word, 4) != -1);
+    }
+  } else {
+    rc = -1;
+  }
+  for (i = 0; i < n; ++i) {
+    FreeIovs(ivs + i);
+  }
+  return rc;
+}
+#else
+// receives batch of messages one at a time
+static i64 RecvmmsgSerial(struct Machine *m, i32 fildes, i64 msgsaddr,
+                          u32 msgcnt, i32 flags, struct timespec *deadline) {
   u32 i;
   i64 rc;
   u8 word[4];
   i32 flags2;
-  struct timespec_linux gt;
   const struct mmsghdr_linux *msgs;
-  struct timespec ts, now, remain, deadline = {0};
   if (!(msgs = (const struct mmsghdr_linux *)SchlepRW(
             m, msgsaddr, msgcnt * sizeof(*msgs)))) {
     return -1;
   }
-  if (timeoutaddr) {
-    if (LoadTimespecR(m, timeoutaddr, &ts) == -1) return -1;
-    deadline = AddTime(GetTime(), ts);
-  }
   for (i = 0; i < msgcnt; ++i) {
     flags2 = flags & ~MSG_WAITFORONE_LINUX;
     if ((flags & MSG_WAITFORONE_LINUX) && i) {
@@ -2141,11 +2412,33 @@ static i64 SysRecvmmsg(struct Machine *m, i32 fildes, i64 msgsaddr, u32 msgcnt,
     // vlen-1 datagrams are received before the timeout expires, but
     // then no further datagrams are received, the call will block
     // forever. ──Quoth the Linux Programmer's Manual § recvmmsg()
-    if (timeoutaddr && CompareTime(GetTime(), deadline) >= 0) {
+    if (deadline && CompareTime(GetTime(), *deadline) >= 0) {
       break;
     }
   }
+  return i;
+}
+#endif
+
+static i64 SysRecvmmsg(struct Machine *m, i32 fildes, i64 msgsaddr, u32 msgcnt,
+                       i32 flags, i64 timeoutaddr) {
+  i64 rc;
+  struct timespec_linux gt;
+  struct timespec ts, now, remain, deadline = {0};
+  msgcnt = MIN(msgcnt, IOV_MAX_LINUX);
+  if (!msgcnt) return 0;
   if (timeoutaddr) {
+    if (LoadTimespecR(m, timeoutaddr, &ts) == -1) return -1;
+    deadline = AddTime(GetTime(), ts);
+  }
+#if defined(HAVE_SENDMMSG) && defined(DISABLE_VFS)
+  rc = RecvmmsgBatch(m, fildes, msgsaddr, msgcnt, flags,
+                     timeoutaddr ? &ts : 0);
+#else
+  rc = RecvmmsgSerial(m, fildes, msgsaddr, msgcnt, flags,
+                      timeoutaddr ? &deadline : 0);
+#endif
+  if (rc != -1 && timeoutaddr) {
     now = GetTime();
     if (CompareTime(now, deadline) >= 0) {
       remain = GetZeroTime();
@@ -2156,7 +2449,7 @@ static i64 SysRecvmmsg(struct Machine *m, i32 fildes, i64 msgsaddr, u32 msgcnt,
     Write64(gt.nsec, remain.tv_nsec);
     CopyToUserWrite(m, timeoutaddr, &gt, sizeof(gt));
   }
-  return i;
+  return rc;
 }
 
 static int SysConnectBind(struct Machine *m, i32 fildes, i64 sockaddr_addr,
@@ -2337,11 +2630,79 @@ static int SysGetsockopt(struct Machine *m, i32 fildes, i32 level, i32 optname,
   return rc;
 }
 
+static bool IsRegularFile(int fildes) {
+  struct stat st;
+  return !VfsFstat(fildes, &st) && S_ISREG(st.st_mode);
+}
+
+// reads into guest memory no more than GetIovMax() fragments at a time,
+// so huge reads into discontiguous host pages don't end up being short
+static i64 ReadChunks(struct Machine *m, int fildes, i64 addr, u64 size,
+                      i64 offset,
+                      ssize_t (*readv_impl)(int, const struct iovec *, int)) {
+  i64 rc;
+  u64 want, done;
+  struct Iovs iv;
+  BorrowIovs(m, &iv);
+  for (done = 0;;) {
+    iv.i = 0;
+    if ((rc = AppendIovsReal(m, &iv, addr + done, size - done, PROT_WRITE)) ==
+        -1) {
+      break;
+    }
+    want = CountIovs(&iv);
+    if (offset == -1) {
+      RESTARTABLE(rc = readv_impl(fildes, iv.p, iv.i));
+    } else {
+      RESTARTABLE(rc = VfsPreadv(fildes, iv.p, iv.i, offset + done));
+    }
+    if (rc == -1) break;
+    done += rc;
+    // pipes and sockets may block if we ask for more than they've got
+    if (rc < want || done == size || !IsRegularFile(fildes)) break;
+  }
+  ReturnIovs(m, &iv);
+  if (!done) return rc;
+  SetWriteAddr(m, addr, done);
+  return done;
+}
+
+// writes guest memory no more than GetIovMax() fragments at a time,
+// so huge writes from discontiguous host pages don't end up being short
+static i64 WriteChunks(struct Machine *m, int fildes, i64 addr, u64 size,
+                       i64 offset,
+                       ssize_t (*writev_impl)(int, const struct iovec *,
+                                              int)) {
+  i64 rc;
+  u64 want, done;
+  struct Iovs iv;
+  BorrowIovs(m, &iv);
+  for (done = 0;;) {
+    iv.i = 0;
+    if ((rc = AppendIovsReal(m, &iv, addr + done, size - done, PROT_READ)) ==
+        -1) {
+      break;
+    }
+    want = CountIovs(&iv);
+    if (offset == -1) {
+      RESTARTABLE(rc = writev_impl(fildes, iv.p, iv.i));
+    } else {
+      RESTARTABLE(rc = VfsPwritev(fildes, iv.p, iv.i, offset + done));
+    }
+    if (rc == -1) break;
+    done += rc;
+    if (rc < want || done == size) break;
+  }
+  ReturnIovs(m, &iv);
+  if (!done) return rc;
+  SetReadAddr(m, addr, done);
+  return done;
+}
+
 static i64 SysRead(struct Machine *m, i32 fildes, i64 addr, u64 size) {
   i64 rc;
   int oflags;
   struct Fd *fd;
-  struct Iovs iv;
   ssize_t (*readv_impl)(int, const struct iovec *, int);
   if (size > NUMERIC_MAX(size_t)) return eoverflow();
   LOCK(&m->system->fds.lock);
@@ -2357,12 +2718,7 @@ static i64 SysRead(struct Machine *m, i32 fildes, i64 addr, u64 size) {
   if (!fd) return -1;
   if ((oflags & O_ACCMODE) == O_WRONLY) return ebadf();
   if (size) {
-    InitIovs(&iv);
-    if ((rc = AppendIovsReal(m, &iv, addr, size, PROT_WRITE)) != -1) {
-      RESTARTABLE(rc = readv_impl(fildes, iv.p, iv.i));
-      if (rc != -1) SetWriteAddr(m, addr, rc);
-    }
-    FreeIovs(&iv);
+    rc = ReadChunks(m, fildes, addr, size, -1, readv_impl);
   } else {
     rc = 0;
   }
@@ -2373,7 +2729,6 @@ static i64 SysWrite(struct Machine *m, i32 fildes, i64 addr, u64 size) {
   i64 rc;
   int oflags;
   struct Fd *fd;
-  struct Iovs iv;
   ssize_t (*writev_impl)(int, const struct iovec *, int);
   if (size > NUMERIC_MAX(size_t)) return eoverflow();
   LOCK(&m->system->fds.lock);
@@ -2389,12 +2744,7 @@ static i64 SysWrite(struct Machine *m, i32 fildes, i64 addr, u64 size) {
   if (!fd) return -1;
   if ((oflags & O_ACCMODE) == O_RDONLY) return ebadf();
   if (size) {
-    InitIovs(&iv);
-    if ((rc = AppendIovsReal(m, &iv, addr, size, PROT_READ)) != -1) {
-      RESTARTABLE(rc = writev_impl(fildes, iv.p, iv.i));
-      if (rc != -1) SetReadAddr(m, addr, rc);
-    }
-    FreeIovs(&iv);
+    rc = WriteChunks(m, fildes, addr, size, -1, writev_impl);
   } else {
     rc = 0;
   }
@@ -2426,16 +2776,11 @@ static long CheckFdAccess(struct Machine *m, i32 fildes, bool writable,
 static i64 SysPread(struct Machine *m, i32 fildes, i64 addr, u64 size,
                     u64 offset) {
   ssize_t rc;
-  struct Iovs iv;
   if (size > NUMERIC_MAX(size_t)) return eoverflow();
   if (CheckFdAccess(m, fildes, false, EBADF) == -1) return -1;
+  if (offset > NUMERIC_MAX(off_t)) return einval();
   if (size) {
-    InitIovs(&iv);
-    if ((rc = AppendIovsReal(m, &iv, addr, size, PROT_WRITE)) != -1) {
-      RESTARTABLE(rc = VfsPreadv(fildes, iv.p, iv.i, offset));
-      if (rc != -1) SetWriteAddr(m, addr, rc);
-    }
-    FreeIovs(&iv);
+    rc = ReadChunks(m, fildes, addr, size, offset, 0);
   } else {
     rc = 0;
   }
@@ -2445,16 +2790,11 @@ static i64 SysPread(struct Machine *m, i32 fildes, i64 addr, u64 size,
 static i64 SysPwrite(struct Machine *m, i32 fildes, i64 addr, u64 size,
                      u64 offset) {
   ssize_t rc;
-  struct Iovs iv;
   if (size > NUMERIC_MAX(size_t)) return eoverflow();
   if (CheckFdAccess(m, fildes, true, EBADF) == -1) return -1;
+  if (offset > NUMERIC_MAX(off_t)) return einval();
   if (size) {
-    InitIovs(&iv);
-    if ((rc = AppendIovsReal(m, &iv, addr, size, PROT_READ)) != -1) {
-      RESTARTABLE(rc = VfsPwritev(fildes, iv.p, iv.i, offset));
-      if (rc != -1) SetReadAddr(m, addr, rc);
-    }
-    FreeIovs(&iv);
+    rc = WriteChunks(m, fildes, addr, size, offset, 0);
   } else {
     rc = 0;
   }
@@ -2485,16 +2825,14 @@ static i64 SysPreadv2(struct Machine *m, i32 fildes, i64 iovaddr, u32 iovlen,
   UNLOCK(&m->system->fds.lock);
   if (!fd) return -1;
   if ((oflags & O_ACCMODE) == O_WRONLY) return ebadf();
+  if (offset < -1) return einval();
+  if (offset > NUMERIC_MAX(off_t)) return eoverflow();
   if (iovlen) {
-    InitIovs(&iv);
+    BorrowIovs(m, &iv);
     if ((rc = AppendIovsGuest(m, &iv, iovaddr, iovlen, PROT_WRITE)) != -1) {
       if (iv.i) {
         if (offset == -1) {
           RESTARTABLE(rc = readv_impl(fildes, iv.p, iv.i));
-        } else if (offset < 0) {
-          return einval();
-        } else if (offset > NUMERIC_MAX(off_t)) {
-          return eoverflow();
         } else {
           RESTARTABLE(rc = VfsPreadv(fildes, iv.p, iv.i, offset));
         }
@@ -2502,7 +2840,7 @@ static i64 SysPreadv2(struct Machine *m, i32 fildes, i64 iovaddr, u32 iovlen,
         rc = 0;
       }
     }
-    FreeIovs(&iv);
+    ReturnIovs(m, &iv);
   } else {
     rc = 0;
   }
@@ -2533,17 +2871,15 @@ static i64 SysPwritev2(struct Machine *m, i32 fildes, i64 iovaddr, u32 iovlen,
   UNLOCK(&m->system->fds.lock);
   if (!fd) return -1;
   if ((oflags & O_ACCMODE) == O_RDONLY) return ebadf();
+  if (offset < -1) return einval();
+  if (offset > NUMERIC_MAX(off_t)) return eoverflow();
   if (iovlen) {
-    InitIovs(&iv);
+    BorrowIovs(m, &iv);
     if ((rc = AppendIovsGuest(m, &iv, iovaddr, iovlen, PROT_READ)) != -1) {
       if (iv.i) {
         if (offset == -1) {
           RESTARTABLE(rc = writev_impl(fildes, iv.p, iv.i));
           rc = HandleSigpipe(m, rc, 0);
-        } else if (offset < 0) {
-          return einval();
-        } else if (offset > NUMERIC_MAX(off_t)) {
-          return eoverflow();
         } else {
           RESTARTABLE(rc = VfsPwritev(fildes, iv.p, iv.i, offset));
         }
@@ -2551,7 +2887,7 @@ static i64 SysPwritev2(struct Machine *m, i32 fildes, i64 iovaddr, u32 iovlen,
         rc = 0;
       }
     }
-    FreeIovs(&iv);
+    ReturnIovs(m, &iv);
   } else {
     rc = 0;
   }
@@ -2622,6 +2958,192 @@ OnFailure:
   }
 }
 
+// moves data between fds through a blink buffer. this is used whenever
+// the host can't do it for us, e.g. because the fds belong to the vfs.
+// if a write fails after a read then the input is rewound by the bytes
+// which weren't written, unless it's a pipe or socket, which can't seek
+// so those bytes are lost, like they'd be if a user program did this
+static ssize_t CopyBuffered(struct Machine *m, int infd, u8 *inoffp, int outfd,
+                            u8 *outoffp, u64 count, bool once) {
+  u8 *buf;
+  u64 toto;
+  ssize_t i, got, wrote;
+  size_t chunk, maxchunk = 65536;
+  if (!count) return 0;
+  if (!(buf = (u8 *)AddToFreeList(m, malloc(MIN(count, maxchunk))))) {
+    return -1;
+  }
+  for (toto = 0; toto < count;) {
+    chunk = MIN(count - toto, maxchunk);
+    if (inoffp) {
+      got = VfsPread(infd, buf, chunk, Read64(inoffp));
+    } else {
+      got = VfsRead(infd, buf, chunk);
+    }
+    if (got == -1) goto OnFailure;
+    if (!got) break;
+    if (inoffp) Write64(inoffp, Read64(inoffp) + got);
+    for (i = 0; i < got; i += wrote) {
+      if (outoffp) {
+        wrote = VfsPwrite(outfd, buf + i, got - i, Read64(outoffp));
+      } else {
+        wrote = VfsWrite(outfd, buf + i, got - i);
+      }
+      if (wrote == -1) {
+        if (inoffp) {
+          Write64(inoffp, Read64(inoffp) - (got - i));
+        } else {
+          int err = errno;
+          VfsSeek(infd, -(got - i), SEEK_CUR);
+          errno = err;
+        }
+        toto += i;
+        goto OnFailure;
+      }
+      if (outoffp) Write64(outoffp, Read64(outoffp) + wrote);
+    }
+    toto += got;
+    if (once) break;
+  }
+  return toto;
+OnFailure:
+  if (toto) {
+    LOGF("buffered copy partial failure: %s", DescribeHostErrno(errno));
+    return toto;
+  } else {
+    return -1;
+  }
+}
+
+static int LoadOffsetPointer(struct Machine *m, i64 addr, u8 **out_offp) {
+  u8 *offp;
+  if (!addr) {
+    *out_offp = 0;
+    return 0;
+  }
+  if (!(offp = (u8 *)SchlepRW(m, addr, 8))) return -1;
+  if ((i64)Read64(offp) < 0) return einval();
+  *out_offp = offp;
+  return 0;
+}
+
+static bool IsFileType(int fildes, mode_t type) {
+  struct stat st;
+  return !VfsFstat(fildes, &st) && (st.st_mode & S_IFMT) == type;
+}
+
+static i64 SysCopyFileRange(struct Machine *m, i32 infd, i64 inoffaddr,
+                            i32 outfd, i64 outoffaddr, u64 count, u32 flags) {
+  ssize_t rc;
+  u8 *inoffp = 0, *outoffp = 0;
+  if (flags) return einval();
+  if (CheckFdAccess(m, infd, false, EBADF) == -1) return -1;
+  if (CheckFdAccess(m, outfd, true, EBADF) == -1) return -1;
+  if (LoadOffsetPointer(m, inoffaddr, &inoffp) == -1) return -1;
+  if (LoadOffsetPointer(m, outoffaddr, &outoffp) == -1) return -1;
+  count = MIN(count, NUMERIC_MAX(ssize_t));
+#ifdef HAVE_COPY_FILE_RANGE
+  int hostin, hostout;
+  off_t inoff = 0, outoff = 0;
+  if ((hostin = VfsGetHostFd(infd)) != -1 &&
+      (hostout = VfsGetHostFd(outfd)) != -1) {
+    if (inoffp) inoff = Read64(inoffp);
+    if (outoffp) outoff = Read64(outoffp);
+    if ((rc = copy_file_range(hostin, inoffp ? &inoff : 0, hostout,
+                              outoffp ? &outoff : 0, count, 0)) != -1) {
+      if (inoffp) Write64(inoffp, inoff);
+      if (outoffp) Write64(outoffp, outoff);
+      return rc;
+    }
+    // older kernels won't copy across filesystems
+    if (errno != EXDEV && errno != ENOSYS && errno != EOPNOTSUPP) return -1;
+  }
+#endif
+  if (!IsFileType(infd, S_IFREG) || !IsFileType(outfd, S_IFREG)) {
+    return einval();
+  }
+  RESTARTABLE(rc = CopyBuffered(m, infd, inoffp, outfd, outoffp, count, false));
+  return rc;
+}
+
+#ifdef HAVE_SPLICE
+static int XlatSpliceFlags(int x) {
+  int res = 0;
+  if (x & SPLICE_F_MOVE_LINUX) res |= SPLICE_F_MOVE;
+  if (x & SPLICE_F_NONBLOCK_LINUX) res |= SPLICE_F_NONBLOCK;
+  if (x & SPLICE_F_MORE_LINUX) res |= SPLICE_F_MORE;
+  if (x & SPLICE_F_GIFT_LINUX) res |= SPLICE_F_GIFT;
+  return res;
+}
+#endif
+
+static i64 SysSplice(struct Machine *m, i32 infd, i64 inoffaddr, i32 outfd,
+                     i64 outoffaddr, u64 count, u32 flags) {
+  ssize_t rc;
+  bool inpipe, outpipe;
+  u8 *inoffp = 0, *outoffp = 0;
+  if (flags & ~(SPLICE_F_MOVE_LINUX | SPLICE_F_NONBLOCK_LINUX |
+                SPLICE_F_MORE_LINUX | SPLICE_F_GIFT_LINUX)) {
+    return einval();
+  }
+  if (CheckFdAccess(m, infd, false, EBADF) == -1) return -1;
+  if (CheckFdAccess(m, outfd, true, EBADF) == -1) return -1;
+  if (LoadOffsetPointer(m, inoffaddr, &inoffp) == -1) return -1;
+  if (LoadOffsetPointer(m, outoffaddr, &outoffp) == -1) return -1;
+  count = MIN(count, NUMERIC_MAX(ssize_t));
+#ifdef HAVE_SPLICE
+  int hostin, hostout;
+  loff_t inoff = 0, outoff = 0;
+  if ((hostin = VfsGetHostFd(infd)) != -1 &&
+      (hostout = VfsGetHostFd(outfd)) != -1) {
+    if (inoffp) inoff = Read64(inoffp);
+    if (outoffp) outoff = Read64(outoffp);
+    RESTARTABLE(rc = splice(hostin, inoffp ? &inoff : 0, hostout,
+                            outoffp ? &outoff : 0, count,
+                            XlatSpliceFlags(flags)));
+    if (rc != -1) {
+      if (inoffp) Write64(inoffp, inoff);
+      if (outoffp) Write64(outoffp, outoff);
+    }
+    return rc;
+  }
+#endif
+  inpipe = IsFileType(infd, S_IFIFO);
+  outpipe = IsFileType(outfd, S_IFIFO);
+  if (!inpipe && !outpipe) return einval();
+  if ((inpipe && inoffp) || (outpipe && outoffp)) {
+    errno = ESPIPE;
+    return -1;
+  }
+  // SPLICE_F_NONBLOCK isn't honored by the fallback, which instead
+  // blocks according to the O_NONBLOCK status of the fds themselves
+  RESTARTABLE(rc = CopyBuffered(m, infd, inoffp, outfd, outoffp, count, true));
+  return rc;
+}
+
+static i64 SysTee(struct Machine *m, i32 infd, i32 outfd, u64 count,
+                  u32 flags) {
+  if (flags & ~(SPLICE_F_MOVE_LINUX | SPLICE_F_NONBLOCK_LINUX |
+                SPLICE_F_MORE_LINUX | SPLICE_F_GIFT_LINUX)) {
+    return einval();
+  }
+  if (CheckFdAccess(m, infd, false, EBADF) == -1) return -1;
+  if (CheckFdAccess(m, outfd, true, EBADF) == -1) return -1;
+  count = MIN(count, NUMERIC_MAX(ssize_t));
+#ifdef HAVE_SPLICE
+  ssize_t rc;
+  int hostin, hostout;
+  if ((hostin = VfsGetHostFd(infd)) != -1 &&
+      (hostout = VfsGetHostFd(outfd)) != -1) {
+    RESTARTABLE(rc = tee(hostin, hostout, count, XlatSpliceFlags(flags)));
+    return rc;
+  }
+#endif
+  // duplicating pipe contents without consuming them isn't possible
+  // using portable apis, so tee() only works on linux host pipes
+  return einval();
+}
+
 static int UnXlatDt(int x) {
 #ifndef DT_UNKNOWN
   return DT_UNKNOWN_LINUX;
@@ -2641,6 +3163,39 @@ static int UnXlatDt(int x) {
 #endif
 }
 
+#if defined(SYS_getdents64) && defined(DISABLE_VFS)
+// reads as many directory entries as fit using one host system call
+//
+// Linux uses the same dirent64 record layout on every architecture, so
+// host records become guest records by rewriting their fields in place.
+// The host buffer mustn't be larger than the guest's, since every entry
+// the host returns advances the directory offset, even if we drop it.
+static i64 GetdentsBulk(struct Machine *m, struct Fd *fd, i64 addr,
+                        i64 size) {
+  u8 *p;
+  u16 reclen;
+  i64 i, rc, off;
+  u64 ino;
+  struct dirent_linux *rec;
+  size = MIN(size, kMaxDirents);
+  if (!(p = (u8 *)AddToFreeList(m, malloc(size)))) return -1;
+  RESTARTABLE(rc = syscall(SYS_getdents64, fd->fildes, p, size));
+  if (rc == -1) return -1;
+  for (i = 0; i < rc; i += reclen) {
+    rec = (struct dirent_linux *)(p + i);
+    memcpy(&ino, p + i, 8);
+    memcpy(&off, p + i + 8, 8);
+    memcpy(&reclen, p + i + 16, 2);
+    Write64(rec->ino, ino);
+    Write64(rec->off, off);
+    Write16(rec->reclen, reclen);
+    Write8(rec->type, UnXlatDt(p[i + 18]));
+  }
+  if (CopyToUserWrite(m, addr, p, rc) == -1) return -1;
+  return rc;
+}
+#endif
+
 static i64 Getdents(struct Machine *m, i32 fildes, i64 addr, i64 size,
                     struct Fd *fd) {
   i64 i;
@@ -2654,20 +3209,23 @@ static i64 Getdents(struct Machine *m, i32 fildes, i64 addr, i64 size,
   if (size < sizeof(rec) - sizeof(rec.name)) return einval();
   if ((fd->oflags & O_DIRECTORY) != O_DIRECTORY) return enotdir();
   if (!IsValidMemory(m, addr, size, PROT_WRITE)) return -1;
+#if defined(SYS_getdents64) && defined(DISABLE_VFS)
+  if (!fd->dirstream) return GetdentsBulk(m, fd, addr, size);
+#endif
   if (VfsFstat(fildes, &st) || !st.st_nlink) return enoent();
   if (!fd->dirstream && !(fd->dirstream = VfsOpendir(fd->fildes))) {
     return -1;
   }
-  for (i = 0; i + sizeof(rec) <= size; i += reclen) {
+  for (i = 0;; i += reclen) {
     // telldir() can actually return negative on ARM/MIPS/i386
 #ifdef HAVE_SEEKDIR
     long tell;
     errno = 0;
     tell = VfsTelldir(fd->dirstream);
     unassert(tell != -1 || errno == 0);
-    off = tell;
 #else
-    off = -1;
+    // without seekdir() we can't put back entries that don't fit
+    if (i + sizeof(rec) > size) break;
 #endif
     if (!(ent = VfsReaddir(fd->dirstream))) break;
     len = strlen(ent->d_name);
@@ -2706,6 +3264,20 @@ static i64 Getdents(struct Machine *m, i32 fildes, i64 addr, i64 size,
     }
 #endif
     reclen = ROUNDUP(8 + 8 + 2 + 1 + len + 1, 8);
+#ifdef HAVE_SEEKDIR
+    if (i + reclen > size) {
+      // put the entry back so the next call returns it
+      VfsSeekdir(fd->dirstream, tell);
+      if (!i) return einval();
+      break;
+    }
+    // linux reports the offset of the entry that comes after
+    errno = 0;
+    off = VfsTelldir(fd->dirstream);
+    unassert(off != -1 || errno == 0);
+#else
+    off = -1;
+#endif
     memset(&rec, 0, sizeof(rec));
     Write64(rec.ino, ent->d_ino);
     Write64(rec.off, off);
@@ -2867,6 +3439,52 @@ static int SysFstatat(struct Machine *m, i32 dirfd, i64 pathaddr, i64 staddr,
   return rc;
 }
 
+static int SysStatx(struct Machine *m, i32 dirfd, i64 pathaddr, i32 flags,
+                    u32 mask, i64 statxaddr) {
+  int rc;
+  const char *path;
+  struct statx_linux gsx;
+  if ((flags & ~(AT_SYMLINK_NOFOLLOW_LINUX | AT_NO_AUTOMOUNT_LINUX |
+                 AT_EMPTY_PATH_LINUX | AT_STATX_SYNC_TYPE_LINUX)) ||
+      (flags & AT_STATX_SYNC_TYPE_LINUX) == AT_STATX_SYNC_TYPE_LINUX ||
+      (mask & STATX__RESERVED_LINUX)) {
+    return einval();
+  }
+  if (!(path = LoadStr(m, pathaddr))) return -1;
+  if (!*path && !(flags & AT_EMPTY_PATH_LINUX)) return enoent();
+#if defined(HAVE_STATX) && defined(DISABLE_VFS)
+  // the host is linux so it understands our flags and mask as they are,
+  // which lets its kernel skip fetching the fields nobody asked for
+  struct statx stx;
+  if (!*path && (flags & AT_EMPTY_PATH_LINUX)) {
+    rc = statx(GetDirFildes(dirfd), "", flags, mask, &stx);
+  } else {
+    rc = VfsStatx(GetDirFildes(dirfd), path, flags & ~AT_EMPTY_PATH_LINUX,
+                  mask, &stx);
+  }
+  if (rc != -1) XlatStatxToLinux(&gsx, &stx);
+#else
+  // fill in the basic stats, which linux says is fine for any mask
+  struct stat st;
+  if (!*path && (flags & AT_EMPTY_PATH_LINUX)) {
+    if (GetDirFildes(dirfd) == AT_FDCWD) {
+      rc = VfsStat(AT_FDCWD, ".", &st, 0);  // linux stats the cwd
+    } else {
+      rc = VfsFstat(dirfd, &st);
+    }
+  } else {
+    rc = VfsStat(GetDirFildes(dirfd), path, &st,
+                 XlatFstatatFlags(flags & (AT_SYMLINK_NOFOLLOW_LINUX |
+                                           AT_NO_AUTOMOUNT_LINUX)));
+  }
+  if (rc != -1) XlatStatToStatxLinux(&gsx, &st);
+#endif
+  if (rc != -1 && CopyToUserWrite(m, statxaddr, &gsx, sizeof(gsx)) == -1) {
+    rc = -1;
+  }
+  return rc;
+}
+
 static int XlatFchownatFlags(int x) {
   int res = 0;
   if (x & AT_SYMLINK_FOLLOW_LINUX) {
@@ -3295,6 +3913,8 @@ static int SysFcntl(struct Machine *m, i32 fildes, i32 cmd, i64 arg) {
   } else if (cmd == F_GETOWN_EX_LINUX) {
     rc = SysFcntlGetownEx(m, fd->fildes, arg);
 #endif
+  } else if (cmd == F_ADD_SEALS_LINUX || cmd == F_GET_SEALS_LINUX) {
+    rc = SysFcntlSeals(fd->fildes, cmd, arg);
 #endif
   } else {
     LOGF("missing fcntl() command %" PRId32, cmd);
@@ -3499,7 +4119,7 @@ static int SysLink(struct Machine *m, i64 existingpath, i64 newpath) {
   return SysLinkat(m, AT_FDCWD_LINUX, existingpath, AT_FDCWD_LINUX, newpath, 0);
 }
 
-static bool IsBlinkSig(struct System *s, int sig) {
+bool IsBlinkSig(struct System *s, int sig) {
   unassert(1 <= sig && sig <= 64);
   return !!(s->blinksigs & ((u64)1 << (sig - 1)));
 }
@@ -3553,16 +4173,40 @@ static void ExecveBlink(struct Machine *m, char *prog, char **argv,
   }
 }
 
+static bool CanExecveBlink(struct Machine *m, char *prog, char **argv) {
+  // prog and argv get changed if it's a shebang script, but since this
+  // is only asking, we want ExecveBlink() to do that again on its own
+  return CanEmulateExecutable(m, &prog, &argv);
+}
+
 static int SysExecve(struct Machine *m, i64 pa, i64 aa, i64 ea) {
+  bool lean = false;
   char *prog, **argv, **envp;
   if (!(prog = CopyStr(m, pa))) return -1;
   if (!(argv = CopyStrList(m, aa))) return -1;
   if (!(envp = CopyStrList(m, ea))) return -1;
+  if (m->vfork) {
+    // a vfork() child that blink is able to emulate won't come back
+    // to the guest memory it's borrowing, since Exec() replaces it
+    lean = m->system->exec && CanExecveBlink(m, prog, argv);
+    if (!lean && VfsAccess(AT_FDCWD, prog, X_OK, 0)) {
+      return -1;  // fail without splitting, so parent can see errno
+    }
+    if (SplitVfork(m, lean)) {
+      m->interrupted = true;  // prevent ax clobber
+      return 0;
+    }
+  }
   LOCK(&m->system->exec_lock);
+  FlushSysTraces();  // exec won't run our atexit() handlers
   ExecveBlink(m, prog, argv, envp);
   SYS_LOGF("execve(%s)", prog);
   VfsExecve(prog, argv, envp);
   UNLOCK(&m->system->exec_lock);
+  if (lean) {
+    // there's no writable memory to return to
+    _Exit(127);
+  }
   return -1;
 }
 
@@ -3593,6 +4237,8 @@ static int SysWait4(struct Machine *m, int pid, i64 opt_out_wstatus_addr,
   RESTARTABLE(rc = waitpid(pid, &wstatus, options));
 #endif
   if (rc != -1 && rc != 0) {
+    // the child may have changed files this process has looked up
+    VfsFlushDentries();
     if (opt_out_wstatus_addr) {
 #ifdef WIFCONTINUED
       if (WIFCONTINUED(wstatus)) {
@@ -3775,15 +4421,53 @@ static ssize_t SysGetrandom(struct Machine *m, i64 a, size_t n, int f) {
 void OnSignal(int sig, siginfo_t *si, void *uc) {
   SIG_LOGF("OnSignal(%s)", DescribeSignal(UnXlatSignal(sig)));
   EnqueueSignal(g_machine, UnXlatSignal(sig));
+  InterruptFutex(g_machine);
+}
+
+// changes host disposition of sig to reflect the guest's sigaction
+void InstallSigaction(struct System *s, int sig) {
+  int syssig;
+  u64 flags;
+  i64 handler;
+  struct sigaction syshand;
+  if ((syssig = XlatSignal(sig)) == -1 || IsBlinkSig(s, sig)) return;
+  flags = Read64(s->hands[sig - 1].flags);
+  handler = Read64(s->hands[sig - 1].handler);
+  if (handler == SIG_IGN_LINUX) {
+    flags &= ~SA_NOCLDWAIT_LINUX;
+  }
+  sigfillset(&syshand.sa_mask);
+  syshand.sa_flags = SA_SIGINFO;
+  if (flags & SA_NOCLDSTOP_LINUX) syshand.sa_flags |= SA_NOCLDSTOP;
+#ifdef SA_NOCLDWAIT
+  if (flags & SA_NOCLDWAIT_LINUX) syshand.sa_flags |= SA_NOCLDWAIT;
+#endif
+  switch (handler) {
+    case SIG_DFL_LINUX:
+      if (GetSignalFdMask() & ((u64)1 << (sig - 1))) {
+        syshand.sa_sigaction = OnSignal;  // signalfd() wants it
+      } else {
+        syshand.sa_handler = SIG_DFL;
+      }
+      break;
+    case SIG_IGN_LINUX:
+      syshand.sa_handler = SIG_IGN;
+      break;
+    default:
+      syshand.sa_sigaction = OnSignal;
+      break;
+  }
+  if (sigaction(syssig, &syshand, 0)) {
+    LOGF("system sigaction(%s) returned %s", DescribeSignal(sig),
+         DescribeHostErrno(errno));
+  }
 }
 
 static int SysSigaction(struct Machine *m, int sig, i64 act, i64 old,
                         u64 sigsetsize) {
-  int syssig;
   u64 flags = 0;
   i64 handler = 0;
   bool isignored = false;
-  struct sigaction syshand;
   struct sigaction_linux hand;
   u32 supported = SA_SIGINFO_LINUX |    //
                   SA_RESTART_LINUX |    //
@@ -3840,29 +4524,7 @@ static int SysSigaction(struct Machine *m, int sig, i64 act, i64 old,
     if (isignored) {
       m->signals &= ~((u64)1 << (sig - 1));
     }
-    if ((syssig = XlatSignal(sig)) != -1 && !IsBlinkSig(m->system, sig)) {
-      sigfillset(&syshand.sa_mask);
-      syshand.sa_flags = SA_SIGINFO;
-      if (flags & SA_NOCLDSTOP_LINUX) syshand.sa_flags |= SA_NOCLDSTOP;
-#ifdef SA_NOCLDWAIT
-      if (flags & SA_NOCLDWAIT_LINUX) syshand.sa_flags |= SA_NOCLDWAIT;
-#endif
-      switch (handler) {
-        case SIG_DFL_LINUX:
-          syshand.sa_handler = SIG_DFL;
-          break;
-        case SIG_IGN_LINUX:
-          syshand.sa_handler = SIG_IGN;
-          break;
-        default:
-          syshand.sa_sigaction = OnSignal;
-          break;
-      }
-      if (sigaction(syssig, &syshand, 0)) {
-        LOGF("system sigaction(%s) returned %s", DescribeSignal(sig),
-             DescribeHostErrno(errno));
-      }
-    }
+    InstallSigaction(m->system, sig);
   }
   UNLOCK(&m->system->sig_lock);
   return 0;
@@ -3919,40 +4581,34 @@ static int SysNanosleep(struct Machine *m, i64 req, i64 rem) {
   if (ts.tv_sec < 0) return einval();
   if (!(0 <= ts.tv_nsec && ts.tv_nsec < 1000000000)) return einval();
   deadline = AddTime(now, ts);
-  for (;;) {
-    if (CompareTime(now, deadline) >= 0) return 0;
-    ts = SubtractTime(deadline, now);
-    if (nanosleep(&ts, 0)) {
-      unassert(errno == EINTR);
-      // this may run a guest signal handler before returning
-      if (CheckInterrupt(m, false)) {
-        // a signal was delivered or is about to be delivered
-        if (rem) {
-          // rem is only updated when -1 w/ eintr is returned
-          now = GetTime();
-          if (CompareTime(now, deadline) < 0) {
-            ts = SubtractTime(deadline, now);
-          } else {
-            ts = GetZeroTime();
-          }
-          Write64(gt.sec, ts.tv_sec);
-          Write64(gt.nsec, ts.tv_nsec);
-          CopyToUserWrite(m, rem, &gt, sizeof(gt));
-        }
-        return -1;
+  if (SleepGuest(m, deadline) == -1) {
+    // a signal was delivered or is about to be delivered
+    if (rem) {
+      // rem is only updated when -1 w/ eintr is returned
+      now = GetTime();
+      if (CompareTime(now, deadline) < 0) {
+        ts = SubtractTime(deadline, now);
+      } else {
+        ts = GetZeroTime();
       }
+      Write64(gt.sec, ts.tv_sec);
+      Write64(gt.nsec, ts.tv_nsec);
+      CopyToUserWrite(m, rem, &gt, sizeof(gt));
     }
-    // sleep apis aren't nearly as fast and reliable as time apis
-    // even if nanosleep() claims it slept the full time we check
-    now = GetTime();
+    return -1;
   }
+  return 0;
 }
 
+// sleeps on the host clock that `clock` was translated to
+//
+// We always sleep on the realtime clock, so the requested clock might
+// disagree about whether we slept long enough, in which case we just go
+// back to sleep for however much time it says is left.
 static int SysClockNanosleep(struct Machine *m, int clock, int flags,
                              i64 reqaddr, i64 remaddr) {
-  int rc;
   clock_t sysclock;
-  struct timespec req, rem;
+  struct timespec req, now;
   struct timespec_linux gtimespec;
   if (XlatClock(clock, &sysclock) == -1) return -1;
   if (flags & ~TIMER_ABSTIME_LINUX) return einval();
@@ -3961,47 +4617,27 @@ static int SysClockNanosleep(struct Machine *m, int clock, int flags,
   }
   req.tv_sec = Read64(gtimespec.sec);
   req.tv_nsec = Read64(gtimespec.nsec);
-TryAgain:
-#if defined(TIMER_ABSTIME) && !defined(__OpenBSD__)
-  flags = flags & TIMER_ABSTIME_LINUX ? TIMER_ABSTIME : 0;
-  if ((rc = clock_nanosleep(sysclock, flags, &req, &rem))) {
-    errno = rc;
-    rc = -1;
-  }
-#else
-  if (!flags) {
-    if (sysclock == CLOCK_REALTIME) {
-      rc = nanosleep(&req, &rem);
-    } else {
-      rc = einval();
-    }
-  } else {
-    struct timespec now;
-    if (!(rc = clock_gettime(sysclock, &now))) {
-      if (CompareTime(now, req) < 0) {
-        req = SubtractTime(req, now);
-        rc = nanosleep(&req, &rem);
-      } else {
-        rc = 0;
-      }
-    }
-  }
-#endif
-  if (rc == -1 && errno == EINTR) {
-    if (CheckInterrupt(m, false)) {
-      if (!flags && remaddr) {
-        Write64(gtimespec.sec, rem.tv_sec);
-        Write64(gtimespec.nsec, rem.tv_nsec);
+  if (req.tv_sec < 0) return einval();
+  if (!(0 <= req.tv_nsec && req.tv_nsec < 1000000000)) return einval();
+  if (clock_gettime(sysclock, &now)) return -1;
+  if (!(flags & TIMER_ABSTIME_LINUX)) {
+    req = AddTime(now, req);
+  }
+  while (CompareTime(now, req) < 0) {
+    if (SleepGuest(m, AddTime(GetTime(), SubtractTime(req, now))) == -1) {
+      if (!(flags & TIMER_ABSTIME_LINUX) && remaddr) {
+        unassert(!clock_gettime(sysclock, &now));
+        now = CompareTime(now, req) < 0 ? SubtractTime(req, now)
+                                        : GetZeroTime();
+        Write64(gtimespec.sec, now.tv_sec);
+        Write64(gtimespec.nsec, now.tv_nsec);
         CopyToUserWrite(m, remaddr, &gtimespec, sizeof(gtimespec));
       }
-    } else {
-      if (!flags) {
-        req = rem;
-      }
-      goto TryAgain;
+      return -1;
     }
+    if (clock_gettime(sysclock, &now)) return -1;
   }
-  return rc;
+  return 0;
 }
 
 static int SigsuspendActual(struct Machine *m, u64 mask) {
@@ -4212,6 +4848,25 @@ static i64 SysTime(struct Machine *m, i64 addr) {
   return secs;
 }
 
+static int SysGetcpu(struct Machine *m, i64 cpuaddr, i64 nodeaddr) {
+  int cpu;
+  u8 buf[4];
+#if defined(__linux) && defined(HAVE_SCHED_GETAFFINITY)
+  if ((cpu = sched_getcpu()) == -1) cpu = 0;
+#else
+  cpu = 0;
+#endif
+  if (cpuaddr) {
+    Write32(buf, cpu);
+    if (CopyToUserWrite(m, cpuaddr, buf, sizeof(buf)) == -1) return -1;
+  }
+  if (nodeaddr) {
+    Write32(buf, 0);
+    if (CopyToUserWrite(m, nodeaddr, buf, sizeof(buf)) == -1) return -1;
+  }
+  return 0;
+}
+
 static i64 SysTimes(struct Machine *m, i64 bufaddr) {
   // no conversion needed thanks to getauxval(AT_CLKTCK)
   clock_t res;
@@ -4412,6 +5067,149 @@ static int SaveFdSet(struct Machine *m, int nfds, const fd_set *fds, i64 addr) {
   return CopyToUserWrite(m, addr, p, FD_SETSIZE_LINUX / 8);
 }
 
+// waits for host file descriptors to become ready
+//
+// All host signals are blocked except while the host kernel is waiting
+// so that guest signals (and kills from other threads, which arrive as
+// SIGSYS) interrupt the wait without racing our pending signal checks.
+static int PollHost(struct Machine *m, struct pollfd *fds, nfds_t nfds,
+                    struct timespec deadline) {
+  int rc;
+  sigset_t block, oldmask;
+  struct timespec now, waitfor;
+  unassert(!sigfillset(&block));
+  unassert(!pthread_sigmask(SIG_BLOCK, &block, &oldmask));
+  for (;;) {
+    if (CheckInterrupt(m, false)) {
+      rc = -1;
+      break;
+    }
+    if (atomic_load_explicit(&m->killed, memory_order_acquire)) {
+      rc = eintr();
+      break;
+    }
+    now = GetTime();
+    if (CompareTime(now, deadline) < 0) {
+      waitfor = SubtractTime(deadline, now);
+    } else {
+      waitfor = GetZeroTime();
+    }
+#ifdef HAVE_PPOLL
+    rc = ppoll(fds, nfds, &waitfor, &oldmask);
+#else
+    // without ppoll() a signal may slip in between unblocking and poll()
+    // so we bound how long it could go unnoticed by waking up regularly
+    if (CompareTime(waitfor, FromMilliseconds(kPollingMs)) > 0) {
+      waitfor = FromMilliseconds(kPollingMs);
+    }
+    unassert(!pthread_sigmask(SIG_SETMASK, &oldmask, 0));
+    rc = poll(fds, nfds, ConvertTimeToInt(ToMilliseconds(waitfor)));
+    unassert(!pthread_sigmask(SIG_BLOCK, &block, 0));
+    if (!rc && CompareTime(GetTime(), deadline) < 0) {
+      continue;
+    }
+#endif
+    if (rc != -1 || errno != EINTR) {
+      break;
+    }
+  }
+  unassert(!pthread_sigmask(SIG_SETMASK, &oldmask, 0));
+  return rc;
+}
+
+// polls guest file descriptors until one is ready or deadline passes
+//
+// Descriptors backed by host files are waited upon together using one
+// host ppoll() call. Only virtual descriptors (e.g. the blinkenlights
+// pty) need to have their poll callback tried individually, in which
+// case we wake up every kPollingMs to check them again. Entries with a
+// negative `fd` are ignored. Unknown descriptors are reported as being
+// POLLNVAL, or raise EBADF if `strict` is true.
+static int PollGuest(struct Machine *m, struct pollfd *fds, nfds_t nfds,
+                     struct timespec deadline, bool strict) {
+  int rc;
+  nfds_t i;
+  bool isvirtual;
+  struct Fd *fd;
+  struct pollfd pfd, *hfds;
+  struct timespec now, until;
+  int (**impls)(struct pollfd *, nfds_t, int);
+  if (!(hfds = (struct pollfd *)AddToFreeList(
+            m, calloc(nfds + 1, sizeof(*hfds)))) ||
+      !(impls = (int (**)(struct pollfd *, nfds_t, int))AddToFreeList(
+            m, calloc(nfds + 1, sizeof(*impls))))) {
+    return -1;
+  }
+  LOCK(&m->system->fds.lock);
+  for (i = 0; i < nfds; ++i) {
+    fds[i].revents = 0;
+    hfds[i].fd = -1;
+    hfds[i].events = fds[i].events;
+    if (fds[i].fd < 0) continue;
+    if ((fd = GetFd(&m->system->fds, fds[i].fd))) {
+      unassert(fd->cb);
+      unassert(impls[i] = fd->cb->poll);
+    } else {
+      fds[i].revents = POLLNVAL;
+    }
+  }
+  UNLOCK(&m->system->fds.lock);
+  for (isvirtual = false, i = 0; i < nfds; ++i) {
+    if (strict && fds[i].revents == POLLNVAL) {
+      return ebadf();
+    }
+    if (impls[i] == VfsPoll && (hfds[i].fd = VfsGetHostFd(fds[i].fd)) != -1) {
+      impls[i] = 0;
+    } else if (impls[i]) {
+      isvirtual = true;
+    }
+  }
+  for (;;) {
+    for (rc = i = 0; i < nfds; ++i) {
+      if (impls[i]) {
+        pfd.fd = fds[i].fd;
+        pfd.events = fds[i].events;
+        pfd.revents = 0;
+        switch (impls[i](&pfd, 1, 0)) {
+          case 1:
+            fds[i].revents = pfd.revents;
+            break;
+          case -1:
+            fds[i].revents = POLLERR;
+            break;
+          default:
+            fds[i].revents = 0;
+            break;
+        }
+      }
+      rc += !!fds[i].revents;
+    }
+    now = GetTime();
+    if (rc) {
+      until = now;
+    } else if (isvirtual) {
+      until = AddTime(now, FromMilliseconds(kPollingMs));
+      if (CompareTime(deadline, until) < 0) {
+        until = deadline;
+      }
+    } else {
+      until = deadline;
+    }
+    if (PollHost(m, hfds, nfds, until) == -1) {
+      return -1;
+    }
+    for (rc = i = 0; i < nfds; ++i) {
+      if (!impls[i] && hfds[i].fd != -1) {
+        fds[i].revents = hfds[i].revents;
+      }
+      rc += !!fds[i].revents;
+    }
+    if (rc || CompareTime(GetTime(), deadline) >= 0) {
+      return rc;
+    }
+  }
+}
+
 static i32 Select(struct Machine *m,          //
                   i32 nfds,                   //
                   i64 readfds_addr,           //
@@ -4421,15 +5219,16 @@ static i32 Select(struct Machine *m,          //
                   const u64 *sigmaskp_guest) {
   int fildes, rc;
   i32 setsize;
+  nfds_t i, n;
   u64 oldmask_guest = 0;
   fd_set readfds, writefds, exceptfds, readyreadfds, readywritefds,
       readyexceptfds;
-  struct pollfd hfds[1];
-  struct timespec now, wait, remain, deadline = {0};
-  struct Fd *fd;
-  int (*poll_impl)(struct pollfd *, nfds_t, int);
+  struct pollfd *fds;
+  struct timespec now, deadline;
   if (timeoutp) {
     deadline = AddTime(GetTime(), *timeoutp);
+  } else {
+    deadline = GetMaxTime();
   }
   setsize = MIN(FD_SETSIZE, FD_SETSIZE_LINUX);
   if (nfds < 0 || nfds > setsize) {
@@ -4460,92 +5259,50 @@ static i32 Select(struct Machine *m,          //
   FD_ZERO(&readyreadfds);
   FD_ZERO(&readywritefds);
   FD_ZERO(&readyexceptfds);
+  if (!(fds = (struct pollfd *)AddToFreeList(
+            m, calloc(nfds + 1, sizeof(*fds))))) {
+    return -1;
+  }
+  for (n = fildes = 0; fildes < nfds; ++fildes) {
+    if (!FD_ISSET(fildes, &readfds) && !FD_ISSET(fildes, &writefds) &&
+        !FD_ISSET(fildes, &exceptfds)) {
+      continue;
+    }
+    fds[n].fd = fildes;
+    fds[n].events = ((FD_ISSET(fildes, &readfds) ? POLLIN : 0) |
+                     (FD_ISSET(fildes, &writefds) ? POLLOUT : 0) |
+                     (FD_ISSET(fildes, &exceptfds) ? POLLPRI : 0));
+    ++n;
+  }
   if (sigmaskp_guest) {
     oldmask_guest = m->sigmask;
     m->sigmask = *sigmaskp_guest;
     SIG_LOGF("sigmask push %" PRIx64, m->sigmask);
   }
-  for (;;) {
-    if (CheckInterrupt(m, false)) {
-      rc = eintr();
-      break;
-    }
-    rc = 0;
-    for (fildes = 0; fildes < nfds; ++fildes) {
-      if (!FD_ISSET(fildes, &readfds) && !FD_ISSET(fildes, &writefds) &&
-          !FD_ISSET(fildes, &exceptfds)) {
-        continue;
-      }
-    TryAgain:
-      if (CheckInterrupt(m, false)) {
-        rc = eintr();
-        break;
-      }
-      LOCK(&m->system->fds.lock);
-      if ((fd = GetFd(&m->system->fds, fildes))) {
-        unassert(fd->cb);
-        unassert(poll_impl = fd->cb->poll);
-      } else {
-        poll_impl = 0;
-      }
-      UNLOCK(&m->system->fds.lock);
-      if (fd) {
-        hfds[0].fd = fildes;
-        hfds[0].events = ((FD_ISSET(fildes, &readfds) ? POLLIN : 0) |
-                          (FD_ISSET(fildes, &writefds) ? POLLOUT : 0) |
-                          (FD_ISSET(fildes, &exceptfds) ? POLLPRI : 0));
-        switch (poll_impl(hfds, 1, 0)) {
-          case 0:
-            break;
-          case 1:
-            if (FD_ISSET(fildes, &readfds) && (hfds[0].revents & POLLIN)) {
-              ++rc;
-              FD_SET(fildes, &readyreadfds);
-              FD_CLR(fildes, &readfds);
-            }
-            if (FD_ISSET(fildes, &writefds) && (hfds[0].revents & POLLOUT)) {
-              ++rc;
-              FD_SET(fildes, &readywritefds);
-              FD_CLR(fildes, &writefds);
-            }
-            if (FD_ISSET(fildes, &exceptfds) && (hfds[0].revents & POLLPRI)) {
-              ++rc;
-              FD_SET(fildes, &readyexceptfds);
-              FD_CLR(fildes, &exceptfds);
-            }
-            break;
-          case -1:
-            if (errno == EINTR) {
-              goto TryAgain;
-            }
-            rc = -1;
-            goto BreakLoop;
-        }
-      } else {
-        rc = ebadf();
-        break;
-      }
-    }
-  BreakLoop:
-    if (rc || (timeoutp && CompareTime(now = GetTime(), deadline) >= 0)) {
-      break;
-    }
-    if (timeoutp) {
-      wait = FromMilliseconds(kPollingMs);
-      remain = SubtractTime(deadline, now);
-      if (CompareTime(remain, wait) < 0) {
-        wait = remain;
-      }
-    } else {
-      wait = FromMilliseconds(kPollingMs);
-    }
-    nanosleep(&wait, 0);
-  }
+  rc = PollGuest(m, fds, n, deadline, true);
   if (sigmaskp_guest) {
     m->sigmask = oldmask_guest;
     SIG_LOGF("sigmask pop %" PRIx64, m->sigmask);
   }
   if (rc != -1) {
+    // same readiness sets as the linux kernel's select() implementation
+    for (rc = i = 0; i < n; ++i) {
+      fildes = fds[i].fd;
+      if (FD_ISSET(fildes, &readfds) &&
+          (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+        ++rc;
+        FD_SET(fildes, &readyreadfds);
+      }
+      if (FD_ISSET(fildes, &writefds) &&
+          (fds[i].revents & (POLLOUT | POLLERR))) {
+        ++rc;
+        FD_SET(fildes, &readywritefds);
+      }
+      if (FD_ISSET(fildes, &exceptfds) && (fds[i].revents & POLLPRI)) {
+        ++rc;
+        FD_SET(fildes, &readyexceptfds);
+      }
+    }
     if ((readfds_addr &&
          SaveFdSet(m, nfds, &readyreadfds, readfds_addr) == -1) ||
         (writefds_addr &&
@@ -4664,81 +5421,37 @@ static i32 SysPselect(struct Machine *m, i32 nfds, i64 readfds_addr,
 static int Poll(struct Machine *m, i64 fdsaddr, u64 nfds,
                 struct timespec deadline) {
   long i;
+  int rc, ev;
   u64 gfdssize;
-  struct Fd *fd;
-  int fildes, rc, ev;
-  struct pollfd hfds[1];
+  struct pollfd *hfds;
   struct pollfd_linux *gfds;
-  struct timespec now, wait, remain;
-  int (*poll_impl)(struct pollfd *, nfds_t, int);
   if (!ckd_mul(&gfdssize, nfds, sizeof(struct pollfd_linux)) &&
       gfdssize <= 0x7ffff000) {
-    if ((gfds = (struct pollfd_linux *)AddToFreeList(m, malloc(gfdssize)))) {
-      rc = 0;
+    if ((gfds = (struct pollfd_linux *)AddToFreeList(m, malloc(gfdssize))) &&
+        (hfds = (struct pollfd *)AddToFreeList(
+             m, calloc(nfds + 1, sizeof(*hfds))))) {
       CopyFromUserRead(m, gfds, fdsaddr, gfdssize);
-      for (;;) {
+      for (i = 0; i < nfds; ++i) {
+        hfds[i].fd = Read32(gfds[i].fd);
+        ev = Read16(gfds[i].events);
+        hfds[i].events = (((ev & POLLIN_LINUX) ? POLLIN : 0) |
+                          ((ev & POLLOUT_LINUX) ? POLLOUT : 0) |
+                          ((ev & POLLPRI_LINUX) ? POLLPRI : 0));
+      }
+      if ((rc = PollGuest(m, hfds, nfds, deadline, false)) != -1) {
         for (i = 0; i < nfds; ++i) {
-        TryAgain:
-          if (CheckInterrupt(m, false)) {
-            rc = eintr();
-            break;
-          }
-          fildes = Read32(gfds[i].fd);
-          LOCK(&m->system->fds.lock);
-          if ((fd = GetFd(&m->system->fds, fildes))) {
-            unassert(fd->cb);
-            unassert(poll_impl = fd->cb->poll);
-          } else {
-            poll_impl = 0;
-          }
-          UNLOCK(&m->system->fds.lock);
-          if (fd) {
-            hfds[0].fd = fildes;
-            ev = Read16(gfds[i].events);
-            hfds[0].events = (((ev & POLLIN_LINUX) ? POLLIN : 0) |
-                              ((ev & POLLOUT_LINUX) ? POLLOUT : 0) |
-                              ((ev & POLLPRI_LINUX) ? POLLPRI : 0));
-            switch (poll_impl(hfds, 1, 0)) {
-              case 0:
-                Write16(gfds[i].revents, 0);
-                break;
-              case 1:
-                ++rc;
-                ev = 0;
-                if (hfds[0].revents & POLLIN) ev |= POLLIN_LINUX;
-                if (hfds[0].revents & POLLPRI) ev |= POLLPRI_LINUX;
-                if (hfds[0].revents & POLLOUT) ev |= POLLOUT_LINUX;
-                if (hfds[0].revents & POLLERR) ev |= POLLERR_LINUX;
-                if (hfds[0].revents & POLLHUP) ev |= POLLHUP_LINUX;
-                if (hfds[0].revents & POLLNVAL) ev |= POLLERR_LINUX;
-                if (!ev) ev |= POLLERR_LINUX;
-                Write16(gfds[i].revents, ev);
-                break;
-              case -1:
-                if (errno == EINTR) {
-                  goto TryAgain;
-                }
-                ++rc;
-                Write16(gfds[i].revents, POLLERR_LINUX);
-                break;
-              default:
-                break;
-            }
-          } else {
-            Write16(gfds[i].revents, POLLNVAL_LINUX);
+          ev = 0;
+          if (hfds[i].revents) {
+            if (hfds[i].revents & POLLIN) ev |= POLLIN_LINUX;
+            if (hfds[i].revents & POLLPRI) ev |= POLLPRI_LINUX;
+            if (hfds[i].revents & POLLOUT) ev |= POLLOUT_LINUX;
+            if (hfds[i].revents & POLLERR) ev |= POLLERR_LINUX;
+            if (hfds[i].revents & POLLHUP) ev |= POLLHUP_LINUX;
+            if (hfds[i].revents & POLLNVAL) ev |= POLLNVAL_LINUX;
+            if (!ev) ev |= POLLERR_LINUX;
           }
+          Write16(gfds[i].revents, ev);
         }
-        if (rc || CompareTime((now = GetTime()), deadline) >= 0) {
-          break;
-        }
-        wait = FromMilliseconds(kPollingMs);
-        remain = SubtractTime(deadline, now);
-        if (CompareTime(remain, wait) < 0) {
-          wait = remain;
-        }
-        nanosleep(&wait, 0);
-      }
-      if (rc != -1) {
         CopyToUserWrite(m, fdsaddr, gfds, nfds * sizeof(*gfds));
       }
     } else {
@@ -4910,7 +5623,7 @@ static int SysTkill(struct Machine *m, int tid, int sig) {
       UNLOCK(&m->system->sig_lock);
       return rc;
     } else {
-      m->signals |= (u64)1 << (sig - 1);
+      EnqueueSignal(m, sig);
       return 0;
     }
   }
@@ -4931,7 +5644,6 @@ static int SysTkill(struct Machine *m, int tid, int sig) {
       if (m2->tid == tid) {
         if (sig) {
           EnqueueSignal(m2, sig);
-          err = pthread_kill(m2->thread, SIGSYS);
         } else {
           err = pthread_kill(m2->thread, 0);
         }
@@ -4968,9 +5680,7 @@ static int SysTgkill(struct Machine *m, int pid, int tid, int sig) {
 }
 
 static int SysPause(struct Machine *m) {
-  int rc;
-  NORESTART(rc, pause());
-  return rc;
+  return SleepGuest(m, GetMaxTime());
 }
 
 static int SysSetsid(struct Machine *m) {
@@ -5442,10 +6152,63 @@ static int SysEpollWait(struct Machine *m, i32 epfd, i64 eventsaddr,
 
 #endif /* HAVE_EPOLL_PWAIT1 */
 
+// services the functions exported by our emulated vdso, which calls
+// us using `hvcall` rather than `syscall`, so none of the overhead of
+// OpSyscall() is incurred, e.g. tlb flushing, page locking and strace
+void OpVdsocall(struct Machine *m, int func) {
+  i64 rc;
+  unassert(!m->nofault);
+  STATISTIC(++g_stats.vdso_calls);
+  switch (func) {
+    case kVdsoClockGettime:
+      rc = SysClockGettime(m, Get64(m->di), Get64(m->si));
+      break;
+    case kVdsoGettimeofday:
+      rc = SysGettimeofday(m, Get64(m->di), Get64(m->si));
+      break;
+    case kVdsoTime:
+      rc = SysTime(m, Get64(m->di));
+      break;
+    case kVdsoGetcpu:
+      rc = SysGetcpu(m, Get64(m->di), Get64(m->si));
+      break;
+    case kVdsoClockGetres:
+      rc = SysClockGetres(m, Get64(m->di), Get64(m->si));
+      break;
+    default:
+      rc = enosys();
+      break;
+  }
+  Put64(m->ax, rc != -1 ? rc : -(XlatErrno(errno) & 0xfff));
+}
+
+// returns first argument of system call if it's a file descriptor
+static i32 GetSyscallFd(const char *signature, u64 di) {
+  if (signature[2] == FD[0] || signature[2] == DIRFD[0]) return di;
+  return -1;
+}
+
 void OpSyscall(P) {
   size_t mark;
+  int sysno;
+  i64 rc;
   u64 ax, di, si, dx, r0, r8, r9;
+  struct timespec start = {0};
+  const char *sysname = 0, *syssig = 0;
   unassert(!m->nofault);
+  if (m->vfork && !IsVforkSafe(Get64(m->ax) & 0xfff)) {
+    sysno = Get64(m->ax) & 0xfff;
+    if (SplitVfork(m, sysno == 0x3C || sysno == 0xE7)) {
+      return;  // the new process will be issuing this call
+    }
+  }
+  if (g_snapshot_sysno == (int)(Get64(m->ax) & 0xfff) && !m->sysdepth &&
+      !m->vfork) {
+    TakeSnapshot(m);
+  }
+  if (m->system->linkcache.key && !m->sysdepth && !m->vfork) {
+    SaveLinkCache(m);
+  }
   if (Get64(m->ax) == 0xE4) {
     // clock_gettime() is
     //   1) called frequently,
@@ -5456,7 +6219,7 @@ void OpSyscall(P) {
     Put64(m->ax, ax != -1 ? ax : -(XlatErrno(errno) & 0xfff));
     return;
   }
-  STATISTIC(++syscalls);
+  STATISTIC(++g_stats.syscalls);
   // make sure blinkenlights display is up to date before performing any
   // potentially blocking operations which would otherwise freeze things
   if (m->system->redraw && m->tid == m->system->pid) {
@@ -5480,6 +6243,7 @@ void OpSyscall(P) {
   // we need to save the current mark, so we don't collect parent's data
   mark = m->freelist.n;
   m->interrupted = false;
+  if (g_systrace) start = GetMonotonic();
   ax = Get64(m->ax);
   di = Get64(m->di);
   si = Get64(m->si);
@@ -5487,7 +6251,8 @@ void OpSyscall(P) {
   r0 = Get64(m->r10);
   r8 = Get64(m->r8);
   r9 = Get64(m->r9);
-  switch (ax & 0xfff) {
+  sysno = ax & 0xfff;
+  switch (sysno) {
     SYSCALL(3, 0x000, "read", SysRead, STRACE_READ);
     SYSCALL(3, 0x001, "write", SysWrite, STRACE_WRITE);
     SYSCALL(3, 0x002, "open", SysOpen, STRACE_OPEN);
@@ -5635,6 +6400,7 @@ void OpSyscall(P) {
     SYSCALL(1, 0x016, "pipe", SysPipe, STRACE_PIPE);
 #ifndef DISABLE_NONPOSIX
     SYSCALL(2, 0x125, "pipe2", SysPipe2, STRACE_PIPE2);
+    SYSCALL(2, 0x13F, "memfd_create", SysMemfdCreate, STRACE_2);
 #endif
     SYSCALL(6, 0x038, "clone", SysClone, STRACE_CLONE);
     SYSCALL(2, 0x0C8, "tkill", SysTkill, STRACE_TKILL);
@@ -5659,6 +6425,9 @@ void OpSyscall(P) {
 #endif /* defined(HAVE_FORK) || defined(HAVE_THREADS) */
 #ifndef DISABLE_NONPOSIX
     SYSCALL(4, 0x028, "sendfile", SysSendfile, STRACE_4);
+    SYSCALL(6, 0x113, "splice", SysSplice, STRACE_6);
+    SYSCALL(4, 0x114, "tee", SysTee, STRACE_4);
+    SYSCALL(6, 0x146, "copy_file_range", SysCopyFileRange, STRACE_6);
     SYSCALL(3, 0x0CC, "sched_get_affinity", SysSchedGetaffinity, STRACE_3);
     SYSCALL(1, 0x00C, "brk", SysBrk, STRACE_1);
     SYSCALL(1, 0x063, "sysinfo", SysSysinfo, STRACE_1);
@@ -5685,9 +6454,23 @@ void OpSyscall(P) {
     SYSCALL(5, 0x147, "preadv2", SysPreadv2, STRACE_PREADV2);
     SYSCALL(5, 0x148, "pwritev2", SysPwritev2, STRACE_PWRITEV2);
     SYSCALL(3, 0x1B4, "close_range", SysCloseRange, STRACE_3);
+    SYSCALL(2, 0x135, "getcpu", SysGetcpu, STRACE_2);
+    SYSCALL(5, 0x14C, "statx", SysStatx, STRACE_STATX);
+#ifdef HAVE_THREADS
+    SYSCALL(2, 0x1A9, "io_uring_setup", SysIoUringSetup, STRACE_2);
+    SYSCALL(6, 0x1AA, "io_uring_enter", SysIoUringEnter, STRACE_6);
+    SYSCALL(4, 0x1AB, "io_uring_register", SysIoUringRegister, STRACE_4);
+#endif
 #ifdef HAVE_EPOLL_PWAIT1
     SYSCALL(1, 0x0D5, "epoll_create", SysEpollCreate, STRACE_1);
     SYSCALL(1, 0x123, "epoll_create1", SysEpollCreate1, STRACE_1);
+    SYSCALL(1, 0x11C, "eventfd", SysEventfd, STRACE_1);
+    SYSCALL(2, 0x122, "eventfd2", SysEventfd2, STRACE_2);
+    SYSCALL(2, 0x11B, "timerfd_create", SysTimerfdCreate, STRACE_2);
+    SYSCALL(4, 0x11E, "timerfd_settime", SysTimerfdSettime, STRACE_4);
+    SYSCALL(2, 0x11F, "timerfd_gettime", SysTimerfdGettime, STRACE_2);
+    SYSCALL(3, 0x11A, "signalfd", SysSignalfd, STRACE_3);
+    SYSCALL(4, 0x121, "signalfd4", SysSignalfd4, STRACE_4);
     SYSCALL(4, 0x0E9, "epoll_ctl", SysEpollCtl, STRACE_4);
     SYSCALL(4, 0x0E8, "epoll_wait", SysEpollWait, STRACE_4);
     SYSCALL(6, 0x119, "epoll_pwait", SysEpollPwait, STRACE_6);
@@ -5704,8 +6487,6 @@ void OpSyscall(P) {
       SigRestore(m);
       m->interrupted = true;  // preevnt ax clobber
       break;
-    case 0x146:
-      // avoid noisy copy_file_range() feature check in cosmo
     case 0x1BC:
       // avoid noisy landlock_create_ruleset() feature check in cosmo
     case 0x500:
@@ -5723,8 +6504,15 @@ void OpSyscall(P) {
       ax = enosys();
       break;
   }
+  rc = ax != -1 ? ax : -(XlatErrno(errno) & 0xfff);
   if (!m->interrupted) {
-    Put64(m->ax, ax != -1 ? ax : -(XlatErrno(errno) & 0xfff));
+    Put64(m->ax, rc);
+  } else {
+    rc = -EINTR_LINUX;
+  }
+  if (g_systrace && sysname) {
+    TraceSyscall(m->tid, sysno, sysname, GetSyscallFd(syssig, di), rc,
+                 start);
   }
   unassert(--m->sysdepth >= 0);
   CollectPageLocks(m);
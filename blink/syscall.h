@@ -56,6 +56,7 @@
 extern char *g_blink_path;
 
 void OpSyscall(P);
+void OpVdsocall(struct Machine *, int);
 
 void SysCloseExec(struct System *);
 int SysClose(struct Machine *, i32);
@@ -63,9 +64,24 @@ int SysCloseRange(struct Machine *, u32, u32, u32);
 int SysDup(struct Machine *, i32, i32, i32, i32);
 int SysOpenat(struct Machine *, i32, i64, i32, i32);
 int SysPipe2(struct Machine *, i64, i32);
+int SysMemfdCreate(struct Machine *, i64, u32);
+int SysFcntlSeals(int, int, i64);
+int SysEventfd(struct Machine *, u32);
+int SysEventfd2(struct Machine *, u32, i32);
+int SysTimerfdCreate(struct Machine *, i32, i32);
+int SysTimerfdSettime(struct Machine *, i32, i32, i64, i64);
+int SysTimerfdGettime(struct Machine *, i32, i64);
+int SysSignalfd(struct Machine *, i32, i64, u64);
+int SysSignalfd4(struct Machine *, i32, i64, u64, i32);
+int SysIoUringSetup(struct Machine *, u32, i64);
+int SysIoUringEnter(struct Machine *, i32, u32, u32, u32, i64, u64);
+int SysIoUringRegister(struct Machine *, i32, u32, i64, u32);
+void ResetIoUrings(void);
+void CancelIoUringMemory(i64, i64, int);
 int SysIoctl(struct Machine *, int, u64, i64);
 _Noreturn void SysExitGroup(struct Machine *, int);
 _Noreturn void SysExit(struct Machine *, int);
+bool SplitVfork(struct Machine *, bool);
 
 int GetDirFildes(int);
 void AddStdFd(struct Fds *, int);
@@ -73,6 +89,11 @@ int GetOflags(struct Machine *, int);
 int GetFildes(struct Machine *, int);
 struct Fd *GetAndLockFd(struct Machine *, int);
 bool CheckInterrupt(struct Machine *, bool);
+int SleepHost(struct Machine *, struct timespec);
+int OpenMemfd(const char *, int);
+int XlatSendFlags(int, int);
+int XlatRecvFlags(int);
+void InstallSigaction(struct System *, int);
 int SysStatfs(struct Machine *, i64, i64);
 int SysFstatfs(struct Machine *, i32, i64);
 int mkfifoat_(int, const char *, mode_t);
@@ -0,0 +1,317 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "blink/systrace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "blink/assert.h"
+#include "blink/atomic.h"
+#include "blink/bitscan.h"
+#include "blink/dll.h"
+#include "blink/log.h"
+#include "blink/macros.h"
+#include "blink/thread.h"
+#include "blink/timespec.h"
+#include "blink/tsan.h"
+#include "blink/tunables.h"
+#include "blink/util.h"
+
+#define APPEND(...) o += snprintf(b + o, o > n ? 0 : n - o, __VA_ARGS__)
+
+#define SYSTRACE_CONTAINER(e) DLL_CONTAINER(struct SysTrace, elem, e)
+
+struct SysTraceRow {
+  const char *name;  // name of system call, or null if never called
+  u64 nanos;         // sum of how long each call took
+  u64 hist[kSysTraceBins];
+};
+
+// state of a thread which made system calls, where the ring is only
+// ever appended to by that thread, so it needn't take locks to do so
+struct SysTrace {
+  int tid;
+  struct Dll elem;
+  _Atomic(u32) head;  // number of records the thread has produced
+  _Atomic(u32) tail;  // number of records written to the trace file
+  struct SysTraceRecord ring[kSysTraceRing];
+  struct SysTraceRow rows[kSysTraceRows];
+};
+
+static struct SysTraces {
+  pthread_once_t_ once;
+  pthread_mutex_t_ lock;
+  int fd;
+  struct timespec epoch;
+  struct Dll *live;
+  struct SysTraceRow gone[kSysTraceRows];
+} g_systraces = {
+    PTHREAD_ONCE_INIT_,
+    PTHREAD_MUTEX_INITIALIZER_,
+    -1,
+};
+
+bool g_systrace;
+static _Thread_local struct SysTrace *g_mysystrace;
+
+// returns index of latency histogram bucket, where bucket zero counts
+// calls taking less than 1µs, and the bucket `i` counts calls taking
+// less than 2ⁱ µs, except the final bucket which counts everything else
+static int GetSysTraceBucket(u64 nanos) {
+  u64 micros;
+  if (!(micros = nanos / 1000)) return 0;
+  return MIN(bsr(micros) + 1, kSysTraceBins - 1);
+}
+
+static void AddSysTraceRow(struct SysTraceRow *x, const struct SysTraceRow *y) {
+  int i;
+  if (!y->name) return;
+  x->name = y->name;
+  x->nanos += y->nanos;
+  for (i = 0; i < kSysTraceBins; ++i) {
+    x->hist[i] += y->hist[i];
+  }
+}
+
+static void WriteSysTrace(const void *p, size_t n) {
+  ssize_t rc;
+  while (n) {
+    if ((rc = write(g_systraces.fd, p, n)) == -1) {
+      if (errno == EINTR) continue;
+      LOG_ONCE(LOGF("failed to write syscall trace: %s",
+                    DescribeHostErrno(errno)));
+      return;
+    }
+    p = (const char *)p + rc;
+    n -= rc;
+  }
+}
+
+static void FlushSysTrace(struct SysTrace *t) {
+  u32 i, n, head, tail;
+  tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+  head = atomic_load_explicit(&t->head, memory_order_acquire);
+  while (tail != head) {
+    i = tail & (kSysTraceRing - 1);
+    n = MIN(head - tail, kSysTraceRing - i);
+    WriteSysTrace(t->ring + i, n * sizeof(*t->ring));
+    tail += n;
+  }
+  atomic_store_explicit(&t->tail, tail, memory_order_release);
+}
+
+// writes whatever records every thread has produced so far
+void FlushSysTraces(void) {
+  struct Dll *e;
+  if (g_systraces.fd == -1) return;
+  LOCK(&g_systraces.lock);
+  for (e = dll_first(g_systraces.live); e; e = dll_next(g_systraces.live, e)) {
+    FlushSysTrace(SYSTRACE_CONTAINER(e));
+  }
+  UNLOCK(&g_systraces.lock);
+}
+
+// creates binary trace file at `path`, which records each system call
+int OpenSysTrace(const char *path) {
+  int fd;
+  struct SysTraceHeader h;
+  _Static_assert(IS2POW(kSysTraceRing), "systrace ring must be two-power");
+  _Static_assert(sizeof(struct SysTraceRecord) == 32, "");
+  if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                 0644)) == -1) {
+    return -1;
+  }
+  unassert((g_systraces.fd = fcntl(fd, F_DUPFD_CLOEXEC, kMinBlinkFd)) != -1);
+  unassert(!close(fd));
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, kSysTraceMagic, sizeof(h.magic));
+  h.version = kSysTraceVersion;
+  h.size = sizeof(struct SysTraceRecord);
+  WriteSysTrace(&h, sizeof(h));
+  g_systraces.epoch = GetMonotonic();
+  g_systrace = true;
+  atexit(FlushSysTraces);
+  return 0;
+}
+
+static void SysTracesBeforeFork(void) {
+  LOCK(&g_systraces.lock);
+}
+
+static void SysTracesAfterFork(void) {
+  UNLOCK(&g_systraces.lock);
+}
+
+// the child of fork() only has the thread which called it; records the
+// parent hasn't written yet are for the parent to write
+static void SysTracesAfterForkChild(void) {
+  int i;
+  struct Dll *e, *e2;
+  struct SysTrace *t;
+  for (e = dll_first(g_systraces.live); e; e = e2) {
+    e2 = dll_next(g_systraces.live, e);
+    t = SYSTRACE_CONTAINER(e);
+    atomic_store_explicit(&t->tail, t->head, memory_order_relaxed);
+    if (t != g_mysystrace) {
+      for (i = 0; i < kSysTraceRows; ++i) {
+        AddSysTraceRow(g_systraces.gone + i, t->rows + i);
+      }
+      dll_remove(&g_systraces.live, e);
+      free(t);
+    }
+  }
+  UNLOCK(&g_systraces.lock);
+}
+
+static void InitSysTraces(void) {
+  unassert(!pthread_atfork(SysTracesBeforeFork, SysTracesAfterFork,
+                           SysTracesAfterForkChild));
+}
+
+static struct SysTrace *GetSysTrace(int tid) {
+  struct SysTrace *t;
+  if ((t = g_mysystrace)) return t;
+  unassert(!pthread_once_(&g_systraces.once, InitSysTraces));
+  if (!(t = (struct SysTrace *)calloc(1, sizeof(*t)))) return 0;
+  t->tid = tid;
+  dll_init(&t->elem);
+  LOCK(&g_systraces.lock);
+  dll_make_last(&g_systraces.live, &t->elem);
+  UNLOCK(&g_systraces.lock);
+  return g_mysystrace = t;
+}
+
+// records that the calling thread made a system call starting at time
+// `start` (on the monotonic clock) which just returned `result`
+void TraceSyscall(int tid, int sysno, const char *name, i32 fd, i64 result,
+                  struct timespec start) {
+  u32 head;
+  u64 nanos;
+  struct SysTrace *t;
+  struct SysTraceRow *row;
+  struct SysTraceRecord *rec;
+  if (!(t = GetSysTrace(tid))) return;
+  t->tid = tid;
+  nanos = ToNanoseconds(SubtractTime(GetMonotonic(), start));
+  if (sysno < kSysTraceRows) {
+    row = t->rows + sysno;
+    IGNORE_RACES_START();
+    row->name = name;
+    row->nanos += nanos;
+    ++row->hist[GetSysTraceBucket(nanos)];
+    IGNORE_RACES_END();
+  }
+  if (g_systraces.fd != -1) {
+    head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&t->tail, memory_order_acquire) ==
+        kSysTraceRing) {
+      LOCK(&g_systraces.lock);
+      FlushSysTrace(t);
+      UNLOCK(&g_systraces.lock);
+    }
+    rec = t->ring + (head & (kSysTraceRing - 1));
+    rec->start = ToNanoseconds(SubtractTime(start, g_systraces.epoch));
+    rec->nanos = MIN(nanos, 0xffffffff);
+    rec->sysno = sysno;
+    rec->pad = 0;
+    rec->tid = tid;
+    rec->fd = fd;
+    rec->result = result;
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+  }
+}
+
+// retires the calling thread, which must happen before it exits
+void UnregisterSysTrace(void) {
+  int i;
+  struct SysTrace *t;
+  if (!(t = g_mysystrace)) return;
+  LOCK(&g_systraces.lock);
+  if (g_systraces.fd != -1) FlushSysTrace(t);
+  for (i = 0; i < kSysTraceRows; ++i) {
+    AddSysTraceRow(g_systraces.gone + i, t->rows + i);
+  }
+  dll_remove(&g_systraces.live, &t->elem);
+  UNLOCK(&g_systraces.lock);
+  g_mysystrace = 0;
+  free(t);
+}
+
+static int FormatSysStatsLocked(char *b, int n, int tid) {
+  u64 calls;
+  struct Dll *e;
+  int i, j, o = 0;
+  struct SysTraceRow row;
+  if (n) b[0] = 0;
+  for (i = 0; i < kSysTraceRows; ++i) {
+    memset(&row, 0, sizeof(row));
+    if (!tid) AddSysTraceRow(&row, g_systraces.gone + i);
+    for (e = dll_first(g_systraces.live); e;
+         e = dll_next(g_systraces.live, e)) {
+      if (!tid || SYSTRACE_CONTAINER(e)->tid == tid) {
+        IGNORE_RACES_START();
+        AddSysTraceRow(&row, SYSTRACE_CONTAINER(e)->rows + i);
+        IGNORE_RACES_END();
+      }
+    }
+    if (!row.name) continue;
+    for (calls = j = 0; j < kSysTraceBins; ++j) {
+      calls += row.hist[j];
+    }
+    if (!calls) continue;
+    APPEND("sys_%-28s = %" PRIu64 " calls, %.6g us avg,", row.name, calls,
+           row.nanos / 1e3 / calls);
+    for (j = 0; j < kSysTraceBins; ++j) {
+      if (!row.hist[j]) continue;
+      if (j < kSysTraceBins - 1) {
+        APPEND(" <%dus:%" PRIu64, 1 << j, row.hist[j]);
+      } else {
+        APPEND(" >=%dus:%" PRIu64, 1 << (j - 1), row.hist[j]);
+      }
+    }
+    APPEND("\n");
+  }
+  return o;
+}
+
+// renders latency histogram of each system call made by thread `tid`
+// or by all threads of the process if `tid` is zero
+int FormatSysStats(char *b, int n, int tid) {
+  int o;
+  LOCK(&g_systraces.lock);
+  o = FormatSysStatsLocked(b, n, tid);
+  UNLOCK(&g_systraces.lock);
+  return o;
+}
+
+// renders latency histograms of all threads from a signal handler, or
+// nothing if it interrupted a thread that's holding the lock
+int FormatSysStatsFromSignal(char *b, int n) {
+  int o;
+  if (n) b[0] = 0;
+  if (pthread_mutex_trylock(&g_systraces.lock)) return 0;
+  o = FormatSysStatsLocked(b, n, 0);
+  UNLOCK(&g_systraces.lock);
+  return o;
+}
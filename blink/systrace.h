@@ -0,0 +1,38 @@
+#ifndef BLINK_SYSTRACE_H_
+#define BLINK_SYSTRACE_H_
+#include <stdbool.h>
+#include <time.h>
+
+#include "blink/types.h"
+
+#define kSysTraceMagic   "blinksys"
+#define kSysTraceVersion 1
+
+// the trace file starts with this header, then has records until eof
+struct SysTraceHeader {
+  char magic[8];  // kSysTraceMagic
+  u32 version;    // kSysTraceVersion
+  u32 size;       // sizeof(struct SysTraceRecord)
+};
+
+// each system call is recorded like this, in host byte order
+struct SysTraceRecord {
+  u64 start;  // nanoseconds since trace began when system call started
+  u32 nanos;  // nanoseconds the system call took, saturated
+  u16 sysno;  // linux system call number
+  u16 pad;
+  i32 tid;     // guest thread id
+  i32 fd;      // first argument if it's a file descriptor, otherwise -1
+  i64 result;  // linux return value, e.g. -2 for ENOENT
+};
+
+extern bool g_systrace;
+
+int OpenSysTrace(const char *);
+void TraceSyscall(int, int, const char *, i32, i64, struct timespec);
+void UnregisterSysTrace(void);
+void FlushSysTraces(void);
+int FormatSysStats(char *, int, int);
+int FormatSysStatsFromSignal(char *, int);
+
+#endif /* BLINK_SYSTRACE_H_ */
@@ -56,6 +56,7 @@
 #define pthread_setcancelstate(x, y)       ((void)(y), 0)
 #define pthread_mutex_init(x, y)           ((void)(y), 0)
 #define pthread_mutex_destroy(x)           0
+#define pthread_mutex_trylock(x)           0
 #define pthread_cond_init(x, y)            ((void)(y), 0)
 #define pthread_cond_wait(x, y)            0
 #define pthread_cond_signal(x)             0
@@ -31,6 +31,7 @@
 #include "blink/log.h"
 #include "blink/machine.h"
 #include "blink/signal.h"
+#include "blink/syscall.h"
 
 void RestoreIp(struct Machine *m) {
   if (m) {
@@ -40,6 +41,9 @@ void RestoreIp(struct Machine *m) {
 }
 
 void DeliverSignalToUser(struct Machine *m, int sig, int code) {
+  if (m->vfork && SplitVfork(m, false)) {
+    return;  // the signal is the child's problem
+  }
   if (m->sigmask & ((u64)1 << (sig - 1))) {
     TerminateSignal(m, sig, code);
   }
@@ -39,7 +39,18 @@
 #define kSemSize      128       // number of bytes used for each semaphore
 #define kBusCount     256       // # load balanced semaphores in virtual bus
 #define kBusRegion    kSemSize  // 16 is sufficient for 8-byte loads/stores
-#define kFutexMax     100
+#define kFutexBuckets 1024      // hashed futex wait queues (two-power)
+#define kBusFutexes   64        // shared futex wakeups if host has no futex
+#define kMinFdTable   64        // initial slots in fd table (two-power)
+#define kMaxDirents   65536     // bytes of host dirents read at once
+#define kDentries     4096      // cached vfs name lookups (two-power)
+#define kDentryWays   4         // slots probed for each cached name
+#define kDentryTtlMs  1000      // trust cached lookups this long; 0 disables
+#define kOverlayMemo  1024      // remembered overlay of each path (two-power)
+#define kSysTraceRing 256       // syscalls buffered by each thread (two-power)
+#define kSysTraceRows 512       // syscall numbers with latency histograms
+#define kSysTraceBins 16        // power-of-two microsecond histogram buckets
+#define kLinkCacheMax 256       // megabytes of link cache kept on disk
 #define kRedzoneSize  128
 #define kSmcQueueSize 32
 #define kMaxMapSize   (UINT64_C(8) * 1024 * 1024 * 1024)
@@ -48,6 +59,8 @@
 #define kMaxAncillary 1000
 #define kMaxShebang   512
 #define kMaxSigDepth  8
+#define kMaxEventFds  64  // polyfilled eventfd(), timerfd(), and signalfd()
+#define kMaxIoWorkers 64  // threads performing i/o for each io_uring
 
 #define kStraceArgMax 256
 #define kStraceBufMax 32
@@ -0,0 +1,203 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include "blink/vdso.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "blink/assert.h"
+#include "blink/elf.h"
+#include "blink/endian.h"
+#include "blink/flag.h"
+#include "blink/log.h"
+#include "blink/machine.h"
+#include "blink/macros.h"
+#include "blink/map.h"
+#include "blink/tunables.h"
+
+/**
+ * @fileoverview Emulated Virtual Dynamic Shared Object.
+ *
+ * Linux maps a tiny shared object into every process, which the C
+ * library uses to read the clock without entering the kernel. Blink
+ * generates an equivalent image at load time. Each function it exports
+ * is an `hvcall` instruction followed by `ret`. The hvcall encoding is
+ * an invalid opcode in ring3, so we only honor it when it's executed
+ * from inside the [vdso] page. That lets us service the call directly
+ * from the instruction handler, bypassing all the bookkeeping OpSyscall
+ * needs to do, e.g. tlb invalidation, page locking, strace, etc.
+ *
+ * The image uses a link base of zero and has no symbol versioning. The
+ * glibc, musl, and cosmopolitan loaders all accept unversioned symbols
+ * when looking up `LINUX_2.6` functions.
+ */
+
+#define kVdsoImageSize 4096
+#define kVdsoStubSize  16
+
+#define VDSO_PHDR_OFF 64
+#define VDSO_HASH_OFF 192
+#define VDSO_SYM_OFF  256
+#define VDSO_STR_OFF  512
+#define VDSO_DYN_OFF  768
+#define VDSO_TEXT_OFF 1024
+
+static const struct VdsoFunction {
+  const char *name;
+  u8 func;
+} kVdsoFunctions[] = {
+    {"__vdso_clock_gettime", kVdsoClockGettime},  //
+    {"__vdso_gettimeofday", kVdsoGettimeofday},   //
+    {"__vdso_time", kVdsoTime},                   //
+    {"__vdso_getcpu", kVdsoGetcpu},               //
+    {"__vdso_clock_getres", kVdsoClockGetres},    //
+};
+
+static const char kVdsoSoname[] = "linux-vdso.so.1";
+
+static void PutDyn(u8 *p, i64 tag, u64 val) {
+  Write64(((Elf64_Dyn_ *)p)->tag, tag);
+  Write64(((Elf64_Dyn_ *)p)->val, val);
+}
+
+static void BuildVdsoImage(u8 image[kVdsoImageSize]) {
+  u8 *p, *dyn;
+  Elf64_Sym_ *sym;
+  Elf64_Ehdr_ *ehdr;
+  Elf64_Phdr_ *phdr;
+  int i, n, strsz, nsyms;
+  memset(image, 0, kVdsoImageSize);
+  n = ARRAYLEN(kVdsoFunctions);
+  nsyms = 1 + n;
+
+  // string table
+  strsz = 1;
+  p = image + VDSO_STR_OFF;
+  memcpy(p + strsz, kVdsoSoname, sizeof(kVdsoSoname));
+  strsz += sizeof(kVdsoSoname);
+  for (i = 0; i < n; ++i) {
+    sym = (Elf64_Sym_ *)(image + VDSO_SYM_OFF) + 1 + i;
+    Write32(sym->name, strsz);
+    sym->info = STB_GLOBAL_ << 4 | STT_FUNC_;
+    Write16(sym->shndx, 1);
+    Write64(sym->value, VDSO_TEXT_OFF + i * kVdsoStubSize);
+    Write64(sym->size, kVdsoStubSize);
+    memcpy(p + strsz, kVdsoFunctions[i].name,
+           strlen(kVdsoFunctions[i].name) + 1);
+    strsz += strlen(kVdsoFunctions[i].name) + 1;
+  }
+  unassert(strsz <= VDSO_DYN_OFF - VDSO_STR_OFF);
+
+  // sysv hash table with a single bucket, which chains every symbol
+  p = image + VDSO_HASH_OFF;
+  Write32(p + 0, 1);      // nbucket
+  Write32(p + 4, nsyms);  // nchain
+  Write32(p + 8, n);      // bucket[0]
+  for (i = 2; i < nsyms; ++i) {
+    Write32(p + 12 + i * 4, i - 1);  // chain[i]
+  }
+  unassert(12 + nsyms * 4 <= VDSO_SYM_OFF - VDSO_HASH_OFF);
+
+  // functions, i.e. `hvcall func ; ret` padded with int3
+  p = image + VDSO_TEXT_OFF;
+  memset(p, 0xcc, n * kVdsoStubSize);
+  for (i = 0; i < n; ++i) {
+    p[i * kVdsoStubSize + 0] = 0x0f;
+    p[i * kVdsoStubSize + 1] = 0xff;
+    p[i * kVdsoStubSize + 2] = 0x7f;
+    p[i * kVdsoStubSize + 3] = kVdsoFunctions[i].func;
+    p[i * kVdsoStubSize + 4] = 0xc3;
+  }
+
+  // dynamic section
+  dyn = image + VDSO_DYN_OFF;
+  PutDyn(dyn, DT_SONAME_, 1), dyn += sizeof(Elf64_Dyn_);
+  PutDyn(dyn, DT_HASH_, VDSO_HASH_OFF), dyn += sizeof(Elf64_Dyn_);
+  PutDyn(dyn, DT_STRTAB_, VDSO_STR_OFF), dyn += sizeof(Elf64_Dyn_);
+  PutDyn(dyn, DT_SYMTAB_, VDSO_SYM_OFF), dyn += sizeof(Elf64_Dyn_);
+  PutDyn(dyn, DT_STRSZ_, strsz), dyn += sizeof(Elf64_Dyn_);
+  PutDyn(dyn, DT_SYMENT_, sizeof(Elf64_Sym_)), dyn += sizeof(Elf64_Dyn_);
+  PutDyn(dyn, DT_NULL_, 0), dyn += sizeof(Elf64_Dyn_);
+
+  // program headers
+  phdr = (Elf64_Phdr_ *)(image + VDSO_PHDR_OFF);
+  Write32(phdr[0].type, PT_LOAD_);
+  Write32(phdr[0].flags, PF_R_ | PF_X_);
+  Write64(phdr[0].filesz, kVdsoImageSize);
+  Write64(phdr[0].memsz, kVdsoImageSize);
+  Write64(phdr[0].align, 4096);
+  Write32(phdr[1].type, PT_DYNAMIC_);
+  Write32(phdr[1].flags, PF_R_);
+  Write64(phdr[1].offset, VDSO_DYN_OFF);
+  Write64(phdr[1].vaddr, VDSO_DYN_OFF);
+  Write64(phdr[1].paddr, VDSO_DYN_OFF);
+  Write64(phdr[1].filesz, dyn - (image + VDSO_DYN_OFF));
+  Write64(phdr[1].memsz, dyn - (image + VDSO_DYN_OFF));
+  Write64(phdr[1].align, 8);
+
+  // elf header
+  ehdr = (Elf64_Ehdr_ *)image;
+  memcpy(ehdr->ident, "\177ELF", 4);
+  ehdr->ident[EI_CLASS_] = ELFCLASS64_;
+  ehdr->ident[EI_DATA_] = ELFDATA2LSB_;
+  ehdr->ident[EI_VERSION_] = EV_CURRENT_;
+  ehdr->ident[EI_OSABI_] = ELFOSABI_LINUX_;
+  Write16(ehdr->type, ET_DYN_);
+  Write16(ehdr->machine, EM_NEXGEN32E_);
+  Write32(ehdr->version, EV_CURRENT_);
+  Write64(ehdr->entry, VDSO_TEXT_OFF);
+  Write64(ehdr->phoff, VDSO_PHDR_OFF);
+  Write16(ehdr->ehsize, sizeof(Elf64_Ehdr_));
+  Write16(ehdr->phentsize, sizeof(Elf64_Phdr_));
+  Write16(ehdr->phnum, 2);
+  Write16(ehdr->shentsize, sizeof(Elf64_Shdr_));
+}
+
+/**
+ * Maps emulated vdso into guest address space.
+ *
+ * @return guest address of elf header, or -1 w/ errno
+ */
+i64 LoadVdso(struct Machine *m) {
+  i64 virt;
+  long pagesize;
+  u8 image[kVdsoImageSize];
+  pagesize = MAX(kVdsoImageSize, FLAG_pagesize);
+  virt = HasLinearMapping() && FLAG_vabits <= 47 && !kSkew ? 0 : kStackTop;
+  if ((virt = ReserveVirtual(m->system, virt, pagesize,
+                             PAGE_FILE | PAGE_U | PAGE_RW | PAGE_XD, -1, 0, 0,
+                             0)) == -1) {
+    return -1;
+  }
+  BuildVdsoImage(image);
+  unassert(!CopyToUser(m, virt, image, sizeof(image)));
+  unassert(!ProtectVirtual(m->system, virt, pagesize, PROT_READ | PROT_EXEC,
+                           false));
+  unassert(AddFileMap(m->system, virt, pagesize, "[vdso]", -1));
+  m->system->elf.at_sysinfo_ehdr = virt;
+  return virt;
+}
+
+/**
+ * Returns true if `hvcall` instruction was executed by our vdso.
+ */
+bool IsVdsoCall(struct Machine *m) {
+  i64 vdso = m->system->elf.at_sysinfo_ehdr;
+  return vdso && (u64)(m->ip - vdso) < kVdsoImageSize;
+}
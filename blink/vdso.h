@@ -0,0 +1,15 @@
+#ifndef BLINK_VDSO_H_
+#define BLINK_VDSO_H_
+#include "blink/machine.h"
+#include "blink/types.h"
+
+#define kVdsoClockGettime 1
+#define kVdsoGettimeofday 2
+#define kVdsoTime         3
+#define kVdsoGetcpu       4
+#define kVdsoClockGetres  5
+
+i64 LoadVdso(struct Machine *);
+bool IsVdsoCall(struct Machine *);
+
+#endif /* BLINK_VDSO_H_ */
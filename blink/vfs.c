@@ -36,6 +36,7 @@
 #include "blink/macros.h"
 #include "blink/procfs.h"
 #include "blink/thread.h"
+#include "blink/timespec.h"
 #include "blink/tunables.h"
 
 #ifndef DISABLE_VFS
@@ -43,10 +44,12 @@
 #define VFS_UNREACHABLE        "(unreachable)"
 #define VFS_TRAVERSE_MAX_LINKS 40
 
-struct VfsFd {
-  struct Dll elem;
-  struct VfsInfo *data;
-  int fd;
+struct VfsDentry {
+  struct VfsInfo *parent;  // owned, so its address can't be reused
+  struct VfsInfo *child;   // owned, or null if the name doesn't exist
+  struct timespec expires;
+  u64 hash;
+  char *name;
 };
 
 struct VfsMap {
@@ -59,7 +62,6 @@ struct VfsMap {
   int flags;
 };
 
-#define VFS_FD_CONTAINER(e)  DLL_CONTAINER(struct VfsFd, elem, (e))
 #define VFS_MAP_CONTAINER(e) DLL_CONTAINER(struct VfsMap, elem, (e))
 
 static struct VfsDevice g_rootdevice = {
@@ -70,6 +72,8 @@ static struct VfsDevice g_rootdevice = {
     .refcount = 1u,
 };
 
+static struct VfsDentry g_dentries[kDentries];
+
 static struct VfsInfo g_initialrootinfo = {
     .device = &g_rootdevice,
     .parent = NULL,
@@ -88,9 +92,11 @@ struct Vfs g_vfs = {
     .devices = NULL,
     .systems = NULL,
     .fds = NULL,
+    .nfds = 0,
     .maps = NULL,
     .lock = PTHREAD_MUTEX_INITIALIZER_,
     .mapslock = PTHREAD_MUTEX_INITIALIZER_,
+    .dentrylock = PTHREAD_MUTEX_INITIALIZER_,
 };
 
 int VfsInit(const char *prefix) {
@@ -308,6 +314,7 @@ int VfsMount(const char *source, const char *target, const char *fstype,
     dll_splice_after(dll_prev(g_vfs.devices, e), &newdevice->elem);
   }
   newdevice->flags = flags;
+  newdevice->dcache = newsystem->dcache;
   newmount->baseino = targetinfo->ino;
   newmount->root->dev = nextdev;
   newmount->root->name = newname;
@@ -317,6 +324,8 @@ int VfsMount(const char *source, const char *target, const char *fstype,
   dll_make_last(&targetdevice->mounts, &newmount->elem);
   UNLOCK(&g_vfs.lock);
   unassert(!VfsFreeInfo(targetinfo));
+  // Lookups cached beneath the mount point would hide the new device.
+  VfsFlushDentries();
   VFS_LOGF("Mounted a new device at %s, dev=%ld", target, nextdev);
   return 0;
 }
@@ -462,6 +471,183 @@ int VfsFreeInfo(struct VfsInfo *info) {
 
 ////////////////////////////////////////////////////////////////////////////////
 
+// The dentry cache remembers the outcome of looking up a name within a
+// directory, including failed lookups, so that resolving a path doesn't
+// need to ask the host about each of its components every time. Entries
+// are matched by the identity of the parent VfsInfo, but are hashed by
+// the inode of the parent, so that changing a name through any alias of
+// a directory evicts everything that was learned about it. Changes made
+// by other processes are noticed once the entries expire.
+
+static u64 VfsDentryHash(struct VfsInfo *parent, const char *name) {
+  u64 hash;
+  hash = parent->ino * 0x9e3779b97f4a7c15 ^ parent->dev;
+  while (*name) {
+    hash = (hash ^ (u8)*name++) * 0x100000001b3;
+  }
+  return hash;
+}
+
+static bool VfsDentryCacheable(struct VfsInfo *parent, const char *name) {
+  return kDentryTtlMs && parent->device->dcache && *name &&
+         strcmp(name, ".") && strcmp(name, "..");
+}
+
+static void VfsDentryDrop(struct VfsDentry *d) {
+  unassert(!VfsFreeInfo(d->parent));
+  unassert(!VfsFreeInfo(d->child));
+  free(d->name);
+  memset(d, 0, sizeof(*d));
+}
+
+// Looks up `name` in `parent` using the result of an earlier lookup.
+// Returns 1 with a new reference to the child, 0 if nothing is known,
+// or -1 with ENOENT if the name is known not to exist.
+static int VfsDentryLookup(struct VfsInfo *parent, const char *name,
+                           struct VfsInfo **child) {
+  int i, rc;
+  u64 hash;
+  struct timespec now;
+  struct VfsDentry *d;
+  if (!VfsDentryCacheable(parent, name)) {
+    return 0;
+  }
+  rc = 0;
+  now = GetMonotonic();
+  hash = VfsDentryHash(parent, name);
+  LOCK(&g_vfs.dentrylock);
+  for (i = 0; i < kDentryWays; ++i) {
+    d = g_dentries + ((hash + i) & (kDentries - 1));
+    if (d->parent == parent && d->hash == hash && !strcmp(d->name, name)) {
+      if (CompareTime(now, d->expires) >= 0) {
+        VfsDentryDrop(d);
+      } else if (d->child) {
+        unassert(!VfsAcquireInfo(d->child, child));
+        rc = 1;
+      } else {
+        rc = enoent();
+      }
+      break;
+    }
+  }
+  UNLOCK(&g_vfs.dentrylock);
+  return rc;
+}
+
+// Remembers that `name` in `parent` is `child`, or doesn't exist if
+// `child` is null.
+static void VfsDentryInsert(struct VfsInfo *parent, const char *name,
+                            struct VfsInfo *child) {
+  int i;
+  u64 hash;
+  char *copy;
+  struct VfsDentry *d, *victim;
+  if (!VfsDentryCacheable(parent, name) ||
+      (child && (child->parent != parent || child->dev != parent->dev))) {
+    return;
+  }
+  if (!(copy = strdup(name))) {
+    return;
+  }
+  victim = 0;
+  hash = VfsDentryHash(parent, name);
+  LOCK(&g_vfs.dentrylock);
+  for (i = 0; i < kDentryWays; ++i) {
+    d = g_dentries + ((hash + i) & (kDentries - 1));
+    if (d->parent == parent && d->hash == hash && !strcmp(d->name, name)) {
+      victim = d;
+      break;
+    }
+    // otherwise prefer an empty slot, then the one expiring soonest
+    if (!victim || (victim->parent &&
+                    (!d->parent ||
+                     CompareTime(d->expires, victim->expires) < 0))) {
+      victim = d;
+    }
+  }
+  if (victim->parent) {
+    VfsDentryDrop(victim);
+  }
+  unassert(!VfsAcquireInfo(parent, &victim->parent));
+  unassert(!VfsAcquireInfo(child, &victim->child));
+  victim->expires = AddTime(GetMonotonic(), FromMilliseconds(kDentryTtlMs));
+  victim->hash = hash;
+  victim->name = copy;
+  UNLOCK(&g_vfs.dentrylock);
+}
+
+// Remembers every directory entry leading from `stop` down to `child`.
+static void VfsDentryInsertChain(struct VfsInfo *child, struct VfsInfo *stop) {
+  for (; child != stop && child->parent && child->name; child = child->parent) {
+    VfsDentryInsert(child->parent, child->name, child);
+  }
+}
+
+// Forgets what's known about `name` in `parent` and all its aliases.
+static void VfsDentryForget(struct VfsInfo *parent, const char *name) {
+  int i;
+  u64 hash;
+  struct VfsDentry *d;
+  if (!VfsDentryCacheable(parent, name)) {
+    return;
+  }
+  hash = VfsDentryHash(parent, name);
+  LOCK(&g_vfs.dentrylock);
+  for (i = 0; i < kDentryWays; ++i) {
+    d = g_dentries + ((hash + i) & (kDentries - 1));
+    if (d->parent && d->hash == hash && d->parent->ino == parent->ino &&
+        d->parent->dev == parent->dev && !strcmp(d->name, name)) {
+      VfsDentryDrop(d);
+    }
+  }
+  UNLOCK(&g_vfs.dentrylock);
+}
+
+void VfsFlushDentries(void) {
+  int i;
+  LOCK(&g_vfs.dentrylock);
+  for (i = 0; i < kDentries; ++i) {
+    if (g_dentries[i].parent) {
+      VfsDentryDrop(g_dentries + i);
+    }
+  }
+  UNLOCK(&g_vfs.dentrylock);
+}
+
+// Returns true with ENOENT if `name` in `parent` is known not to exist.
+static bool VfsDentryAbsent(struct VfsInfo *parent, const char *name) {
+  struct VfsInfo *child;
+  switch (VfsDentryLookup(parent, name, &child)) {
+    case 1:
+      unassert(!VfsFreeInfo(child));
+      return false;
+    case -1:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Finds `name` in `dir`, consulting the dentry cache first.
+static int VfsFinddir(struct VfsInfo *dir, const char *name,
+                      struct VfsInfo **output) {
+  int rc;
+  if ((rc = VfsDentryLookup(dir, name, output))) {
+    return rc == 1 ? 0 : -1;
+  }
+  if (!dir->device->ops->Finddir) {
+    return eperm();
+  }
+  if (dir->device->ops->Finddir(dir, name, output) == -1) {
+    if (errno == ENOENT) {
+      VfsDentryInsert(dir, name, NULL);
+    }
+    return -1;
+  }
+  VfsDentryInsert(dir, name, *output);
+  return 0;
+}
+
 static int VfsTraverseMount(struct VfsInfo **info,
                             char childname[VFS_NAME_MAX]) {
   struct VfsMount *mount;
@@ -504,10 +690,36 @@ static int VfsTraverseMount(struct VfsInfo **info,
   return 0;
 }
 
+// Resolves the first component of `*path` using the dentry cache. If it
+// isn't known then `name` is set to it, or to "" if it can't be cached.
+static int VfsTraverseCached(struct VfsInfo **stack, const char **path,
+                             char name[VFS_NAME_MAX]) {
+  int rc;
+  const char *p, *end;
+  struct VfsInfo *next;
+  name[0] = '\0';
+  for (p = *path; *p == '/'; ++p) {
+  }
+  for (end = p; *end && *end != '/'; ++end) {
+  }
+  if (end == p || end - p >= VFS_NAME_MAX) {
+    return 0;
+  }
+  memcpy(name, p, end - p);
+  name[end - p] = '\0';
+  if ((rc = VfsDentryLookup(*stack, name, &next)) == 1) {
+    unassert(!VfsFreeInfo(*stack));
+    *stack = next;
+    *path = end;
+  }
+  return rc;
+}
+
 static int VfsTraverseStackBuild(struct VfsInfo **stack, const char *path,
                                  struct VfsInfo *root, bool follow, int level) {
-  struct VfsInfo *next, *origin;
+  struct VfsInfo *next, *origin, *prev;
   const char *end;
+  int hit;
   char filename[VFS_NAME_MAX];
   char *link;
   VFS_LOGF("VfsTraverseStackBuild(%p, \"%s\", %p, %d)", stack, path, root,
@@ -531,10 +743,19 @@ static int VfsTraverseStackBuild(struct VfsInfo **stack, const char *path,
       goto cleananddie;
     }
     unassert(!VfsTraverseMount(stack, NULL));
-    if ((*stack)->device->ops && (*stack)->device->ops->Traverse) {
+    if ((hit = VfsTraverseCached(stack, &path, filename)) == -1) {
+      goto cleananddie;
+    } else if (hit) {
+      // resolved the next component using the dentry cache
+    } else if ((*stack)->device->ops && (*stack)->device->ops->Traverse) {
+      prev = *stack;
       if ((*stack)->device->ops->Traverse(stack, &path, root) == -1) {
+        if (errno == ENOENT && *filename) {
+          VfsDentryInsert(prev, filename, NULL);
+        }
         goto cleananddie;
       }
+      VfsDentryInsertChain(*stack, prev);
     } else {
       while (*path == '/') {
         ++path;
@@ -564,7 +785,7 @@ static int VfsTraverseStackBuild(struct VfsInfo **stack, const char *path,
         }
         continue;
       }
-      if ((*stack)->device->ops->Finddir(*stack, filename, &next) == -1) {
+      if (VfsFinddir(*stack, filename, &next) == -1) {
         goto cleananddie;
       }
       unassert(!VfsFreeInfo(*stack));
@@ -717,38 +938,35 @@ ssize_t VfsPathBuild(struct VfsInfo *info, struct VfsInfo *root, bool absolute,
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int VfsAddFdAtOrAfter(struct VfsInfo *data, int minfd) {
-  struct VfsFd *vfsfd;
-  struct Dll *e;
-  vfsfd = (struct VfsFd *)malloc(sizeof(*vfsfd));
-  if (vfsfd == NULL) {
+// grows fd table so it has a slot for `fd`, with vfs locked
+static int VfsReserveFd(int fd) {
+  int n;
+  struct VfsInfo **p;
+  if (fd < g_vfs.nfds) return 0;
+  n = g_vfs.nfds ? g_vfs.nfds : kMinFdTable;
+  while (n <= fd) n *= 2;
+  if (!(p = (struct VfsInfo **)realloc(g_vfs.fds, n * sizeof(*p)))) {
     return -1;
   }
-  vfsfd->data = data;
+  memset(p + g_vfs.nfds, 0, (n - g_vfs.nfds) * sizeof(*p));
+  g_vfs.fds = p;
+  g_vfs.nfds = n;
+  return 0;
+}
+
+int VfsAddFdAtOrAfter(struct VfsInfo *data, int minfd) {
+  int fd;
+  if (minfd < 0) return einval();
   LOCK(&g_vfs.lock);
-  for (e = dll_first(g_vfs.fds); e; e = dll_next(g_vfs.fds, e)) {
-    if (VFS_FD_CONTAINER(e)->fd < minfd) {
-      continue;
-    } else if (VFS_FD_CONTAINER(e)->fd == minfd) {
-      ++minfd;
-    } else {
-      break;
-    }
+  for (fd = minfd; fd < g_vfs.nfds && g_vfs.fds[fd]; ++fd) {
   }
-  vfsfd->fd = minfd;
-  dll_init(&vfsfd->elem);
-  if (e == NULL) {
-    dll_make_last(&g_vfs.fds, &vfsfd->elem);
-  } else {
-    e = dll_prev(g_vfs.fds, e);
-    if (e == NULL) {
-      dll_make_first(&g_vfs.fds, &vfsfd->elem);
-    } else {
-      dll_splice_after(e, &vfsfd->elem);
-    }
+  if (VfsReserveFd(fd) == -1) {
+    UNLOCK(&g_vfs.lock);
+    return -1;
   }
+  g_vfs.fds[fd] = data;
   UNLOCK(&g_vfs.lock);
-  return vfsfd->fd;
+  return fd;
 }
 
 int VfsAddFd(struct VfsInfo *data) {
@@ -760,68 +978,56 @@ int VfsAddFd(struct VfsInfo *data) {
  * it.
  */
 int VfsFreeFd(int fd, struct VfsInfo **data) {
-  struct Dll *e;
-  struct VfsFd *vfsfd;
   LOCK(&g_vfs.lock);
-  for (e = dll_first(g_vfs.fds); e;) {
-    vfsfd = VFS_FD_CONTAINER(e);
-    if (VFS_FD_CONTAINER(e)->fd == fd) {
-      *data = vfsfd->data;
-      dll_remove(&g_vfs.fds, &vfsfd->elem);
-      free(vfsfd);
-      VFS_LOGF("VfsFreeFd(%d)", fd);
-      UNLOCK(&g_vfs.lock);
-      return 0;
-    }
-    e = dll_next(g_vfs.fds, e);
+  if (0 <= fd && fd < g_vfs.nfds && g_vfs.fds[fd]) {
+    *data = g_vfs.fds[fd];
+    g_vfs.fds[fd] = NULL;
+    VFS_LOGF("VfsFreeFd(%d)", fd);
+    UNLOCK(&g_vfs.lock);
+    return 0;
   }
   UNLOCK(&g_vfs.lock);
   return ebadf();
 }
 
 int VfsGetFd(int fd, struct VfsInfo **output) {
-  struct Dll *e;
   LOCK(&g_vfs.lock);
-  for (e = dll_first(g_vfs.fds); e; e = dll_next(g_vfs.fds, e)) {
-    if (VFS_FD_CONTAINER(e)->fd == fd) {
-      UNLOCK(&g_vfs.lock);
-      unassert(!VfsAcquireInfo(VFS_FD_CONTAINER(e)->data, output));
-      return 0;
-    }
+  if (0 <= fd && fd < g_vfs.nfds && g_vfs.fds[fd]) {
+    unassert(!VfsAcquireInfo(g_vfs.fds[fd], output));
+    UNLOCK(&g_vfs.lock);
+    return 0;
   }
   UNLOCK(&g_vfs.lock);
   return ebadf();
 }
 
+// returns host fd backing `fd`, or raises EXDEV if it isn't a host file
+int VfsGetHostFd(int fd) {
+  int ret;
+  struct VfsInfo *info;
+  if (VfsGetFd(fd, &info) == -1) {
+    return -1;
+  }
+  if (info->device->ops == &g_hostfs.ops && info->data) {
+    ret = ((struct HostfsInfo *)info->data)->filefd;
+  } else {
+    ret = exdev();
+  }
+  unassert(!VfsFreeInfo(info));
+  return ret;
+}
+
 int VfsSetFd(int fd, struct VfsInfo *data) {
-  struct Dll *e;
-  struct VfsFd *vfsfd;
+  if (fd < 0) return ebadf();
   LOCK(&g_vfs.lock);
-  for (e = dll_first(g_vfs.fds); e; e = dll_next(g_vfs.fds, e)) {
-    if (VFS_FD_CONTAINER(e)->fd == fd) {
-      unassert(!VfsFreeInfo(VFS_FD_CONTAINER(e)->data));
-      VFS_FD_CONTAINER(e)->data = data;
-      UNLOCK(&g_vfs.lock);
-      return 0;
-    } else if (VFS_FD_CONTAINER(e)->fd > fd) {
-      break;
-    }
-  }
-  vfsfd = (struct VfsFd *)malloc(sizeof(*vfsfd));
-  if (vfsfd == NULL) {
+  if (VfsReserveFd(fd) == -1) {
     UNLOCK(&g_vfs.lock);
     return enomem();
   }
-  vfsfd->data = data;
-  vfsfd->fd = fd;
-  dll_init(&vfsfd->elem);
-  if (e == NULL) {
-    dll_make_last(&g_vfs.fds, &vfsfd->elem);
-  } else if ((e = dll_prev(g_vfs.fds, e))) {
-    dll_splice_after(e, &vfsfd->elem);
-  } else {
-    dll_make_first(&g_vfs.fds, &vfsfd->elem);
+  if (g_vfs.fds[fd]) {
+    unassert(!VfsFreeInfo(g_vfs.fds[fd]));
   }
+  g_vfs.fds[fd] = data;
   UNLOCK(&g_vfs.lock);
   return 0;
 }
@@ -984,7 +1190,7 @@ static int VfsHandleDirfdSymlink(struct VfsInfo **dir,
     if (!(*dir)->device->ops->Finddir || !(*dir)->device->ops->Readlink) {
       return eperm();
     }
-    if ((*dir)->device->ops->Finddir(*dir, name, &tmp) == -1) {
+    if (VfsFinddir(*dir, name, &tmp) == -1) {
       if (errno != ENOENT) {
         return -1;
       } else {
@@ -1052,6 +1258,7 @@ int VfsUnlink(int dirfd, const char *name, int flags) {
   unassert(!VfsTraverseMount(&dir, newname));
   if (dir->device->ops->Unlink) {
     ret = dir->device->ops->Unlink(dir, newname, flags);
+    VfsDentryForget(dir, newname);
   } else {
     ret = eperm();
   }
@@ -1076,6 +1283,7 @@ int VfsMkdir(int dirfd, const char *name, mode_t mode) {
   unassert(!VfsTraverseMount(&dir, newname));
   if (dir->device->ops->Mkdir) {
     ret = dir->device->ops->Mkdir(dir, newname, mode);
+    VfsDentryForget(dir, newname);
   } else {
     ret = eperm();
   }
@@ -1100,6 +1308,7 @@ int VfsMkfifo(int dirfd, const char *name, mode_t mode) {
   unassert(!VfsTraverseMount(&dir, newname));
   if (dir->device->ops->Mkfifo) {
     ret = dir->device->ops->Mkfifo(dir, newname, mode);
+    VfsDentryForget(dir, newname);
   } else {
     ret = eperm();
   }
@@ -1126,12 +1335,17 @@ int VfsOpen(int dirfd, const char *name, int flags, int mode) {
   }
   unassert(!VfsTraverseMount(&dir, newname));
   if (ret != -1) {
-    if (dir->device->ops->Open) {
+    if (!(flags & O_CREAT) && VfsDentryAbsent(dir, newname)) {
+      ret = -1;
+    } else if (dir->device->ops->Open) {
       if (dir->device->ops->Open(dir, newname, flags, mode, &out) == -1) {
         ret = -1;
       } else {
         ret = VfsAddFd(out);
       }
+      if (flags & O_CREAT) {
+        VfsDentryForget(dir, newname);
+      }
     } else {
       ret = eperm();
     }
@@ -1204,7 +1418,9 @@ int VfsAccess(int dirfd, const char *name, mode_t mode, int flags) {
   }
   unassert(!VfsTraverseMount(&dir, newname));
   if (ret != -1) {
-    if (dir->device->ops->Access) {
+    if (VfsDentryAbsent(dir, newname)) {
+      ret = -1;
+    } else if (dir->device->ops->Access) {
       ret = dir->device->ops->Access(dir, newname, mode, flags);
     } else {
       ret = eperm();
@@ -1231,6 +1447,7 @@ int VfsSymlink(const char *target, int dirfd, const char *name) {
   unassert(!VfsTraverseMount(&dir, newname));
   if (dir->device->ops->Symlink) {
     ret = dir->device->ops->Symlink(target, dir, newname);
+    VfsDentryForget(dir, newname);
   } else {
     ret = eperm();
   }
@@ -1254,7 +1471,9 @@ int VfsStat(int dirfd, const char *name, struct stat *st, int flags) {
   }
   unassert(!VfsTraverseMount(&dir, newname));
   if (ret != -1) {
-    if (dir->device->ops->Stat) {
+    if (VfsDentryAbsent(dir, newname)) {
+      ret = -1;
+    } else if (dir->device->ops->Stat) {
       ret = dir->device->ops->Stat(dir, newname, st, flags);
     } else {
       ret = eperm();
@@ -1308,8 +1527,9 @@ int VfsFchown(int fd, uid_t uid, gid_t gid) {
 
 int VfsRename(int olddirfd, const char *oldname, int newdirfd,
               const char *newname) {
-  struct VfsInfo *olddir, *newdir;
+  struct VfsInfo *olddir, *newdir, *file;
   char newoldname[VFS_NAME_MAX], newnewname[VFS_NAME_MAX];
+  bool isdir;
   int ret;
   VFS_LOGF("VfsRename(%d, \"%s\", %d, \"%s\")", olddirfd, oldname, newdirfd,
            newname);
@@ -1329,7 +1549,20 @@ int VfsRename(int olddirfd, const char *oldname, int newdirfd,
   unassert(!VfsTraverseMount(&olddir, newoldname));
   unassert(!VfsTraverseMount(&newdir, newnewname));
   if (olddir->device->ops->Rename) {
+    if (VfsFinddir(olddir, newoldname, &file) != -1) {
+      isdir = S_ISDIR(file->mode);
+      unassert(!VfsFreeInfo(file));
+    } else {
+      isdir = false;
+    }
     ret = olddir->device->ops->Rename(olddir, newoldname, newdir, newnewname);
+    if (isdir) {
+      // Names cached beneath a directory are tied to where it used to be.
+      VfsFlushDentries();
+    } else {
+      VfsDentryForget(olddir, newoldname);
+      VfsDentryForget(newdir, newnewname);
+    }
   } else {
     ret = eperm();
   }
@@ -1357,7 +1590,7 @@ ssize_t VfsReadlink(int dirfd, const char *name, char *buf, size_t bufsiz) {
       return -1;
     }
     if (!dir->device->ops->Finddir ||
-        dir->device->ops->Finddir(dir, newname, &file) == -1) {
+        VfsFinddir(dir, newname, &file) == -1) {
       unassert(!VfsFreeInfo(dir));
       return -1;
     }
@@ -1411,6 +1644,7 @@ int VfsLink(int olddirfd, const char *oldname, int newdirfd,
   } else if (olddir->device->ops->Link) {
     ret = olddir->device->ops->Link(olddir, newoldname, newdir, newnewname,
                                     flags);
+    VfsDentryForget(newdir, newnewname);
   } else {
     ret = eperm();
   }
@@ -1952,22 +2186,17 @@ void VfsRewinddir(DIR *dir) {
 
 int VfsClosedir(DIR *dir) {
   struct VfsInfo *info;
-  struct Dll *e;
-  struct VfsFd *vfsfd;
-  int ret;
+  int fd, ret;
   VFS_LOGF("VfsClosedir(%p)", dir);
   info = (struct VfsInfo *)dir;
   if (info->device->ops->Closedir) {
     ret = info->device->ops->Closedir(info);
     if (ret != -1) {
       LOCK(&g_vfs.lock);
-      for (e = dll_first(g_vfs.fds); e;) {
-        vfsfd = VFS_FD_CONTAINER(e);
-        e = dll_next(g_vfs.fds, e);
-        if (vfsfd->data == info) {
-          unassert(!VfsFreeInfo(vfsfd->data));
-          dll_remove(&g_vfs.fds, &vfsfd->elem);
-          free(vfsfd);
+      for (fd = 0; fd < g_vfs.nfds; ++fd) {
+        if (g_vfs.fds[fd] == info) {
+          unassert(!VfsFreeInfo(info));
+          g_vfs.fds[fd] = NULL;
           break;
         }
       }
@@ -2018,6 +2247,7 @@ int VfsBind(int fd, const struct sockaddr *addr, socklen_t addrlen) {
         } else {
           unassert(!VfsFreeInfo(oldparent));
           unassert(!VfsFreeDevice(olddevice));
+          VfsDentryForget(dir, newname);
         }
       }
       unassert(!VfsFreeInfo(dir));
@@ -35,10 +35,12 @@ struct VfsMap;
 struct Vfs {
   struct Dll *devices GUARDED_BY(lock);
   struct Dll *systems GUARDED_BY(lock);
-  struct Dll *fds GUARDED_BY(lock);
+  struct VfsInfo **fds GUARDED_BY(lock);  // indexed by fd number
+  int nfds GUARDED_BY(lock);               // number of slots in fds
   struct Dll *maps GUARDED_BY(mapslock);
   pthread_mutex_t_ lock;
   pthread_mutex_t_ mapslock;
+  pthread_mutex_t_ dentrylock;  // guards the cache of name lookups
 };
 
 struct VfsOps {
@@ -146,6 +148,7 @@ struct VfsSystem {
   struct VfsOps ops;
   char name[VFS_SYSTEM_NAME_MAX];
   bool nodev;
+  bool dcache;  // name lookups may be cached
 };
 
 struct VfsMount {
@@ -163,6 +166,7 @@ struct VfsDevice {
   struct Dll elem;
   u64 flags;
   u32 dev;
+  bool dcache;
   _Atomic(u32) refcount;
 };
 
@@ -279,6 +283,7 @@ int VfsMsync(void *, size_t, int);
 int VfsInit(const char *);
 int VfsRegister(struct VfsSystem *);
 int VfsTraverse(const char *, struct VfsInfo **, bool);
+void VfsFlushDentries(void);
 int VfsCreateInfo(struct VfsInfo **);
 int VfsAcquireInfo(struct VfsInfo *, struct VfsInfo **);
 int VfsCreateDevice(struct VfsDevice **output);
@@ -288,6 +293,7 @@ int VfsFreeInfo(struct VfsInfo *);
 int VfsAddFd(struct VfsInfo *);
 int VfsFreeFd(int, struct VfsInfo **);
 int VfsSetFd(int, struct VfsInfo *);
+int VfsGetHostFd(int);
 ssize_t VfsPathBuildFull(struct VfsInfo *, struct VfsInfo *, char **);
 ssize_t VfsPathBuild(struct VfsInfo *, struct VfsInfo *, bool,
                      char[VFS_PATH_MAX]);
@@ -295,6 +301,7 @@ ssize_t VfsPathBuild(struct VfsInfo *, struct VfsInfo *, bool,
 #define VfsChown       OverlaysChown
 #define VfsAccess      OverlaysAccess
 #define VfsStat        OverlaysStat
+#define VfsStatx       OverlaysStatx
 #define VfsChdir       OverlaysChdir
 #define VfsGetcwd      OverlaysGetcwd
 #define VfsMkdir       OverlaysMkdir
@@ -369,10 +376,13 @@ ssize_t VfsPathBuild(struct VfsInfo *, struct VfsInfo *, bool,
 #define VfsMunmap      munmap
 #define VfsMprotect    mprotect
 #define VfsMsync       msync
+#define VfsGetHostFd(fd) (fd)
+#define VfsFlushDentries OverlaysFlushLookups
 #else
 #define VfsChown       fchownat
 #define VfsAccess      faccessat
 #define VfsStat        fstatat
+#define VfsStatx       statx
 #define VfsChdir       chdir
 #define VfsGetcwd      getcwd
 #define VfsMkdir       mkdirat
@@ -447,6 +457,8 @@ ssize_t VfsPathBuild(struct VfsInfo *, struct VfsInfo *, bool,
 #define VfsMunmap      munmap
 #define VfsMprotect    mprotect
 #define VfsMsync       msync
+#define VfsGetHostFd(fd) (fd)
+#define VfsFlushDentries() (void)0
 #endif
 
 #endif /* BLINK_VFS_H_ */
@@ -1166,6 +1166,71 @@ void XlatStatToLinux(struct stat_linux *dst, const struct stat *src) {
   Write64(dst->ctim.nsec, src->st_ctim.tv_nsec);
 }
 
+// splits device number the way linux's makedev() would combine it
+static u32 GetLinuxMajor(u64 dev) {
+  return ((dev >> 8) & 0xfff) | ((dev >> 32) & ~0xfff);
+}
+
+static u32 GetLinuxMinor(u64 dev) {
+  return (dev & 0xff) | ((dev >> 12) & ~0xff);
+}
+
+static void XlatStatxTimestamp(struct statx_timestamp_linux *dst, i64 sec,
+                               u32 nsec) {
+  Write64(dst->sec, sec);
+  Write32(dst->nsec, nsec);
+  Write32(dst->pad_, 0);
+}
+
+void XlatStatToStatxLinux(struct statx_linux *dst, const struct stat *src) {
+  memset(dst, 0, sizeof(*dst));
+  Write32(dst->mask, STATX_BASIC_STATS_LINUX);
+  Write32(dst->blksize, src->st_blksize);
+  Write32(dst->nlink, src->st_nlink);
+  Write32(dst->uid, src->st_uid);
+  Write32(dst->gid, src->st_gid);
+  Write16(dst->mode, src->st_mode);
+  Write64(dst->ino, src->st_ino);
+  Write64(dst->size, src->st_size);
+  Write64(dst->blocks, src->st_blocks);
+  XlatStatxTimestamp(&dst->atime, src->st_atim.tv_sec, src->st_atim.tv_nsec);
+  XlatStatxTimestamp(&dst->mtime, src->st_mtim.tv_sec, src->st_mtim.tv_nsec);
+  XlatStatxTimestamp(&dst->ctime, src->st_ctim.tv_sec, src->st_ctim.tv_nsec);
+  Write32(dst->rdev_major, GetLinuxMajor(src->st_rdev));
+  Write32(dst->rdev_minor, GetLinuxMinor(src->st_rdev));
+  Write32(dst->dev_major, GetLinuxMajor(src->st_dev));
+  Write32(dst->dev_minor, GetLinuxMinor(src->st_dev));
+}
+
+#ifdef HAVE_STATX
+void XlatStatxToLinux(struct statx_linux *dst, const struct statx *src) {
+  memset(dst, 0, sizeof(*dst));
+  Write32(dst->mask, src->stx_mask);
+  Write32(dst->blksize, src->stx_blksize);
+  Write64(dst->attributes, src->stx_attributes);
+  Write32(dst->nlink, src->stx_nlink);
+  Write32(dst->uid, src->stx_uid);
+  Write32(dst->gid, src->stx_gid);
+  Write16(dst->mode, src->stx_mode);
+  Write64(dst->ino, src->stx_ino);
+  Write64(dst->size, src->stx_size);
+  Write64(dst->blocks, src->stx_blocks);
+  Write64(dst->attributes_mask, src->stx_attributes_mask);
+  XlatStatxTimestamp(&dst->atime, src->stx_atime.tv_sec,
+                     src->stx_atime.tv_nsec);
+  XlatStatxTimestamp(&dst->btime, src->stx_btime.tv_sec,
+                     src->stx_btime.tv_nsec);
+  XlatStatxTimestamp(&dst->ctime, src->stx_ctime.tv_sec,
+                     src->stx_ctime.tv_nsec);
+  XlatStatxTimestamp(&dst->mtime, src->stx_mtime.tv_sec,
+                     src->stx_mtime.tv_nsec);
+  Write32(dst->rdev_major, src->stx_rdev_major);
+  Write32(dst->rdev_minor, src->stx_rdev_minor);
+  Write32(dst->dev_major, src->stx_dev_major);
+  Write32(dst->dev_minor, src->stx_dev_minor);
+}
+#endif
+
 void XlatRusageToLinux(struct rusage_linux *dst, const struct rusage *src) {
   Write64(dst->utime.sec, src->ru_utime.tv_sec);
   Write64(dst->utime.usec, src->ru_utime.tv_usec);
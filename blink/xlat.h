@@ -12,6 +12,8 @@
 
 #include "blink/linux.h"
 
+struct statx;
+
 int UnXlatSiCode(int, int);
 int UnXlatOpenFlags(int);
 int UnXlatAccMode(int);
@@ -39,6 +41,8 @@ int XlatSockaddrToHost(struct sockaddr_storage *, const struct sockaddr_linux *,
 int XlatSockaddrToLinux(struct sockaddr_storage_linux *,
                         const struct sockaddr *, socklen_t);
 void XlatStatToLinux(struct stat_linux *, const struct stat *);
+void XlatStatToStatxLinux(struct statx_linux *, const struct stat *);
+void XlatStatxToLinux(struct statx_linux *, const struct statx *);
 void XlatRusageToLinux(struct rusage_linux *, const struct rusage *);
 void XlatItimervalToLinux(struct itimerval_linux *, const struct itimerval *);
 void XlatLinuxToItimerval(struct itimerval *, const struct itimerval_linux *);
@@ -0,0 +1,118 @@
+// test locked bit ops and double-width compare-and-swap stay atomic
+// when many threads race on the same memory
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define THREADS    4
+#define ITERATIONS 10000
+
+_Alignas(16) unsigned long pair[2];
+_Alignas(8) unsigned quad[2];
+_Alignas(8) unsigned long bits;
+_Alignas(8) char buf[16];
+unsigned long flips[THREADS];
+
+bool Cmpxchg16b(unsigned long *p, unsigned long *a, unsigned long *d,
+                unsigned long b, unsigned long c) {
+  bool ok;
+  asm volatile("lock cmpxchg16b\t%1\n\t"
+               "sete\t%0"
+               : "=q"(ok), "+m"(*(char(*)[16])p), "+a"(*a), "+d"(*d)
+               : "b"(b), "c"(c)
+               : "memory", "cc");
+  return ok;
+}
+
+bool Cmpxchg8b(unsigned *p, unsigned *a, unsigned *d, unsigned b,
+               unsigned c) {
+  bool ok;
+  asm volatile("lock cmpxchg8b\t%1\n\t"
+               "sete\t%0"
+               : "=q"(ok), "+m"(*(char(*)[8])p), "+a"(*a), "+d"(*d)
+               : "b"(b), "c"(c)
+               : "memory", "cc");
+  return ok;
+}
+
+bool Bts(unsigned long *p, long bit) {
+  bool cf;
+  asm volatile("lock btsq\t%2,%1\n\t"
+               "setc\t%0"
+               : "=q"(cf), "+m"(*p)
+               : "r"(bit)
+               : "memory", "cc");
+  return cf;
+}
+
+bool Btr(unsigned long *p, long bit) {
+  bool cf;
+  asm volatile("lock btrq\t%2,%1\n\t"
+               "setc\t%0"
+               : "=q"(cf), "+m"(*p)
+               : "r"(bit)
+               : "memory", "cc");
+  return cf;
+}
+
+void Btc(unsigned long *p, long bit) {
+  asm volatile("lock btcq\t%1,%0" : "+m"(*p) : "r"(bit) : "memory", "cc");
+}
+
+void Xadd(void *p, unsigned x) {
+  asm volatile("lock xaddl\t%1,%0"
+               : "+m"(*(unsigned *)p), "+r"(x)
+               :
+               : "memory", "cc");
+}
+
+void *Worker(void *arg) {
+  int i;
+  long id = (long)arg;
+  unsigned a, d;
+  unsigned long x, y;
+  for (i = 0; i < ITERATIONS; ++i) {
+    // both halves of the pair must always change together
+    x = pair[0];
+    y = pair[1];
+    while (!Cmpxchg16b(pair, &x, &y, x + 1, y + 2)) {
+    }
+    a = quad[0];
+    d = quad[1];
+    while (!Cmpxchg8b(quad, &a, &d, a + 1, d + 3)) {
+    }
+    // each thread owns one bit of a word shared by every thread
+    if (Bts(&bits, id)) return (void *)1;
+    if (!Btr(&bits, id)) return (void *)2;
+    Btc(&bits, 8 + id);
+    ++flips[id];
+    // misaligned operands still need to be updated atomically
+    Xadd(buf + 3, 1);
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  long i;
+  void *res;
+  unsigned x;
+  pthread_t t[THREADS];
+  for (i = 0; i < THREADS; ++i) {
+    if (pthread_create(t + i, 0, Worker, (void *)i)) return 1;
+  }
+  for (i = 0; i < THREADS; ++i) {
+    if (pthread_join(t[i], &res)) return 2;
+    if (res) return 3;
+  }
+  if (pair[0] != THREADS * ITERATIONS) return 4;
+  if (pair[1] != THREADS * ITERATIONS * 2) return 5;
+  if (quad[0] != THREADS * ITERATIONS) return 6;
+  if (quad[1] != THREADS * ITERATIONS * 3) return 7;
+  if (bits & 0xff) return 8;
+  for (i = 0; i < THREADS; ++i) {
+    if (!!(bits & 1ul << (8 + i)) != (flips[i] & 1)) return 9;
+  }
+  memcpy(&x, buf + 3, 4);
+  if (x != THREADS * ITERATIONS) return 10;
+  return 0;
+}
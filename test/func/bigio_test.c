@@ -0,0 +1,43 @@
+// test huge reads and writes complete even when the memory they use
+// is backed by host pages that aren't contiguous
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define PAGES 4096
+#define SIZE  (PAGES * 4096)
+
+int main(int argc, char *argv[]) {
+  int fd, i;
+  char path[] = "/tmp/bigio_test.XXXXXX";
+  unsigned char *a, *b;
+  if ((a = mmap(0, SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                -1, 0)) == MAP_FAILED) {
+    return 1;
+  }
+  if ((b = mmap(0, SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                -1, 0)) == MAP_FAILED) {
+    return 2;
+  }
+  // touching pages backwards scatters them in the host address space
+  for (i = PAGES; i--;) {
+    memset(a + i * 4096, i * 7, 4096);
+    b[i * 4096] = 0;
+  }
+  if ((fd = mkstemp(path)) == -1) return 3;
+  if (unlink(path)) return 4;
+  if (write(fd, a, SIZE) != SIZE) return 5;
+  if (pwrite(fd, a, SIZE, SIZE) != SIZE) return 6;
+  if (lseek(fd, 0, SEEK_SET)) return 7;
+  if (read(fd, b, SIZE) != SIZE) return 8;
+  if (memcmp(a, b, SIZE)) return 9;
+  memset(b, 0, SIZE);
+  if (pread(fd, b, SIZE, SIZE) != SIZE) return 10;
+  if (memcmp(a, b, SIZE)) return 11;
+  // reading past the end of file is still short
+  if (pread(fd, b, SIZE, SIZE + 4096) != SIZE - 4096) return 12;
+  if (close(fd)) return 13;
+  return 0;
+}
@@ -0,0 +1,73 @@
+// test names looked up before being created, renamed, or removed are
+// seen to change right away
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+char dir[] = "/tmp/dentry_test.XXXXXX";
+char a[64], b[64], sub[64], subfile[64], moved[64], movedfile[64];
+
+int main(int argc, char *argv[]) {
+  int i, fd, ws;
+  struct stat st;
+  if (!mkdtemp(dir)) return 1;
+  snprintf(a, sizeof(a), "%s/a", dir);
+  snprintf(b, sizeof(b), "%s/b", dir);
+  snprintf(sub, sizeof(sub), "%s/sub", dir);
+  snprintf(subfile, sizeof(subfile), "%s/sub/f", dir);
+  snprintf(moved, sizeof(moved), "%s/moved", dir);
+  snprintf(movedfile, sizeof(movedfile), "%s/moved/f", dir);
+
+  // names which don't exist keep not existing
+  for (i = 0; i < 3; ++i) {
+    if (stat(a, &st) != -1 || errno != ENOENT) return 2;
+    if (open(a, O_RDONLY) != -1 || errno != ENOENT) return 3;
+    if (access(a, F_OK) != -1 || errno != ENOENT) return 4;
+  }
+
+  // until they're created
+  if ((fd = open(a, O_CREAT | O_WRONLY, 0644)) == -1) return 5;
+  if (close(fd)) return 6;
+  if (stat(a, &st) || !S_ISREG(st.st_mode)) return 7;
+
+  // renaming moves the name
+  if (stat(b, &st) != -1 || errno != ENOENT) return 8;
+  if (rename(a, b)) return 9;
+  if (stat(a, &st) != -1 || errno != ENOENT) return 10;
+  if (stat(b, &st) || !S_ISREG(st.st_mode)) return 11;
+
+  // unlinking removes it
+  if (unlink(b)) return 12;
+  if (stat(b, &st) != -1 || errno != ENOENT) return 13;
+
+  // a name may become a directory, then be renamed with its contents
+  if (stat(subfile, &st) != -1 || errno != ENOENT) return 14;
+  if (mkdir(sub, 0755)) return 15;
+  if (stat(sub, &st) || !S_ISDIR(st.st_mode)) return 16;
+  if ((fd = creat(subfile, 0644)) == -1) return 17;
+  if (close(fd)) return 18;
+  if (stat(subfile, &st)) return 19;
+  if (rename(sub, moved)) return 20;
+  if (stat(subfile, &st) != -1 || errno != ENOENT) return 21;
+  if (stat(movedfile, &st)) return 22;
+
+  // files created by child processes are seen once they're reaped
+  if (stat(a, &st) != -1 || errno != ENOENT) return 23;
+  if (!fork()) {
+    _exit(symlink("moved/f", a) ? 1 : 0);
+  }
+  if (wait(&ws) == -1 || ws) return 24;
+  if (lstat(a, &st) || !S_ISLNK(st.st_mode)) return 25;
+  if (stat(a, &st) || !S_ISREG(st.st_mode)) return 26;
+
+  if (unlink(a)) return 27;
+  if (unlink(movedfile)) return 28;
+  if (rmdir(moved)) return 29;
+  if (stat(moved, &st) != -1 || errno != ENOENT) return 30;
+  if (rmdir(dir)) return 31;
+  return 0;
+}
@@ -0,0 +1,77 @@
+// test a dynamically linked program gets the same results each time
+// it execve()s itself, since blink may reuse jit code made for shared
+// objects by the program which ran before it, then print the results
+// so that runs which were restored from the link cache can be compared
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define DEPTH 3
+
+extern char **environ;
+
+int Compare(const void *a, const void *b) {
+  return strcmp(*(const char **)a, *(const char **)b);
+}
+
+void Compute(char *buf, size_t size) {
+  int i, n;
+  char words[16][16];
+  const char *list[16];
+  for (i = 0; i < 16; ++i) {
+    snprintf(words[i], sizeof(words[i]), "%x", (i * 2654435761u) >> 7);
+    list[i] = words[i];
+  }
+  qsort(list, 16, sizeof(*list), Compare);
+  for (n = i = 0; i < 16; ++i) {
+    n += snprintf(buf + n, size - n, "%s %ld\n", list[i],
+                  strtol(list[i], 0, 16) % 1000);
+  }
+}
+
+int Run(const char *prog, char *out, size_t size) {
+  int fds[2], pid, ws;
+  ssize_t got, n = 0;
+  char depth[] = "1";
+  char *args[] = {(char *)prog, depth, 0};
+  if (pipe(fds)) return -1;
+  if ((pid = fork()) == -1) return -1;
+  if (!pid) {
+    dup2(fds[1], 1);
+    execve(prog, args, environ);
+    _exit(127);
+  }
+  close(fds[1]);
+  while ((got = read(fds[0], out + n, size - 1 - n)) > 0) n += got;
+  out[n] = 0;
+  close(fds[0]);
+  if (waitpid(pid, &ws, 0) != pid) return -1;
+  return WIFEXITED(ws) ? WEXITSTATUS(ws) : -1;
+}
+
+int main(int argc, char *argv[]) {
+  int i, depth;
+  char want[1024], got[1024], next[2];
+  if (argc > 1) {
+    // keep becoming a new copy of ourself, then print the results
+    if ((depth = atoi(argv[1])) < DEPTH) {
+      next[0] = '0' + depth + 1;
+      next[1] = 0;
+      argv[1] = next;
+      execve(argv[0], argv, environ);
+      return 127;
+    }
+    Compute(got, sizeof(got));
+    fputs(got, stdout);
+    return 0;
+  }
+  Compute(want, sizeof(want));
+  for (i = 0; i < 2; ++i) {
+    if (Run(argv[0], got, sizeof(got))) return 1 + i;
+    if (strcmp(got, want)) return 3 + i;
+  }
+  fputs(want, stdout);
+  return 0;
+}
@@ -0,0 +1,110 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+void TestEventfd(void) {
+  int fd;
+  uint64_t x;
+  if ((fd = eventfd(3, EFD_NONBLOCK)) == -1) exit(1);
+  x = 4;
+  if (write(fd, &x, 8) != 8) exit(2);
+  if (read(fd, &x, 8) != 8) exit(3);
+  if (x != 7) exit(4);
+  if (read(fd, &x, 8) != -1 || errno != EAGAIN) exit(5);
+  if (close(fd)) exit(6);
+}
+
+void TestEventfdSemaphore(void) {
+  int fd;
+  uint64_t x;
+  if ((fd = eventfd(2, EFD_SEMAPHORE | EFD_NONBLOCK)) == -1) exit(7);
+  if (read(fd, &x, 8) != 8 || x != 1) exit(8);
+  if (read(fd, &x, 8) != 8 || x != 1) exit(9);
+  if (read(fd, &x, 8) != -1 || errno != EAGAIN) exit(10);
+  if (close(fd)) exit(11);
+}
+
+void TestEventfdFork(void) {
+  int fd, ws;
+  uint64_t x;
+  if ((fd = eventfd(0, 0)) == -1) exit(12);
+  if (!fork()) {
+    x = 42;
+    _exit(write(fd, &x, 8) != 8);
+  }
+  if (read(fd, &x, 8) != 8 || x != 42) exit(13);
+  if (wait(&ws) == -1 || ws) exit(14);
+  if (close(fd)) exit(15);
+}
+
+void TestTimerfdEpoll(void) {
+  uint64_t x;
+  int ep, fd;
+  struct epoll_event ev;
+  struct itimerspec its = {{0, 1000000}, {0, 1000000}};
+  if ((fd = timerfd_create(CLOCK_MONOTONIC, 0)) == -1) exit(16);
+  if ((ep = epoll_create1(0)) == -1) exit(17);
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev)) exit(18);
+  if (timerfd_settime(fd, 0, &its, 0)) exit(19);
+  if (epoll_wait(ep, &ev, 1, 5000) != 1) exit(20);
+  if (ev.data.fd != fd) exit(21);
+  if (read(fd, &x, 8) != 8 || !x) exit(22);
+  memset(&its, 0, sizeof(its));
+  if (timerfd_settime(fd, 0, &its, 0)) exit(23);
+  if (timerfd_gettime(fd, &its)) exit(24);
+  if (its.it_value.tv_sec || its.it_value.tv_nsec) exit(25);
+  if (close(fd) || close(ep)) exit(26);
+}
+
+void TestSignalfd(void) {
+  int fd;
+  sigset_t ss;
+  struct signalfd_siginfo si;
+  sigemptyset(&ss);
+  sigaddset(&ss, SIGUSR1);
+  if (sigprocmask(SIG_BLOCK, &ss, 0)) exit(27);
+  if ((fd = signalfd(-1, &ss, SFD_NONBLOCK)) == -1) exit(28);
+  if (read(fd, &si, sizeof(si)) != -1 || errno != EAGAIN) exit(29);
+  if (kill(getpid(), SIGUSR1)) exit(30);
+  if (read(fd, &si, sizeof(si)) != sizeof(si)) exit(31);
+  if (si.ssi_signo != SIGUSR1) exit(32);
+  if (close(fd)) exit(33);
+}
+
+int main(int argc, char *argv[]) {
+  TestEventfd();
+  TestEventfdSemaphore();
+  TestEventfdFork();
+  TestTimerfdEpoll();
+  TestSignalfd();
+  return 0;
+}
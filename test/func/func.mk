@@ -71,9 +71,74 @@ o/$(MODE)/test/func/%.com:						\
 	@echo "o/$(MODE)/blink/blink -L/dev/null -msss $< || exit" >>$@
 	@chmod +x $@
 
+# dynamically linked tests are only run by blink, because the host may
+# not have musl's dynamic linker, which blink finds using its overlays.
+# each one is also run twice with the link cache, where the second run
+# is restored from the first one's link, and their output is compared
+TEST_FUNC_DYNAMIC_SRCS = $(wildcard test/func/dynamic/*.c)
+TEST_FUNC_DYNAMIC_OBJS = $(TEST_FUNC_DYNAMIC_SRCS:%.c=o/$(MODE)/x86_64/%.o)
+TEST_FUNC_DYNAMIC_BINS = $(TEST_FUNC_DYNAMIC_SRCS:%.c=o/$(MODE)/%.elf)
+TEST_FUNC_DYNAMIC_CHECKS = $(TEST_FUNC_DYNAMIC_SRCS:%.c=o/$(MODE)/%.elf.ok)
+
+$(TEST_FUNC_DYNAMIC_OBJS): private CFLAGS = -O -g
+$(TEST_FUNC_DYNAMIC_OBJS): private CPPFLAGS = -isystem.
+$(TEST_FUNC_DYNAMIC_OBJS): test/func/func.mk
+
+.PRECIOUS: o/$(MODE)/test/func/dynamic/%.elf
+o/$(MODE)/test/func/dynamic/%.elf:					\
+		o/$(MODE)/x86_64/test/func/dynamic/%.o			\
+		o/third_party/gcc/x86_64/bin/x86_64-linux-musl-gcc	\
+		$(VM)
+	@mkdir -p $(@D)
+	$(VM)								\
+		o/third_party/gcc/x86_64/bin/x86_64-linux-musl-gcc	\
+		-Wl,-z,max-page-size=65536				\
+		-Wl,-z,common-page-size=65536				\
+		$<							\
+		-o $@
+
+o/$(MODE)/test/func/dynamic/%.elf.ok:					\
+		o/$(MODE)/test/func/dynamic/%.elf			\
+		o/lib/ld-musl-x86_64.so.1				\
+		o/$(MODE)/blink/blink
+	o/$(MODE)/blink/blink $<
+	o/$(MODE)/blink/blink -m $<
+	o/$(MODE)/blink/blink -j $<
+	o/$(MODE)/blink/blink -jm $<
+	BLINK_KEEPASLR=1 o/$(MODE)/blink/blink $<
+	BLINK_KEEPASLR=1 o/$(MODE)/blink/blink -m $<
+	@rm -rf $@.cache
+	@mkdir -p $@.cache
+	BLINK_LINKCACHE=$(abspath $@.cache) o/$(MODE)/blink/blink $< >$@.1
+	BLINK_LINKCACHE=$(abspath $@.cache) o/$(MODE)/blink/blink $< >$@.2
+	cmp $@.1 $@.2
+	@rm -rf $@.cache $@.1 $@.2
+	@touch $@
+
+# snapshots taken at the first write() must print the same thing when
+# they're resumed, including in another memory mode or jit mode
+o/$(MODE)/test/func/dynamic/snapshot.ok:				\
+		o/$(MODE)/test/func/dynamic/exec_test.elf		\
+		o/lib/ld-musl-x86_64.so.1				\
+		o/$(MODE)/blink/blink
+	@rm -f $@.*
+	o/$(MODE)/blink/blink $< 3 >$@.want
+	for s in "" -m -j -jm; do						\
+	  o/$(MODE)/blink/blink $$s -S 1:$@.img $< 3 >/dev/null || exit;	\
+	  for r in "" -m -j -jm; do						\
+	    echo "[test] blink $$s -S 1:$@.img; blink $$r -R $@.img" >&2;	\
+	    o/$(MODE)/blink/blink $$r -R $@.img >$@.got || exit;		\
+	    cmp $@.want $@.got || exit;					\
+	  done;									\
+	done
+	@rm -f $@.*
+	@touch $@
+
 .PHONY: o/$(MODE)/test/func
 o/$(MODE)/test/func:							\
-	$(TEST_FUNC_CHECKS)
+	$(TEST_FUNC_CHECKS)						\
+	$(TEST_FUNC_DYNAMIC_CHECKS)					\
+	o/$(MODE)/test/func/dynamic/snapshot.ok
 
 .PHONY: o/$(MODE)/test/func/emulates
 o/$(MODE)/test/func/emulates:						\
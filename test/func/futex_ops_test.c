@@ -0,0 +1,143 @@
+// test futex bitsets, requeueing, wake ops, and priority inheritance
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define N 20
+
+atomic_int ready;
+atomic_int done;
+atomic_int word;
+atomic_int word2;
+int counter;
+pthread_mutex_t mu;
+
+long Futex(atomic_int *uaddr, int op, int val, const struct timespec *timeout,
+           atomic_int *uaddr2, int val3) {
+  return syscall(SYS_futex, uaddr, op, val, timeout, uaddr2, val3);
+}
+
+void *Waiter(void *arg) {
+  ++ready;
+  while (!done) {
+    if (Futex(&word, FUTEX_WAIT_PRIVATE, 0, 0, 0, 0) && errno != EAGAIN &&
+        errno != EINTR) {
+      return (void *)1;
+    }
+  }
+  return 0;
+}
+
+void *BitsetWaiter(void *arg) {
+  ++ready;
+  while (!done) {
+    if (Futex(&word, FUTEX_WAIT_BITSET_PRIVATE, 0, 0, 0, 2) &&
+        errno != EAGAIN && errno != EINTR) {
+      return (void *)1;
+    }
+  }
+  return 0;
+}
+
+void *Locker(void *arg) {
+  int i;
+  for (i = 0; i < 100; ++i) {
+    if (pthread_mutex_lock(&mu)) return (void *)1;
+    ++counter;
+    if (pthread_mutex_unlock(&mu)) return (void *)1;
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int i;
+  void *res;
+  pthread_t th[N];
+  struct timespec ts;
+  pthread_mutexattr_t attr;
+
+  // absolute monotonic timeouts that already passed time out at once
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  if (Futex(&word, FUTEX_WAIT_BITSET_PRIVATE, 0, &ts, 0, -1) != -1 ||
+      errno != ETIMEDOUT) {
+    return 1;
+  }
+  if (Futex(&word, FUTEX_WAIT_BITSET_PRIVATE, 0, 0, 0, 0) != -1 ||
+      errno != EINVAL) {
+    return 2;
+  }
+
+  // wakers only wake waiters whose bitsets overlap their own
+  if (pthread_create(th, 0, BitsetWaiter, 0)) return 3;
+  while (ready < 1) usleep(1000);
+  usleep(50000);
+  if (Futex(&word, FUTEX_WAKE_BITSET_PRIVATE, 1, 0, 0, 1) != 0) return 4;
+  done = 1;
+  if (Futex(&word, FUTEX_WAKE_BITSET_PRIVATE, 1, 0, 0, 3) != 1) return 5;
+  if (pthread_join(th[0], &res) || res) return 6;
+
+  // requeue wakes one waiter and moves the rest to another address
+  ready = 0;
+  done = 0;
+  for (i = 0; i < N; ++i) {
+    if (pthread_create(th + i, 0, Waiter, 0)) return 7;
+  }
+  while (ready < N) usleep(1000);
+  usleep(50000);
+  if (Futex(&word, FUTEX_CMP_REQUEUE_PRIVATE, 1, (void *)(long)N, &word2,
+            1) != -1 ||
+      errno != EAGAIN) {
+    return 8;
+  }
+  done = 1;
+  if (Futex(&word, FUTEX_CMP_REQUEUE_PRIVATE, 1, (void *)(long)N, &word2,
+            0) != N) {
+    return 9;
+  }
+  if (Futex(&word, FUTEX_WAKE_PRIVATE, N, 0, 0, 0) != 0) return 10;
+  if (Futex(&word2, FUTEX_WAKE_PRIVATE, N, 0, 0, 0) != N - 1) return 11;
+  for (i = 0; i < N; ++i) {
+    if (pthread_join(th[i], &res) || res) return 12;
+  }
+
+  // wake op changes the second word and compares its old value
+  word2 = 5;
+  if (Futex(&word, FUTEX_WAKE_OP_PRIVATE, 1, (void *)1L, &word2,
+            FUTEX_OP(FUTEX_OP_ADD, 2, FUTEX_OP_CMP_EQ, 5)) != 0) {
+    return 13;
+  }
+  if (word2 != 7) return 14;
+  if (Futex(&word, FUTEX_WAKE_OP_PRIVATE, 1, (void *)1L, &word2,
+            FUTEX_OP(FUTEX_OP_ANDN, 1, FUTEX_OP_CMP_EQ, 0) |
+                FUTEX_OP_OPARG_SHIFT << 28) != 0) {
+    return 15;
+  }
+  if (word2 != 5) return 16;
+
+  // priority inheritance mutexes hand off ownership to waiters
+  if (pthread_mutexattr_init(&attr)) return 17;
+  if (pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT)) return 18;
+  if (pthread_mutex_init(&mu, &attr)) return 19;
+  for (i = 0; i < N; ++i) {
+    if (pthread_create(th + i, 0, Locker, 0)) return 20;
+  }
+  for (i = 0; i < N; ++i) {
+    if (pthread_join(th[i], &res) || res) return 21;
+  }
+  if (counter != N * 100) return 22;
+  word = syscall(SYS_gettid);
+  if (Futex(&word, FUTEX_LOCK_PI_PRIVATE, 0, 0, 0, 0) != -1 ||
+      errno != EDEADLK) {
+    return 23;
+  }
+  if (Futex(&word, FUTEX_UNLOCK_PI_PRIVATE, 0, 0, 0, 0) || word) return 24;
+  if (Futex(&word, FUTEX_UNLOCK_PI_PRIVATE, 0, 0, 0, 0) != -1 ||
+      errno != EPERM) {
+    return 25;
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+// test many threads can wait on distinct futexes at the same time
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define N 200
+
+atomic_int ready;
+atomic_int words[N];
+
+void *Worker(void *arg) {
+  long i = (long)arg;
+  ++ready;
+  while (!words[i]) {
+    if (syscall(SYS_futex, words + i, FUTEX_WAIT_PRIVATE, 0, 0, 0, 0) &&
+        errno != EAGAIN && errno != EINTR) {
+      return (void *)1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  long i;
+  void *res;
+  pthread_t th[N];
+  for (i = 0; i < N; ++i) {
+    if (pthread_create(th + i, 0, Worker, (void *)i)) return 1;
+  }
+  while (ready < N) usleep(1000);
+  usleep(50000);
+  for (i = 0; i < N; ++i) {
+    words[i] = 1;
+    if (syscall(SYS_futex, words + i, FUTEX_WAKE_PRIVATE, 1, 0, 0, 0) == -1) {
+      return 2;
+    }
+  }
+  for (i = 0; i < N; ++i) {
+    if (pthread_join(th[i], &res)) return 3;
+    if (res) return 4;
+  }
+  return 0;
+}
@@ -0,0 +1,95 @@
+// test big directories can be listed, seeked, and read into tiny buffers
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define N 1000
+
+struct Dirent {
+  unsigned long ino;
+  long off;
+  unsigned short reclen;
+  unsigned char type;
+  char name[];
+};
+
+char dir[] = "/tmp/getdents_test.XXXXXX";
+char seen[N];
+
+int Cleanup(void) {
+  int i;
+  char path[64];
+  for (i = 0; i < N; ++i) {
+    sprintf(path, "%s/%0*d", dir, i % 50 + 1, i);
+    unlink(path);
+  }
+  return rmdir(dir);
+}
+
+int main(int argc, char *argv[]) {
+  DIR *d;
+  long off;
+  int i, n, fd;
+  char path[64];
+  struct dirent *e;
+  struct Dirent *r;
+  char buf[64];
+
+  // names of many different lengths are all listed exactly once
+  if (!mkdtemp(dir)) return 1;
+  for (i = 0; i < N; ++i) {
+    sprintf(path, "%s/%0*d", dir, i % 50 + 1, i);
+    if ((fd = creat(path, 0644)) == -1) return 2;
+    if (close(fd)) return 3;
+  }
+  if (!(d = opendir(dir))) return 4;
+  for (n = 0; (e = readdir(d));) {
+    if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) {
+      if (e->d_type != DT_DIR) return 5;
+      continue;
+    }
+    if (e->d_type != DT_REG) return 6;
+    i = atoi(e->d_name);
+    if (i < 0 || i >= N || seen[i]++) return 7;
+    ++n;
+  }
+  if (n != N) return 8;
+
+  // directories may be seeked back to where they were
+  rewinddir(d);
+  for (i = 0; i < N / 2; ++i) {
+    if (!readdir(d)) return 9;
+  }
+  off = telldir(d);
+  if (!(e = readdir(d))) return 10;
+  strcpy(path, e->d_name);
+  seekdir(d, off);
+  if (!(e = readdir(d)) || strcmp(path, e->d_name)) return 11;
+  if (closedir(d)) return 12;
+
+  // buffers too small for any record are an error, not the end
+  if ((fd = open(dir, O_RDONLY | O_DIRECTORY)) == -1) return 13;
+  for (n = 0;;) {
+    if ((i = syscall(SYS_getdents64, fd, buf, sizeof(buf))) == -1) {
+      if (errno != EINVAL) return 14;
+      break;
+    }
+    if (!i) return 15;
+    r = (struct Dirent *)buf;
+    if (r->reclen > i || r->reclen % 8) return 16;
+    n += i;
+  }
+  if (!n) return 17;
+  if (syscall(SYS_getdents64, fd, buf, 8) != -1 || errno != EINVAL) {
+    return 18;
+  }
+  if (close(fd)) return 19;
+  if (Cleanup()) return 20;
+  return 0;
+}
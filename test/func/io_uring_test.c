@@ -0,0 +1,257 @@
+// test io_uring rings can be mapped, submitted to, and waited upon
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define OP_NOP          0
+#define OP_POLL_ADD     6
+#define OP_TIMEOUT      11
+#define OP_ASYNC_CANCEL 14
+#define OP_READ         22
+#define OP_WRITE        23
+#define OP_LAST         48
+
+#define SQE_IO_LINK 4
+
+#define ENTER_GETEVENTS 1
+#define ENTER_EXT_ARG   8
+
+#define REGISTER_PROBE 8
+
+#define OFF_SQ_RING 0
+#define OFF_CQ_RING 0x08000000
+#define OFF_SQES    0x10000000
+
+struct Params {
+  unsigned sq_entries, cq_entries, flags, sq_thread_cpu, sq_thread_idle;
+  unsigned features, wq_fd, resv[3];
+  struct {
+    unsigned head, tail, ring_mask, ring_entries, flags, dropped, array;
+    unsigned resv1;
+    unsigned long resv2;
+  } sq_off;
+  struct {
+    unsigned head, tail, ring_mask, ring_entries, overflow, cqes, flags;
+    unsigned resv1;
+    unsigned long resv2;
+  } cq_off;
+};
+
+struct Sqe {
+  unsigned char opcode, flags;
+  unsigned short ioprio;
+  int fd;
+  unsigned long off, addr;
+  unsigned len, op_flags;
+  unsigned long user_data;
+  unsigned short buf_index, personality;
+  int file_index;
+  unsigned long addr3, pad;
+};
+
+struct Cqe {
+  unsigned long user_data;
+  int res;
+  unsigned flags;
+};
+
+struct GeteventsArg {
+  unsigned long sigmask;
+  unsigned sigmask_sz, pad;
+  unsigned long ts;
+};
+
+struct Probe {
+  unsigned char last_op, ops_len;
+  unsigned short resv;
+  unsigned resv2[3];
+  struct {
+    unsigned char op, resv;
+    unsigned short flags;
+    unsigned resv2;
+  } ops[OP_LAST];
+};
+
+int ring;
+struct Params p;
+unsigned char *sq, *cq;
+struct Sqe *sqes;
+
+struct Sqe *GetSqe(void) {
+  unsigned tail = *(unsigned *)(sq + p.sq_off.tail);
+  unsigned i = tail & *(unsigned *)(sq + p.sq_off.ring_mask);
+  ((unsigned *)(sq + p.sq_off.array))[i] = i;
+  memset(sqes + i, 0, sizeof(*sqes));
+  atomic_store_explicit((_Atomic(unsigned) *)(sq + p.sq_off.tail), tail + 1,
+                        memory_order_release);
+  return sqes + i;
+}
+
+long Enter(unsigned submit, unsigned wait, unsigned flags, void *arg,
+           unsigned long argsz) {
+  return syscall(__NR_io_uring_enter, ring, submit, wait, flags, arg, argsz);
+}
+
+int Reap(struct Cqe *cqe) {
+  unsigned head = *(unsigned *)(cq + p.cq_off.head);
+  if (head == atomic_load_explicit((_Atomic(unsigned) *)(cq + p.cq_off.tail),
+                                   memory_order_acquire)) {
+    return 0;
+  }
+  *cqe = ((struct Cqe *)(cq + p.cq_off.cqes))
+      [head & *(unsigned *)(cq + p.cq_off.ring_mask)];
+  atomic_store_explicit((_Atomic(unsigned) *)(cq + p.cq_off.head), head + 1,
+                        memory_order_release);
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  char buf[8];
+  char *page;
+  int n, wrote = 0;
+  int pfds[2];
+  struct Sqe *e;
+  struct Cqe cqe;
+  struct pollfd pfd;
+  struct Probe probe;
+  struct GeteventsArg ga;
+  struct timespec ts = {0, 10000000};
+
+  // rings are set up by the kernel then mapped by the process
+  if ((ring = syscall(__NR_io_uring_setup, 3, &p)) == -1) return 1;
+  if (p.sq_entries != 4 || p.cq_entries != 8) return 2;
+  if ((sq = mmap(0, p.sq_off.array + p.sq_entries * 4, PROT_READ | PROT_WRITE,
+                 MAP_SHARED, ring, OFF_SQ_RING)) == MAP_FAILED) {
+    return 3;
+  }
+  if ((cq = mmap(0, p.cq_off.cqes + p.cq_entries * sizeof(struct Cqe),
+                 PROT_READ | PROT_WRITE, MAP_SHARED, ring, OFF_CQ_RING)) ==
+      MAP_FAILED) {
+    return 4;
+  }
+  if ((sqes = mmap(0, p.sq_entries * sizeof(struct Sqe),
+                   PROT_READ | PROT_WRITE, MAP_SHARED, ring, OFF_SQES)) ==
+      MAP_FAILED) {
+    return 5;
+  }
+
+  // operations linked together are performed in order
+  if (pipe(pfds)) return 6;
+  e = GetSqe();
+  e->opcode = OP_WRITE;
+  e->flags = SQE_IO_LINK;
+  e->fd = pfds[1];
+  e->off = -1;
+  e->addr = (unsigned long)"hello";
+  e->len = 5;
+  e->user_data = 1;
+  e = GetSqe();
+  e->opcode = OP_READ;
+  e->fd = pfds[0];
+  e->off = -1;
+  e->addr = (unsigned long)buf;
+  e->len = sizeof(buf);
+  e->user_data = 2;
+  e = GetSqe();
+  e->opcode = OP_NOP;
+  e->user_data = 3;
+  if (Enter(3, 3, ENTER_GETEVENTS, 0, 0) != 3) return 7;
+  for (n = 0; Reap(&cqe); ++n) {
+    if (cqe.user_data == 1 && (cqe.res != 5 || wrote++)) return 8;
+    if (cqe.user_data == 2 && (cqe.res != 5 || !wrote)) return 9;
+    if (cqe.user_data == 3 && cqe.res) return 9;
+  }
+  if (n != 3 || memcmp(buf, "hello", 5)) return 9;
+
+  // polls complete once the file becomes ready later on
+  e = GetSqe();
+  e->opcode = OP_POLL_ADD;
+  e->fd = pfds[0];
+  e->op_flags = POLLIN;
+  e->user_data = 4;
+  if (Enter(1, 0, 0, 0, 0) != 1) return 10;
+  usleep(10000);
+  if (Reap(&cqe)) return 11;
+  if (write(pfds[1], "x", 1) != 1) return 12;
+  if (Enter(0, 1, ENTER_GETEVENTS, 0, 0)) return 13;
+  if (!Reap(&cqe) || cqe.user_data != 4 || !(cqe.res & POLLIN)) return 14;
+  if (read(pfds[0], buf, 1) != 1) return 15;
+
+  // timeouts expire with ETIME and pending polls may be canceled
+  e = GetSqe();
+  e->opcode = OP_TIMEOUT;
+  e->addr = (unsigned long)&ts;
+  e->len = 1;
+  e->user_data = 5;
+  if (Enter(1, 1, ENTER_GETEVENTS, 0, 0) != 1) return 16;
+  if (!Reap(&cqe) || cqe.user_data != 5 || cqe.res != -ETIME) return 17;
+  e = GetSqe();
+  e->opcode = OP_POLL_ADD;
+  e->fd = pfds[0];
+  e->op_flags = POLLIN;
+  e->user_data = 6;
+  e = GetSqe();
+  e->opcode = OP_ASYNC_CANCEL;
+  e->addr = 6;
+  e->user_data = 7;
+  if (Enter(2, 2, ENTER_GETEVENTS, 0, 0) != 2) return 18;
+  while (Reap(&cqe)) {
+    if (cqe.user_data == 6 && cqe.res != -ECANCELED) return 19;
+    if (cqe.user_data == 7 && cqe.res) return 20;
+  }
+
+  // waiting with an extended argument may time out
+  memset(&ga, 0, sizeof(ga));
+  ga.ts = (unsigned long)&ts;
+  if (Enter(0, 1, ENTER_GETEVENTS | ENTER_EXT_ARG, &ga, sizeof(ga)) != -1 ||
+      errno != ETIME) {
+    return 21;
+  }
+
+  // probing reports which operations are supported
+  memset(&probe, 0, sizeof(probe));
+  if (syscall(__NR_io_uring_register, ring, REGISTER_PROBE, &probe, OP_LAST)) {
+    return 22;
+  }
+  if (probe.ops_len != OP_LAST) return 23;
+  if (!(probe.ops[OP_READ].flags & 1)) return 24;
+
+  // the ring polls as readable only while completions are waiting
+  pfd.fd = ring;
+  pfd.events = POLLIN;
+  if (poll(&pfd, 1, 0)) return 25;
+  e = GetSqe();
+  e->opcode = OP_NOP;
+  e->user_data = 8;
+  if (Enter(1, 0, 0, 0, 0) != 1) return 26;
+  if (poll(&pfd, 1, 1000) != 1 || !(pfd.revents & POLLIN)) return 27;
+  if (!Reap(&cqe) || cqe.user_data != 8) return 28;
+  if (poll(&pfd, 1, 0)) return 29;
+
+  // unmapping a buffer cancels the read that's waiting to fill it
+  if ((page = mmap(0, 4096, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+    return 30;
+  }
+  e = GetSqe();
+  e->opcode = OP_READ;
+  e->fd = pfds[0];
+  e->off = -1;
+  e->addr = (unsigned long)page;
+  e->len = 4096;
+  e->user_data = 9;
+  if (Enter(1, 0, 0, 0, 0) != 1) return 31;
+  usleep(10000);
+  if (munmap(page, 4096)) return 32;
+  if (write(pfds[1], "y", 1) != 1) return 33;
+  if (Enter(0, 1, ENTER_GETEVENTS, 0, 0)) return 34;
+  if (!Reap(&cqe) || cqe.user_data != 9 || cqe.res != -ECANCELED) return 35;
+  if (read(pfds[0], buf, 1) != 1 || buf[0] != 'y') return 36;
+  if (close(ring)) return 37;
+  return 0;
+}
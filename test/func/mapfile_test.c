@@ -0,0 +1,90 @@
+// test pieces of private and shared file mappings can be changed,
+// protected, and unmapped independently of the rest of the mapping
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PAGE  65536
+#define PAGES 4
+
+char path[] = "/tmp/mapfile_test.XXXXXX";
+char buf[PAGE];
+char *want;
+
+void OnSigSegv(int sig, siginfo_t *si, void *vctx) {
+  _exit(si->si_addr == want ? 0 : 1);
+}
+
+// stores to p in a child process, which should fault
+int Faults(char *p) {
+  int ws;
+  struct sigaction sa = {.sa_sigaction = OnSigSegv, .sa_flags = SA_SIGINFO};
+  if (!fork()) {
+    want = p;
+    sigaction(SIGSEGV, &sa, 0);
+    *p = 1;
+    _exit(2);
+  }
+  return wait(&ws) != -1 && !ws;
+}
+
+int main(int argc, char *argv[]) {
+  int i, fd, ws;
+  char *a, *b, *c;
+  if ((fd = mkstemp(path)) == -1) return 1;
+  if (unlink(path)) return 2;
+  for (i = 0; i < PAGES; ++i) {
+    memset(buf, 'a' + i, PAGE);
+    if (write(fd, buf, PAGE) != PAGE) return 3;
+  }
+
+  // two private mappings of the same file don't see each other's stores
+  a = mmap(0, PAGE * PAGES, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (a == MAP_FAILED) return 4;
+  b = mmap(0, PAGE * PAGES, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (b == MAP_FAILED) return 5;
+  for (i = 0; i < PAGES; ++i) {
+    if (a[i * PAGE] != 'a' + i) return 6;
+    if (b[i * PAGE + PAGE - 1] != 'a' + i) return 7;
+  }
+  a[PAGE + 1] = 'x';
+  if (b[PAGE + 1] != 'b') return 8;
+  if (pread(fd, buf, 2, PAGE) != 2 || buf[1] != 'b') return 9;
+
+  // a child's private stores aren't seen by its parent
+  if (!fork()) {
+    b[0] = 'y';
+    _exit(b[PAGE] == 'b' ? 0 : 1);
+  }
+  if (wait(&ws) == -1 || ws) return 10;
+  if (b[0] != 'a') return 11;
+
+  // pages in the middle may be unmapped or protected on their own
+  if (munmap(a + PAGE * 2, PAGE)) return 12;
+  if (mprotect(a, PAGE, PROT_READ)) return 13;
+  if (a[0] != 'a' || a[PAGE + 1] != 'x' || a[PAGE * 3] != 'd') return 14;
+  a[PAGE * 3] = 'z';
+  if (!Faults(a)) return 15;
+  if (!Faults(a + PAGE * 2)) return 16;
+
+  // shared mappings store through to the file
+  c = mmap(0, PAGE * PAGES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (c == MAP_FAILED) return 17;
+  c[PAGE * 3 + 7] = 'w';
+  if (msync(c + PAGE * 3, PAGE, MS_SYNC)) return 18;
+  if (pread(fd, buf, 8, PAGE * 3) != 8 || buf[7] != 'w') return 19;
+  if (munmap(c + PAGE, PAGE)) return 20;
+  if (c[PAGE * 2] != 'c') return 21;
+
+  if (munmap(a, PAGE * 2)) return 22;
+  if (munmap(a + PAGE * 3, PAGE)) return 23;
+  if (munmap(b, PAGE * PAGES)) return 24;
+  if (munmap(c, PAGE)) return 25;
+  if (munmap(c + PAGE * 2, PAGE * 2)) return 26;
+  if (close(fd)) return 27;
+  return 0;
+}
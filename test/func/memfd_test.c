@@ -0,0 +1,50 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+  int fd, ws;
+  char *p, *q;
+  if ((fd = memfd_create("hello", MFD_CLOEXEC)) == -1) exit(1);
+  if (ftruncate(fd, 65536)) exit(2);
+  p = mmap(0, 65536, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) exit(3);
+  q = mmap(0, 65536, PROT_READ, MAP_SHARED, fd, 0);
+  if (q == MAP_FAILED) exit(4);
+  strcpy(p + 5000, "parent");
+  if (strcmp(q + 5000, "parent")) exit(5);
+  if (!fork()) {
+    strcpy(p + 40000, "child");
+    _exit(0);
+  }
+  if (wait(&ws) == -1 || ws) exit(6);
+  if (strcmp(q + 40000, "child")) exit(7);
+  if (pread(fd, p, 5, 40000) != 5) exit(8);
+  if (munmap(q, 65536) || munmap(p, 65536)) exit(9);
+  if (close(fd)) exit(10);
+  return 0;
+}
@@ -0,0 +1,52 @@
+// test poll() and select() wake up as soon as a host fd becomes ready
+// and report the same readiness the linux kernel would report
+#include <poll.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+long Millis(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char *argv[]) {
+  char c;
+  long t;
+  int ws, pfds[2];
+  fd_set rfds;
+  struct timeval tv = {0};
+  struct pollfd pfd[3];
+  if (pipe(pfds)) return 1;
+  if (!fork()) {
+    usleep(10000);
+    write(pfds[1], "x", 1);
+    _exit(0);
+  }
+  // an indefinite wait must return shortly after the write happens
+  t = Millis();
+  pfd[0].fd = pfds[0];
+  pfd[0].events = POLLIN;
+  if (poll(pfd, 1, -1) != 1) return 2;
+  if (pfd[0].revents != POLLIN) return 3;
+  if (Millis() - t > 1000) return 4;
+  if (wait(&ws) == -1 || ws) return 5;
+  // negative fds are ignored while bad fds count as ready
+  pfd[1].fd = -1;
+  pfd[1].events = POLLIN;
+  pfd[2].fd = 100;
+  pfd[2].events = POLLIN;
+  if (poll(pfd, 3, 0) != 2) return 6;
+  if (pfd[1].revents) return 7;
+  if (pfd[2].revents != POLLNVAL) return 8;
+  if (read(pfds[0], &c, 1) != 1) return 9;
+  // select() considers end of file to be readable
+  if (close(pfds[1])) return 10;
+  FD_ZERO(&rfds);
+  FD_SET(pfds[0], &rfds);
+  if (select(pfds[0] + 1, &rfds, 0, 0, &tv) != 1) return 11;
+  if (!FD_ISSET(pfds[0], &rfds)) return 12;
+  return 0;
+}
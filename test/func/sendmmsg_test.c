@@ -0,0 +1,86 @@
+// test batches of datagrams can be sent and received in one call
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define N 8
+
+int main(int argc, char *argv[]) {
+  int i, a, b;
+  char buf[N][16];
+  char want[N][16];
+  struct iovec iov[N][2];
+  struct mmsghdr mm[N];
+  struct sockaddr_in addr, from[N];
+  socklen_t addrlen = sizeof(addr);
+  struct timespec ts = {0, 10000000};
+
+  if ((a = socket(AF_INET, SOCK_DGRAM, 0)) == -1) return 1;
+  if ((b = socket(AF_INET, SOCK_DGRAM, 0)) == -1) return 2;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(b, (struct sockaddr *)&addr, sizeof(addr))) return 3;
+  if (getsockname(b, (struct sockaddr *)&addr, &addrlen)) return 4;
+
+  // every message in the batch is sent to its own destination
+  memset(mm, 0, sizeof(mm));
+  for (i = 0; i < N; ++i) {
+    memset(want[i], 'a' + i, sizeof(want[i]));
+    iov[i][0].iov_base = want[i];
+    iov[i][0].iov_len = 4;
+    iov[i][1].iov_base = want[i] + 4;
+    iov[i][1].iov_len = i + 1;
+    mm[i].msg_hdr.msg_iov = iov[i];
+    mm[i].msg_hdr.msg_iovlen = 2;
+    mm[i].msg_hdr.msg_name = &addr;
+    mm[i].msg_hdr.msg_namelen = sizeof(addr);
+  }
+  if (sendmmsg(a, mm, N, 0) != N) return 5;
+  for (i = 0; i < N; ++i) {
+    if (mm[i].msg_len != 4 + i + 1) return 6;
+  }
+
+  // received messages report their lengths and where they came from
+  memset(mm, 0, sizeof(mm));
+  memset(buf, 0, sizeof(buf));
+  for (i = 0; i < N; ++i) {
+    iov[i][0].iov_base = buf[i];
+    iov[i][0].iov_len = 2;
+    iov[i][1].iov_base = buf[i] + 2;
+    iov[i][1].iov_len = sizeof(buf[i]) - 2;
+    mm[i].msg_hdr.msg_iov = iov[i];
+    mm[i].msg_hdr.msg_iovlen = 2;
+    mm[i].msg_hdr.msg_name = from + i;
+    mm[i].msg_hdr.msg_namelen = sizeof(from[i]);
+  }
+  if (recvmmsg(b, mm, N, 0, 0) != N) return 7;
+  for (i = 0; i < N; ++i) {
+    if (mm[i].msg_len != 4 + i + 1) return 8;
+    if (memcmp(buf[i], want[i], 4 + i + 1)) return 9;
+    if (mm[i].msg_hdr.msg_namelen != sizeof(from[i])) return 10;
+    if (from[i].sin_family != AF_INET) return 11;
+    if (from[i].sin_addr.s_addr != htonl(INADDR_LOOPBACK)) return 12;
+  }
+
+  // waiting for one message returns whatever has already arrived
+  for (i = 0; i < 3; ++i) {
+    mm[i].msg_hdr.msg_name = &addr;
+  }
+  if (sendmmsg(a, mm, 3, 0) != 3) return 13;
+  usleep(10000);
+  if (recvmmsg(b, mm, N, MSG_WAITFORONE, 0) != 3) return 14;
+
+  // nonblocking batches fail when nothing has arrived yet
+  if (recvmmsg(b, mm, N, MSG_DONTWAIT, &ts) != -1 || errno != EAGAIN) {
+    return 15;
+  }
+  if (close(b)) return 16;
+  if (close(a)) return 17;
+  return 0;
+}
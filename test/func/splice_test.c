@@ -0,0 +1,74 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+char path1[] = "/tmp/blink.splice.XXXXXX";
+char path2[] = "/tmp/blink.splice.XXXXXX";
+
+void TestCopyFileRange(int a, int b) {
+  char buf[16];
+  loff_t x, y;
+  if (write(a, "hello world", 11) != 11) exit(1);
+  x = 6;
+  y = 0;
+  if (copy_file_range(a, &x, b, &y, 100, 0) != 5) exit(2);
+  if (x != 11 || y != 5) exit(3);
+  if (pread(b, buf, sizeof(buf), 0) != 5) exit(4);
+  if (memcmp(buf, "world", 5)) exit(5);
+  if (lseek(a, 0, SEEK_SET)) exit(6);
+  if (copy_file_range(a, 0, b, 0, 5, 0) != 5) exit(7);
+  if (lseek(a, 0, SEEK_CUR) != 5) exit(8);
+  if (lseek(b, 0, SEEK_CUR) != 5) exit(9);
+  if (pread(b, buf, sizeof(buf), 0) != 5) exit(10);
+  if (memcmp(buf, "hello", 5)) exit(11);
+}
+
+void TestSplice(int a, int b) {
+  int p[2];
+  loff_t x;
+  char buf[16];
+  if (pipe(p)) exit(12);
+  x = 0;
+  if (splice(a, &x, p[1], 0, 11, 0) != 11) exit(13);
+  if (x != 11) exit(14);
+  x = 100;
+  if (splice(p[0], 0, b, &x, 11, 0) != 11) exit(15);
+  if (pread(b, buf, 11, 100) != 11) exit(16);
+  if (memcmp(buf, "hello world", 11)) exit(17);
+  if (splice(a, 0, b, 0, 1, 0) != -1 || errno != EINVAL) exit(18);
+  if (close(p[0]) || close(p[1])) exit(19);
+}
+
+int main(int argc, char *argv[]) {
+  int a, b;
+  if ((a = mkstemp(path1)) == -1) exit(20);
+  if ((b = mkstemp(path2)) == -1) exit(21);
+  TestCopyFileRange(a, b);
+  TestSplice(a, b);
+  if (unlink(path1) || unlink(path2)) exit(22);
+  return 0;
+}
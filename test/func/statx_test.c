@@ -0,0 +1,74 @@
+// test statx() reports the same things as fstatat()
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+  int fd;
+  struct stat st;
+  struct statx stx;
+  char path[] = "/tmp/statx_test.XXXXXX";
+  if ((fd = mkstemp(path)) == -1) return 1;
+  if (write(fd, "hello", 5) != 5) return 2;
+  if (fstat(fd, &st)) return 3;
+
+  // basic stats are reported by path
+  memset(&stx, -1, sizeof(stx));
+  if (statx(AT_FDCWD, path, 0, STATX_BASIC_STATS, &stx)) return 4;
+  if ((stx.stx_mask & STATX_BASIC_STATS) != STATX_BASIC_STATS) return 5;
+  if (stx.stx_size != 5) return 6;
+  if (stx.stx_ino != st.st_ino) return 7;
+  if (stx.stx_mode != st.st_mode) return 8;
+  if (stx.stx_nlink != st.st_nlink) return 9;
+  if (stx.stx_uid != st.st_uid || stx.stx_gid != st.st_gid) return 10;
+  if (makedev(stx.stx_dev_major, stx.stx_dev_minor) != st.st_dev) return 11;
+  if (stx.stx_mtime.tv_sec != st.st_mtim.tv_sec ||
+      stx.stx_mtime.tv_nsec != st.st_mtim.tv_nsec) {
+    return 12;
+  }
+
+  // empty paths refer to the directory file descriptor itself
+  memset(&stx, 0, sizeof(stx));
+  if (statx(fd, "", AT_EMPTY_PATH, STATX_SIZE, &stx)) return 13;
+  if (!(stx.stx_mask & STATX_SIZE) || stx.stx_size != 5) return 14;
+  if (statx(fd, "", 0, STATX_SIZE, &stx) != -1 || errno != ENOENT) return 15;
+  if (stat(".", &st)) return 16;
+  if (statx(AT_FDCWD, "", AT_EMPTY_PATH, STATX_INO, &stx)) return 17;
+  if (stx.stx_ino != st.st_ino) return 18;
+
+  // symbolic links are only followed if asked
+  unlink("/tmp/statx_test.lnk");
+  if (symlink(path, "/tmp/statx_test.lnk")) return 19;
+  if (statx(AT_FDCWD, "/tmp/statx_test.lnk", AT_SYMLINK_NOFOLLOW,
+            STATX_TYPE, &stx)) {
+    return 20;
+  }
+  if (!S_ISLNK(stx.stx_mode)) return 21;
+  if (statx(AT_FDCWD, "/tmp/statx_test.lnk", 0, STATX_TYPE, &stx)) return 22;
+  if (!S_ISREG(stx.stx_mode)) return 23;
+
+  // bad flags and reserved mask bits are rejected
+  if (statx(AT_FDCWD, path, AT_STATX_FORCE_SYNC | AT_STATX_DONT_SYNC,
+            STATX_BASIC_STATS, &stx) != -1 ||
+      errno != EINVAL) {
+    return 24;
+  }
+  if (statx(AT_FDCWD, path, 0, STATX__RESERVED, &stx) != -1 ||
+      errno != EINVAL) {
+    return 25;
+  }
+  if (statx(AT_FDCWD, "/tmp/statx_test.nope", 0, STATX_BASIC_STATS, &stx) !=
+          -1 ||
+      errno != ENOENT) {
+    return 26;
+  }
+  if (unlink("/tmp/statx_test.lnk")) return 27;
+  if (unlink(path)) return 28;
+  if (close(fd)) return 29;
+  return 0;
+}
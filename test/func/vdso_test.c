@@ -0,0 +1,63 @@
+/*-*- mode:c;indent-tabs-mode:nil;c-basic-offset:2;tab-width:8;coding:utf-8 -*-│
+│ vi: set et ft=c ts=2 sts=2 sw=2 fenc=utf-8                               :vi │
+╞══════════════════════════════════════════════════════════════════════════════╡
+│ Copyright 2023 Justine Alexandra Roberts Tunney                              │
+│                                                                              │
+│ Permission to use, copy, modify, and/or distribute this software for         │
+│ any purpose with or without fee is hereby granted, provided that the         │
+│ above copyright notice and this permission notice appear in all copies.      │
+│                                                                              │
+│ THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL                │
+│ WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED                │
+│ WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE             │
+│ AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL         │
+│ DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR        │
+│ PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER               │
+│ TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR             │
+│ PERFORMANCE OF THIS SOFTWARE.                                                │
+╚─────────────────────────────────────────────────────────────────────────────*/
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/auxv.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+void TestVdsoIsMapped(void) {
+  const char *ehdr;
+  if (!(ehdr = (const char *)getauxval(AT_SYSINFO_EHDR))) exit(1);
+  if (memcmp(ehdr, "\177ELF", 4)) exit(2);
+}
+
+void TestClockGettime(void) {
+  struct timespec a, b, c;
+  if (clock_gettime(CLOCK_MONOTONIC, &a)) exit(3);
+  if (syscall(SYS_clock_gettime, CLOCK_MONOTONIC, &b)) exit(4);
+  if (clock_gettime(CLOCK_MONOTONIC, &c)) exit(5);
+  if (b.tv_sec < a.tv_sec || (b.tv_sec == a.tv_sec && b.tv_nsec < a.tv_nsec)) {
+    exit(6);
+  }
+  if (c.tv_sec < b.tv_sec || (c.tv_sec == b.tv_sec && c.tv_nsec < b.tv_nsec)) {
+    exit(7);
+  }
+  if (clock_gettime(-1000, &a) != -1) exit(8);
+  if (errno != EINVAL) exit(9);
+}
+
+void TestRealtime(void) {
+  time_t t;
+  struct timeval tv;
+  if (gettimeofday(&tv, 0)) exit(10);
+  if ((t = time(0)) == -1) exit(11);
+  if (t < tv.tv_sec) exit(12);
+  if (t - tv.tv_sec > 1) exit(13);
+}
+
+int main(int argc, char *argv[]) {
+  TestVdsoIsMapped();
+  TestClockGettime();
+  TestRealtime();
+  return 0;
+}
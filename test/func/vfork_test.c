@@ -0,0 +1,84 @@
+// test vfork() children share the memory of their suspended parent
+// but not its pid, signal handlers, or signal mask, and can exec
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+volatile int shared;
+volatile int handled;
+
+void OnSigUsr1(int sig) {
+  handled = 1;
+}
+
+int Wait(int pid) {
+  int ws;
+  if (waitpid(pid, &ws, 0) != pid) return -1;
+  if (!WIFEXITED(ws)) return -1;
+  return WEXITSTATUS(ws);
+}
+
+int main(int argc, char *argv[]) {
+  int pid, me;
+  sigset_t ss, old;
+  struct sigaction sa = {.sa_handler = OnSigUsr1};
+  char *args[] = {argv[0], "child", 0};
+  if (argc > 1) return 42;
+  me = getpid();
+
+  // the child's stores are seen by its parent
+  if (!(pid = vfork())) {
+    shared = 1;
+    _exit(3);
+  }
+  if (pid == -1) return 1;
+  if (Wait(pid) != 3) return 2;
+  if (shared != 1) return 3;
+
+  // the child's signal handlers and mask are its own
+  if (sigaction(SIGUSR1, &sa, 0)) return 4;
+  sigemptyset(&ss);
+  sigaddset(&ss, SIGUSR2);
+  if (sigprocmask(SIG_BLOCK, &ss, 0)) return 5;
+  if (!(pid = vfork())) {
+    signal(SIGUSR1, SIG_DFL);
+    sigprocmask(SIG_UNBLOCK, &ss, 0);
+    _exit(4);
+  }
+  if (pid == -1) return 6;
+  if (Wait(pid) != 4) return 7;
+  if (sigprocmask(SIG_SETMASK, 0, &old)) return 8;
+  if (!sigismember(&old, SIGUSR2)) return 9;
+  if (raise(SIGUSR1) || !handled) return 10;
+
+  // the child has a pid of its own
+  if (!(pid = vfork())) {
+    _exit(getpid() != me && getppid() == me ? 5 : 0);
+  }
+  if (pid == -1) return 11;
+  if (Wait(pid) != 5) return 12;
+
+  // the child can become another program
+  if (!(pid = vfork())) {
+    execve(args[0], args, 0);
+    _exit(127);
+  }
+  if (pid == -1) return 13;
+  if (Wait(pid) != 42) return 14;
+
+  // the parent can see why the child failed to exec
+  shared = 0;
+  if (!(pid = vfork())) {
+    execve("/nonexistent/program", args, 0);
+    shared = errno;
+    _exit(127);
+  }
+  if (pid == -1) return 15;
+  if (Wait(pid) != 127) return 16;
+  if (shared != ENOENT) return 17;
+
+  return 0;
+}
@@ -0,0 +1,87 @@
+// test signals sent to sleeping threads wake them up right away, even
+// when they arrive just before the thread goes to sleep
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define N 200
+
+atomic_int ready;
+atomic_int handled;
+
+void OnSigusr1(int sig) {
+  ++handled;
+}
+
+long Millis(struct timespec a, struct timespec b) {
+  return (b.tv_sec - a.tv_sec) * 1000 + (b.tv_nsec - a.tv_nsec) / 1000000;
+}
+
+void *Pauser(void *arg) {
+  ready = 1;
+  if (pause() != -1 || errno != EINTR) return (void *)1;
+  return 0;
+}
+
+void *Sleeper(void *arg) {
+  struct timespec ts = {10}, rem;
+  ready = 1;
+  if (nanosleep(&ts, &rem) != -1 || errno != EINTR) return (void *)1;
+  if (rem.tv_sec < 8) return (void *)2;
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  int i;
+  void *res;
+  pthread_t th;
+  struct sigaction sa;
+  struct timespec ts, start, end;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = OnSigusr1;
+  if (sigaction(SIGUSR1, &sa, 0)) return 1;
+
+  // kicks which race with the thread going to sleep aren't lost
+  for (i = 0; i < N; ++i) {
+    ready = 0;
+    if (pthread_create(&th, 0, Pauser, 0)) return 2;
+    while (!ready) {
+    }
+    if (pthread_kill(th, SIGUSR1)) return 3;
+    if (pthread_join(th, &res) || res) return 4;
+  }
+  if (handled != N) return 5;
+
+  // long sleeps are interrupted as soon as the signal is sent
+  ready = 0;
+  if (pthread_create(&th, 0, Sleeper, 0)) return 6;
+  while (!ready) usleep(1000);
+  usleep(10000);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (pthread_kill(th, SIGUSR1)) return 7;
+  if (pthread_join(th, &res) || res) return 8;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (Millis(start, end) > 1000) return 9;
+
+  // absolute deadlines on the monotonic clock are honored
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_nsec += 20000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_nsec -= 1000000000;
+    ++ts.tv_sec;
+  }
+  if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0)) return 10;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (end.tv_sec < ts.tv_sec ||
+      (end.tv_sec == ts.tv_sec && end.tv_nsec < ts.tv_nsec)) {
+    return 11;
+  }
+  ts.tv_sec = 0;
+  ts.tv_nsec = 1000000000;
+  if (clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, 0) != EINVAL) return 12;
+  return 0;
+}
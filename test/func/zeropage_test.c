@@ -0,0 +1,85 @@
+// test compare-and-swap works on anonymous pages that have only been
+// read so far, which may be backed by the shared zero page
+#include <sys/mman.h>
+
+#define PAGES 64
+
+// returns fresh anonymous memory that's been read but not written
+static volatile long *ReadOnlyOnce(void) {
+  int i, sum;
+  volatile long *p;
+  p = mmap(0, PAGES * 4096, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return 0;
+  for (sum = i = 0; i < PAGES; ++i) {
+    sum += p[i * 512];
+  }
+  if (sum) return 0;
+  return p;
+}
+
+static int Cmpxchg8b(volatile long *p, long old, long neu) {
+  char ok;
+  unsigned lo = old, hi = old >> 32;
+  asm volatile("lock cmpxchg8b\t%1\n\t"
+               "sete\t%0"
+               : "=q"(ok), "+m"(*p), "+a"(lo), "+d"(hi)
+               : "b"((unsigned)neu), "c"((unsigned)(neu >> 32))
+               : "memory", "cc");
+  return ok;
+}
+
+static int Cmpxchg16b(volatile long *p, long old, long neu) {
+  char ok;
+  long lo = old, hi = 0;
+  asm volatile("lock cmpxchg16b\t%1\n\t"
+               "sete\t%0"
+               : "=q"(ok), "+m"(*(volatile char(*)[16])p), "+a"(lo),
+                 "+d"(hi)
+               : "b"(neu), "c"(0L)
+               : "memory", "cc");
+  return ok;
+}
+
+int main(int argc, char *argv[]) {
+  int i, j;
+  double d;
+  volatile long *p;
+  if (!(p = ReadOnlyOnce())) return 1;
+  for (j = 0; j < 100; ++j) {
+    for (i = 0; i < PAGES; ++i) {
+      if (__sync_val_compare_and_swap(p + i * 512, j, j + 1) != j) {
+        return 3;
+      }
+    }
+  }
+  for (i = 0; i < PAGES; ++i) {
+    if (p[i * 512] != 100) return 4;
+  }
+
+  // locked eight and sixteen byte compare-and-swap
+  if (!(p = ReadOnlyOnce())) return 5;
+  for (i = 0; i < PAGES; ++i) {
+    if (!Cmpxchg8b(p + i * 512, 0, 0x100000001)) return 6;
+  }
+  for (i = 0; i < PAGES; ++i) {
+    if (p[i * 512] != 0x100000001) return 7;
+  }
+  if (!(p = ReadOnlyOnce())) return 8;
+  for (i = 0; i < PAGES; ++i) {
+    if (!Cmpxchg16b(p + i * 512, 0, 42)) return 9;
+  }
+  for (i = 0; i < PAGES; ++i) {
+    if (p[i * 512] != 42 || p[i * 512 + 1]) return 10;
+  }
+
+  // sse store, which the jit will have compiled after the first page
+  if (!(p = ReadOnlyOnce())) return 11;
+  for (d = 1, i = 0; i < PAGES; ++i) {
+    asm volatile("movsd\t%1,%0" : "=m"(p[i * 512]) : "x"(d));
+  }
+  for (i = 0; i < PAGES; ++i) {
+    if (*(volatile double *)(p + i * 512) != 1) return 12;
+  }
+  return 0;
+}
@@ -0,0 +1,8 @@
+// Checks for Linux 4.5+ or FreeBSD 13+ copy_file_range() support.
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+  off_t a = 0, b = 0;
+  copy_file_range(-1, &a, -1, &b, 0, 0);
+  return 0;
+}
@@ -0,0 +1,10 @@
+// Checks for Linux futex() support, so guest threads can wait in-kernel.
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+  int x = 0;
+  syscall(SYS_futex, &x, FUTEX_WAKE_PRIVATE, 1, 0, 0, 0);
+  return 0;
+}
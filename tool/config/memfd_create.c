@@ -0,0 +1,12 @@
+// Checks for Linux 3.17+ memfd_create() support.
+#include <fcntl.h>
+#include <sys/mman.h>
+
+int main(int argc, char *argv[]) {
+  int fd;
+  fd = memfd_create("config", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  fcntl(fd, F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW |
+                             F_SEAL_WRITE);
+  fcntl(fd, F_GET_SEALS);
+  return 0;
+}
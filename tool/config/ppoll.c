@@ -0,0 +1,12 @@
+// Checks for ppoll() support, which waits with an atomic signal mask.
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+
+int main(int argc, char *argv[]) {
+  sigset_t mask;
+  struct timespec ts = {0};
+  sigemptyset(&mask);
+  ppoll(NULL, 0, &ts, &mask);
+  return 0;
+}
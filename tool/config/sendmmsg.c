@@ -0,0 +1,9 @@
+// Checks for Linux 3.0+ sendmmsg() and recvmmsg() support.
+#include <sys/socket.h>
+
+int main(int argc, char *argv[]) {
+  struct mmsghdr mm = {0};
+  sendmmsg(-1, &mm, 1, MSG_NOSIGNAL);
+  recvmmsg(-1, &mm, 1, MSG_WAITFORONE, 0);
+  return 0;
+}
@@ -0,0 +1,10 @@
+// Checks for Linux 2.6.17+ splice() and tee() support.
+#include <fcntl.h>
+#include <sys/types.h>
+
+int main(int argc, char *argv[]) {
+  loff_t a = 0, b = 0;
+  splice(-1, &a, -1, &b, 0, SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+  tee(-1, -1, 0, SPLICE_F_NONBLOCK);
+  return 0;
+}
@@ -0,0 +1,9 @@
+// Checks for Linux 4.11+ statx() support.
+#include <fcntl.h>
+#include <sys/stat.h>
+
+int main(int argc, char *argv[]) {
+  struct statx stx;
+  statx(AT_FDCWD, ".", AT_SYMLINK_NOFOLLOW, STATX_BASIC_STATS, &stx);
+  return 0;
+}
@@ -0,0 +1,10 @@
+// Checks for Linux 2.6.27+ timerfd() support.
+#include <sys/timerfd.h>
+
+int main(int argc, char *argv[]) {
+  struct itimerspec its = {0};
+  timerfd_settime(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC),
+                  TFD_TIMER_ABSTIME, &its, 0);
+  timerfd_gettime(-1, &its);
+  return 0;
+}